@@ -0,0 +1,41 @@
+#version 330 core
+
+// The lighting pass of the "DeferredRenderer": it shades each pixel of the G-buffer written by "light.frag" once,
+// so its cost depends on the number of pixels and the lights in their clusters (not on the number of objects)
+// The ambient & emissive light was already written into the scene by the G-buffer pass, so the result is added to it
+
+#include "include/lights.glsl"
+
+uniform sampler2D gbuffer_albedo;   // RGB: the diffuse color
+uniform sampler2D gbuffer_normal;   // XYZ: the world space normal
+uniform sampler2D gbuffer_specular; // RGB: the specular color, A: the roughness
+uniform sampler2D gbuffer_depth;
+
+// These are used to reconstruct the world position of a pixel from its depth
+uniform mat4 inverse_VP;
+uniform vec2 viewport_size;
+uniform vec3 camera_position;
+
+in vec2 tex_coord;
+out vec4 frag_color;
+
+void main(){
+    // The targets have the size of the screen, so each pixel reads its own texel
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbuffer_depth, texel, 0).r;
+    // No lit surface covers this pixel
+    if(depth >= 1.0) discard;
+
+    vec4 ndc = vec4(gl_FragCoord.xy / viewport_size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverse_VP * ndc;
+    vec3 world_pos = world.xyz / world.w;
+
+    vec3 material_diffuse = texelFetch(gbuffer_albedo, texel, 0).rgb;
+    vec3 normal = normalize(texelFetch(gbuffer_normal, texel, 0).xyz);
+    vec4 specular = texelFetch(gbuffer_specular, texel, 0);
+    // The same conversion from the roughness as "light.frag"
+    float material_shininess = 2.0 / pow(clamp(specular.a, 0.001, 0.999), 4.0) - 2.0;
+
+    vec3 color = compute_lights(gl_FragCoord.xy, normal, camera_position - world_pos, world_pos, material_diffuse, specular.rgb, material_shininess);
+    frag_color = vec4(color, 1.0);
+}
@@ -0,0 +1,154 @@
+// The lights & the light clusters shared by the lighting shaders (this file is included, see "shader-preprocessor.hpp")
+
+struct Light {
+    int type; // 0: Directional, 1: Point, 2: Spot
+    vec3 position;
+    vec3 direction;
+    vec3 color;
+    vec3 attenuation; // x: constant, y: linear, z: quadratic
+    float inner_cone;
+    float outer_cone;
+    float range; // 0 means that the light has no range
+    int shadow; // The index of the shadow map of the light (-1 means that the light has no shadow)
+};
+
+// The lights are stored in a texture buffer (5 texels per light) where the directional lights come first
+// The point and spot lights are assigned to clusters (a 3D grid over the view frustum) on the CPU
+// and each cluster stores the offset and the count of its lights in the light index list
+uniform samplerBuffer light_data;
+uniform usamplerBuffer cluster_data;
+uniform usamplerBuffer light_indices;
+uniform int directional_light_count;
+
+// The values needed to find the cluster of the fragment (see "LightClusters" in "light-clusters.hpp")
+uniform ivec3 cluster_grid;
+uniform vec2 cluster_tile_size;
+uniform float cluster_slice_scale;
+uniform float cluster_slice_bias;
+uniform vec3 cluster_camera_forward;
+
+// The shadow maps (see "ShadowMaps" in "shadow-maps.hpp"). The sizes of the arrays must match the limits in the class.
+// The directional light with a shadow uses the cascades: the view frustum is split in depth and each slice has its own map
+// The spot lights with a shadow have a tile in the atlas (the shadow index of the light is the index of its matrix)
+uniform sampler2DArrayShadow shadow_cascades;
+uniform int shadow_cascade_count;
+uniform mat4 shadow_cascade_matrices[4]; // From the world space to the texture space of each cascade
+uniform vec4 shadow_cascade_splits; // The view depth at which each cascade ends
+uniform vec4 shadow_cascade_texel_sizes; // The world space size of a texel in each cascade
+uniform sampler2DShadow spot_shadow_atlas;
+uniform mat4 spot_shadow_matrices[16]; // From the world space to the texture space of the tile of each spot light
+uniform float spot_shadow_resolution; // The size of a tile in texels
+
+Light fetch_light(int index){
+    vec4 data0 = texelFetch(light_data, 5 * index + 0);
+    vec4 data1 = texelFetch(light_data, 5 * index + 1);
+    vec4 data2 = texelFetch(light_data, 5 * index + 2);
+    vec4 data3 = texelFetch(light_data, 5 * index + 3);
+    vec4 data4 = texelFetch(light_data, 5 * index + 4);
+    Light light;
+    light.type = int(data0.w);
+    light.position = data0.xyz;
+    light.direction = data1.xyz;
+    light.range = data1.w;
+    light.color = data2.xyz;
+    light.inner_cone = data2.w;
+    light.attenuation = data3.xyz;
+    light.outer_cone = data3.w;
+    light.shadow = int(data4.x);
+    return light;
+}
+
+// Returns how much the fragment is lit by the directional light with the cascades (0: fully in shadow, 1: fully lit)
+float directional_shadow(vec3 world_pos, vec3 normal, float view_depth){
+    if(view_depth >= shadow_cascade_splits[shadow_cascade_count - 1]) return 1.0;
+    int cascade = 0;
+    while(cascade < shadow_cascade_count - 1 && view_depth > shadow_cascade_splits[cascade]) cascade++;
+    // The position is pushed along the normal by a texel or two, which removes the acne left by the depth bias
+    vec3 position = world_pos + normal * (1.5 * shadow_cascade_texel_sizes[cascade]);
+    vec3 coord = (shadow_cascade_matrices[cascade] * vec4(position, 1.0)).xyz;
+    // Each tap compares 2x2 texels with a bilinear filter, so the 4 taps give a smooth filter over 3x3 texels
+    vec2 texel = 1.0 / vec2(textureSize(shadow_cascades, 0).xy);
+    float lit = 0.0;
+    for(int i = 0; i < 4; i++){
+        vec2 offset = (vec2(i & 1, i >> 1) - 0.5) * texel;
+        lit += texture(shadow_cascades, vec4(coord.xy + offset, float(cascade), coord.z));
+    }
+    return 0.25 * lit;
+}
+
+// Returns how much the fragment at the given distance from the spot light is lit by it
+float spot_shadow(Light light, vec3 world_pos, vec3 normal, float distance){
+    // The world space size of a texel grows with the distance from the light
+    float texel_size = 2.0 * distance * tan(light.outer_cone) / spot_shadow_resolution;
+    vec4 coord = spot_shadow_matrices[light.shadow] * vec4(world_pos + normal * (1.5 * texel_size), 1.0);
+    return texture(spot_shadow_atlas, coord.xyz / coord.w);
+}
+
+// Returns the Phong lighting of a light that reaches the surface from the given direction with the given attenuation
+vec3 shade(vec3 light_color, vec3 light_direction, float attenuation, vec3 normal, vec3 view,
+           vec3 material_diffuse, vec3 material_specular, float material_shininess){
+    // Diffuse
+    float lambert = max(dot(normal, light_direction), 0.0);
+    vec3 diffuse = light_color * material_diffuse * lambert * attenuation;
+    // Specular
+    vec3 reflect_dir = reflect(-light_direction, normal);
+    float phong = pow(max(dot(view, reflect_dir), 0.0), material_shininess);
+
+    vec3 specular = light_color * material_specular * phong * attenuation;
+    return diffuse + specular;
+}
+
+// The directional lights come first in the light data, so their loop does not check the light type
+vec3 compute_directional_light(Light light, vec3 normal, vec3 view, vec3 world_pos, float view_depth,
+                               vec3 material_diffuse, vec3 material_specular, float material_shininess){
+    float attenuation = light.shadow >= 0 && shadow_cascade_count > 0 ? directional_shadow(world_pos, normal, view_depth) : 1.0;
+    return shade(light.color, normalize(-light.direction), attenuation, normal, view, material_diffuse, material_specular, material_shininess);
+}
+
+// The clusters only hold point and spot lights
+vec3 compute_local_light(Light light, vec3 normal, vec3 view, vec3 world_pos, vec3 material_diffuse, vec3 material_specular, float material_shininess){
+    vec3 light_vector = light.position - world_pos;
+    float distance = length(light_vector);
+    vec3 light_direction = light_vector / distance;
+    float attenuation = 1.0 / dot(light.attenuation, vec3(1.0, distance, distance * distance));
+    // Fade the light out near the end of its range so that the cluster boundaries are not visible
+    if(light.range > 0.0) attenuation *= smoothstep(light.range, 0.9 * light.range, distance);
+
+    if(light.type == 2){ // Spot
+        float angle = acos(dot(-light_direction, light.direction));
+        attenuation *= smoothstep(light.outer_cone, light.inner_cone, angle);
+        if(light.shadow >= 0 && attenuation > 0.0) attenuation *= spot_shadow(light, world_pos, normal, distance);
+    }
+    return shade(light.color, light_direction, attenuation, normal, view, material_diffuse, material_specular, material_shininess);
+}
+
+// Returns the index of the cluster that contains the fragment (from its screen location and its view depth)
+int find_cluster(vec2 frag_coord, float view_depth){
+    // The slices are exponential in depth
+    ivec2 tile = clamp(ivec2(frag_coord / cluster_tile_size), ivec2(0), cluster_grid.xy - 1);
+    float depth = max(view_depth, 1e-4);
+    int slice = clamp(int(log(depth) * cluster_slice_scale + cluster_slice_bias), 0, cluster_grid.z - 1);
+    return tile.x + cluster_grid.x * (tile.y + cluster_grid.y * slice);
+}
+
+// Returns the sum of the lighting of all the lights that reach the fragment
+// where "view_vector" is the vector from the fragment to the camera (not normalized)
+vec3 compute_lights(vec2 frag_coord, vec3 normal, vec3 view_vector, vec3 world_pos,
+                    vec3 material_diffuse, vec3 material_specular, float material_shininess){
+    vec3 view = normalize(view_vector);
+    vec3 color = vec3(0.0);
+    float view_depth = dot(-view_vector, cluster_camera_forward);
+    // The directional lights reach every fragment
+    for(int i = 0; i < directional_light_count; i++){
+        color += compute_directional_light(fetch_light(i), normal, view, world_pos, view_depth, material_diffuse, material_specular, material_shininess);
+    }
+
+    // Then we only loop over the point and spot lights that reach the cluster of this fragment
+    int cluster = find_cluster(frag_coord, view_depth);
+    uvec2 cluster_lights = texelFetch(cluster_data, cluster).xy;
+    for(uint i = 0u; i < cluster_lights.y; i++){
+        int index = int(texelFetch(light_indices, int(cluster_lights.x + i)).r);
+        color += compute_local_light(fetch_light(index), normal, view, world_pos, material_diffuse, material_specular, material_shininess);
+    }
+    return color;
+}
@@ -1,22 +1,57 @@
 #version 330 core
 
+// The material features are selected by defines (see "LitMaterial::getFeatures"), so a material only samples the maps it has:
+// HAS_ALBEDO, ALBEDO_PACKED (the albedo is a region in a texture array, see "texture-packer.hpp"), HAS_ORM & HAS_EMISSIVE
+// The DEPTH_ONLY variant is drawn in the depth pre-pass (see "LitMaterial::getDepthShader"), so it does not shade anything
+// The TRANSPARENT variant can also write the weighted blended transparency targets (see "ForwardRenderer::drawWeightedTransparency")
+// while the opaque variants can write the G-buffer instead of shading the surface (see "DeferredRenderer")
+
+#ifdef DEPTH_ONLY
+
+void main(){
+}
+
+#else
+
 in Varyings {
     vec4 color;
     vec2 tex_coord;
     vec3 normal;
     vec3 view;
     vec3 world;
+    flat vec4 albedo_rect;
+    flat float albedo_layer;
 } fs_in;
 
-out vec4 frag_color;
+layout(location = 0) out vec4 frag_color;
+
+#ifdef TRANSPARENT
+// When true, the color is accumulated with a weight instead of being blended over the scene
+uniform bool weighted_oit;
+layout(location = 1) out vec4 frag_weight;
+#else
+// When true, the ambient & emissive light is written into "frag_color" and the surface data is written into the G-buffer
+// so that the other lights are added in screen space by "deferred-lighting.frag" (which decodes the same data)
+uniform bool gbuffer;
+layout(location = 1) out vec4 gbuffer_albedo;   // RGB: the diffuse color
+layout(location = 2) out vec4 gbuffer_normal;   // XYZ: the world space normal
+layout(location = 3) out vec4 gbuffer_specular; // RGB: the specular color, A: the roughness
+#endif
 
 struct Material {
+#ifdef HAS_ALBEDO
+#ifdef ALBEDO_PACKED
+    sampler2DArray albedo_array;
+#else
     sampler2D albedo;
-    sampler2D specular;
-    sampler2D roughness;
-    sampler2D ambient_occlusion;
+#endif
+#endif
+#ifdef HAS_ORM
+    sampler2D orm; // R: ambient occlusion, G: roughness, B: specular
+#endif
+#ifdef HAS_EMISSIVE
     sampler2D emissive;
-
+#endif
 
     vec3 diffuse;
     vec3 specular_color;
@@ -26,72 +61,71 @@ struct Material {
 uniform Material material;
 uniform vec4 tint;
 
-struct Light {
-    int type; // 0: Directional, 1: Point, 2: Spot
-    vec3 position;
-    vec3 direction;
-    vec3 color;
-    vec3 attenuation; // x: constant, y: linear, z: quadratic
-    float inner_cone;
-    float outer_cone;
-};
-
-#define MAX_LIGHTS 16
-uniform Light lights[MAX_LIGHTS];
-uniform int light_count;
-
 uniform vec3 ambient_light;
 
+#include "include/lights.glsl"
+
+vec4 sample_albedo(vec2 tex_coord){
+#if !defined(HAS_ALBEDO)
+    return vec4(1.0);
+#elif !defined(ALBEDO_PACKED)
+    return texture(material.albedo, tex_coord);
+#else
+    // A texture in an atlas repeats inside its region. The gradients are computed from the coordinates before wrapping,
+    // so the mip level does not jump at the edges of the region.
+    vec2 scale = fs_in.albedo_rect.zw;
+    vec2 coord = scale == vec2(1.0) ? tex_coord : fs_in.albedo_rect.xy + fract(tex_coord) * scale;
+    return textureGrad(material.albedo_array, vec3(coord, fs_in.albedo_layer), dFdx(tex_coord) * scale, dFdy(tex_coord) * scale);
+#endif
+}
+
 void main(){
     vec3 normal = normalize(fs_in.normal);
-    vec3 view = normalize(fs_in.view);
-    vec3 world_pos = fs_in.world;
 
-    vec3 material_diffuse  = material.diffuse * texture(material.albedo, fs_in.tex_coord).rgb;
-    vec3 material_specular = material.specular_color * texture(material.specular, fs_in.tex_coord).rgb;
-    float material_roughness =  texture(material.roughness, fs_in.tex_coord).r; // Default roughness
-    
+    vec4 tex_color = sample_albedo(fs_in.tex_coord);
+#ifdef HAS_ORM
+    vec3 orm = texture(material.orm, fs_in.tex_coord).rgb;
+#else
+    // Without a map, the surface is fully unoccluded with a medium roughness (a Phong exponent of 30) and a full specular,
+    // so "specular_color" alone controls the highlight
+    vec3 orm = vec3(1.0, 0.5, 1.0);
+#endif
+
+    vec3 material_diffuse  = material.diffuse * tex_color.rgb;
+    vec3 material_specular = material.specular_color * orm.b;
+    float material_roughness = orm.g;
+
     float material_shininess = 2.0 / pow(clamp(material_roughness, 0.001, 0.999), 4.0) - 2.0;
-    vec3 material_ambient = material.ambient * material_diffuse * texture(material.ambient_occlusion, fs_in.tex_coord).r; // Ambient Occlusion Map we will use only 1 Channel
+    vec3 material_ambient = material.ambient * material_diffuse * orm.r;
+#ifdef HAS_EMISSIVE
     vec3 material_emissive = texture(material.emissive, fs_in.tex_coord).rgb;
-
-    vec3 color = vec3(0.0);
-
-    vec3 ambient = ambient_light * material_ambient;
-    color += ambient + material_emissive;
-
-    for(int i = 0; i < light_count; i++){
-        Light light = lights[i];
-
-        vec3 light_direction;
-        float attenuation = 1.0;
-
-        if(light.type == 0){ // Directional
-            light_direction = normalize(-light.direction);
-        } else { // Point or Spot
-            vec3 light_vector = light.position - world_pos;
-            float distance = length(light_vector);
-            light_direction = light_vector / distance;
-            attenuation = 1.0 / dot(light.attenuation, vec3(1.0, distance, distance * distance));
-            
-            if(light.type == 2){ // Spot
-
-                float angle = acos(dot(-light_direction, light.direction));
-                attenuation*= smoothstep(light.outer_cone, light.inner_cone, angle);
-            }
-        }
-        // Diffuse
-        float lambert = max(dot(normal, light_direction), 0.0);
-        vec3 diffuse = light.color * material_diffuse * lambert * attenuation;
-        color += diffuse;
-        // Specular
-        vec3 reflect_dir = reflect(-light_direction, normal);
-        float phong = pow(max(dot(view, reflect_dir), 0.0), material_shininess);
-
-        vec3 specular = light.color * material_specular * phong * attenuation;
-        color += specular;
+#else
+    vec3 material_emissive = vec3(0.0);
+#endif
+
+    vec3 color = ambient_light * material_ambient + material_emissive;
+#ifndef TRANSPARENT
+    if(gbuffer){
+        frag_color = vec4(color, 1.0);
+        gbuffer_albedo = vec4(material_diffuse, 1.0);
+        gbuffer_normal = vec4(normal, 0.0);
+        gbuffer_specular = vec4(material_specular, material_roughness);
+        return;
+    }
+#endif
+    color += compute_lights(gl_FragCoord.xy, normal, fs_in.view, fs_in.world, material_diffuse, material_specular, material_shininess);
+
+    float alpha = tex_color.a;
+#ifdef TRANSPARENT
+    if(weighted_oit){
+        // The weight favors the opaque & close fragments, so they dominate the average color of the layers
+        float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+        frag_color = vec4(color * alpha * weight, alpha);
+        frag_weight = vec4(alpha * weight);
+        return;
     }
+#endif
+    frag_color = vec4(color, alpha);
+}
 
-    vec4 tex_color = texture(material.albedo, fs_in.tex_coord);
-    frag_color = vec4(color, tex_color.a);
-}
\ No newline at end of file
+#endif
@@ -4,6 +4,12 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
 layout(location = 2) in vec2 tex_coord;
 layout(location = 3) in vec3 normal;
+// The index of the draw inside a multi-draw-indirect call (see "GeometryArena")
+layout(location = 4) in uint draw_id;
+
+// The depth pre-pass draws with this same vertex shader then the lit pass only shades the fragments with an equal depth,
+// so the position must be computed identically in both programs
+invariant gl_Position;
 
 out Varyings {
     vec4 color;
@@ -11,19 +17,55 @@ out Varyings {
     vec3 normal;
     vec3 view;
     vec3 world;
+    flat vec4 albedo_rect;
+    flat float albedo_layer;
 } vs_out;
 
 uniform mat4 M;
 uniform mat4 M_IT;
 uniform mat4 VP;
 uniform vec3 camera_position;
+// If true, the normal is octahedral encoded in its x & y components (see "VertexFormat")
+uniform bool oct_normals;
+
+// The region of the packed albedo texture (see "TextureRegion")
+uniform vec4 albedo_rect;
+uniform float albedo_layer;
+
+// When the object is drawn in a multi-draw-indirect batch, the model matrices and the albedo region are read from the object data
+// (10 texels per draw: the columns of M, the columns of M_IT, the albedo rect then the albedo layer) instead of the uniforms
+const int OBJECT_TEXELS = 10;
+uniform bool multi_draw;
+uniform samplerBuffer object_data;
+
+mat4 fetch_matrix(int first){
+    return mat4(texelFetch(object_data, first), texelFetch(object_data, first + 1),
+                texelFetch(object_data, first + 2), texelFetch(object_data, first + 3));
+}
+
+vec3 decode_octahedral(vec2 encoded){
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if(normal.z < 0.0) normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(normal);
+}
 
 void main(){
-    vec4 world_position = M * vec4(position, 1.0);
+    mat4 model = M, model_inverse_transpose = M_IT;
+    vs_out.albedo_rect = albedo_rect;
+    vs_out.albedo_layer = albedo_layer;
+    if(multi_draw){
+        int first = OBJECT_TEXELS * int(draw_id);
+        model = fetch_matrix(first);
+        model_inverse_transpose = fetch_matrix(first + 4);
+        vs_out.albedo_rect = texelFetch(object_data, first + 8);
+        vs_out.albedo_layer = texelFetch(object_data, first + 9).x;
+    }
+    vec4 world_position = model * vec4(position, 1.0);
     gl_Position = VP * world_position;
     vs_out.color = color;
     vs_out.tex_coord = tex_coord;
-    vs_out.normal = normalize((M_IT * vec4(normal, 0.0)).xyz);
+    vec3 local_normal = oct_normals ? decode_octahedral(normal.xy) : normal;
+    vs_out.normal = normalize((model_inverse_transpose * vec4(local_normal, 0.0)).xyz);
     vs_out.view = camera_position - world_position.xyz;
     vs_out.world = world_position.xyz;
 }
\ No newline at end of file
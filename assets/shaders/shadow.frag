@@ -0,0 +1,5 @@
+#version 330 core
+
+// The shadow maps only store the depth which is written without the help of the fragment shader
+void main(){
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+// The shadow casters only need their positions (see "ShadowMaps")
+layout(location = 0) in vec3 position;
+
+uniform mat4 transform;
+
+void main(){
+    gl_Position = transform * vec4(position, 1.0);
+}
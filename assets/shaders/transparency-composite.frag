@@ -0,0 +1,22 @@
+#version 330
+
+// The targets of the weighted blended transparency (see "ForwardRenderer::drawWeightedTransparency"):
+// - "accumulation" holds the sum of the weighted premultiplied colors in RGB and the revealage (the product of (1 - alpha)) in A
+// - "weights" holds the sum of the weighted alphas
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+
+in vec2 tex_coord;
+out vec4 frag_color;
+
+void main(){
+    // The targets have the size of the screen, so each pixel reads its own texel
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumulation, texel, 0);
+    float revealage = accum.a;
+    // Nothing transparent covers this pixel
+    if(revealage >= 1.0) discard;
+    float weight = texelFetch(weights, texel, 0).r;
+    // The average color of the layers is blended over the scene with the total coverage of the layers
+    frag_color = vec4(accum.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
@@ -23,6 +23,11 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "texture/texture-uploader.hpp"
+#include "texture/texture-streamer.hpp"
+#include "shader/shader.hpp"
+#include "asset-registry.hpp"
+#include "io/virtual-file-system.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -185,6 +190,7 @@ int our::Application::run(int run_for_frames) {
 
 
     gladLoadGL(glfwGetProcAddress);         // Load the OpenGL functions from the driver
+    our::ShaderProgram::enableParallelCompilation();
 
     // Print information about the OpenGL context
     std::cout << "VENDOR          : " << glGetString(GL_VENDOR) << std::endl;
@@ -234,13 +240,23 @@ int our::Application::run(int run_for_frames) {
         }
     }
 
-    // If a scene change was requested, apply it
-    if(nextState) {
-        currentState = nextState;
-        nextState = nullptr;
+    // If an asset pack is given, the assets are read from it (the loose files on the disk still override the files in the pack)
+    if(std::string asset_pack = app_config.value("assetPack", ""); !asset_pack.empty()) {
+        our::vfs::mount(asset_pack);
     }
-    // Call onInitialize if the scene needs to do some custom initialization (such as file loading, object creation, etc).
-    if(currentState) currentState->onInitialize();
+
+    // The texture uploader streams the textures in, so it uploads at most this number of bytes per frame
+    our::TextureUploader::get().setFrameBudget(app_config.value("textureUploadBudget", our::TextureUploader::DEFAULT_FRAME_BUDGET));
+    // The streamed texture levels cannot use more than this number of bytes of the VRAM
+    our::TextureStreamer::get().setBudget(app_config.value("textureMemoryBudget", our::TextureStreamer::DEFAULT_BUDGET));
+    // The assets released by the states stay cached (so entering a state again does not reload them) till they exceed this number of bytes
+    our::AssetRegistry::get().setBudget(app_config.value("assetCacheBudget", our::AssetRegistry::DEFAULT_BUDGET));
+    // While a state is loading, this number of milliseconds is spent each frame on creating its assets (the decoding runs on the workers)
+    assetLoadingBudget = app_config.value("assetLoadingBudget", 4.0);
+
+    // If a scene change was requested, start loading it. A state without assets to load is initialized right away
+    // (onInitialize is called when the scene needs to do some custom initialization such as file loading, object creation, etc).
+    updateStateChange();
 
     // The time at which the last frame started. But there was no frames yet, so we'll just pick the current time.
     double last_frame_time = glfwGetTime();
@@ -257,6 +273,11 @@ int our::Application::run(int run_for_frames) {
         ImGui::NewFrame();
 
         if(currentState) currentState->onImmediateGui(); // Call to run any required Immediate GUI.
+        // While the next state is loading, show its progress (using the current state if any)
+        if(nextState){
+            if(currentState) currentState->onLoadingGui(getLoadingProgress());
+            else State::drawLoadingWindow(getLoadingProgress());
+        }
 
         // If ImGui is using the mouse or keyboard, then we don't want the captured events to affect our keyboard and mouse objects.
         // For example, if you're focusing on an input and writing "W", the keyboard object shouldn't record this event.
@@ -286,6 +307,11 @@ int our::Application::run(int run_for_frames) {
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
+        // Continue uploading the streamed textures (within the frame budget) before drawing the frame
+        our::TextureUploader::get().update();
+        // Stream the texture levels requested by the last frame in (and evict the levels that are over the VRAM budget)
+        our::TextureStreamer::get().update();
+
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
         if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
@@ -331,22 +357,26 @@ int our::Application::run(int run_for_frames) {
         keyboard.update();
         mouse.update();
 
-        // If a scene change was requested, apply it
-        while(nextState){
-            // If a scene was already running, destroy it (not delete since we can go back to it later)
-            if(currentState) currentState->onDestroy();
-            // Switch scenes
-            currentState = nextState;
-            nextState = nullptr;
-            // Initialize the new scene
-            currentState->onInitialize();
-        }
+        // If a scene change was requested, continue loading it and apply it once it is ready
+        updateStateChange();
 
         ++current_frame;
     }
 
     // Call for cleaning up
-    if(currentState) currentState->onDestroy();
+    if(currentState){
+        currentState->onDestroy();
+        our::declareDeferredAssets({}, nullptr);
+        our::releaseAssets(currentState->assets);
+    }
+    // The preloads wait for their decoding jobs and release their assets
+    preloads.clear();
+    // The cached assets must be deleted while the OpenGL context still exists
+    our::clearAllAssets();
+    // The uploader buffers must be deleted while the OpenGL context still exists
+    our::TextureUploader::get().clear();
+    our::TextureStreamer::get().clear();
+    our::vfs::unmount();
 
     // Shutdown ImGui & destroy the context
     ImGui_ImplOpenGL3_Shutdown();
@@ -361,6 +391,54 @@ int our::Application::run(int run_for_frames) {
     return 0; // Good bye
 }
 
+our::AssetLoadingJob& our::Application::startPreload(State* state) {
+    auto& job = preloads[state];
+    if(!job){
+        AssetManifest manifest = state->getAssetManifest();
+        // Only the assets used by the state are loaded now, the others are declared once the state starts
+        state->deferredAssets = our::splitManifest(manifest);
+        job = std::make_unique<AssetLoadingJob>(manifest.assets, manifest.options);
+    }
+    return *job;
+}
+
+void our::Application::updateStateChange() {
+    // The preloads that were started for later state changes continue too
+    for(auto& [state, job] : preloads){
+        if(state != nextState) job->update(assetLoadingBudget);
+    }
+    // The loop is needed since a state can request another state change in its onInitialize
+    while(nextState){
+        AssetLoadingJob& job = startPreload(nextState);
+        if(!job.update(assetLoadingBudget)) return;
+        // If a scene was already running, destroy it (not delete since we can go back to it later)
+        // Its assets are released after the next state acquired its assets, so the shared assets are not reloaded
+        if(currentState){
+            currentState->onDestroy();
+            our::declareDeferredAssets({}, nullptr);
+            our::releaseAssets(currentState->assets);
+        }
+        // Switch scenes
+        currentState = nextState;
+        nextState = nullptr;
+        currentState->assets = job.takeReferences();
+        our::declareDeferredAssets(std::move(currentState->deferredAssets), &currentState->assets);
+        preloads.erase(currentState);
+        // Initialize the new scene
+        currentState->onInitialize();
+    }
+}
+
+void our::State::drawLoadingWindow(float progress) {
+    ImVec2 displaySize = ImGui::GetIO().DisplaySize;
+    ImGui::SetNextWindowPos(ImVec2(displaySize.x * 0.5f, displaySize.y - 40.0f), ImGuiCond_Always, ImVec2(0.5f, 1.0f));
+    ImGui::SetNextWindowSize(ImVec2(320.0f, 0.0f));
+    ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings);
+    ImGui::Text("Loading...");
+    ImGui::ProgressBar(progress);
+    ImGui::End();
+}
+
 // Sets-up the window callback functions from GLFW to our (Mouse/Keyboard) classes.
 void our::Application::setupCallbacks() {
 
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <type_traits>
@@ -12,6 +13,7 @@
 
 #include "input/keyboard.hpp"
 #include "input/mouse.hpp"
+#include "asset-loader.hpp"
 
 namespace our {
 
@@ -29,6 +31,10 @@ namespace our {
     class State {
         // Each scene will have a pointer to the application that owns it
         Application* application;
+        // The assets of the state manifest (they are acquired before "onInitialize" and released after "onDestroy")
+        AssetReferences assets;
+        // The assets of the state manifest that are loaded on their first use (see "AssetManifest::uses")
+        DeferredAssets deferredAssets;
         friend Application;
     public:
         virtual void onInitialize(){}                   // Called once before the game loop.
@@ -36,6 +42,16 @@ namespace our {
         virtual void onDraw(double deltaTime){}         // Called every frame in the game loop passing the time taken to draw the frame "Delta time".
         virtual void onDestroy(){}                      // Called once after the game loop ends for house cleaning.
 
+        // Returns the assets that the state needs. The application loads them in the background (while the previous state keeps running)
+        // and only calls "onInitialize" once they are ready, so the state can get them from the asset loaders right away.
+        // This is called before "onInitialize", so it can only use the application config.
+        virtual AssetManifest getAssetManifest() { return {}; }
+        // Called every frame (after "onImmediateGui") while the assets of the next state are loading, where the progress is in [0, 1]
+        // By default, it shows a small window with a progress bar
+        virtual void onLoadingGui(float progress) { drawLoadingWindow(progress); }
+        // Draws a window with a loading progress bar at the bottom of the screen
+        static void drawLoadingWindow(float progress);
+
 
         // Override these functions to get mouse and keyboard event.
         virtual void onKeyEvent(int key, int scancode, int action, int mods){}      
@@ -62,6 +78,9 @@ namespace our {
         std::unordered_map<std::string, State*> states;   // This will store all the states that the application can run
         State * currentState = nullptr;         // This will store the current scene that is being run
         State * nextState = nullptr;            // If it is requested to go to another scene, this will contain a pointer to that scene
+        // The assets of the states that are loading (or loaded but not entered yet)
+        std::unordered_map<State*, std::unique_ptr<AssetLoadingJob>> preloads;
+        double assetLoadingBudget = 4.0;       // The time (in milliseconds) spent each frame on creating the loaded assets
 
         
         // Virtual functions to be overrode and change the default behaviour of the application
@@ -70,6 +89,11 @@ namespace our {
         virtual WindowConfiguration getWindowConfiguration();       // Returns the WindowConfiguration current struct instance.
         virtual void setupCallbacks();                              // Sets-up the window callback functions from GLFW to our (Mouse/Keyboard) classes.
 
+        // Starts loading the assets of the given state in the background (if they are not loading already)
+        AssetLoadingJob& startPreload(State* state);
+        // Continues the preloads. If the next state is ready, the current state is destroyed and the next state is initialized.
+        void updateStateChange();
+
     public:
 
         // Create an application with following configuration
@@ -96,7 +120,8 @@ namespace our {
         }
 
         // Tells the application to change its current state
-        // The change will not be applied until the current frame ends
+        // The change will not be applied until the current frame ends and the assets of the state are loaded
+        // (the current state keeps running while they are loading)
         void changeState(std::string name){
             auto it = states.find(name);
             if(it != states.end()){
@@ -104,6 +129,19 @@ namespace our {
             }
         }
 
+        // Starts loading the assets of a state in the background, so changing to it later does not wait for them
+        // (e.g. the menu preloads the assets of the game as soon as it appears)
+        void preloadState(const std::string& name){
+            if(auto it = states.find(name); it != states.end() && it->second != currentState) startPreload(it->second);
+        }
+
+        // Returns the loading progress of the next state (in [0, 1]) or 1 if there is no state change
+        float getLoadingProgress() const {
+            if(!nextState) return 1.0f;
+            auto it = preloads.find(nextState);
+            return it != preloads.end() ? it->second->getProgress() : 0.0f;
+        }
+
         // Closes the Application
         void close(){
             glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -3,43 +3,247 @@
 #include "shader/shader.hpp"
 #include "texture/texture2d.hpp"
 #include "texture/texture-utils.hpp"
+#include "texture/texture-uploader.hpp"
+#include "texture/texture-compressor.hpp"
+#include "texture/texture-packer.hpp"
+#include "texture/texture-streamer.hpp"
 #include "texture/sampler.hpp"
 #include "mesh/mesh.hpp"
 #include "mesh/mesh-utils.hpp"
+#include "mesh/gltf-loader.hpp"
 #include "material/material.hpp"
 #include "deserialize-utils.hpp"
+#include "asset-pipeline.hpp"
+#include "asset-registry.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <unordered_set>
 
 namespace our {
 
-    // This will load all the shaders defined in "data"
-    // data must be in the form:
-    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader" }, ... }
-    template<>
-    void AssetLoader<ShaderProgram>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string vsPath = desc.value("vs", "");
-                std::string fsPath = desc.value("fs", "");
-                auto shader = new ShaderProgram();
+    // The assets are loaded by an asset pipeline (see "asset-pipeline.hpp"), so each asset type has a function that adds
+    // a task for each asset in "data" to the pipeline. The ids of the added tasks are recorded by the asset names
+    // so that the materials can depend on the assets they use.
+    using TaskMap = std::unordered_map<std::string, std::vector<AssetPipeline::TaskId>>;
+    // The estimated memory used by each loaded asset (by its name), which is recorded in the asset registry
+    using SizeMap = std::unordered_map<std::string, size_t>;
+
+    // The textures that should be packed into texture arrays and the decoded images given to the packer so far
+    struct TexturePacking {
+        std::unordered_set<std::string> names;
+        std::vector<texture_packer::PackInput> inputs;
+        std::vector<std::string> arrays;                            // The names of the created texture arrays
+        std::unordered_map<std::string, std::string> regionArrays;  // The name of the array that holds each packed texture
+    };
+
+    // Returns the memory used by a texture created from the given data (including the mip chain that the uploader generates)
+    static size_t getTextureBytes(const texture_utils::Image& image, const texture_compressor::CompressedImage& compressed,
+                                  const std::vector<texture_compressor::MipLevel>& mips){
+        size_t bytes = image.pixels ? size_t(image.size.x) * image.size.y * image.channels * 4 / 3 : 0;
+        for(const auto& level : compressed.levels) bytes += level.size();
+        for(const auto& level : mips) bytes += level.pixels.size();
+        return bytes;
+    }
+
+    // Compiling & linking a shader uses OpenGL, so the shaders are only created on the main thread
+    static void addShaderTasks(AssetPipeline& pipeline, const nlohmann::json& data, TaskMap& tasks){
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()){
+            std::string vsPath = desc.value("vs", "");
+            std::string fsPath = desc.value("fs", "");
+            std::vector<std::string> defines = desc.value("defines", std::vector<std::string>());
+            tasks[name].push_back(pipeline.add("shader " + name, nullptr, [name = name, vsPath, fsPath, defines](){
+                auto shader = new ShaderProgram(defines);
                 shader->attach(vsPath, GL_VERTEX_SHADER);
                 shader->attach(fsPath, GL_FRAGMENT_SHADER);
                 shader->link();
-                assets[name] = shader;
+                AssetLoader<ShaderProgram>::set(name, shader);
+            }));
+        }
+    }
+
+    // The images are decoded on the workers then given to the texture uploader on the main thread
+    // (which streams them into their textures over the next frames, see "texture-uploader.hpp")
+    // If a texture should be compressed, the worker also builds its mip chain and compresses it (or reads it from the texture cache)
+    // If a texture is an ORM map, the worker packs the channels of its source images into a single image
+    // The textures named in "packing" are not uploaded, they are given to the texture packer instead (see "addTexturePackingTask")
+    // If "streamMips" is true, the other textures are given to the texture streamer (see "texture-streamer.hpp") with their whole mip chain,
+    // so the uncompressed images are decoded as RGBA and the worker builds their mip chain too
+    static void addTextureTasks(AssetPipeline& pipeline, const nlohmann::json& data, TaskMap& tasks,
+                                texture_compressor::Compression defaultCompression, bool streamMips = false,
+                                std::shared_ptr<TexturePacking> packing = nullptr, std::shared_ptr<SizeMap> sizes = nullptr){
+        using texture_compressor::Compression;
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()){
+            std::string path;
+            std::array<std::string, 3> ormPaths;
+            bool orm = false, srgb = false, useCache = true;
+            Compression compression = defaultCompression;
+            if(desc.is_string()){
+                path = desc.get<std::string>();
+            } else if(desc.is_object()){
+                path = desc.value("path", "");
+                if(desc.contains("compression")) compression = texture_compressor::parseCompression(desc["compression"].get<std::string>());
+                useCache = desc.value("cache", true);
+                srgb = desc.value("srgb", false);
+                ormPaths = {desc.value("occlusion", ""), desc.value("roughness", ""), desc.value("metal", "")};
+                orm = !(ormPaths[0].empty() && ormPaths[1].empty() && ormPaths[2].empty());
+            }
+            // The ORM & sRGB textures are not compressed (the compressor only outputs linear BC formats)
+            if(orm || srgb) compression = Compression::NONE;
+            // The support is checked here since the workers cannot query the OpenGL context
+            if(compression != Compression::NONE && !texture_compressor::isSupported(compression)){
+                std::cerr << "The compression of texture \"" << name << "\" is not supported, so it is loaded uncompressed" << std::endl;
+                compression = Compression::NONE;
+            }
+            // The packed textures are sampled from their texture array, so they are never streamed
+            bool packed = packing && packing->names.count(name);
+            bool streamed = streamMips && !packed;
+            auto image = std::make_shared<texture_utils::Image>();
+            auto compressed = std::make_shared<texture_compressor::CompressedImage>();
+            auto mips = std::make_shared<std::vector<texture_compressor::MipLevel>>();
+            tasks[name].push_back(pipeline.add("texture " + name,
+                [path, ormPaths, orm, srgb, compression, useCache, streamed, image, compressed, mips](){
+                    // The missing channels of an ORM map have the same values that "light.frag" uses without a map
+                    // (fully unoccluded, a medium roughness and a full specular scaled by "specular_color")
+                    if(orm){
+                        texture_utils::decodePackedImage(ormPaths, {255, 128, 255}, *image);
+                    } else {
+                        // If the image could not be compressed, we still try to load it uncompressed
+                        if(compression != Compression::NONE && texture_compressor::load(path, compression, useCache, *compressed)) return;
+                        // The channels of the file are kept, so the gray maps take a quarter of the memory (unless the mip chain is built here)
+                        texture_utils::decodeImage(path, *image, streamed ? 4 : 0);
+                        image->srgb = srgb;
+                    }
+                    if(streamed && image->pixels && image->channels == 4){
+                        *mips = texture_compressor::buildMipChain(image->pixels.get(), image->size);
+                        image->pixels.reset();
+                    }
+                },
+                [name = name, packed, streamed, image, compressed, mips, packing, sizes](){
+                    if(sizes) (*sizes)[name] = getTextureBytes(*image, *compressed, *mips);
+                    if(packed){
+                        packing->inputs.push_back({name, std::move(*image), std::move(*compressed)});
+                        return;
+                    }
+                    if(streamed && (!mips->empty() || !compressed->levels.empty())){
+                        auto& streamer = TextureStreamer::get();
+                        Texture2D* texture = mips->empty() ? streamer.add(std::move(*compressed)) : streamer.add(std::move(*mips), image->srgb);
+                        AssetLoader<Texture2D>::set(name, texture);
+                        return;
+                    }
+                    auto& uploader = TextureUploader::get();
+                    Texture2D* texture = compressed->levels.empty() ? uploader.upload(std::move(*image)) : uploader.upload(std::move(*compressed));
+                    AssetLoader<Texture2D>::set(name, texture);
+                }));
+        }
+    }
+
+    static void addSamplerTasks(AssetPipeline& pipeline, const nlohmann::json& data, TaskMap& tasks){
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()){
+            tasks[name].push_back(pipeline.add("sampler " + name, nullptr, [name = name, desc = desc](){
+                auto sampler = new Sampler();
+                sampler->deserialize(desc);
+                AssetLoader<Sampler>::set(name, sampler);
+            }));
+        }
+    }
+
+    // The mesh files are parsed & optimized (or read from the mesh cache) on the workers then uploaded on the main thread
+    static void addMeshTasks(AssetPipeline& pipeline, const nlohmann::json& data, TaskMap& tasks, std::shared_ptr<SizeMap> sizes = nullptr){
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()){
+            std::string path, meshName;
+            VertexFormat format = VertexFormat::STANDARD;
+            bool useCache = true;
+            if(desc.is_string()){
+                path = desc.get<std::string>();
+            } else if(desc.is_object()){
+                path = desc.value("path", "");
+                format = parseVertexFormat(desc.value("format", "standard"));
+                useCache = desc.value("cache", true);
+                meshName = desc.value("mesh", "");
+            } else continue;
+
+            std::string extension = std::filesystem::path(path).extension().string();
+            if(extension == ".gltf" || extension == ".glb"){
+                auto entry = std::make_shared<mesh_cache::CacheEntry>();
+                auto loaded = std::make_shared<bool>(false);
+                tasks[name].push_back(pipeline.add("mesh " + name,
+                    [path, meshName, format, useCache, entry, loaded](){ *loaded = gltf_loader::prepare(path, meshName, *entry, format, useCache); },
+                    [name = name, entry, loaded, sizes](){
+                        if(sizes) (*sizes)[name] = entry->vertexData.size() + entry->elementData.size();
+                        AssetLoader<Mesh>::set(name, *loaded ? mesh_utils::createMesh(*entry) : nullptr);
+                    }));
+            } else {
+                auto entry = std::make_shared<mesh_cache::CacheEntry>();
+                auto loaded = std::make_shared<bool>(false);
+                tasks[name].push_back(pipeline.add("mesh " + name,
+                    [path, format, useCache, entry, loaded](){ *loaded = mesh_utils::prepareOBJ(path, *entry, format, useCache); },
+                    [name = name, entry, loaded, sizes](){
+                        if(sizes) (*sizes)[name] = entry->vertexData.size() + entry->elementData.size();
+                        AssetLoader<Mesh>::set(name, *loaded ? mesh_utils::createMesh(*entry) : nullptr);
+                    }));
+            }
+        }
+    }
+
+    // A material is created on the main thread after the assets it uses are created
+    // Any string in the material description that names a shader, a texture or a sampler in "dependencies" is considered a dependency
+    static void addMaterialTasks(AssetPipeline& pipeline, const nlohmann::json& data, TaskMap& tasks, const TaskMap& dependencies){
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()){
+            AssetPipeline::TaskId task = pipeline.add("material " + name, nullptr, [name = name, desc = desc](){
+                std::string type = desc.value("type", "");
+                auto material = createMaterialFromType(type);
+                material->deserialize(desc);
+                AssetLoader<Material>::set(name, material);
+            });
+            tasks[name].push_back(task);
+            for(auto& [key, value] : desc.items()){
+                if(!value.is_string()) continue;
+                if(auto it = dependencies.find(value.get<std::string>()); it != dependencies.end()){
+                    for(AssetPipeline::TaskId dependency : it->second) pipeline.addDependency(task, dependency);
+                }
             }
         }
+    }
+
+    // This will load all the shaders defined in "data"
+    // data must be in the form:
+    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader" }, ... }
+    // and each shader can have "defines" (optional) where the value is an array of defines in the form "NAME" or "NAME=VALUE"
+    template<>
+    void AssetLoader<ShaderProgram>::deserialize(const nlohmann::json& data) {
+        AssetPipeline pipeline;
+        TaskMap tasks;
+        addShaderTasks(pipeline, data, tasks);
+        pipeline.run();
     };
 
     // This will load all the textures defined in "data"
     // data must be in the form:
     //    { texture_name : "path/to/image", ... }
+    // or, to store the texture in a block compressed format on the GPU:
+    //    { texture_name : { "path": "path/to/image", "compression": "auto", "cache": true }, ... }
+    // where the compression can be "none", "auto" (BC1 or BC3 depending on the alpha), "bc1", "bc3" or "bc5" (see "texture-compressor.hpp").
+    // The compressed mip chains are cached in "cache/textures", so only the first launch (or a launch after the file changes) compresses them
+    // An uncompressed texture keeps the channels of its file (a gray image becomes an R8 texture) and it can be stored in sRGB with "srgb": true.
+    // An ORM map packs the ambient occlusion, the roughness and the metalness (or specular) images into the RGB channels of a single texture:
+    //    { texture_name : { "occlusion": "path/to/ao", "roughness": "path/to/roughness", "metal": "path/to/metal" }, ... }
     template<>
     void AssetLoader<Texture2D>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = texture_utils::loadImage(path);
-            }
-        }
+        AssetPipeline pipeline;
+        TaskMap tasks;
+        addTextureTasks(pipeline, data, tasks, texture_compressor::Compression::NONE);
+        pipeline.run();
+        TextureUploader::get().flush();
     };
 
     // This will load all the samplers defined in "data"
@@ -51,31 +255,32 @@ namespace our {
     //  For "MAX_ANISOTROPY", the value must be a float with a value >= 1.0f
     template<>
     void AssetLoader<Sampler>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                auto sampler = new Sampler();
-                sampler->deserialize(desc);
-                assets[name] = sampler;
-            }
-        }
+        AssetPipeline pipeline;
+        TaskMap tasks;
+        addSamplerTasks(pipeline, data, tasks);
+        pipeline.run();
     };
 
     // This will load all the meshes defined in "data"
     // data must be in the form:
     //    { mesh_name : "path/to/3d-model-file", ... }
+    // or, to pick the vertex format of the mesh and whether it should use the binary mesh cache:
+    //    { mesh_name : { "path": "path/to/3d-model-file", "format": "packed", "cache": true }, ... }
+    // The processed meshes are cached in "cache/meshes", so only the first launch (or a launch after the file changes) parses the file
+    // The file can be an ".obj" file or a glTF file (".gltf" or ".glb"). For glTF files, "mesh" can select the mesh in the file by its name
+    // and each primitive becomes a submesh
     template<>
     void AssetLoader<Mesh>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
-            }
-        }
+        AssetPipeline pipeline;
+        TaskMap tasks;
+        addMeshTasks(pipeline, data, tasks);
+        pipeline.run();
     };
 
     // This will load all the materials defined in "data"
     // Material deserialization depends on shaders, textures and samplers
     // so you must deserialize these 3 asset types before deserializing materials
+    // (or use "deserializeAllAssets" which creates each material once the assets it uses are created)
     // data must be in the form:
     //    { material_name : parameters, ... }
     // Where parameters is an object where the keys can be:
@@ -87,36 +292,391 @@ namespace our {
     //      ... more keys/values can be added depending on the material type (e.g. "texture", "sampler", "tint")
     template<>
     void AssetLoader<Material>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string type = desc.value("type", "");
-                auto material = createMaterialFromType(type);
-                material->deserialize(desc);
-                assets[name] = material;
+        AssetPipeline pipeline;
+        TaskMap tasks;
+        addMaterialTasks(pipeline, data, tasks, {});
+        pipeline.run();
+    };
+
+    // The lit materials used to have a texture for each of the ambient occlusion, the roughness and the specular maps.
+    // Before loading, these maps are packed into a single ORM texture (named "<material>.orm") which the material reads from "orm",
+    // so the shader samples one texture instead of three. The source textures that no material uses anymore are not loaded.
+    // Each map becomes a single channel, so a colored specular map (a tinted metal) loses its color and only its luminance drives
+    // the metalness (the tint then comes from the albedo). A warning is printed when a colored map is packed (see "decodePackedImage").
+    static void packMaterialMaps(nlohmann::json& textures, nlohmann::json& materials){
+        if(!textures.is_object() || !materials.is_object()) return;
+        const std::array<const char*, 3> materialKeys = {"ambient_occlusion", "roughness", "specular"};
+        const std::array<const char*, 3> channelKeys = {"occlusion", "roughness", "metal"};
+        std::unordered_map<std::string, std::string> packedTextures; // Maps each packed description to its texture, so materials can share them
+        std::vector<std::string> sources;
+        for(auto& [name, desc] : materials.items()){
+            if(!desc.is_object() || desc.value("type", "") != "lit" || desc.contains("orm")) continue;
+            nlohmann::json orm = nlohmann::json::object();
+            for(size_t channel = 0; channel < 3; ++channel){
+                auto it = desc.find(materialKeys[channel]);
+                if(it == desc.end() || !it->is_string() || !textures.contains(it->get<std::string>())) continue;
+                std::string source = it->get<std::string>();
+                const auto& sourceDesc = textures[source];
+                std::string path = sourceDesc.is_string() ? sourceDesc.get<std::string>() : sourceDesc.value("path", "");
+                if(path.empty()) continue;
+                orm[channelKeys[channel]] = path;
+                sources.push_back(source);
+                desc.erase(it);
+            }
+            if(orm.empty()) continue;
+            auto [it, inserted] = packedTextures.emplace(orm.dump(), name + ".orm");
+            if(inserted) textures[it->second] = orm;
+            desc["orm"] = it->second;
+        }
+        // Only the textures that are still named by a material are loaded
+        for(const auto& source : sources){
+            bool used = false;
+            for(auto& [name, desc] : materials.items()){
+                for(auto& [key, value] : desc.items()) used |= value.is_string() && value.get<std::string>() == source;
+            }
+            if(!used) textures.erase(source);
+        }
+    }
+
+    // Only the lit materials can sample a packed albedo, so a texture is packed if it is only named as the albedo of lit materials
+    static std::unordered_set<std::string> findPackableTextures(const nlohmann::json& textures, const nlohmann::json& materials){
+        std::unordered_set<std::string> albedos, others;
+        for(auto& [name, desc] : materials.items()){
+            if(!desc.is_object()) continue;
+            bool lit = desc.value("type", "") == "lit";
+            for(auto& [key, value] : desc.items()){
+                if(!value.is_string() || !textures.contains(value.get<std::string>())) continue;
+                (lit && key == "albedo" ? albedos : others).insert(value.get<std::string>());
+            }
+        }
+        for(const auto& name : others) albedos.erase(name);
+        return albedos;
+    }
+
+    // Once all the textures to pack are decoded, they are packed into texture arrays on the main thread.
+    // The materials that use them depend on this task instead of the texture tasks (since their regions are only known after packing).
+    static void addTexturePackingTask(AssetPipeline& pipeline, std::shared_ptr<TexturePacking> packing,
+                                      const texture_packer::PackOptions& options, TaskMap& tasks){
+        AssetPipeline::TaskId task = pipeline.add("texture packing", nullptr, [packing, options](){
+            texture_packer::PackResult result = texture_packer::pack(packing->inputs, options);
+            // The arrays are owned by the asset loader, so they get unique names
+            static size_t arrayCount = 0;
+            std::unordered_map<TextureArray*, std::string> arrayNames;
+            for(TextureArray* array : result.arrays){
+                std::string arrayName = "packed-array-" + std::to_string(arrayCount++);
+                AssetLoader<TextureArray>::set(arrayName, array);
+                arrayNames[array] = arrayName;
+                packing->arrays.push_back(arrayName);
             }
+            for(auto& [name, region] : result.regions){
+                AssetLoader<TextureRegion>::set(name, new TextureRegion(region));
+                packing->regionArrays[name] = arrayNames[region.array];
+            }
+            // The textures that did not fit in any array are uploaded as usual
+            auto& uploader = TextureUploader::get();
+            for(size_t index : result.unpacked){
+                auto& input = packing->inputs[index];
+                Texture2D* texture = input.compressed.levels.empty() ? uploader.upload(std::move(input.image)) : uploader.upload(std::move(input.compressed));
+                AssetLoader<Texture2D>::set(input.name, texture);
+            }
+            packing->inputs.clear();
+        });
+        for(const auto& name : packing->names){
+            auto& textureTasks = tasks[name];
+            for(AssetPipeline::TaskId dependency : textureTasks) pipeline.addDependency(task, dependency);
+            textureTasks = {task};
+        }
+    }
+
+    // Returns the assets in "data" that should be loaded: the assets that are not in the registry or were loaded from another description
+    // An asset can be recorded under any of the given types (a texture can become a texture region when it is packed)
+    static nlohmann::json findMissingAssets(const nlohmann::json& data, std::initializer_list<const char*> types){
+        nlohmann::json missing = nlohmann::json::object();
+        if(!data.is_object()) return missing;
+        auto& registry = AssetRegistry::get();
+        for(auto& [name, desc] : data.items()){
+            std::string description = desc.dump();
+            bool loaded = std::any_of(types.begin(), types.end(), [&](const char* type){
+                return registry.isLoaded(AssetRegistry::getKey(type, name), description);
+            });
+            if(loaded) continue;
+            // If the asset was loaded from another description, the old asset is deleted unless it is still used (by another state or asset)
+            bool used = false;
+            for(const char* type : types) used = !registry.unload(AssetRegistry::getKey(type, name)) || used;
+            if(used){
+                std::cerr << "The asset \"" << name << "\" is still used with another description, so it is not loaded again" << std::endl;
+                continue;
+            }
+            missing[name] = desc;
+        }
+        return missing;
+    }
+
+    // Returns the key of a loaded asset of any of the given types (or an empty string if it is not recorded)
+    static std::string findKey(const std::string& name, std::initializer_list<const char*> types){
+        for(const char* type : types){
+            std::string key = AssetRegistry::getKey(type, name);
+            if(AssetRegistry::get().contains(key)) return key;
         }
+        return "";
+    }
+
+    // The state of a loading job (the pipeline & everything its tasks write into)
+    struct AssetLoadingJob::Data {
+        AssetLoadingOptions options;
+        std::chrono::steady_clock::time_point start;
+        nlohmann::json shaders, textures, samplers, meshes, materials;
+        nlohmann::json missingShaders, missingTextures, missingSamplers, missingMeshes, missingMaterials;
+        AssetPipeline pipeline;
+        TaskMap materialDependencies, meshTasks, materialTasks;
+        std::shared_ptr<SizeMap> sizes = std::make_shared<SizeMap>();
+        std::shared_ptr<TexturePacking> packing;
     };
 
-    void deserializeAllAssets(const nlohmann::json& assetData){
-        if(!assetData.is_object()) return;
-        if(assetData.contains("shaders"))
-            AssetLoader<ShaderProgram>::deserialize(assetData["shaders"]);
-        if(assetData.contains("textures"))
-            AssetLoader<Texture2D>::deserialize(assetData["textures"]);
-        if(assetData.contains("samplers"))
-            AssetLoader<Sampler>::deserialize(assetData["samplers"]);
-        if(assetData.contains("meshes"))
-            AssetLoader<Mesh>::deserialize(assetData["meshes"]);
-        if(assetData.contains("materials"))
-            AssetLoader<Material>::deserialize(assetData["materials"]);
+    AssetLoadingJob::AssetLoadingJob(const nlohmann::json& assetData, const AssetLoadingOptions& options): data(std::make_unique<Data>()) {
+        data->options = options;
+        data->start = std::chrono::steady_clock::now();
+        if(!assetData.is_object()){
+            done = true;
+            return;
+        }
+        const auto textureTypes = {AssetTypeName<Texture2D>::value, AssetTypeName<TextureRegion>::value};
+
+        // The maps of the lit materials are packed first since this changes the textures & materials to load
+        data->textures = assetData.value("textures", nlohmann::json::object());
+        data->materials = assetData.value("materials", nlohmann::json::object());
+        packMaterialMaps(data->textures, data->materials);
+        data->shaders = assetData.value("shaders", nlohmann::json::object());
+        data->samplers = assetData.value("samplers", nlohmann::json::object());
+        data->meshes = assetData.value("meshes", nlohmann::json::object());
+
+        // Only the assets that are not in the registry yet are loaded (the others are reused from a previous state)
+        data->missingShaders = findMissingAssets(data->shaders, {AssetTypeName<ShaderProgram>::value});
+        data->missingTextures = findMissingAssets(data->textures, textureTypes);
+        data->missingSamplers = findMissingAssets(data->samplers, {AssetTypeName<Sampler>::value});
+        data->missingMeshes = findMissingAssets(data->meshes, {AssetTypeName<Mesh>::value});
+        data->missingMaterials = findMissingAssets(data->materials, {AssetTypeName<Material>::value});
+
+        // All the assets are loaded by a single pipeline, so the images & meshes are decoded at the same time
+        // and each material is created as soon as the assets it uses are ready
+        AssetPipeline& pipeline = data->pipeline;
+        addShaderTasks(pipeline, data->missingShaders, data->materialDependencies);
+        // If requested, the albedo textures of the lit materials are packed into texture arrays so that their materials can be batched
+        if(options.packTextures){
+            data->packing = std::make_shared<TexturePacking>();
+            data->packing->names = findPackableTextures(data->missingTextures, data->materials);
+        }
+        addTextureTasks(pipeline, data->missingTextures, data->materialDependencies, options.textureCompression, options.streamTextureMips,
+                        data->packing, data->sizes);
+        if(data->packing && !data->packing->names.empty()) addTexturePackingTask(pipeline, data->packing, options.packing, data->materialDependencies);
+        addSamplerTasks(pipeline, data->missingSamplers, data->materialDependencies);
+        addMeshTasks(pipeline, data->missingMeshes, data->meshTasks, data->sizes);
+        addMaterialTasks(pipeline, data->missingMaterials, data->materialTasks, data->materialDependencies);
+        pipeline.start(options.parallel);
+    }
+
+    AssetLoadingJob::~AssetLoadingJob(){
+        // The assets created so far stay in the asset loaders (they are deleted by "clearAllAssets")
+        releaseAssets(references);
+    }
+
+    bool AssetLoadingJob::update(double budgetMilliseconds){
+        if(done) return true;
+        if(!data->pipeline.update(budgetMilliseconds)) return false;
+        // The shaders are compiled by the driver in the background (if it can), so their results are only checked once they are ready
+        if(ShaderProgram::updateLinking() > 0) return false;
+        // Unless the textures should be streamed, we wait for their uploads (which the application continues every frame)
+        // so that they are ready on the first frame of the state
+        if(!data->options.streamTextures && TextureUploader::get().getPendingCount() > 0) return false;
+        finish();
+        return true;
+    }
+
+    void AssetLoadingJob::wait(){
+        if(done) return;
+        data->pipeline.wait();
+        ShaderProgram::finishLinking();
+        if(!data->options.streamTextures) TextureUploader::get().flush();
+        finish();
+    }
+
+    float AssetLoadingJob::getProgress() const {
+        if(done || data->pipeline.size() == 0) return done ? 1.0f : 0.0f;
+        return float(data->pipeline.getCreatedCount()) / float(data->pipeline.size());
+    }
+
+    AssetReferences AssetLoadingJob::takeReferences(){
+        return std::move(references);
+    }
+
+    void AssetLoadingJob::finish(){
+        done = true;
+        const auto textureTypes = {AssetTypeName<Texture2D>::value, AssetTypeName<TextureRegion>::value};
+
+        // Record the new assets in the registry (each asset after the assets it uses)
+        auto& registry = AssetRegistry::get();
+        auto& sizes = *data->sizes;
+        for(auto& [name, desc] : data->missingShaders.items()){
+            if(AssetLoader<ShaderProgram>::get(name)) registry.add<ShaderProgram>(name, desc.dump());
+        }
+        if(data->packing){
+            for(const auto& name : data->packing->arrays) registry.add<TextureArray>(name, "");
+        }
+        for(auto& [name, desc] : data->missingTextures.items()){
+            if(AssetLoader<Texture2D>::get(name)){
+                registry.add<Texture2D>(name, desc.dump(), sizes[name]);
+            } else if(AssetLoader<TextureRegion>::get(name)){
+                registry.add<TextureRegion>(name, desc.dump(), sizes[name],
+                                            {AssetRegistry::getKey<TextureArray>(data->packing->regionArrays[name])});
+            }
+        }
+        for(auto& [name, desc] : data->missingSamplers.items()){
+            if(AssetLoader<Sampler>::get(name)) registry.add<Sampler>(name, desc.dump());
+        }
+        for(auto& [name, desc] : data->missingMeshes.items()){
+            if(AssetLoader<Mesh>::get(name)) registry.add<Mesh>(name, desc.dump(), sizes[name]);
+        }
+        // A material uses every shader, texture & sampler named in its description
+        for(auto& [name, desc] : data->missingMaterials.items()){
+            if(!AssetLoader<Material>::get(name)) continue;
+            std::vector<std::string> dependencies;
+            for(auto& [key, value] : desc.items()){
+                if(!value.is_string()) continue;
+                std::string dependency = findKey(value.get<std::string>(), {AssetTypeName<ShaderProgram>::value, AssetTypeName<Texture2D>::value,
+                                                                            AssetTypeName<TextureRegion>::value, AssetTypeName<Sampler>::value});
+                if(!dependency.empty()) dependencies.push_back(dependency);
+            }
+            registry.add<Material>(name, desc.dump(), 0, std::move(dependencies));
+        }
+
+        // Then all the assets of the manifest are acquired (whether they were loaded now or reused)
+        auto acquire = [&](const nlohmann::json& assets, std::initializer_list<const char*> types){
+            for(auto& [name, desc] : assets.items()){
+                std::string key = findKey(name, types);
+                if(key.empty()) continue;
+                registry.acquire(key);
+                references.push_back(key);
+            }
+        };
+        acquire(data->shaders, {AssetTypeName<ShaderProgram>::value});
+        acquire(data->textures, textureTypes);
+        acquire(data->samplers, {AssetTypeName<Sampler>::value});
+        acquire(data->meshes, {AssetTypeName<Mesh>::value});
+        acquire(data->materials, {AssetTypeName<Material>::value});
+
+        size_t total = data->shaders.size() + data->textures.size() + data->samplers.size() + data->meshes.size() + data->materials.size();
+        size_t missing = data->missingShaders.size() + data->missingTextures.size() + data->missingSamplers.size() +
+                         data->missingMeshes.size() + data->missingMaterials.size();
+        auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - data->start).count();
+        std::cout << "Loaded " << data->pipeline.size() << " assets in " << milliseconds << " ms ("
+                  << (data->options.parallel ? "parallel" : "serial") << " decoding, " << total - missing << " assets reused)" << std::endl;
+    }
+
+    AssetReferences deserializeAllAssets(const nlohmann::json& assetData, const AssetLoadingOptions& options){
+        AssetLoadingJob job(assetData, options);
+        job.wait();
+        return job.takeReferences();
+    }
+
+    void releaseAssets(AssetReferences& references){
+        auto& registry = AssetRegistry::get();
+        for(const auto& key : references) registry.release(key);
+        references.clear();
+        // The released assets stay cached unless the cache exceeds its budget
+        registry.trim();
+    }
+
+    // The keys of the asset types in the asset data
+    static const std::array<const char*, 5> ASSET_CATEGORIES = {"shaders", "textures", "samplers", "meshes", "materials"};
+
+    // Returns the key in the asset data that holds the assets of the given type (or a nullptr if the type is not in the asset data)
+    static const char* getAssetCategory(const std::string& type){
+        if(type == AssetTypeName<ShaderProgram>::value) return "shaders";
+        if(type == AssetTypeName<Texture2D>::value || type == AssetTypeName<TextureRegion>::value) return "textures";
+        if(type == AssetTypeName<Sampler>::value) return "samplers";
+        if(type == AssetTypeName<Mesh>::value) return "meshes";
+        if(type == AssetTypeName<Material>::value) return "materials";
+        return nullptr;
+    }
+
+    // Moves an asset from "source" to "target" with the assets named by the strings in its description (e.g. the shader & textures of a material)
+    static void moveAsset(nlohmann::json& source, nlohmann::json& target, const std::string& category, const std::string& name){
+        auto categoryIt = source.find(category);
+        if(categoryIt == source.end() || !categoryIt->is_object()) return;
+        auto it = categoryIt->find(name);
+        if(it == categoryIt->end()) return;
+        nlohmann::json desc = std::move(*it);
+        categoryIt->erase(it);
+        target[category][name] = desc;
+        if(!desc.is_object()) return;
+        for(auto& [key, value] : desc.items()){
+            if(!value.is_string()) continue;
+            for(const char* dependencyCategory : ASSET_CATEGORIES) moveAsset(source, target, dependencyCategory, value.get<std::string>());
+        }
+    }
+
+    // Moves every asset named by a string in "uses" (at any depth) from "source" to "target"
+    static void moveUsedAssets(nlohmann::json& source, nlohmann::json& target, const nlohmann::json& uses){
+        if(uses.is_string()){
+            for(const char* category : ASSET_CATEGORIES) moveAsset(source, target, category, uses.get<std::string>());
+        } else if(uses.is_structured()){
+            for(auto& value : uses) moveUsedAssets(source, target, value);
+        }
+    }
+
+    DeferredAssets splitManifest(AssetManifest& manifest){
+        DeferredAssets deferred;
+        deferred.options = manifest.options;
+        if(manifest.uses.is_null() || !manifest.assets.is_object()) return deferred;
+        nlohmann::json used = nlohmann::json::object();
+        moveUsedAssets(manifest.assets, used, manifest.uses);
+        deferred.assets = std::move(manifest.assets);
+        manifest.assets = std::move(used);
+        return deferred;
+    }
+
+    // The declared deferred assets (the assets are removed once they are loaded) and the references of the state that declared them
+    static DeferredAssets deferredAssets;
+    static AssetReferences* deferredReferences = nullptr;
+    static bool loadingDeferredAsset = false;
+
+    void declareDeferredAssets(DeferredAssets deferred, AssetReferences* references){
+        deferredAssets = std::move(deferred);
+        deferredReferences = references;
+    }
+
+    bool loadDeferredAsset(const char* type, const std::string& name){
+        // The assets that a deferred asset uses are loaded with it, so a deferred asset is never loaded while another one is loading
+        const char* category = getAssetCategory(type);
+        if(!category || loadingDeferredAsset) return false;
+        nlohmann::json assets = nlohmann::json::object();
+        moveAsset(deferredAssets.assets, assets, category, name);
+        if(assets.empty()) return false;
+
+        // The asset is needed right away, so it is loaded on this frame
+        // Packing a few albedos into their own texture array would not batch anything, so the deferred textures are never packed
+        AssetLoadingOptions options = deferredAssets.options;
+        options.packTextures = false;
+        loadingDeferredAsset = true;
+        AssetReferences references = deserializeAllAssets(assets, options);
+        loadingDeferredAsset = false;
+        if(deferredReferences){
+            deferredReferences->insert(deferredReferences->end(), references.begin(), references.end());
+        } else {
+            releaseAssets(references);
+        }
+        return true;
     }
 
     void clearAllAssets(){
+        AssetRegistry::get().clear();
         AssetLoader<ShaderProgram>::clear();
         AssetLoader<Texture2D>::clear();
+        AssetLoader<TextureRegion>::clear();
+        AssetLoader<TextureArray>::clear();
         AssetLoader<Sampler>::clear();
         AssetLoader<Mesh>::clear();
         AssetLoader<Material>::clear();
     }
 
-}
\ No newline at end of file
+}
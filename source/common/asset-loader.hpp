@@ -1,51 +1,222 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <json/json.hpp>
+#include "texture/texture-compressor.hpp"
+#include "texture/texture-packer.hpp"
 
 namespace our {
 
+    class ShaderProgram;
+    class Texture2D;
+    struct TextureRegion;
+    class TextureArray;
+    class Sampler;
+    class Mesh;
+    class Material;
+
+    // The name of each asset type (it is used in the asset registry keys, see "asset-registry.hpp")
+    template<typename T> struct AssetTypeName;
+    template<> struct AssetTypeName<ShaderProgram> { static constexpr const char* value = "shader"; };
+    template<> struct AssetTypeName<Texture2D> { static constexpr const char* value = "texture"; };
+    template<> struct AssetTypeName<TextureRegion> { static constexpr const char* value = "texture-region"; };
+    template<> struct AssetTypeName<TextureArray> { static constexpr const char* value = "texture-array"; };
+    template<> struct AssetTypeName<Sampler> { static constexpr const char* value = "sampler"; };
+    template<> struct AssetTypeName<Mesh> { static constexpr const char* value = "mesh"; };
+    template<> struct AssetTypeName<Material> { static constexpr const char* value = "material"; };
+
+    // Loads a deferred asset (and the deferred assets it uses) on its first use. Returns false if the asset is not deferred.
+    // This is called by "AssetLoader<T>::get" (see "declareDeferredAssets")
+    bool loadDeferredAsset(const char* type, const std::string& name);
+
+    template<typename T> class AssetHandle;
+
     // This static template class will hold the loaded assets
     // and can be called from anywhere to get an asset by its name.
     // Since we have different types of assets, this declared as a template class
     // and for each asset type, we define a specialization in "asset-loader.cpp"
+    // Each name gets a slot the first time it is seen and keeps it till the application exits (even if the asset is deleted),
+    // so a handle to the slot can be resolved once and then used to get the asset without looking up its name (see "AssetHandle").
     template<typename T>
     class AssetLoader {
-        // This map stores a pointer to each asset identified by its name
-        // All assets in this map are owned by the asset loader so it should not be deleted outside of this class
-        static inline std::unordered_map<std::string, T*> assets;
+        // The slots store a pointer to each asset (or a nullptr if the asset is not loaded) and the name of each slot
+        // All assets in the slots are owned by the asset loader so it should not be deleted outside of this class
+        static inline std::vector<T*> slots;
+        static inline std::vector<std::string> names;
+        // This map stores the slot of each name
+        static inline std::unordered_map<std::string, uint32_t> indices;
     public:
         // This function loads the assets defined by the given json object
         // The json object should be defined in the form: {asset_name: asset_description}
         // For example: {"white": "textures/white.png", "polka": "textures/polka.png"} defines 2 textures
         // where the key will be asset name and the description holds the path to the texture file
         static void deserialize(const nlohmann::json&);
+        // Returns a handle to the asset with the given name (the asset does not have to be loaded yet)
+        static AssetHandle<T> getHandle(const std::string& name) {
+            auto [it, inserted] = indices.emplace(name, uint32_t(slots.size()));
+            if(inserted){
+                slots.push_back(nullptr);
+                names.push_back(name);
+            }
+            return AssetHandle<T>(it->second);
+        }
+        // This function returns the asset of the given handle
+        // If the asset is not loaded but it was deferred (see "declareDeferredAssets"), it is loaded now
+        // If the asset could not be found, the function returns a nullptr
+        static T* get(AssetHandle<T> handle) {
+            if(handle.index >= slots.size()) return nullptr;
+            if(T* asset = slots[handle.index]) return asset;
+            if(!loadDeferredAsset(AssetTypeName<T>::value, names[handle.index])) return nullptr;
+            return slots[handle.index];
+        }
         // This function find an asset by its name and returns a pointer to it
         // If no asset with the given name was found, the function returns a nullptr
         // WARNING: never delete the asset returned by the function.
         // The asset could be shared with another object and
         // all the assets will be automatically cleared when the function "clear" is called
+        // (Unlike the handles, it never loads a deferred asset, so it can be used to check whether an asset is loaded)
         static T* get(const std::string& name) {
-            if(auto it = assets.find(name); it != assets.end()){
-                return it->second;
+            if(auto it = indices.find(name); it != indices.end()){
+                return slots[it->second];
             }
             return nullptr;
         };
-        // This function deletes all the assets held by this class and clear the assets map 
+        // This function stores an asset by its name (the asset loader takes the ownership of the asset)
+        // It is used by the asset pipeline to store the assets once they are created on the main thread
+        static void set(const std::string& name, T* asset) {
+            slots[getHandle(name).index] = asset;
+        }
+        // This function deletes a single asset (it is used by the asset registry to evict the cached assets)
+        static void remove(const std::string& name){
+            if(auto it = indices.find(name); it != indices.end()){
+                delete slots[it->second];
+                slots[it->second] = nullptr;
+            }
+        }
+        // This function deletes all the assets held by this class (the slots are kept so the handles stay valid)
         static void clear(){
-            for(auto& [name, asset] : assets){
+            for(auto& asset : slots){
                 delete asset;
+                asset = nullptr;
             }
-            assets.clear();
         }
     };
 
+    // A handle is the index of an asset slot in "AssetLoader<T>", so it can be stored (e.g. by the components) instead of the asset name
+    // and getting its asset does not need a lookup. The handle stays valid if the asset is deleted then loaded again.
+    // A default constructed handle refers to no asset.
+    template<typename T>
+    class AssetHandle {
+        friend class AssetLoader<T>;
+        static constexpr uint32_t INVALID = ~uint32_t(0);
+        uint32_t index = INVALID;
+        explicit AssetHandle(uint32_t index): index(index) {}
+    public:
+        AssetHandle() = default;
+        // Returns a handle to the asset with the given name (or a handle to no asset if the name is empty)
+        static AssetHandle find(const std::string& name) { return name.empty() ? AssetHandle() : AssetLoader<T>::getHandle(name); }
+
+        // Returns the asset (which is loaded on the first use if it was deferred) or a nullptr if it is not loaded
+        T* get() const { return AssetLoader<T>::get(*this); }
+        T* operator->() const { return get(); }
+        // Returns whether the handle refers to an asset slot (the asset may not be loaded)
+        bool isValid() const { return index != INVALID; }
+
+        bool operator==(const AssetHandle& other) const { return index == other.index; }
+        bool operator!=(const AssetHandle& other) const { return index != other.index; }
+    };
+
+    // The options of "deserializeAllAssets"
+    struct AssetLoadingOptions {
+        // The CPU heavy work (decoding images, parsing meshes) runs on the worker threads unless this is false
+        // (which is only useful to compare the loading times)
+        bool parallel = true;
+        // If true, the function returns before the textures are uploaded and they become ready over the next frames
+        bool streamTextures = false;
+        // The compression of the textures that do not pick their own compression (see "AssetLoader<Texture2D>::deserialize")
+        texture_compressor::Compression textureCompression = texture_compressor::Compression::NONE;
+        // If true, the albedo textures of the lit materials are packed into texture arrays & atlases (see "texture-packer.hpp")
+        // so the lit materials that only differ in their albedo can be drawn in the same batch
+        bool packTextures = false;
+        texture_packer::PackOptions packing;
+        // If true, the textures (except the packed ones) keep their mip chains on the RAM and only the levels needed by the objects
+        // on the screen are resident on the VRAM (see "texture-streamer.hpp")
+        bool streamTextureMips = false;
+    };
+
+    // The keys of the assets acquired by a state in the asset registry (see "asset-registry.hpp")
+    using AssetReferences = std::vector<std::string>;
+
+    // The assets that a state needs (in the form read by "deserializeAllAssets") and how they are loaded
+    // The application loads the manifest of a state in the background before the state is initialized (see "State::getAssetManifest")
+    struct AssetManifest {
+        nlohmann::json assets = nlohmann::json::object();
+        AssetLoadingOptions options;
+        // If this is not null, only the assets named by the strings in it (e.g. the world of the state) and the assets they use
+        // are loaded before the state is initialized. The other assets are deferred till their first use (see "declareDeferredAssets").
+        nlohmann::json uses = nullptr;
+    };
+
+    // The assets of a manifest that are only loaded on their first use
+    struct DeferredAssets {
+        nlohmann::json assets = nlohmann::json::object();
+        AssetLoadingOptions options;
+    };
+
+    // Keeps the assets used by the manifest (see "AssetManifest::uses") in "manifest.assets" and returns the other assets
+    DeferredAssets splitManifest(AssetManifest& manifest);
+    // Declares the assets that are loaded when a handle to them is first used (only one group of assets is declared at a time).
+    // The loaded assets are acquired and their keys are added to "references" (the references of the state that declared them).
+    void declareDeferredAssets(DeferredAssets deferred, AssetReferences* references);
+
+    // Loads a group of assets over many frames: the images & meshes are decoded on the workers while the application keeps presenting,
+    // and every frame "update" creates the OpenGL objects that are ready within a time budget.
+    // Once it is done, the assets are recorded & acquired in the asset registry like "deserializeAllAssets" does.
+    // If the references are not taken, they are released when the job is destroyed.
+    class AssetLoadingJob {
+        struct Data;
+        std::unique_ptr<Data> data;
+        AssetReferences references;
+        bool done = false;
+
+        // Records the loaded assets in the registry and acquires all the assets of the manifest
+        void finish();
+    public:
+        // Starts loading the given assets (the assets that are already loaded from the same descriptions are reused)
+        explicit AssetLoadingJob(const nlohmann::json& assetData, const AssetLoadingOptions& options = {});
+        ~AssetLoadingJob();
+
+        // Creates the assets that are ready within the given time budget (in milliseconds). Returns true once all the assets are ready.
+        // This must be called on the main thread.
+        bool update(double budgetMilliseconds);
+        // Loads everything that is left and returns after all the assets are ready
+        void wait();
+
+        bool isDone() const { return done; }
+        // Returns the fraction of the assets that are ready (in [0, 1])
+        float getProgress() const;
+        // Takes the references to the loaded assets (the caller must give them to "releaseAssets" once it does not use them)
+        AssetReferences takeReferences();
+
+        AssetLoadingJob(const AssetLoadingJob&) = delete;
+        AssetLoadingJob& operator=(const AssetLoadingJob&) = delete;
+    };
+
     // Given a json holding the data for all the assets
     // This function will call "AssetLoader<T>::deserialize" for all the different asset types T
     // For example, a json in the form {"shaders": ... , "textures": ... } will call "deserialize" for:
     // AssetLoader<ShaderProgram> and AssetLoader<Texture2D>
-    void deserializeAllAssets(const nlohmann::json& assetData);
-    // This will call "AssetLoader<T>::clear" for all the different asset types T
+    // The options control how the assets are decoded & uploaded (see "AssetLoadingOptions")
+    // The assets that are already loaded from the same description (e.g. by a previous state) are reused instead of being loaded again.
+    // The returned references keep the assets loaded till they are given to "releaseAssets".
+    AssetReferences deserializeAllAssets(const nlohmann::json& assetData, const AssetLoadingOptions& options = {});
+    // Releases the assets acquired by "deserializeAllAssets". The assets that are not used anymore stay cached
+    // (so the next state that uses them does not load them again) till the cache exceeds its budget.
+    void releaseAssets(AssetReferences& references);
+    // This will call "AssetLoader<T>::clear" for all the different asset types T (even if they are still referenced)
     void clearAllAssets();
 }
\ No newline at end of file
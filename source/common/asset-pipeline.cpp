@@ -0,0 +1,124 @@
+#include "asset-pipeline.hpp"
+#include "jobs/job-system.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+
+namespace our {
+
+    AssetPipeline::~AssetPipeline(){
+        while(pendingDecodes > 0){
+            receiveDecodedTasks();
+            if(pendingDecodes == 0) break;
+            if(!JobSystem::get().runPendingJob()){
+                std::unique_lock<std::mutex> lock(mutex);
+                taskDecoded.wait(lock, [this](){ return !decodedTasks.empty(); });
+            }
+        }
+    }
+
+    AssetPipeline::TaskId AssetPipeline::add(const std::string& name, std::function<void()> decode, std::function<void()> create){
+        Task task;
+        task.name = name;
+        task.decode = std::move(decode);
+        task.create = std::move(create);
+        tasks.push_back(std::move(task));
+        return tasks.size() - 1;
+    }
+
+    void AssetPipeline::addDependency(TaskId task, TaskId dependency){
+        if(task == dependency) return;
+        tasks[dependency].dependents.push_back(task);
+        ++tasks[task].remainingDependencies;
+    }
+
+    void AssetPipeline::onDecoded(TaskId id){
+        tasks[id].decoded = true;
+        if(tasks[id].remainingDependencies == 0) ready.push_back(id);
+    }
+
+    void AssetPipeline::create(TaskId id){
+        Task& task = tasks[id];
+        task.create();
+        task.created = true;
+        ++createdCount;
+        for(TaskId dependent : task.dependents){
+            if(--tasks[dependent].remainingDependencies == 0 && tasks[dependent].decoded) ready.push_back(dependent);
+        }
+    }
+
+    void AssetPipeline::receiveDecodedTasks(){
+        std::vector<TaskId> received;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.swap(decodedTasks);
+        }
+        pendingDecodes -= received.size();
+        for(TaskId id : received) onDecoded(id);
+    }
+
+    void AssetPipeline::start(bool parallel){
+        // Start decoding all the tasks. A task without a decode step is decoded already.
+        for(TaskId id = 0; id < tasks.size(); ++id){
+            Task& task = tasks[id];
+            if(!task.decode){
+                onDecoded(id);
+            } else if(!parallel){
+                task.decode();
+                onDecoded(id);
+            } else {
+                ++pendingDecodes;
+                JobSystem::get().submit([this, id](){
+                    tasks[id].decode();
+                    // The notification is sent while the mutex is held, since the pipeline can be destroyed right after the unlock
+                    std::lock_guard<std::mutex> lock(mutex);
+                    decodedTasks.push_back(id);
+                    taskDecoded.notify_one();
+                });
+            }
+        }
+    }
+
+    bool AssetPipeline::update(double budgetMilliseconds){
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&](){ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+        while(!isDone()){
+            receiveDecodedTasks();
+            if(ready.empty()){
+                if(pendingDecodes > 0) return false;
+                // Every task is decoded but none is ready, so the remaining tasks depend on each other
+                // We report them and create them in order anyway
+                for(TaskId id = 0; id < tasks.size(); ++id){
+                    if(tasks[id].created) continue;
+                    std::cerr << "The asset \"" << tasks[id].name << "\" is part of a dependency cycle" << std::endl;
+                    tasks[id].remainingDependencies = 0;
+                    create(id);
+                }
+                break;
+            }
+            // Create every task that is ready (creating a task can make its dependents ready) till the budget is spent
+            TaskId id = ready.front();
+            ready.pop_front();
+            create(id);
+            if(elapsed() >= budgetMilliseconds) break;
+        }
+        return isDone();
+    }
+
+    void AssetPipeline::run(bool parallel){
+        start(parallel);
+        wait();
+    }
+
+    void AssetPipeline::wait(){
+        while(!update(std::numeric_limits<double>::infinity())){
+            // Help the workers instead of sleeping. If no job is queued, we wait for a worker to finish one.
+            if(!JobSystem::get().runPendingJob()){
+                std::unique_lock<std::mutex> lock(mutex);
+                taskDecoded.wait(lock, [this](){ return !decodedTasks.empty(); });
+            }
+        }
+    }
+
+}
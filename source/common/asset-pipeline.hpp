@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace our {
+
+    // The asset pipeline loads a group of assets where each asset is loaded in two steps:
+    // - "decode" runs on a worker thread and does the CPU heavy work (reading files, decoding images, parsing & optimizing meshes).
+    // - "create" runs on the main thread (since the OpenGL context is only current there) and creates the OpenGL objects from the decoded data.
+    // An asset can depend on other assets (for example, a material depends on its shader, textures and sampler),
+    // so its "create" step only runs after the "create" steps of all its dependencies are done.
+    // While the main thread waits for the workers, it runs the queued decode jobs too.
+    // The pipeline can also be run over many frames ("start" then "update" every frame), so the application keeps presenting while it loads.
+    class AssetPipeline {
+    public:
+        using TaskId = size_t;
+
+    private:
+        struct Task {
+            std::string name;                   // Used for error messages
+            std::function<void()> decode;       // Runs on a worker thread (can be empty)
+            std::function<void()> create;       // Runs on the main thread
+            std::vector<TaskId> dependents;     // The tasks that wait for this task to be created
+            size_t remainingDependencies = 0;   // The number of dependencies that are not created yet
+            bool decoded = false, created = false;
+        };
+        std::vector<Task> tasks;
+
+        // The workers push the tasks that they decoded here and the main thread takes them
+        std::vector<TaskId> decodedTasks;
+        std::mutex mutex;
+        std::condition_variable taskDecoded;
+
+        size_t createdCount = 0, pendingDecodes = 0;
+        std::deque<TaskId> ready;               // The tasks that are decoded and whose dependencies are created
+
+        void onDecoded(TaskId id);
+        void create(TaskId id);
+        // Takes the tasks that the workers finished
+        void receiveDecodedTasks();
+
+    public:
+        AssetPipeline() = default;
+        // Waits for the decode jobs that are still running (since they write into the tasks)
+        ~AssetPipeline();
+
+        // Adds a task and returns its id (which is used to add dependencies)
+        TaskId add(const std::string& name, std::function<void()> decode, std::function<void()> create);
+        // The given task will only be created after the dependency is created
+        void addDependency(TaskId task, TaskId dependency);
+
+        // Runs all the tasks and returns after all of them are created
+        // If "parallel" is false, each task is decoded then created on the calling thread in order (this is useful to measure the speedup)
+        void run(bool parallel = true);
+
+        // Starts decoding all the tasks (without waiting for them). If "parallel" is false, the tasks are decoded on the calling thread.
+        void start(bool parallel = true);
+        // Creates the tasks that are ready till the given time budget (in milliseconds) is spent (at least one task is created if any is ready)
+        // This should be called on the main thread after "start". It returns true once all the tasks are created.
+        bool update(double budgetMilliseconds);
+        // Creates all the remaining tasks (after "start") and returns after all of them are created
+        void wait();
+        // Returns whether all the tasks are created
+        bool isDone() const { return createdCount == tasks.size(); }
+
+        // Returns the number of tasks
+        size_t size() const { return tasks.size(); }
+        // Returns the number of created tasks (to show the loading progress)
+        size_t getCreatedCount() const { return createdCount; }
+
+        AssetPipeline(const AssetPipeline&) = delete;
+        AssetPipeline& operator=(const AssetPipeline&) = delete;
+    };
+
+}
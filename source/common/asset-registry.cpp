@@ -0,0 +1,94 @@
+#include "asset-registry.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    AssetRegistry& AssetRegistry::get(){
+        static AssetRegistry instance;
+        return instance;
+    }
+
+    void AssetRegistry::addRecord(const std::string& key, std::string description, size_t bytes,
+                                  std::vector<std::string> dependencies, std::function<void()> remove){
+        for(const auto& dependency : dependencies){
+            if(auto it = records.find(dependency); it != records.end()) ++it->second.dependents;
+        }
+        Record& record = records[key];
+        record.description = std::move(description);
+        record.users = record.dependents = 0;
+        record.bytes = bytes;
+        record.releaseTime = ++time;
+        record.dependencies = std::move(dependencies);
+        record.remove = std::move(remove);
+        cachedBytes += bytes;
+    }
+
+    bool AssetRegistry::isLoaded(const std::string& key, const std::string& description) const {
+        auto it = records.find(key);
+        return it != records.end() && it->second.description == description;
+    }
+
+    void AssetRegistry::acquire(const std::string& key){
+        auto it = records.find(key);
+        if(it == records.end()) return;
+        if(it->second.users++ == 0) cachedBytes -= it->second.bytes;
+    }
+
+    void AssetRegistry::release(const std::string& key){
+        auto it = records.find(key);
+        if(it == records.end() || it->second.users == 0) return;
+        if(--it->second.users == 0){
+            cachedBytes += it->second.bytes;
+            it->second.releaseTime = ++time;
+        }
+    }
+
+    bool AssetRegistry::unload(const std::string& key){
+        auto it = records.find(key);
+        if(it == records.end()) return true;
+        if(it->second.users > 0 || it->second.dependents > 0) return false;
+        Record record = std::move(it->second);
+        records.erase(it);
+        cachedBytes -= record.bytes;
+        record.remove();
+        // The dependencies can be deleted once no other asset depends on them
+        for(const auto& dependency : record.dependencies){
+            if(auto dependencyIt = records.find(dependency); dependencyIt != records.end()) --dependencyIt->second.dependents;
+        }
+        return true;
+    }
+
+    void AssetRegistry::trim(){
+        while(cachedBytes > budget){
+            // Unloading an asset can free its dependencies, so the oldest asset that can be deleted is searched again each time
+            auto oldest = records.end();
+            for(auto it = records.begin(); it != records.end(); ++it){
+                if(it->second.users > 0 || it->second.dependents > 0) continue;
+                if(oldest == records.end() || it->second.releaseTime < oldest->second.releaseTime) oldest = it;
+            }
+            if(oldest == records.end()) break;
+            unload(oldest->first);
+        }
+    }
+
+    void AssetRegistry::setBudget(size_t bytes){
+        budget = bytes;
+        trim();
+    }
+
+    void AssetRegistry::clear(){
+        records.clear();
+        cachedBytes = 0;
+    }
+
+    AssetRegistry::Stats AssetRegistry::getStats() const {
+        Stats stats;
+        stats.assetCount = records.size();
+        stats.cachedCount = size_t(std::count_if(records.begin(), records.end(), [](const auto& item){ return item.second.users == 0; }));
+        stats.cachedBytes = cachedBytes;
+        stats.budgetBytes = budget;
+        return stats;
+    }
+
+}
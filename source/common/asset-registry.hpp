@@ -0,0 +1,94 @@
+#pragma once
+
+#include "asset-loader.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // The asset registry counts the references to the assets held by the "AssetLoader"s, so the assets can outlive the states that load them.
+    // Each state acquires the assets it uses (see "AssetLoadingJob" & "State::getAssetManifest") and releases them when it is destroyed (see "releaseAssets").
+    // An asset that no state uses is not deleted right away. It stays cached so that the next state that uses it does not load it again,
+    // and the cached assets are only deleted (the least recently released first) when their size exceeds the cache budget.
+    // An asset is also used by the assets that depend on it (e.g. a material uses its shader & its textures),
+    // so a cached asset is only deleted after the assets that depend on it.
+    // Each asset is recorded with the description it was loaded from, so an asset is loaded again if its description changes.
+    // It is a singleton since the assets are shared by all the states.
+    class AssetRegistry {
+        struct Record {
+            std::string description;                // The json description that the asset was loaded from
+            size_t users = 0;                       // The number of states that acquired the asset
+            size_t dependents = 0;                  // The number of assets that depend on the asset
+            size_t bytes = 0;                       // The (estimated) memory used by the asset
+            uint64_t releaseTime = 0;               // When the last state released the asset (to evict the oldest first)
+            std::vector<std::string> dependencies;  // The keys of the assets used by this asset
+            std::function<void()> remove;           // Deletes the asset from its asset loader
+        };
+
+        std::unordered_map<std::string, Record> records;
+        size_t budget = DEFAULT_BUDGET;
+        // The bytes of the assets that no state uses (even if they are still used by other cached assets)
+        size_t cachedBytes = 0;
+        uint64_t time = 0;
+
+        AssetRegistry() = default;
+
+        void addRecord(const std::string& key, std::string description, size_t bytes,
+                       std::vector<std::string> dependencies, std::function<void()> remove);
+
+    public:
+        // The default maximum number of bytes used by the cached assets (the assets that no state uses)
+        static constexpr size_t DEFAULT_BUDGET = 512 << 20;
+
+        struct Stats {
+            size_t assetCount = 0;
+            size_t cachedCount = 0;     // The number of assets that no state uses
+            size_t cachedBytes = 0;
+            size_t budgetBytes = 0;
+        };
+
+        // Returns the only instance of the registry
+        static AssetRegistry& get();
+
+        // Returns the key of an asset in the registry (the names are only unique per asset type)
+        static std::string getKey(const std::string& type, const std::string& name) { return type + ":" + name; }
+        template<typename T>
+        static std::string getKey(const std::string& name) { return getKey(AssetTypeName<T>::value, name); }
+
+        // Records an asset that was stored in "AssetLoader<T>" (it starts cached, so it should be acquired by the state that loaded it)
+        // The dependencies must be recorded before the asset
+        template<typename T>
+        void add(const std::string& name, std::string description, size_t bytes = 0, std::vector<std::string> dependencies = {}){
+            addRecord(getKey<T>(name), std::move(description), bytes, std::move(dependencies), [name](){ AssetLoader<T>::remove(name); });
+        }
+
+        // Returns whether the asset is recorded
+        bool contains(const std::string& key) const { return records.count(key) != 0; }
+        // Returns whether the asset is recorded and was loaded from the given description
+        bool isLoaded(const std::string& key, const std::string& description) const;
+
+        // Adds or removes a state that uses the asset (an asset that no state uses is cached)
+        void acquire(const std::string& key);
+        void release(const std::string& key);
+
+        // Deletes the asset if no state or asset uses it. Returns false if the asset is still used.
+        bool unload(const std::string& key);
+        // Deletes the least recently released assets till the cached assets fit in the budget
+        void trim();
+
+        // Sets the maximum number of bytes used by the cached assets
+        void setBudget(size_t bytes);
+        // Forgets all the records (this is called by "clearAllAssets" which deletes the assets)
+        void clear();
+
+        Stats getStats() const;
+
+        AssetRegistry(const AssetRegistry&) = delete;
+        AssetRegistry& operator=(const AssetRegistry&) = delete;
+    };
+
+}
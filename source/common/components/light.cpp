@@ -17,6 +17,8 @@ namespace our {
         attenuation = data.value("attenuation", glm::vec3(0.0f, 0.0f, 1.0f));
         innerCone = data.value("innerCone", glm::radians(15.0f));
         outerCone = data.value("outerCone", glm::radians(30.0f)); 
+        range = data.value("range", 0.0f);
+        castShadows = data.value("castShadows", true);
     }
 
 }
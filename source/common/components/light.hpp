@@ -25,6 +25,11 @@ namespace our {
         // Spot light specific properties
         float innerCone = 0.0f;
         float outerCone = 0.0f;
+        // The distance after which the light is ignored (for point and spot lights)
+        // If it is 0, the range is computed from the attenuation
+        float range = 0.0f;
+        // Whether the light casts shadows (only directional and spot lights have shadow maps, see "ShadowMaps")
+        bool castShadows = true;
         //Component ID
         static std::string getID() { return "Light"; }
         // Deserialize from json
@@ -2,7 +2,7 @@
 #include "../asset-loader.hpp"
 
 namespace our {
-    // Receives the mesh & material from the AssetLoader by the names given in the json object
+    // Receives the handles of the mesh & material from the AssetLoader by the names given in the json object
     void MeshRendererComponent::deserialize(const nlohmann::json& data){
         if(!data.is_object()) return;
         // Notice how we just get a string from the json file and pass it to the AssetLoader to get us the actual asset
@@ -11,7 +11,17 @@ namespace our {
         // Hint: To get a value of type T from a json object "data" where the key corresponding to the value is "key",
         // you can use write: data["key"].get<T>().
         // Look at "source/common/asset-loader.hpp" to know how to use the static class AssetLoader.
-        mesh = our::AssetLoader<our::Mesh>::get(data["mesh"].get<std::string>());
-        material = our::AssetLoader<our::Material>::get(data["material"].get<std::string>());
+        // The names are only looked up here, the handles are used to get the assets afterwards
+        mesh = our::AssetHandle<our::Mesh>::find(data["mesh"].get<std::string>());
+        material = our::AssetHandle<our::Material>::find(data.value("material", ""));
+        // A mesh with multiple submeshes (such as a glTF mesh with multiple primitives) can have a material per submesh
+        // where "materials" is an array of material names in the same order as the submeshes
+        materials.clear();
+        if(data.contains("materials") && data["materials"].is_array()){
+            for(auto& name : data["materials"]) materials.push_back(our::AssetHandle<our::Material>::find(name.get<std::string>()));
+        }
+        if(!material.isValid() && !materials.empty()) material = materials[0];
+        castShadows = data.value("castShadows", true);
+        isStatic = data.value("static", false);
     }
 }
\ No newline at end of file
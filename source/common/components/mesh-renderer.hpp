@@ -4,20 +4,35 @@
 #include "../mesh/mesh.hpp"
 #include "../material/material.hpp"
 #include "../asset-loader.hpp"
+#include <vector>
 
 namespace our {
 
     // This component denotes that any renderer should draw the given mesh using the given material at the transformation of the owning entity.
     class MeshRendererComponent : public Component {
     public:
-        Mesh* mesh; // The mesh that should be drawn
-        Material* material; // The material used to draw the mesh
+        // The assets are held by handles, so they are found in O(1) every frame and a deferred asset is loaded when it is first drawn
+        AssetHandle<Mesh> mesh; // The mesh that should be drawn
+        AssetHandle<Material> material; // The material used to draw the mesh
+        std::vector<AssetHandle<Material>> materials; // The materials of the submeshes (a submesh without a material here uses "material")
         bool enabled = true; // Whether this component is enabled or not
+        bool castShadows = true; // Whether the mesh is drawn into the shadow maps
+        // A static mesh rarely moves, so its depth in the shadow maps is cached (see "ShadowMaps")
+        // Moving a static mesh still works but it redraws the whole cache (its transformation is part of the cache hash)
+        bool isStatic = false;
+
+        // Returns the material that should be used to draw the given submesh
+        Material* getMaterial(size_t submesh) const {
+            if(submesh < materials.size()){
+                if(Material* submeshMaterial = materials[submesh].get()) return submeshMaterial;
+            }
+            return material.get();
+        }
 
         // The ID of this component type is "Mesh Renderer"
         static std::string getID() { return "Mesh Renderer"; }
 
-        // Receives the mesh & material from the AssetLoader by the names given in the json object
+        // Receives the handles of the mesh & material from the AssetLoader by the names given in the json object
         void deserialize(const nlohmann::json& data) override;
     };
 
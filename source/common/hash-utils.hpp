@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// This file contains some helper functions for hashing which are used by:
+// - The hash tables that weld vertices (the hash must be well distributed since the tables use open addressing)
+// - The caches that identify files by their content
+
+namespace our::hash_utils {
+
+    // Scrambles the bits of a 64-bit value so that every input bit affects every output bit (the finalizer of SplitMix64)
+    inline uint64_t mix(uint64_t value){
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ULL;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebULL;
+        value ^= value >> 31;
+        return value;
+    }
+
+    // Combines two hash values into one. Unlike "h1 ^ (h2 << 1)", the order matters and the result is well distributed.
+    inline uint64_t combine(uint64_t seed, uint64_t value){
+        return mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+    }
+
+    // Returns a 64-bit hash of the given bytes
+    inline uint64_t hash(const void* data, size_t size, uint64_t seed = 0){
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        uint64_t result = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+        // We process the data in 8 byte words then we process the remaining bytes as one word padded with zeros
+        for(; size >= 8; bytes += 8, size -= 8){
+            uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            result = combine(result, word);
+        }
+        if(size > 0){
+            uint64_t word = 0;
+            std::memcpy(&word, bytes, size);
+            result = combine(result, word);
+        }
+        return mix(result);
+    }
+
+}
@@ -0,0 +1,154 @@
+#include "asset-pack.hpp"
+#include "lz4.hpp"
+#include "cache-file.hpp"
+#include "../hash-utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace our {
+
+    namespace {
+        const char MAGIC[4] = {'O', 'P', 'A', 'K'};
+    }
+
+    using cache_file::alignTo16;
+    using cache_file::isInside;
+
+    bool AssetPack::open(const std::string& filename){
+        header = nullptr;
+        entries = nullptr;
+        paths = nullptr;
+        if(!file.open(filename)) return false;
+
+        const char* data = file.data();
+        uint64_t fileSize = file.size();
+        // The mapping is page aligned and every part of the pack is aligned to 16 bytes, so the structures can be read in place
+        const auto* packHeader = reinterpret_cast<const PackHeader*>(data);
+        bool valid = fileSize >= sizeof(PackHeader) && std::memcmp(packHeader->magic, MAGIC, 4) == 0 &&
+                     packHeader->fileVersion == PACK_FILE_VERSION && packHeader->tableOffset % 16 == 0 &&
+                     isInside(packHeader->tableOffset, uint64_t(packHeader->entryCount) * sizeof(PackEntry), fileSize) &&
+                     isInside(packHeader->pathsOffset, packHeader->pathsSize, fileSize);
+        const auto* table = valid ? reinterpret_cast<const PackEntry*>(data + packHeader->tableOffset) : nullptr;
+        for(uint32_t index = 0; valid && index < packHeader->entryCount; ++index){
+            const PackEntry& entry = table[index];
+            valid = isInside(entry.dataOffset, entry.storedSize, fileSize) &&
+                    isInside(entry.pathOffset, entry.pathLength, packHeader->pathsSize) &&
+                    (entry.compression == PackCompression::LZ4 || (entry.compression == PackCompression::NONE && entry.storedSize == entry.size));
+        }
+        if(!valid){
+            std::cerr << "Invalid asset pack: " << filename << std::endl;
+            file.close();
+            return false;
+        }
+        header = packHeader;
+        entries = table;
+        paths = data + packHeader->pathsOffset;
+        return true;
+    }
+
+    const PackEntry* AssetPack::find(std::string_view path) const {
+        const PackEntry* end = entries + getEntryCount();
+        const PackEntry* it = std::lower_bound(entries, end, path, [this](const PackEntry& entry, std::string_view value){
+            return getPath(entry) < value;
+        });
+        return it != end && getPath(*it) == path ? it : nullptr;
+    }
+
+    std::string AssetPack::normalizePath(const std::string& path){
+        return fs::path(path).lexically_normal().generic_string();
+    }
+
+    bool AssetPack::build(const std::string& directory, const std::string& packPath, bool compress){
+        std::error_code error;
+        std::vector<std::string> files;
+        for(auto it = fs::recursive_directory_iterator(directory, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)){
+            if(it->is_regular_file(error)) files.push_back(normalizePath(it->path().string()));
+        }
+        if(error){
+            std::cerr << "Couldn't read the directory: " << directory << " (" << error.message() << ")" << std::endl;
+            return false;
+        }
+        // The table is sorted by path so that "find" can use a binary search
+        std::sort(files.begin(), files.end());
+
+        std::vector<PackEntry> table(files.size());
+        std::string pathBlob;
+        for(size_t index = 0; index < files.size(); ++index){
+            table[index] = {};
+            table[index].pathOffset = uint32_t(pathBlob.size());
+            table[index].pathLength = uint32_t(files[index].size());
+            pathBlob += files[index];
+        }
+
+        // We know the size of everything before the data, so we write the data first then we go back to write the table
+        PackHeader header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.fileVersion = PACK_FILE_VERSION;
+        header.entryCount = uint32_t(table.size());
+        header.pathsSize = uint32_t(pathBlob.size());
+        header.tableOffset = alignTo16(sizeof(PackHeader));
+        header.pathsOffset = header.tableOffset + table.size() * sizeof(PackEntry);
+        uint64_t offset = alignTo16(header.pathsOffset + pathBlob.size());
+
+        // The pack is written into a temporary file then renamed, so a failed build never replaces a working pack with a broken one
+        uint64_t totalBytes = 0, duplicateCount = 0, compressedCount = 0;
+        bool written = cache_file::writeAtomically(packPath, [&](std::ostream& pack){
+            cache_file::writeAt(pack, 0, &header, sizeof(PackHeader));
+            // The gap before the paths is the (not yet written) table, so it is filled with zeros for now
+            cache_file::writeAt(pack, header.pathsOffset, pathBlob.data(), pathBlob.size());
+
+            // The stored files by their content hash (to find the duplicates, the contents are compared since two files can have the same hash)
+            std::unordered_map<uint64_t, std::vector<size_t>> stored;
+            for(size_t index = 0; index < files.size(); ++index){
+                MappedFile source(files[index]);
+                if(!source.isOpen()) return false;
+                PackEntry& entry = table[index];
+                entry.size = source.size();
+                entry.contentHash = hash_utils::hash(source.data(), source.size());
+                totalBytes += entry.size;
+
+                auto& candidates = stored[entry.contentHash];
+                auto duplicate = std::find_if(candidates.begin(), candidates.end(), [&](size_t other){
+                    MappedFile otherSource(files[other]);
+                    return otherSource.isOpen() && otherSource.size() == source.size() &&
+                           std::memcmp(otherSource.data(), source.data(), source.size()) == 0;
+                });
+                if(duplicate != candidates.end()){
+                    const PackEntry& original = table[*duplicate];
+                    entry.dataOffset = original.dataOffset;
+                    entry.storedSize = original.storedSize;
+                    entry.compression = original.compression;
+                    ++duplicateCount;
+                    continue;
+                }
+                candidates.push_back(index);
+
+                // Compression is only worth it if it saves at least an eighth of the file (the already compressed images do not shrink)
+                std::vector<char> compressed;
+                if(compress && source.size() > 0) compressed = lz4::compress(source.data(), source.size());
+                bool useCompressed = !compressed.empty() && compressed.size() < source.size() - source.size() / 8;
+                entry.dataOffset = offset;
+                entry.compression = useCompressed ? PackCompression::LZ4 : PackCompression::NONE;
+                entry.storedSize = useCompressed ? compressed.size() : source.size();
+                cache_file::writeAt(pack, offset, useCompressed ? compressed.data() : source.data(), size_t(entry.storedSize));
+                offset = alignTo16(offset + entry.storedSize);
+                if(useCompressed) ++compressedCount;
+            }
+            pack.seekp(std::streamoff(header.tableOffset));
+            pack.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(PackEntry)));
+            return true;
+        });
+        if(!written) return false;
+        std::cout << "Packed " << files.size() << " files (" << totalBytes / 1024 << " KB) into " << packPath
+                  << " (" << offset / 1024 << " KB, " << compressedCount << " compressed, " << duplicateCount << " duplicates)" << std::endl;
+        return true;
+    }
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "mapped-file.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace our {
+
+    // An asset pack stores many asset files in a single archive, so the assets are read from one mapped file
+    // instead of opening each loose file on its own (see "virtual-file-system.hpp").
+    // - The table of contents is sorted by path, so an entry is found by a binary search.
+    // - Each entry can be compressed with LZ4 (the entries that do not shrink, such as jpg & png images, are stored as they are).
+    // - The files with the same contents are stored once (the entries point to the same data).
+    //
+    // File layout (little endian, the table and every data blob start at a multiple of 16 bytes):
+    //   PackHeader | table of contents (PackEntry * entryCount) | paths | data ...
+
+    // Increment this whenever the layout of the pack file changes
+    constexpr uint32_t PACK_FILE_VERSION = 1;
+
+    // How the data of an entry is stored
+    enum class PackCompression : uint32_t {
+        NONE = 0,
+        LZ4 = 1
+    };
+
+    struct PackHeader {
+        char magic[4];              // Always "OPAK"
+        uint32_t fileVersion;
+        uint32_t entryCount;
+        uint32_t pathsSize;         // The size of the paths blob
+        uint64_t tableOffset;       // The offset of the table of contents
+        uint64_t pathsOffset;       // The offset of the paths blob (the paths are not null terminated)
+    };
+    static_assert(sizeof(PackHeader) == 32, "The pack header should not contain any padding");
+
+    struct PackEntry {
+        uint64_t contentHash;       // The hash of the uncompressed contents (used to find the duplicated files)
+        uint64_t dataOffset;        // The offset of the stored data in the pack
+        uint64_t storedSize;        // The size of the stored (possibly compressed) data
+        uint64_t size;              // The size of the uncompressed contents
+        uint32_t pathOffset;        // The offset of the path in the paths blob
+        uint32_t pathLength;
+        PackCompression compression;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(PackEntry) == 48, "The pack entry should not contain any padding");
+
+    // A read-only asset pack that is mapped into the memory
+    class AssetPack {
+        MappedFile file;
+        const PackHeader* header = nullptr;
+        const PackEntry* entries = nullptr;
+        const char* paths = nullptr;
+    public:
+        // Maps the pack and validates its table of contents. Returns false if the file is not a valid pack.
+        bool open(const std::string& filename);
+
+        // Returns the entry of the given path (which must be normalized, see "normalizePath") or nullptr if the pack does not contain it
+        const PackEntry* find(std::string_view path) const;
+
+        size_t getEntryCount() const { return header ? header->entryCount : 0; }
+        const PackEntry& getEntry(size_t index) const { return entries[index]; }
+        std::string_view getPath(const PackEntry& entry) const { return {paths + entry.pathOffset, entry.pathLength}; }
+        // Returns the stored data of an entry (it is only the contents if the entry is not compressed)
+        const char* getData(const PackEntry& entry) const { return file.data() + entry.dataOffset; }
+
+        // Converts a path to the form stored in the packs: relative to the working directory with forward slashes (e.g. "assets/textures/wood.jpg")
+        static std::string normalizePath(const std::string& path);
+
+        // Writes a pack that contains every file inside the given directory (and its subdirectories)
+        // If "compress" is true, each file is compressed with LZ4 unless that saves less than an eighth of its size
+        static bool build(const std::string& directory, const std::string& packPath, bool compress = true);
+    };
+
+}
@@ -0,0 +1,396 @@
+#include "async-file-reader.hpp"
+#include "../jobs/job-system.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace our {
+
+    namespace {
+        // The I/O thread closes the cached file descriptors when there are more than this number of them
+        constexpr size_t MAX_OPEN_FILES = 256;
+    }
+
+    // The io_uring instance: a submission queue where we put the reads and a completion queue where the kernel puts their results.
+    // Both queues are rings shared with the kernel through mapped memory. We are the only producer of the submission queue
+    // and the only consumer of the completion queue, so no locks are needed (only the ordering of the head & tail updates).
+    // There is no vendored liburing, so the rings are set up with the raw system calls.
+    struct AsyncFileReader::Ring {
+#ifdef __linux__
+        int fd = -1;
+        void* sqMapping = MAP_FAILED;
+        void* cqMapping = MAP_FAILED;
+        void* sqeMapping = MAP_FAILED;
+        size_t sqMappingSize = 0, cqMappingSize = 0, sqeMappingSize = 0;
+        unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+        unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        bool registeredBuffers = false;
+
+        ~Ring(){
+            if(sqeMapping != MAP_FAILED) munmap(sqeMapping, sqeMappingSize);
+            if(cqMapping != MAP_FAILED && cqMapping != sqMapping) munmap(cqMapping, cqMappingSize);
+            if(sqMapping != MAP_FAILED) munmap(sqMapping, sqMappingSize);
+            if(fd >= 0) close(fd);
+        }
+#endif
+    };
+
+    AsyncFileReader::AsyncFileReader(Backend requested) {
+        // The callbacks run on the job system, so it must be created first (to be destroyed after this reader)
+        JobSystem::get();
+        backend = Backend::THREAD_POOL;
+        if(requested != Backend::THREAD_POOL){
+            if(setupRing()){
+                backend = Backend::IO_URING;
+                ioThread = std::thread([this](){ ioLoop(); });
+            } else {
+                ring.reset();
+                if(requested == Backend::IO_URING) std::cerr << "io_uring is not available, the file reads will use the thread pool" << std::endl;
+            }
+        }
+    }
+
+    AsyncFileReader::~AsyncFileReader(){
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        if(ioThread.joinable()) ioThread.join();
+#ifndef _WIN32
+        for(auto& [path, fd] : openFiles) close(fd);
+#endif
+    }
+
+    AsyncFileReader& AsyncFileReader::get(){
+        static AsyncFileReader instance;
+        return instance;
+    }
+
+    const char* AsyncFileReader::getBackendName(Backend backend){
+        switch(backend){
+            case Backend::IO_URING: return "io_uring";
+            case Backend::THREAD_POOL: return "thread pool";
+            default: return "auto";
+        }
+    }
+
+    bool AsyncFileReader::setupRing(){
+#ifdef __linux__
+        ring = std::make_unique<Ring>();
+        io_uring_params params = {};
+        ring->fd = int(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        if(ring->fd < 0) return false;
+
+        // Make sure that the kernel supports the read operations (IORING_OP_READ came after io_uring itself)
+        constexpr unsigned PROBE_OPERATIONS = 64;
+        std::vector<char> probeMemory(sizeof(io_uring_probe) + PROBE_OPERATIONS * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(probeMemory.data());
+        if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, PROBE_OPERATIONS) < 0) return false;
+        for(unsigned operation : {unsigned(IORING_OP_READ), unsigned(IORING_OP_READ_FIXED)}){
+            if(operation > probe->last_op || !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+
+        ring->sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(singleMapping) ring->sqMappingSize = ring->cqMappingSize = std::max(ring->sqMappingSize, ring->cqMappingSize);
+        ring->sqMapping = mmap(nullptr, ring->sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+        if(ring->sqMapping == MAP_FAILED) return false;
+        ring->cqMapping = singleMapping ? ring->sqMapping :
+            mmap(nullptr, ring->cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cqMapping == MAP_FAILED) return false;
+        ring->sqeMappingSize = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqeMapping = mmap(nullptr, ring->sqeMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+        if(ring->sqeMapping == MAP_FAILED) return false;
+
+        auto* sq = static_cast<char*>(ring->sqMapping);
+        ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<char*>(ring->cqMapping);
+        ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        ring->sqes = static_cast<io_uring_sqe*>(ring->sqeMapping);
+
+        // Registering the buffers pins them once, instead of mapping the pages of every read into the kernel.
+        // It can fail if the locked memory limit is too small, in which case every read uses its own buffer.
+        buffers.reset(new char[BUFFER_COUNT * BUFFER_SIZE]);
+        std::vector<iovec> vectors(BUFFER_COUNT);
+        for(size_t index = 0; index < BUFFER_COUNT; ++index) vectors[index] = {buffers.get() + index * BUFFER_SIZE, BUFFER_SIZE};
+        ring->registeredBuffers = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, vectors.data(), unsigned(BUFFER_COUNT)) == 0;
+        if(ring->registeredBuffers){
+            for(int index = int(BUFFER_COUNT) - 1; index >= 0; --index) freeBuffers.push_back(index);
+        } else {
+            buffers.reset();
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void AsyncFileReader::read(const std::string& path, uint64_t offset, size_t size, ReadCallback callback){
+        auto request = std::make_unique<Request>();
+        request->path = path;
+        request->offset = offset;
+        request->size = size;
+        request->callback = std::move(callback);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pendingCount;
+            if(backend == Backend::IO_URING) queue.push_back(std::move(request));
+        }
+        if(request) readWithThreadPool(std::move(request));
+        else changed.notify_all();
+    }
+
+    void AsyncFileReader::wait(){
+        JobSystem& jobs = JobSystem::get();
+        while(true){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(pendingCount == 0) return;
+            }
+            // Help with the callbacks (or the thread pool reads) instead of sleeping
+            if(!jobs.runPendingJob()){
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait_for(lock, std::chrono::milliseconds(1), [this](){ return pendingCount == 0; });
+            }
+        }
+    }
+
+    AsyncFileReader::Stats AsyncFileReader::getStats() const {
+        Stats stats;
+        stats.completedReads = completedReads.load();
+        stats.failedReads = failedReads.load();
+        stats.bytesRead = bytesRead.load();
+        return stats;
+    }
+
+    char* AsyncFileReader::getBuffer(const Request& request) const {
+        return request.buffer >= 0 ? buffers.get() + size_t(request.buffer) * BUFFER_SIZE : request.ownedBuffer.get();
+    }
+
+    void AsyncFileReader::complete(std::unique_ptr<Request> request, long result){
+        if(result < 0){
+            std::cerr << "Couldn't read file: " << request->path << " (" << std::strerror(int(-result)) << ")" << std::endl;
+            ++failedReads;
+        } else {
+            ++completedReads;
+            bytesRead += uint64_t(result);
+        }
+        // "std::function" must be copyable, so the request is moved into a shared pointer
+        std::shared_ptr<Request> shared = std::move(request);
+        JobSystem::get().submit([this, shared, result](){
+            bool success = result >= 0;
+            shared->callback(success, success ? getBuffer(*shared) : nullptr, success ? size_t(result) : 0);
+            // The notification is sent while the mutex is held, since "wait" can return and the reader can be destroyed right after the unlock
+            std::lock_guard<std::mutex> lock(mutex);
+            if(shared->buffer >= 0) freeBuffers.push_back(shared->buffer);
+            --pendingCount;
+            changed.notify_all();
+        });
+    }
+
+    void AsyncFileReader::readWithThreadPool(std::unique_ptr<Request> request){
+        std::shared_ptr<Request> shared = std::move(request);
+        JobSystem::get().submit([this, shared](){
+            shared->ownedBuffer.reset(new char[std::max<size_t>(shared->size, 1)]);
+            long result = 0;
+#ifdef _WIN32
+            std::ifstream file(shared->path, std::ios::binary);
+            if(!file) result = -ENOENT;
+            else {
+                file.seekg(std::streamoff(shared->offset));
+                file.read(shared->ownedBuffer.get(), std::streamsize(shared->size));
+                result = long(file.gcount());
+            }
+#else
+            int fd = open(shared->path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0) result = -errno;
+            // "pread" can return less than the requested size, so we keep reading till the end of the request or the file
+            while(fd >= 0 && size_t(result) < shared->size){
+                ssize_t count = pread(fd, shared->ownedBuffer.get() + result, shared->size - size_t(result), off_t(shared->offset + uint64_t(result)));
+                if(count < 0 && errno == EINTR) continue;
+                if(count < 0) result = -errno;
+                if(count <= 0) break;
+                result += long(count);
+            }
+            if(fd >= 0) close(fd);
+#endif
+            // The callback runs on the same worker, so "complete" is not used (it would queue another job)
+            if(result < 0){
+                std::cerr << "Couldn't read file: " << shared->path << " (" << std::strerror(int(-result)) << ")" << std::endl;
+                ++failedReads;
+            } else {
+                ++completedReads;
+                bytesRead += uint64_t(result);
+            }
+            bool success = result >= 0;
+            shared->callback(success, success ? shared->ownedBuffer.get() : nullptr, success ? size_t(result) : 0);
+            std::lock_guard<std::mutex> lock(mutex);
+            --pendingCount;
+            changed.notify_all();
+        });
+    }
+
+    int AsyncFileReader::openFile(const std::string& path){
+#ifdef __linux__
+        if(auto it = openFiles.find(path); it != openFiles.end()) return it->second;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) return -errno;
+        openFiles[path] = fd;
+        return fd;
+#else
+        return -ENOSYS;
+#endif
+    }
+
+    void AsyncFileReader::fallBackToThreadPool(std::vector<Request*>& inFlightRequests){
+        std::deque<std::unique_ptr<Request>> queued;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            backend = Backend::THREAD_POOL;
+            queued.swap(queue);
+        }
+        // The registered buffers of the in flight reads are never returned since the kernel may still use them
+        // (the thread pool does not use the registered buffers anyway)
+        for(Request* request : inFlightRequests){
+            if(request->ownedBuffer) retiredBuffers.push_back(std::move(request->ownedBuffer));
+            request->buffer = -1;
+            request->done = 0;
+            readWithThreadPool(std::unique_ptr<Request>(request));
+        }
+        inFlightRequests.clear();
+        for(auto& request : queued){
+            if(request->buffer >= 0){
+                std::lock_guard<std::mutex> lock(mutex);
+                freeBuffers.push_back(request->buffer);
+                request->buffer = -1;
+            }
+            readWithThreadPool(std::move(request));
+        }
+    }
+
+    void AsyncFileReader::ioLoop(){
+#ifdef __linux__
+        // The requests are owned by the ring (through "user_data") while they are in flight
+        std::vector<Request*> inFlightRequests;
+        unsigned sqTail = *ring->sqTail;
+        std::vector<std::unique_ptr<Request>> batch;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // A request can start if it does not need a registered buffer or if one of them is free
+                auto canStart = [this](){
+                    return !queue.empty() && (!ring->registeredBuffers || queue.front()->size > BUFFER_SIZE || !freeBuffers.empty());
+                };
+                // If some reads are in flight (or must be resubmitted), we wait for their completions in "io_uring_enter" instead
+                size_t inFlight = inFlightRequests.size();
+                if(inFlight == 0 && batch.empty()) changed.wait(lock, [&](){ return stopping || canStart(); });
+                if(stopping && inFlight == 0 && batch.empty()) break;
+                while(canStart() && inFlight + batch.size() < QUEUE_DEPTH){
+                    auto& request = queue.front();
+                    if(ring->registeredBuffers && request->size <= BUFFER_SIZE){
+                        request->buffer = freeBuffers.back();
+                        freeBuffers.pop_back();
+                    }
+                    batch.push_back(std::move(request));
+                    queue.pop_front();
+                }
+            }
+
+            if(inFlightRequests.empty() && batch.empty()) continue;
+            if(inFlightRequests.empty() && openFiles.size() > MAX_OPEN_FILES){
+                for(auto& [path, fd] : openFiles) close(fd);
+                openFiles.clear();
+            }
+
+            // Fill the submission queue with the whole batch, so one system call submits all of it
+            for(auto& request : batch){
+                int fd = openFile(request->path);
+                if(fd < 0){
+                    complete(std::move(request), fd);
+                    continue;
+                }
+                if(request->buffer < 0) request->ownedBuffer.reset(new char[std::max<size_t>(request->size, 1)]);
+                unsigned index = sqTail & *ring->sqMask;
+                io_uring_sqe& sqe = ring->sqes[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = request->buffer >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                sqe.fd = fd;
+                // A resubmitted read continues after the bytes that were already read
+                sqe.off = request->offset + request->done;
+                sqe.addr = reinterpret_cast<uint64_t>(getBuffer(*request) + request->done);
+                sqe.len = unsigned(request->size - request->done);
+                if(request->buffer >= 0) sqe.buf_index = uint16_t(request->buffer);
+                inFlightRequests.push_back(request.get());
+                sqe.user_data = reinterpret_cast<uint64_t>(request.release());
+                ring->sqArray[index] = index;
+                ++sqTail;
+            }
+            batch.clear();
+            __atomic_store_n(ring->sqTail, sqTail, __ATOMIC_RELEASE);
+
+            // Submit the new reads (and any the kernel did not take yet) then wait for at least one completion
+            unsigned toSubmit = sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+            bool failed = false;
+            if(!inFlightRequests.empty()){
+                long result = syscall(__NR_io_uring_enter, ring->fd, toSubmit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+                // The other errors (such as EBADF or EFAULT) will not go away, so retrying would spin forever
+                if(result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+                    std::cerr << "io_uring_enter failed: " << std::strerror(errno) << ", the file reads will use the thread pool" << std::endl;
+                    failed = true;
+                }
+            }
+
+            unsigned cqHead = *ring->cqHead;
+            unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+            for(; cqHead != cqTail; ++cqHead){
+                const io_uring_cqe& cqe = ring->cqes[cqHead & *ring->cqMask];
+                std::unique_ptr<Request> request(reinterpret_cast<Request*>(cqe.user_data));
+                inFlightRequests.erase(std::find(inFlightRequests.begin(), inFlightRequests.end(), request.get()));
+                // A short read is resubmitted for the rest of the range (like "pread" in the thread pool), unless the end of the file was reached
+                if(cqe.res > 0 && request->done + size_t(cqe.res) < request->size && !failed){
+                    request->done += size_t(cqe.res);
+                    batch.push_back(std::move(request));
+                    continue;
+                }
+                complete(std::move(request), cqe.res < 0 ? long(cqe.res) : long(request->done + size_t(cqe.res)));
+            }
+            __atomic_store_n(ring->cqHead, cqHead, __ATOMIC_RELEASE);
+
+            if(failed){
+                for(auto& request : batch) inFlightRequests.push_back(request.release());
+                batch.clear();
+                fallBackToThreadPool(inFlightRequests);
+                break;
+            }
+        }
+#endif
+    }
+
+}
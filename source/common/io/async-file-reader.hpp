@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // The async file reader reads parts of files in the background so that streaming does not block the main thread.
+    // Each read is queued with a callback that runs on the job system once the data is ready.
+    // On Linux, the reads are sent to the kernel in batches through io_uring (one system call submits many reads and
+    // waits for their completions) and the small reads land in buffers that are registered with the kernel once.
+    // If io_uring is not available (old kernels, containers that block it or other systems), each read is a "pread"
+    // that runs on the job system.
+    class AsyncFileReader {
+    public:
+        enum class Backend {
+            AUTO,       // io_uring if it is available, otherwise the thread pool
+            IO_URING,
+            THREAD_POOL
+        };
+
+        // Called on a worker thread. If the read failed, "success" is false and "data" is null.
+        // The data is only valid during the call (it is copied by the callback if it is needed later).
+        // The size can be less than the requested size only if the end of the file was reached
+        // (both backends keep reading after a short read till the request is complete).
+        using ReadCallback = std::function<void(bool success, const char* data, size_t size)>;
+
+        // The number of registered buffers and the size of each (the larger reads use a buffer allocated for them)
+        static constexpr size_t BUFFER_COUNT = 64;
+        static constexpr size_t BUFFER_SIZE = 256 << 10;
+        // The number of reads that can be in flight in io_uring at the same time
+        static constexpr unsigned QUEUE_DEPTH = 128;
+
+        struct Stats {
+            uint64_t completedReads = 0;
+            uint64_t failedReads = 0;
+            uint64_t bytesRead = 0;
+        };
+
+        explicit AsyncFileReader(Backend backend = Backend::AUTO);
+        ~AsyncFileReader();
+
+        // Returns the shared instance used by the engine (it is created on first use)
+        static AsyncFileReader& get();
+
+        // Returns the backend that is actually used (never AUTO)
+        Backend getBackend() const { return backend; }
+        static const char* getBackendName(Backend backend);
+
+        // Queues a read of "size" bytes at "offset" from the given file
+        void read(const std::string& path, uint64_t offset, size_t size, ReadCallback callback);
+
+        // Waits till all the queued reads are done and their callbacks returned
+        // The calling thread runs jobs while it waits
+        void wait();
+
+        Stats getStats() const;
+
+        AsyncFileReader(const AsyncFileReader&) = delete;
+        AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    private:
+        struct Request {
+            std::string path;
+            uint64_t offset = 0;
+            size_t size = 0;
+            ReadCallback callback;
+            int buffer = -1;                    // The index of the registered buffer (-1 if the read uses "ownedBuffer")
+            std::unique_ptr<char[]> ownedBuffer;
+            size_t done = 0;                    // The bytes read so far (io_uring can complete a read with fewer bytes than requested)
+        };
+
+        // The backend can change from io_uring to the thread pool if the ring fails while the reader is running
+        std::atomic<Backend> backend;
+
+        std::mutex mutex;                       // Guards the queue, the free buffers and "stopping"
+        std::condition_variable changed;        // Notified when a request is queued, a buffer is freed or a request is done
+        std::deque<std::unique_ptr<Request>> queue;
+        std::vector<int> freeBuffers;
+        size_t pendingCount = 0;                // The reads that were queued and whose callbacks did not return yet
+        bool stopping = false;
+
+        std::atomic<uint64_t> completedReads{0}, failedReads{0}, bytesRead{0};
+
+        std::unique_ptr<char[]> buffers;        // The registered buffers (BUFFER_COUNT * BUFFER_SIZE bytes)
+        // The buffers of the reads that were in flight when the ring failed. The kernel may still write into them,
+        // so they are only freed after the ring is closed (which cancels the reads).
+        std::vector<std::unique_ptr<char[]>> retiredBuffers;
+        std::thread ioThread;                   // Submits the io_uring reads and reaps their completions
+        std::unordered_map<std::string, int> openFiles; // The file descriptors used by the io_uring reads (only used by "ioThread")
+
+        struct Ring;
+        std::unique_ptr<Ring> ring;
+
+        bool setupRing();
+        void ioLoop();
+        // Called by the I/O thread if the ring fails: the queued & in flight reads are moved to the thread pool
+        void fallBackToThreadPool(std::vector<Request*>& inFlightRequests);
+        int openFile(const std::string& path);
+        // Runs the callback of a finished request on the job system then frees its buffer
+        void complete(std::unique_ptr<Request> request, long result);
+        void readWithThreadPool(std::unique_ptr<Request> request);
+        char* getBuffer(const Request& request) const;
+    };
+
+}
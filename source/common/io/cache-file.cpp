@@ -0,0 +1,66 @@
+#include "cache-file.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace our::cache_file {
+
+    void writeAt(std::ostream& stream, uint64_t offset, const void* data, size_t size){
+        const char zeros[16] = {};
+        // The gap is usually the alignment padding, but it can be longer (e.g. a table that is written after the data)
+        for(uint64_t gap = offset - uint64_t(stream.tellp()); gap > 0; gap -= std::min<uint64_t>(gap, 16)){
+            stream.write(zeros, std::streamsize(std::min<uint64_t>(gap, 16)));
+        }
+        if(size > 0) stream.write(static_cast<const char*>(data), std::streamsize(size));
+    }
+
+    std::string getFileName(const std::string& prefix, uint64_t key, const std::string& extension){
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+        return prefix + hex + extension;
+    }
+
+    bool writeAtomically(const std::string& path, const std::function<bool(std::ostream&)>& write){
+        std::error_code error;
+        std::string temporaryPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            if(!file){
+                std::cerr << "Couldn't write file: " << path << std::endl;
+                return false;
+            }
+            if(!write(file) || !file){
+                std::cerr << "Couldn't write file: " << path << std::endl;
+                file.close();
+                fs::remove(temporaryPath, error);
+                return false;
+            }
+        }
+        fs::rename(temporaryPath, path, error);
+        if(error){
+            std::cerr << "Couldn't write file: " << path << " (" << error.message() << ")" << std::endl;
+            fs::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    void removeStale(const std::string& directory, const std::string& prefix, const std::string& extension, const std::string& current){
+        std::error_code error;
+        for(auto& item : fs::directory_iterator(directory, error)){
+            std::string name = item.path().filename().string();
+            // The key is 16 hex digits between the prefix and the extension
+            if(name != current && name.size() == prefix.size() + 16 + extension.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+               name.compare(name.size() - extension.size(), extension.size(), extension) == 0){
+                fs::remove(item.path(), error);
+            }
+        }
+    }
+
+}
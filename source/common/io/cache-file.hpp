@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace our::cache_file {
+
+    // The helpers shared by the binary files that the engine writes for itself (the mesh, texture & shader caches and the asset pack).
+    // Every blob in these files starts at a multiple of 16 bytes, and the files are validated with "isInside" before they are read.
+
+    // Rounds the given offset up to the next multiple of 16 bytes
+    inline uint64_t alignTo16(uint64_t offset){ return (offset + 15) & ~uint64_t(15); }
+
+    // Checks that the blob [offset, offset + size) lies inside a file of the given size
+    inline bool isInside(uint64_t offset, uint64_t size, uint64_t fileSize){
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    // Writes the given data at the given offset of the stream, and fills the gap between the current position and the offset with zeros
+    void writeAt(std::ostream& stream, uint64_t offset, const void* data, size_t size);
+
+    // Returns the name of a cache file: "<prefix><key as 16 hex digits><extension>"
+    std::string getFileName(const std::string& prefix, uint64_t key, const std::string& extension);
+
+    // Calls "write" to fill a temporary file then renames it to the given path, so a crash while writing never leaves a broken file
+    // (the temporary name contains the thread id since the same file can be written by two threads at the same time)
+    // Returns false if the writer returned false or the file could not be written.
+    bool writeAtomically(const std::string& path, const std::function<bool(std::ostream&)>& write);
+
+    // Deletes the files in the directory that are named by "getFileName" with the given prefix & extension (but a different key)
+    // except the current file. This is used to delete the stale cache files of a source after a new one is stored.
+    void removeStale(const std::string& directory, const std::string& prefix, const std::string& extension, const std::string& current);
+
+}
@@ -0,0 +1,112 @@
+#include "lz4.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace our::lz4 {
+
+    namespace {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t LAST_LITERALS = 5;     // The last 5 bytes of a block are always literals
+        constexpr size_t MATCH_FIND_LIMIT = 12; // The last match must start at least 12 bytes before the end of the block
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr int HASH_BITS = 16;
+
+        inline uint32_t read32(const char* data){
+            uint32_t value;
+            std::memcpy(&value, data, 4);
+            return value;
+        }
+
+        // A length that does not fit in the 4 bits of the token continues in bytes of 255 till the last byte (which is less than 255)
+        void writeLength(std::vector<char>& output, size_t length){
+            for(; length >= 255; length -= 255) output.push_back(char(255));
+            output.push_back(char(length));
+        }
+
+        // Writes a sequence (the last sequence has no match, so "matchLength" is 0)
+        void writeSequence(std::vector<char>& output, const char* literals, size_t literalLength, size_t offset, size_t matchLength){
+            size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+            output.push_back(char((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+            if(literalLength >= 15) writeLength(output, literalLength - 15);
+            output.insert(output.end(), literals, literals + literalLength);
+            if(matchLength == 0) return;
+            output.push_back(char(offset & 0xFF));
+            output.push_back(char(offset >> 8));
+            if(matchCode >= 15) writeLength(output, matchCode - 15);
+        }
+
+        // Reads the rest of a length whose 4 bits in the token are all ones. Returns false if the block ends first.
+        bool readLength(const uint8_t*& input, const uint8_t* end, size_t& length){
+            uint8_t byte;
+            do {
+                if(input >= end) return false;
+                byte = *input++;
+                length += byte;
+            } while(byte == 255);
+            return true;
+        }
+    }
+
+    std::vector<char> compress(const char* data, size_t size){
+        std::vector<char> output;
+        output.reserve(size + size / 255 + 16);
+        // The table maps the hash of 4 bytes to the last position where they were seen (plus 1, so 0 means empty)
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        size_t anchor = 0, position = 0;
+        size_t matchStartLimit = size > MATCH_FIND_LIMIT ? size - MATCH_FIND_LIMIT : 0;
+        while(position < matchStartLimit){
+            uint32_t sequence = read32(data + position);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = uint32_t(position + 1);
+            if(candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence){
+                ++position;
+                continue;
+            }
+            // Extend the match as far as possible (but it must end before the last literals)
+            size_t match = candidate - 1, length = MIN_MATCH;
+            while(position + length < size - LAST_LITERALS && data[match + length] == data[position + length]) ++length;
+            writeSequence(output, data + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+        writeSequence(output, data + anchor, size - anchor, 0, 0);
+        return output;
+    }
+
+    bool decompress(const char* block, size_t blockSize, char* output, size_t outputSize){
+        const uint8_t* input = reinterpret_cast<const uint8_t*>(block);
+        const uint8_t* inputEnd = input + blockSize;
+        uint8_t* destination = reinterpret_cast<uint8_t*>(output);
+        uint8_t* destinationStart = destination;
+        uint8_t* destinationEnd = destination + outputSize;
+        while(input < inputEnd){
+            uint8_t token = *input++;
+            size_t literalLength = token >> 4;
+            if(literalLength == 15 && !readLength(input, inputEnd, literalLength)) return false;
+            if(literalLength > size_t(inputEnd - input) || literalLength > size_t(destinationEnd - destination)) return false;
+            std::memcpy(destination, input, literalLength);
+            input += literalLength;
+            destination += literalLength;
+            // The last sequence has no match
+            if(input == inputEnd) break;
+
+            if(inputEnd - input < 2) return false;
+            size_t offset = size_t(input[0]) | (size_t(input[1]) << 8);
+            input += 2;
+            if(offset == 0 || offset > size_t(destination - destinationStart)) return false;
+            size_t matchLength = token & 15;
+            if(matchLength == 15 && !readLength(input, inputEnd, matchLength)) return false;
+            matchLength += MIN_MATCH;
+            if(matchLength > size_t(destinationEnd - destination)) return false;
+            // The match can overlap the bytes it writes (e.g. an offset of 1 repeats a byte), so it is copied byte by byte
+            const uint8_t* match = destination - offset;
+            for(size_t index = 0; index < matchLength; ++index) destination[index] = match[index];
+            destination += matchLength;
+        }
+        return destination == destinationEnd;
+    }
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace our::lz4 {
+
+    // A small implementation of the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+    // Each block is a list of sequences where a sequence copies some literal bytes then repeats a match from the previous 64 KB.
+    // The decompression is only a loop of copies, so it is much faster than reading the uncompressed data from the disk.
+    // The compressor is greedy (it takes the first match it finds in a hash table), which is fast but does not give the best ratio.
+
+    // Compresses the given bytes into an LZ4 block
+    std::vector<char> compress(const char* data, size_t size);
+
+    // Decompresses an LZ4 block into "output" which must have room for exactly "outputSize" bytes
+    // Returns false if the block is corrupted (it never reads or writes outside the given buffers)
+    bool decompress(const char* block, size_t blockSize, char* output, size_t outputSize);
+
+}
@@ -0,0 +1,107 @@
+#include "mapped-file.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace our {
+
+#ifdef _WIN32
+
+    bool MappedFile::open(const std::string& filename){
+        close();
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE){
+            std::cerr << "Couldn't open file: " << filename << std::endl;
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize)){
+            std::cerr << "Couldn't read the size of file: " << filename << std::endl;
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        length = static_cast<size_t>(fileSize.QuadPart);
+        opened = true;
+        // An empty file can not be mapped, so we stop here
+        if(length == 0) return true;
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if(!view){
+            std::cerr << "Couldn't map file: " << filename << std::endl;
+            if(mapping) CloseHandle(mapping);
+            close();
+            return false;
+        }
+        mappingHandle = mapping;
+        contents = static_cast<const char*>(view);
+        return true;
+    }
+
+    void MappedFile::close(){
+        if(contents) UnmapViewOfFile(contents);
+        if(mappingHandle) CloseHandle(mappingHandle);
+        if(fileHandle) CloseHandle(fileHandle);
+        contents = nullptr;
+        mappingHandle = fileHandle = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+#else
+
+    bool MappedFile::open(const std::string& filename){
+        close();
+        int file = ::open(filename.c_str(), O_RDONLY);
+        if(file < 0){
+            std::cerr << "Couldn't open file: " << filename << std::endl;
+            return false;
+        }
+        struct stat status;
+        if(fstat(file, &status) != 0){
+            std::cerr << "Couldn't read the size of file: " << filename << std::endl;
+            ::close(file);
+            return false;
+        }
+        fileDescriptor = file;
+        length = static_cast<size_t>(status.st_size);
+        opened = true;
+        // An empty file can not be mapped, so we stop here
+        if(length == 0) return true;
+
+        void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+        if(view == MAP_FAILED){
+            std::cerr << "Couldn't map file: " << filename << std::endl;
+            close();
+            return false;
+        }
+        // We will read the whole file from start to end, so we ask the kernel to read ahead
+        madvise(view, length, MADV_SEQUENTIAL);
+        contents = static_cast<const char*>(view);
+        return true;
+    }
+
+    void MappedFile::close(){
+        if(contents) munmap(const_cast<char*>(contents), length);
+        if(fileDescriptor >= 0) ::close(fileDescriptor);
+        contents = nullptr;
+        fileDescriptor = -1;
+        length = 0;
+        opened = false;
+    }
+
+#endif
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace our {
+
+    // A read-only view of a whole file that is mapped into the memory by the operating system.
+    // The file pages are loaded on demand when they are first read, so there is no copy into a user buffer
+    // and multiple threads can read different parts of the file at the same time.
+    class MappedFile {
+        const char* contents = nullptr;
+        size_t length = 0;
+        bool opened = false; // An empty file is open but has no contents since it can not be mapped
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#else
+        int fileDescriptor = -1;
+#endif
+    public:
+        MappedFile() = default;
+        // Maps the given file (check "isOpen" to know if it succeeded)
+        explicit MappedFile(const std::string& filename) { open(filename); }
+        ~MappedFile() { close(); }
+
+        // Maps the given file into the memory. Returns false if the file could not be opened or mapped.
+        bool open(const std::string& filename);
+        // Unmaps the file (the data pointer becomes invalid)
+        void close();
+
+        bool isOpen() const { return opened; }
+        const char* data() const { return contents; }
+        size_t size() const { return length; }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+}
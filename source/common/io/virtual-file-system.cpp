@@ -0,0 +1,84 @@
+#include "virtual-file-system.hpp"
+#include "asset-pack.hpp"
+#include "lz4.hpp"
+#include "mapped-file.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace our::vfs {
+
+    namespace {
+        // The files are opened by the loading jobs, so the mounted pack is guarded by a mutex
+        // (each view holds its own reference to the pack, so the pack is only unmapped after its last view is gone)
+        std::mutex mountMutex;
+        std::shared_ptr<AssetPack> mountedPack;
+
+        std::shared_ptr<AssetPack> getPack(){
+            std::lock_guard<std::mutex> lock(mountMutex);
+            return mountedPack;
+        }
+
+        bool isLooseFile(const std::string& path){
+            std::error_code error;
+            return fs::is_regular_file(path, error);
+        }
+    }
+
+    bool mount(const std::string& packPath){
+        auto pack = std::make_shared<AssetPack>();
+        if(!pack->open(packPath)) return false;
+        std::cout << "Mounted asset pack: " << packPath << " (" << pack->getEntryCount() << " files)" << std::endl;
+        std::lock_guard<std::mutex> lock(mountMutex);
+        mountedPack = std::move(pack);
+        return true;
+    }
+
+    void unmount(){
+        std::lock_guard<std::mutex> lock(mountMutex);
+        mountedPack.reset();
+    }
+
+    bool isMounted(){
+        return getPack() != nullptr;
+    }
+
+    FileView open(const std::string& path){
+        // A loose file overrides the pack
+        if(isLooseFile(path)){
+            auto file = std::make_shared<MappedFile>(path);
+            if(!file->isOpen()) return {};
+            const char* data = file->data();
+            size_t size = file->size();
+            return {std::move(file), data, size};
+        }
+
+        auto pack = getPack();
+        const PackEntry* entry = pack ? pack->find(AssetPack::normalizePath(path)) : nullptr;
+        if(!entry){
+            std::cerr << "Couldn't open file: " << path << std::endl;
+            return {};
+        }
+        const char* stored = pack->getData(*entry);
+        if(entry->compression == PackCompression::NONE) return {std::move(pack), stored, size_t(entry->size)};
+
+        auto buffer = std::make_shared<std::vector<char>>(size_t(entry->size));
+        if(!lz4::decompress(stored, size_t(entry->storedSize), buffer->data(), buffer->size())){
+            std::cerr << "Corrupted asset pack entry: " << path << std::endl;
+            return {};
+        }
+        const char* data = buffer->data();
+        return {std::move(buffer), data, size_t(entry->size)};
+    }
+
+    bool exists(const std::string& path){
+        if(isLooseFile(path)) return true;
+        auto pack = getPack();
+        return pack && pack->find(AssetPack::normalizePath(path)) != nullptr;
+    }
+
+}
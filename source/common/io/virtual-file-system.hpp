@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace our {
+
+    // A read-only view of the contents of a file opened through the virtual file system.
+    // The view keeps whatever holds the contents alive (a mapped loose file, the mapped pack or a decompressed buffer),
+    // so it stays valid even if the pack is unmounted while it is in use.
+    class FileView {
+        std::shared_ptr<const void> owner;
+        const char* contents = nullptr;
+        size_t length = 0;
+        bool opened = false;
+    public:
+        FileView() = default;
+        FileView(std::shared_ptr<const void> owner, const char* contents, size_t length):
+            owner(std::move(owner)), contents(contents), length(length), opened(true) {}
+
+        bool isOpen() const { return opened; }
+        const char* data() const { return contents; }
+        size_t size() const { return length; }
+    };
+
+    // The virtual file system lets the loaders read the assets from an asset pack (see "asset-pack.hpp") or from the disk.
+    // A loose file on the disk always overrides the pack entry with the same path, so an asset can be edited without rebuilding the pack.
+    // The uncompressed pack entries are not copied (the view points into the mapped pack).
+    namespace vfs {
+
+        // Mounts the given asset pack (replacing the mounted pack if any). Returns false if the pack could not be opened.
+        bool mount(const std::string& packPath);
+        // Unmounts the pack (the open views stay valid)
+        void unmount();
+        // Returns whether a pack is mounted
+        bool isMounted();
+
+        // Opens a file from the disk or from the mounted pack (check "isOpen" to know if it succeeded)
+        FileView open(const std::string& path);
+        // Returns whether the file exists on the disk or in the mounted pack
+        bool exists(const std::string& path);
+
+    }
+
+}
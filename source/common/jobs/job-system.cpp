@@ -0,0 +1,110 @@
+#include "job-system.hpp"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace our {
+
+    JobSystem::JobSystem(){
+        // We keep one core for the main thread since it participates in "parallelFor" and also does the OpenGL work
+        unsigned int cores = std::thread::hardware_concurrency();
+        size_t workerCount = cores > 1 ? cores - 1 : 1;
+        for(size_t index = 0; index < workerCount; ++index){
+            workers.emplace_back([this](){ workerLoop(); });
+        }
+    }
+
+    JobSystem::~JobSystem(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for(auto& worker : workers) worker.join();
+    }
+
+    JobSystem& JobSystem::get(){
+        static JobSystem instance;
+        return instance;
+    }
+
+    void JobSystem::workerLoop(){
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this](){ return stopping || !jobs.empty(); });
+                if(stopping && jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void JobSystem::submit(std::function<void()> job){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wakeUp.notify_one();
+    }
+
+    bool JobSystem::runPendingJob(){
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(jobs.empty()) return false;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+        return true;
+    }
+
+    void JobSystem::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& body){
+        if(count == 0) return;
+        batchSize = std::max<size_t>(batchSize, 1);
+        size_t batchCount = (count + batchSize - 1) / batchSize;
+        // If there is only one batch, there is no point in waking up the workers
+        if(batchCount == 1){
+            body(0, count);
+            return;
+        }
+
+        // The shared state lives as long as the last helper job that references it.
+        // A helper only calls "body" after it claims a batch, and the caller cannot return before that batch is done,
+        // so "body" is never called after it goes out of scope.
+        struct State {
+            std::atomic<size_t> next{0}, done{0};
+            size_t count, batchSize, batchCount;
+            const std::function<void(size_t, size_t)>* body;
+        };
+        auto state = std::make_shared<State>();
+        state->count = count;
+        state->batchSize = batchSize;
+        state->batchCount = batchCount;
+        state->body = &body;
+
+        auto work = [state](){
+            size_t batch;
+            while((batch = state->next.fetch_add(1)) < state->batchCount){
+                size_t begin = batch * state->batchSize;
+                size_t end = std::min(begin + state->batchSize, state->count);
+                (*state->body)(begin, end);
+                state->done.fetch_add(1, std::memory_order_release);
+            }
+        };
+
+        size_t helpers = std::min(workers.size(), batchCount - 1);
+        for(size_t index = 0; index < helpers; ++index) submit(work);
+        // The calling thread works on the batches too
+        work();
+        // Then it waits for the batches claimed by the workers (running other queued jobs meanwhile)
+        while(state->done.load(std::memory_order_acquire) < batchCount){
+            if(!runPendingJob()) std::this_thread::yield();
+        }
+    }
+
+}
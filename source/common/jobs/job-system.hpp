@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace our {
+
+    // The job system owns a small pool of worker threads that run jobs in the background.
+    // It is a singleton since the machine has a fixed number of cores and every system should share them.
+    // Jobs must not touch OpenGL since the OpenGL context is only current on the main thread.
+    class JobSystem {
+        std::vector<std::thread> workers;               // The worker threads (one less than the number of cores since the main thread works too)
+        std::deque<std::function<void()>> jobs;         // The jobs that are waiting for a free worker
+        std::mutex mutex;                               // Guards "jobs" and "stopping"
+        std::condition_variable wakeUp;                 // Used to wake up a sleeping worker when a job is submitted
+        bool stopping = false;                          // Set on destruction to tell the workers to exit
+
+        JobSystem();
+        ~JobSystem();
+
+        // The function run by each worker thread. It keeps running jobs till the system is stopped.
+        void workerLoop();
+
+    public:
+        // Returns the only instance of the job system (it is created on first use)
+        static JobSystem& get();
+
+        // Returns the number of worker threads (not counting the calling thread)
+        size_t getWorkerCount() const { return workers.size(); }
+
+        // Queues a job to be run by one of the worker threads
+        void submit(std::function<void()> job);
+
+        // Pops a single queued job and runs it on the calling thread
+        // Returns false if there was no job to run
+        // This is useful to keep a waiting thread busy instead of letting it sleep
+        bool runPendingJob();
+
+        // Splits the range [0, count) into batches of (at most) "batchSize" items and calls body(begin, end) for each batch
+        // The batches run on the workers and on the calling thread, and the function returns after all of them are done
+        void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& body);
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+    };
+
+}
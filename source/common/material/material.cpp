@@ -3,6 +3,8 @@
 #include "../asset-loader.hpp"
 #include "deserialize-utils.hpp"
 
+#include <iostream>
+
 namespace our {
 
     // This function should setup the pipeline state and set the shader to be used
@@ -59,63 +61,51 @@ namespace our {
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
     }
 
+    std::vector<std::string> LitMaterial::getFeatures() const {
+        std::vector<std::string> features;
+        if(albedo || albedoRegion) features.push_back("HAS_ALBEDO");
+        if(albedoRegion) features.push_back("ALBEDO_PACKED");
+        if(orm) features.push_back("HAS_ORM");
+        if(emissive) features.push_back("HAS_EMISSIVE");
+        // Only the transparent variant has the outputs of the weighted blended transparency
+        if(transparent) features.push_back("TRANSPARENT");
+        return features;
+    }
+
     void LitMaterial::setup() const {
         TexturedMaterial::setup();
         
+        // The shader variant only has the samplers of the maps that this material has
         if(albedo){
             glActiveTexture(GL_TEXTURE0);
             albedo->bind();
             if(sampler) sampler->bind(0);
             shader->set("material.albedo", 0);
-            //shader->set("material.has_albedo", true);
-        } 
-        // else {
-        //     shader->set("material.has_albedo", false);
-        // }
+        }
 
-        if(specular){
-            glActiveTexture(GL_TEXTURE1);
-            specular->bind();
-            if(sampler) sampler->bind(1);
-            shader->set("material.specular", 1);
-            //shader->set("material.has_specular", true);
-        } 
-        // else {
-        //     shader->set("material.has_specular", false);
-        // }
-
-        if(roughness){
-            glActiveTexture(GL_TEXTURE2);
-            roughness->bind();
-            if(sampler) sampler->bind(2);
-            shader->set("material.roughness", 2);
-            //shader->set("material.has_roughness", true);
-        } 
-        // else {
-        //     shader->set("material.has_roughness", false);
-        // }
-
-        if(ambientOcclusion){
+        // A packed albedo is sampled from its region in the texture array (the batches read the region from the draw data instead)
+        if(albedoRegion){
             glActiveTexture(GL_TEXTURE3);
-            ambientOcclusion->bind();
+            albedoRegion->array->bind();
             if(sampler) sampler->bind(3);
-            shader->set("material.ambient_occlusion", 3);
-            //shader->set("material.has_ambient_occlusion", true);
-        } 
-        // else {
-        //     shader->set("material.has_ambient_occlusion", false);
-        // }
+            shader->set("material.albedo_array", 3);
+            shader->set("albedo_rect", albedoRegion->rect);
+            shader->set("albedo_layer", float(albedoRegion->layer));
+        }
+
+        if(orm){
+            glActiveTexture(GL_TEXTURE1);
+            orm->bind();
+            if(sampler) sampler->bind(1);
+            shader->set("material.orm", 1);
+        }
 
         if(emissive){
-            glActiveTexture(GL_TEXTURE4);
+            glActiveTexture(GL_TEXTURE2);
             emissive->bind();
-            if(sampler) sampler->bind(4);
-            shader->set("material.emissive", 4);
-            //shader->set("material.has_emissive", true);
-        } 
-        // else {
-        //     shader->set("material.has_emissive", false);
-        // }
+            if(sampler) sampler->bind(2);
+            shader->set("material.emissive", 2);
+        }
 
         shader->set("material.diffuse", diffuse);
         shader->set("material.specular_color", specularColor);
@@ -129,9 +119,12 @@ namespace our {
         if(!data.is_object()) return;
 
         albedo = AssetLoader<Texture2D>::get(data.value("albedo", ""));
-        specular = AssetLoader<Texture2D>::get(data.value("specular", ""));
-        roughness = AssetLoader<Texture2D>::get(data.value("roughness", ""));
-        ambientOcclusion = AssetLoader<Texture2D>::get(data.value("ambient_occlusion", ""));
+        if(!albedo) albedoRegion = AssetLoader<TextureRegion>::get(data.value("albedo", ""));
+        orm = AssetLoader<Texture2D>::get(data.value("orm", ""));
+        // The separate maps are only packed into "orm" by "deserializeAllAssets"
+        if(!orm && (data.contains("specular") || data.contains("roughness") || data.contains("ambient_occlusion"))){
+            std::cerr << "The specular, roughness & ambient occlusion maps of a lit material must be packed into an \"orm\" texture" << std::endl;
+        }
         emissive = AssetLoader<Texture2D>::get(data.value("emissive", ""));
         
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
@@ -139,6 +132,28 @@ namespace our {
         diffuse = data.value("diffuse", glm::vec3(1.0f));
         specularColor = data.value("specular_color", glm::vec3(1.0f));
         ambient = data.value("ambient", glm::vec3(1.0f));
+
+        // The variants are shared, so the materials with the same maps still use the same shader (and can be batched together)
+        if(shader) shader = shader->getVariant(getFeatures());
+        depthShader = nullptr;
+    }
+
+    ShaderProgram* LitMaterial::getDepthShader() const {
+        // The variants are cached by the shader, so the materials that share a shader also share its depth variant
+        if(!depthShader && shader) depthShader = shader->getVariant({"DEPTH_ONLY"});
+        return depthShader;
+    }
+
+    bool LitMaterial::canBatchWith(const Material* other) const {
+        if(other == this) return true;
+        auto lit = dynamic_cast<const LitMaterial*>(other);
+        // Everything except the albedo region must be the same (and both albedos must be in the same texture array)
+        if(!lit || !albedoRegion || !lit->albedoRegion || albedoRegion->array != lit->albedoRegion->array) return false;
+        return shader == lit->shader && pipelineState == lit->pipelineState && transparent == lit->transparent &&
+               tint == lit->tint && TexturedMaterial::texture == lit->TexturedMaterial::texture &&
+               TexturedMaterial::sampler == lit->TexturedMaterial::sampler && alphaThreshold == lit->alphaThreshold &&
+               orm == lit->orm && emissive == lit->emissive && sampler == lit->sampler &&
+               diffuse == lit->diffuse && specularColor == lit->specularColor && ambient == lit->ambient;
     }
 
 }
\ No newline at end of file
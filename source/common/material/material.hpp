@@ -2,11 +2,13 @@
 
 #include "pipeline-state.hpp"
 #include "../texture/texture2d.hpp"
+#include "../texture/texture-array.hpp"
 #include "../texture/sampler.hpp"
 #include "../shader/shader.hpp"
 
 #include <glm/vec4.hpp>
 #include <json/json.hpp>
+#include <vector>
 
 namespace our {
 
@@ -26,6 +28,21 @@ namespace our {
         virtual void setup() const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
+
+        // The materials that only differ in the region of a packed texture (see "texture-packer.hpp") can be drawn in the same batch.
+        // In a batch, the setup of the first material is used and the region of each material is sent with the draw data.
+        // This function returns whether this material can be drawn with the setup of the other material.
+        virtual bool canBatchWith(const Material* other) const { return other == this; }
+        // The region of the packed texture that is sent with the draw data (nullptr if the material has no packed texture)
+        virtual const TextureRegion* getBatchRegion() const { return nullptr; }
+        // Adds the textures sampled by this material to "textures" (the renderer requests their mip levels from the "TextureStreamer")
+        virtual void collectTextures(std::vector<Texture2D*>&) const {}
+        // Returns the program that draws this material without shading it (used by the depth pre-pass, see "ForwardRenderer")
+        // It must compute the same positions as "shader", so the material can be drawn again with an equal depth test.
+        // If it returns nullptr, the material is not drawn in the pre-pass (e.g. if its shader has no depth only variant).
+        virtual ShaderProgram* getDepthShader() const { return nullptr; }
+
+        virtual ~Material() = default;
     };
 
     // This material adds a uniform for a tint (a color that will be sent to the shader)
@@ -51,14 +68,20 @@ namespace our {
 
         void setup() const override;
         void deserialize(const nlohmann::json& data) override;
+        void collectTextures(std::vector<Texture2D*>& textures) const override { textures.push_back(texture); }
     };
 
+    // This material adds the textures & colors used by the lighting shader
+    // The ambient occlusion, the roughness and the specular maps are packed into the RGB channels of a single ORM texture
+    // (see "packMaterialMaps" in "asset-loader.cpp"), so the shader samples 3 textures: albedo, orm & emissive
+    // If the albedo texture was packed into a texture array, the material samples its region instead,
+    // so the lit materials that only differ in their albedo can be drawn in the same batch
+    // The shader is the variant of the material shader that only samples the maps that the material has (see "getFeatures")
     class LitMaterial : public TexturedMaterial {
     public:
         Texture2D* albedo = nullptr;
-        Texture2D* specular = nullptr;
-        Texture2D* roughness = nullptr;
-        Texture2D* ambientOcclusion = nullptr;
+        TextureRegion* albedoRegion = nullptr;
+        Texture2D* orm = nullptr;
         Texture2D* emissive = nullptr;
         
         Sampler* sampler = nullptr;
@@ -67,8 +90,18 @@ namespace our {
         glm::vec3 specularColor = glm::vec3(1.0f);
         glm::vec3 ambient = glm::vec3(1.0f);
 
+        // Returns the defines of the shader variant that covers the maps of this material (e.g. "HAS_ALBEDO" if it has an albedo)
+        std::vector<std::string> getFeatures() const;
+
         void setup() const override;
         void deserialize(const nlohmann::json& data) override;
+        bool canBatchWith(const Material* other) const override;
+        const TextureRegion* getBatchRegion() const override { return albedoRegion; }
+        void collectTextures(std::vector<Texture2D*>& textures) const override { textures.insert(textures.end(), {albedo, orm, emissive}); }
+        // The "DEPTH_ONLY" variant of the shader (it is only compiled when the pre-pass first needs it)
+        ShaderProgram* getDepthShader() const override;
+    private:
+        mutable ShaderProgram* depthShader = nullptr;
     };
 
     // This function returns a new material instance based on the given type
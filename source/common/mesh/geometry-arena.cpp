@@ -0,0 +1,161 @@
+#include "geometry-arena.hpp"
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace our {
+
+    size_t GeometryArena::RangeAllocator::allocate(size_t size, size_t alignment){
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it){
+            auto [start, length] = *it;
+            size_t aligned = (start + alignment - 1) / alignment * alignment;
+            size_t padding = aligned - start;
+            if(length < padding + size) continue;
+            freeRanges.erase(it);
+            // Return the unused parts before and after the allocated range to the free list
+            if(padding > 0) freeRanges[start] = padding;
+            if(length > padding + size) freeRanges[aligned + size] = length - padding - size;
+            return aligned;
+        }
+        return SIZE_MAX;
+    }
+
+    void GeometryArena::RangeAllocator::free(size_t start, size_t size){
+        if(size == 0) return;
+        auto it = freeRanges.emplace(start, size).first;
+        // Merge with the next range if they touch
+        if(auto next = std::next(it); next != freeRanges.end() && it->first + it->second == next->first){
+            it->second += next->second;
+            freeRanges.erase(next);
+        }
+        // Merge with the previous range if they touch
+        if(it != freeRanges.begin()){
+            auto previous = std::prev(it);
+            if(previous->first + previous->second == it->first){
+                previous->second += it->second;
+                freeRanges.erase(it);
+            }
+        }
+    }
+
+    GeometryArena& GeometryArena::get(){
+        static GeometryArena instance;
+        return instance;
+    }
+
+    uint32_t GeometryArena::createPage(VertexFormat format, size_t vertexCapacity, size_t elementCapacity){
+        // Reuse the slot of a deleted page if there is one, so that the page indices of the other meshes stay valid
+        uint32_t index = (uint32_t)pages.size();
+        for(uint32_t slot = 0; slot < pages.size(); ++slot){
+            if(pages[slot].VAO == 0){ index = slot; break; }
+        }
+        if(index == pages.size()) pages.emplace_back();
+        Page& page = pages[index];
+        page.format = format;
+        page.vertices = RangeAllocator(vertexCapacity);
+        page.elements = RangeAllocator(elementCapacity);
+        page.allocationCount = 0;
+
+        // The draw id buffer is shared by all the pages and it always contains 0, 1, 2, ..., MAX_DRAW_IDS-1
+        if(drawIdBuffer == 0){
+            std::vector<GLuint> drawIds(MAX_DRAW_IDS);
+            std::iota(drawIds.begin(), drawIds.end(), 0u);
+            glGenBuffers(1, &drawIdBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+            glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+        }
+
+        glGenVertexArrays(1, &page.VAO);
+        glGenBuffers(1, &page.VBO);
+        glGenBuffers(1, &page.EBO);
+        bindVertexArray(page.VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertexCapacity * getVertexSize(format)), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(elementCapacity), nullptr, GL_STATIC_DRAW);
+
+        setupVertexAttributes(format);
+
+        // The draw id advances once per instance, so with an instance count of 1 it equals the base instance of the draw
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glEnableVertexAttribArray(ATTRIB_LOC_DRAW_ID);
+        glVertexAttribIPointer(ATTRIB_LOC_DRAW_ID, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+        glVertexAttribDivisor(ATTRIB_LOC_DRAW_ID, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return index;
+    }
+
+    GeometryAllocation GeometryArena::allocate(VertexFormat format, const void* vertexData, GLsizei vertexCount,
+                                               const void* elementData, size_t elementSize, size_t elementAlignment){
+        GeometryAllocation allocation;
+        size_t vertexStart = SIZE_MAX, elementStart = SIZE_MAX;
+        // Look for a page of the same format that has room for both the vertices and the elements
+        for(uint32_t index = 0; index < pages.size(); ++index){
+            Page& page = pages[index];
+            if(page.VAO == 0 || page.format != format) continue;
+            vertexStart = page.vertices.allocate(vertexCount, 1);
+            if(vertexStart == SIZE_MAX) continue;
+            elementStart = page.elements.allocate(elementSize, elementAlignment);
+            if(elementStart == SIZE_MAX){
+                page.vertices.free(vertexStart, vertexCount);
+                continue;
+            }
+            allocation.page = index;
+            break;
+        }
+        // If no page has enough room, we create a new one
+        if(!allocation.isValid()){
+            uint32_t index = createPage(format, std::max<size_t>(DEFAULT_PAGE_VERTICES, vertexCount),
+                                        std::max<size_t>(DEFAULT_PAGE_ELEMENT_BYTES, elementSize));
+            vertexStart = pages[index].vertices.allocate(vertexCount, 1);
+            elementStart = pages[index].elements.allocate(elementSize, elementAlignment);
+            allocation.page = index;
+        }
+
+        Page& page = pages[allocation.page];
+        ++page.allocationCount;
+        allocation.baseVertex = static_cast<GLint>(vertexStart);
+        allocation.vertexCount = vertexCount;
+        allocation.elementOffset = elementStart;
+        allocation.elementSize = elementSize;
+
+        // Upload the data into the ranges. We use the copy target for the elements since
+        // the element array binding is a part of the vertex array state.
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.VBO);
+        const size_t vertexSize = getVertexSize(format);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(vertexStart * vertexSize),
+                        static_cast<GLsizeiptr>(vertexCount * vertexSize), vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(elementStart), static_cast<GLsizeiptr>(elementSize), elementData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    void GeometryArena::free(GeometryAllocation& allocation){
+        if(!allocation.isValid()) return;
+        Page& page = pages[allocation.page];
+        page.vertices.free(allocation.baseVertex, allocation.vertexCount);
+        page.elements.free(allocation.elementOffset, allocation.elementSize);
+        allocation.page = UINT32_MAX;
+
+        // Delete the page once it is empty to free its memory
+        if(--page.allocationCount > 0) return;
+        unbindVertexArray(page.VAO);
+        glDeleteVertexArrays(1, &page.VAO);
+        glDeleteBuffers(1, &page.VBO);
+        glDeleteBuffers(1, &page.EBO);
+        page = Page();
+
+        // If no pages are left, delete the draw id buffer too (this happens when all the assets are cleared)
+        bool empty = std::all_of(pages.begin(), pages.end(), [](const Page& page){ return page.VAO == 0; });
+        if(empty && drawIdBuffer){
+            glDeleteBuffers(1, &drawIdBuffer);
+            drawIdBuffer = 0;
+            pages.clear();
+        }
+    }
+
+}
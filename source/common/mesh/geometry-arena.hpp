@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "vertex-format.hpp"
+
+namespace our {
+
+    // A range of vertices and elements that the geometry arena gave to a mesh
+    struct GeometryAllocation {
+        uint32_t page = UINT32_MAX;     // The index of the arena page that holds the data
+        GLint baseVertex = 0;           // The index of the first vertex in the page vertex buffer
+        GLsizei vertexCount = 0;        // The number of vertices in the range
+        size_t elementOffset = 0;       // The offset (in bytes) of the first element in the page element buffer
+        size_t elementSize = 0;         // The size (in bytes) of the elements in the range
+
+        bool isValid() const { return page != UINT32_MAX; }
+    };
+
+    // The geometry arena stores the vertices and elements of all the meshes in a few large vertex & element buffers (pages).
+    // Each mesh receives a range inside a page when it is loaded and gives it back when it is deleted.
+    // Each page holds the vertices of a single vertex format, so each page needs a single vertex array object
+    // and drawing many meshes from the same page does not switch vertex arrays. The meshes are drawn with "glDrawElementsBaseVertex"
+    // since the element values are relative to the first vertex of the mesh range.
+    class GeometryArena {
+    public:
+        // Since instanced attributes are offset by the base instance of a draw, this attribute is used by the multi-draw-indirect path
+        // to know the index of the current draw (it reads from a buffer containing 0, 1, 2, ...)
+        static constexpr GLuint ATTRIB_LOC_DRAW_ID = 4;
+        // The maximum number of draws in a single multi-draw-indirect call (the size of the draw id buffer)
+        static constexpr GLsizei MAX_DRAW_IDS = 1 << 16;
+
+    private:
+        // A first-fit allocator of ranges inside a buffer. It only does the bookkeeping, the data lives in OpenGL buffers.
+        class RangeAllocator {
+            std::map<size_t, size_t> freeRanges; // Maps the start of each free range to its size (neighbouring ranges are always merged)
+        public:
+            explicit RangeAllocator(size_t capacity = 0) { if(capacity) freeRanges[0] = capacity; }
+            // Returns the start of a free range with the given size and alignment or SIZE_MAX if no range is big enough
+            size_t allocate(size_t size, size_t alignment);
+            // Returns the given range to the free ranges
+            void free(size_t start, size_t size);
+        };
+
+        struct Page {
+            GLuint VAO = 0, VBO = 0, EBO = 0;
+            VertexFormat format = VertexFormat::STANDARD;
+            RangeAllocator vertices;        // Measured in vertices
+            RangeAllocator elements;        // Measured in bytes
+            size_t allocationCount = 0;     // When it reaches 0, the page is deleted to free the VRAM
+        };
+
+        std::vector<Page> pages;
+        GLuint drawIdBuffer = 0;
+
+        // The vertex array object that is currently bound, so that we skip binding it again
+        static inline GLuint boundVertexArray = 0;
+
+        GeometryArena() = default;
+
+        // Creates a page that can hold at least the given number of vertices (in the given format) and element bytes
+        uint32_t createPage(VertexFormat format, size_t vertexCapacity, size_t elementCapacity);
+
+    public:
+        // The default size of a page. A mesh bigger than that gets a page of its own.
+        static constexpr size_t DEFAULT_PAGE_VERTICES = 1 << 18;
+        static constexpr size_t DEFAULT_PAGE_ELEMENT_BYTES = 1 << 22;
+
+        // Returns the only instance of the arena
+        static GeometryArena& get();
+
+        // Finds a range for the given vertices & elements in a page of the given format, uploads them and returns the range
+        // The vertices must be already in the given format and the element size must be a multiple of the element alignment
+        GeometryAllocation allocate(VertexFormat format, const void* vertexData, GLsizei vertexCount,
+                                    const void* elementData, size_t elementSize, size_t elementAlignment);
+        // Gives the range back to the arena. If it was the last range in its page, the page is deleted.
+        void free(GeometryAllocation& allocation);
+
+        // Binds the vertex array of the given page
+        void bind(uint32_t page) { bindVertexArray(pages[page].VAO); }
+        // Returns the vertex format of the given page
+        VertexFormat getFormat(uint32_t page) const { return pages[page].format; }
+
+        // Binds the given vertex array unless it is already bound.
+        // Any code that binds a vertex array object should use this function so that the bound vertex array is tracked correctly.
+        static void bindVertexArray(GLuint vertexArray){
+            if(boundVertexArray == vertexArray) return;
+            glBindVertexArray(vertexArray);
+            boundVertexArray = vertexArray;
+        }
+
+        // Unbinds the given vertex array if it is bound (this should be called before deleting a vertex array)
+        static void unbindVertexArray(GLuint vertexArray){
+            if(boundVertexArray == vertexArray) bindVertexArray(0);
+        }
+
+        // Returns whether the OpenGL context supports the multi-draw-indirect path (OpenGL 4.3 or the equivalent extensions)
+        static bool supportsMultiDrawIndirect(){
+            return GLAD_GL_VERSION_4_3 || (GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance);
+        }
+
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena& operator=(const GeometryArena&) = delete;
+    };
+
+}
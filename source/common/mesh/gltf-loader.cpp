@@ -0,0 +1,282 @@
+#include "gltf-loader.hpp"
+#include "mesh-utils.hpp"
+#include "../io/virtual-file-system.hpp"
+#include "../hash-utils.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+
+// We will use "Tiny glTF" to read ".gltf" and ".glb" files
+// It uses the same json library as the rest of the engine, and we do not need it to read the images
+// since the textures are loaded separately by the asset loader.
+#include <json/json.hpp>
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_INCLUDE_JSON
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include <tinygltf/tiny_gltf.h>
+
+namespace our::gltf_loader {
+
+    // Since the images are not needed, this image loader ignores them (Tiny glTF fails if no image loader is specified)
+    static bool ignoreImage(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*){
+        return true;
+    }
+
+    // The buffers referenced by a ".gltf" file are read through the virtual file system (so they can come from the asset pack)
+    static bool fileExists(const std::string& path, void*){
+        return vfs::exists(path);
+    }
+
+    static std::string expandFilePath(const std::string& path, void*){
+        return path;
+    }
+
+    static bool readWholeFile(std::vector<unsigned char>* out, std::string* error, const std::string& path, void*){
+        FileView file = vfs::open(path);
+        if(!file.isOpen()){
+            if(error) *error += "Couldn't open file: " + path + "\n";
+            return false;
+        }
+        out->assign(file.data(), file.data() + file.size());
+        return true;
+    }
+
+    // Reads the components of an accessor element as floats (the normalized integers are mapped to [0, 1] or [-1, 1])
+    // Missing components are left as they are in "out", so the caller can set their defaults first
+    static void readFloats(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t index, float* out, int maxComponents){
+        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+        const unsigned char* element = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset + index * accessor.ByteStride(view);
+        int components = std::min(tinygltf::GetNumComponentsInType(accessor.type), maxComponents);
+        for(int component = 0; component < components; ++component){
+            switch(accessor.componentType){
+                case TINYGLTF_COMPONENT_TYPE_FLOAT: std::memcpy(&out[component], element + 4 * component, 4); break;
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                    uint16_t value; std::memcpy(&value, element + 2 * component, 2);
+                    out[component] = accessor.normalized ? value / 65535.0f : float(value);
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_SHORT: {
+                    int16_t value; std::memcpy(&value, element + 2 * component, 2);
+                    out[component] = accessor.normalized ? std::max(value / 32767.0f, -1.0f) : float(value);
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+                    uint8_t value = element[component];
+                    out[component] = accessor.normalized ? value / 255.0f : float(value);
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_BYTE: {
+                    int8_t value = int8_t(element[component]);
+                    out[component] = accessor.normalized ? std::max(value / 127.0f, -1.0f) : float(value);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Reads an element (vertex index) from an indices accessor
+    static uint32_t readIndex(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t index){
+        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+        const unsigned char* element = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset + index * accessor.ByteStride(view);
+        switch(accessor.componentType){
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return *element;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t value; std::memcpy(&value, element, 2); return value; }
+            default: { uint32_t value; std::memcpy(&value, element, 4); return value; }
+        }
+    }
+
+    bool read(const std::string& filename, const std::string& meshName, GltfMeshData& data){
+        tinygltf::TinyGLTF loader;
+        loader.SetImageLoader(ignoreImage, nullptr);
+        tinygltf::Model model;
+        std::string error, warning;
+        loader.SetFsCallbacks({fileExists, expandFilePath, readWholeFile, tinygltf::WriteWholeFile, nullptr});
+        FileView file = vfs::open(filename);
+        if(!file.isOpen()) return false;
+        bool binary = std::filesystem::path(filename).extension() == ".glb";
+        std::string baseDirectory = std::filesystem::path(filename).parent_path().generic_string();
+        const auto* bytes = reinterpret_cast<const unsigned char*>(file.data());
+        bool loaded = binary ? loader.LoadBinaryFromMemory(&model, &error, &warning, bytes, unsigned(file.size()), baseDirectory)
+                             : loader.LoadASCIIFromString(&model, &error, &warning, file.data(), unsigned(file.size()), baseDirectory);
+        if(!warning.empty()) std::cout << "WARN while loading gltf file \"" << filename << "\": " << warning << std::endl;
+        if(!loaded){
+            std::cerr << "Failed to load gltf file \"" << filename << "\" due to error: " << error << std::endl;
+            return false;
+        }
+
+        // Find the requested mesh by its name or its index
+        int meshIndex = meshName.empty() ? 0 : -1;
+        for(size_t index = 0; index < model.meshes.size() && meshIndex < 0; ++index){
+            if(model.meshes[index].name == meshName || std::to_string(index) == meshName) meshIndex = int(index);
+        }
+        if(meshIndex < 0 || meshIndex >= int(model.meshes.size())){
+            std::cerr << "The gltf file \"" << filename << "\" does not contain the mesh \"" << meshName << "\"" << std::endl;
+            return false;
+        }
+        const tinygltf::Mesh& gltfMesh = model.meshes[meshIndex];
+
+        // Check that we can read every primitive
+        // (the accessors must also fit in their buffer views since we read them without any further checks)
+        auto isUsable = [&](int accessorIndex){
+            if(accessorIndex < 0 || accessorIndex >= int(model.accessors.size())) return false;
+            const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+            // Sparse accessors and accessors without a buffer view are not supported
+            if(accessor.sparse.isSparse || accessor.bufferView < 0 || accessor.bufferView >= int(model.bufferViews.size())) return false;
+            if(accessor.count == 0) return true;
+            const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+            int stride = accessor.ByteStride(view);
+            if(stride <= 0 || view.buffer < 0 || view.buffer >= int(model.buffers.size())) return false;
+            size_t end = accessor.byteOffset + (accessor.count - 1) * size_t(stride) +
+                         tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
+            return end <= view.byteLength && view.byteOffset + view.byteLength <= model.buffers[view.buffer].data.size();
+        };
+        static const char* attributeNames[] = {"POSITION", "COLOR_0", "TEXCOORD_0", "NORMAL"};
+        for(const auto& primitive : gltfMesh.primitives){
+            // The glTF modes have the same values as the OpenGL modes
+            GLenum mode = primitive.mode < 0 ? GL_TRIANGLES : GLenum(primitive.mode);
+            bool usable = primitive.extensions.count("KHR_draco_mesh_compression") == 0 && primitive.attributes.count("POSITION") != 0 &&
+                          (mode == GL_TRIANGLES || mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN);
+            for(const char* name : attributeNames){
+                auto it = primitive.attributes.find(name);
+                if(it != primitive.attributes.end()) usable = usable && isUsable(it->second);
+            }
+            if(primitive.indices >= 0) usable = usable && isUsable(primitive.indices);
+            if(!usable){
+                std::cerr << "The gltf file \"" << filename << "\" contains a primitive that is not supported "
+                          << "(sparse, draco compressed, without positions or not made of triangles)" << std::endl;
+                return false;
+            }
+        }
+
+        data.vertices.clear();
+        data.elements.clear();
+        data.ranges.clear();
+        for(const auto& primitive : gltfMesh.primitives){
+            GLenum mode = primitive.mode < 0 ? GL_TRIANGLES : GLenum(primitive.mode);
+            auto findAccessor = [&](const char* name) -> const tinygltf::Accessor* {
+                auto it = primitive.attributes.find(name);
+                return it == primitive.attributes.end() ? nullptr : &model.accessors[it->second];
+            };
+            const tinygltf::Accessor& positions = *findAccessor("POSITION");
+            const tinygltf::Accessor* colors = findAccessor("COLOR_0");
+            const tinygltf::Accessor* texCoords = findAccessor("TEXCOORD_0");
+            const tinygltf::Accessor* normals = findAccessor("NORMAL");
+
+            // Decode the vertices of the primitive (the missing attributes are set to their defaults: white color, zero texture coordinates and normal)
+            uint32_t firstVertex = uint32_t(data.vertices.size());
+            for(size_t index = 0; index < positions.count; ++index){
+                Vertex vertex;
+                readFloats(model, positions, index, &vertex.position.x, 3);
+                glm::vec4 color(1.0f);
+                if(colors && index < colors->count) readFloats(model, *colors, index, &color.x, 4);
+                vertex.color = Color(glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f));
+                vertex.tex_coord = glm::vec2(0.0f);
+                if(texCoords && index < texCoords->count) readFloats(model, *texCoords, index, &vertex.tex_coord.x, 2);
+                // The texture coordinates are flipped since our images are flipped vertically when they are loaded (see "texture-utils.cpp")
+                vertex.tex_coord.y = 1.0f - vertex.tex_coord.y;
+                vertex.normal = glm::vec3(0.0f);
+                if(normals && index < normals->count) readFloats(model, *normals, index, &vertex.normal.x, 3);
+                data.vertices.push_back(vertex);
+            }
+
+            // Read the elements (or number the vertices in order if the primitive has no elements)
+            std::vector<uint32_t> indices;
+            if(primitive.indices >= 0){
+                const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
+                indices.reserve(accessor.count);
+                for(size_t index = 0; index < accessor.count; ++index) indices.push_back(readIndex(model, accessor, index));
+            } else {
+                indices.resize(positions.count);
+                for(size_t index = 0; index < indices.size(); ++index) indices[index] = uint32_t(index);
+            }
+
+            // Strips and fans are turned into separate triangles so that every submesh can be drawn (and batched) as GL_TRIANGLES
+            // The winding of every second triangle in a strip is swapped to keep all the triangles facing the same side
+            uint32_t firstElement = uint32_t(data.elements.size());
+            auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c){
+                for(uint32_t index : {a, b, c}){
+                    if(index >= positions.count) return; // Skip the triangles that reference missing vertices
+                }
+                for(uint32_t index : {a, b, c}) data.elements.push_back(firstVertex + index);
+            };
+            if(mode == GL_TRIANGLE_STRIP){
+                for(size_t index = 2; index < indices.size(); ++index){
+                    if(index % 2 == 0) addTriangle(indices[index - 2], indices[index - 1], indices[index]);
+                    else addTriangle(indices[index - 1], indices[index - 2], indices[index]);
+                }
+            } else if(mode == GL_TRIANGLE_FAN){
+                for(size_t index = 2; index < indices.size(); ++index) addTriangle(indices[0], indices[index - 1], indices[index]);
+            } else {
+                for(size_t index = 2; index < indices.size(); index += 3) addTriangle(indices[index - 2], indices[index - 1], indices[index]);
+            }
+            data.ranges.push_back({firstElement, uint32_t(data.elements.size()) - firstElement});
+        }
+
+        data.boundsMin = data.boundsMax = data.vertices.empty() ? glm::vec3(0.0f) : data.vertices[0].position;
+        for(const auto& vertex : data.vertices){
+            data.boundsMin = glm::min(data.boundsMin, vertex.position);
+            data.boundsMax = glm::max(data.boundsMax, vertex.position);
+        }
+        return true;
+    }
+
+    // The cache key of a glTF mesh also depends on the selected mesh and the external buffers of a ".gltf" file
+    // (the buffers are read by tinygltf, so they are hashed here since editing only a ".bin" file must rebuild the cache)
+    // Returns 0 if a file could not be read
+    static uint64_t computeKey(const std::string& filename, const std::string& meshName, VertexFormat format){
+        uint64_t key = mesh_cache::computeKey(filename, format);
+        if(key == 0) return 0;
+        key = hash_utils::hash(meshName.data(), meshName.size(), key);
+        if(std::filesystem::path(filename).extension() != ".gltf") return key;
+
+        FileView file = vfs::open(filename);
+        if(!file.isOpen()) return 0;
+        nlohmann::json json = nlohmann::json::parse(file.data(), file.data() + file.size(), nullptr, false);
+        if(json.is_discarded() || !json.contains("buffers") || !json["buffers"].is_array()) return key;
+        std::filesystem::path baseDirectory = std::filesystem::path(filename).parent_path();
+        for(const auto& buffer : json["buffers"]){
+            std::string uri = buffer.is_object() ? buffer.value("uri", "") : "";
+            // The embedded buffers are already part of the file hash
+            if(uri.empty() || uri.rfind("data:", 0) == 0) continue;
+            FileView bufferFile = vfs::open((baseDirectory / uri).generic_string());
+            if(!bufferFile.isOpen()) return 0;
+            key = hash_utils::hash(bufferFile.data(), bufferFile.size(), key);
+        }
+        return key;
+    }
+
+    bool prepare(const std::string& filename, const std::string& meshName, mesh_cache::CacheEntry& entry, VertexFormat format, bool useCache){
+        // The cache files are named after the file & the mesh, so the meshes of the same file do not delete each other's cache files
+        std::string cacheName = meshName.empty() ? filename : filename + "#" + meshName;
+        uint64_t cacheKey = useCache ? computeKey(filename, meshName, format) : 0;
+        if(cacheKey != 0 && mesh_cache::read(cacheName, format, cacheKey, entry)) return true;
+
+        GltfMeshData data;
+        if(!read(filename, meshName, data)) return false;
+
+        // Pack the data like an obj mesh. The triangles are not reordered since each primitive must stay in its own range.
+        entry.format = format == VertexFormat::STANDARD ? format : selectPackedFormat(data.vertices);
+        entry.vertexData = packVertices(data.vertices, entry.format, entry.dequantization);
+        entry.vertexCount = static_cast<GLsizei>(data.vertices.size());
+        entry.elementData = packElements(data.elements, data.vertices.size(), entry.elementType);
+        entry.elementCount = static_cast<GLsizei>(data.elements.size());
+        entry.boundsMin = data.boundsMin;
+        entry.boundsMax = data.boundsMax;
+        entry.lods = {{0, uint32_t(data.elements.size()), 0.0f}};
+        entry.submeshes.clear();
+        for(const auto& range : data.ranges) entry.submeshes.push_back({range.x, range.y});
+        if(cacheKey != 0) mesh_cache::store(cacheName, format, cacheKey, entry);
+        return true;
+    }
+
+    Mesh* load(const std::string& filename, const std::string& meshName, VertexFormat format, bool useCache){
+        mesh_cache::CacheEntry entry;
+        if(!prepare(filename, meshName, entry, format, useCache)) return nullptr;
+        return mesh_utils::createMesh(entry);
+    }
+
+}
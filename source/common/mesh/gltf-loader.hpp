@@ -0,0 +1,40 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "mesh-cache.hpp"
+#include <string>
+#include <vector>
+
+namespace our::gltf_loader {
+
+    // The data of a glTF mesh after it is read from the file (before any OpenGL object is created)
+    struct GltfMeshData {
+        // The vertices and the elements of all the primitives (the elements of each primitive are offset by the index of its first vertex)
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> elements;
+        // The elements of each primitive as (first element, element count)
+        std::vector<glm::uvec2> ranges;
+        glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f); // The bounds of the positions
+    };
+
+    // Reads a mesh from a glTF file into the given data. This does not use OpenGL, so it can run on a worker thread.
+    // Returns false if the file could not be read or the mesh is not supported.
+    bool read(const std::string& filename, const std::string& meshName, GltfMeshData& data);
+
+    // Reads a mesh from a glTF file (or its cache file) into the data that is uploaded to the GPU (one submesh per primitive)
+    // The format defines the layout of the vertices on the VRAM (see "VertexFormat")
+    // If "useCache" is true, the packed mesh is read from (or written to) the binary mesh cache (see "mesh-cache.hpp"),
+    // so the accessors are only decoded on the first launch (or after the file or its buffers change).
+    // This does not use OpenGL, so it can run on a worker thread (the mesh is then created by "mesh_utils::createMesh")
+    bool prepare(const std::string& filename, const std::string& meshName, mesh_cache::CacheEntry& entry,
+                 VertexFormat format = VertexFormat::STANDARD, bool useCache = true);
+
+    // Loads a mesh from a glTF 2.0 file (either ".gltf" with its buffers or a binary ".glb").
+    // Each primitive of the mesh becomes a submesh, so each primitive can be drawn with its own material.
+    // The accessors are decoded into our vertices and every primitive is triangulated, so all the primitives are stored
+    // in a single range of the geometry arena (like the obj meshes) and the mesh can be batched with the rest of the scene.
+    // Points and lines are not supported.
+    // "meshName" selects the mesh in the file by its name or its index (the first mesh is used if it is empty).
+    // The node hierarchy (and its transformations) is ignored since each entity in the scene defines its own transformation.
+    Mesh* load(const std::string& filename, const std::string& meshName = "", VertexFormat format = VertexFormat::STANDARD, bool useCache = true);
+}
@@ -0,0 +1,164 @@
+#include "mesh-cache.hpp"
+#include "../io/mapped-file.hpp"
+#include "../io/virtual-file-system.hpp"
+#include "../io/cache-file.hpp"
+#include "../hash-utils.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace our::mesh_cache {
+
+    namespace {
+        const char MAGIC[4] = {'O', 'M', 'S', 'H'};
+        const char* CACHE_DIRECTORY = "cache/meshes";
+    }
+
+    using cache_file::alignTo16;
+    using cache_file::isInside;
+
+    uint64_t computeKey(const std::string& sourcePath, VertexFormat format){
+        FileView source = vfs::open(sourcePath);
+        if(!source.isOpen()) return 0;
+        uint64_t key = hash_utils::hash(source.data(), source.size());
+        key = hash_utils::combine(key, LOADER_VERSION);
+        key = hash_utils::combine(key, static_cast<uint64_t>(format));
+        return key;
+    }
+
+    // The cache file name is "<source name>-<source path hash>-<requested format>-<key>.mesh"
+    // This function returns the part before the key (which is shared by all the cache files of the same source & format)
+    // The format is part of the prefix so that the files of the same source loaded in two formats do not delete each other
+    static std::string getCachePrefix(const std::string& sourcePath, VertexFormat format){
+        char hex[9];
+        uint64_t pathHash = hash_utils::hash(sourcePath.data(), sourcePath.size());
+        std::snprintf(hex, sizeof(hex), "%08llx", static_cast<unsigned long long>(pathHash & 0xffffffffULL));
+        return fs::path(sourcePath).stem().string() + "-" + hex + "-" + std::to_string(static_cast<uint32_t>(format)) + "-";
+    }
+
+    std::string getCachePath(const std::string& sourcePath, VertexFormat format, uint64_t key){
+        return (fs::path(CACHE_DIRECTORY) / cache_file::getFileName(getCachePrefix(sourcePath, format), key, ".mesh")).string();
+    }
+
+    // Opens the cache file of the given source file and key and checks that it is valid
+    // Returns false if there is no valid cache file for this key
+    static bool open(const std::string& sourcePath, VertexFormat format, uint64_t key, MappedFile& file, CacheHeader& header){
+        std::string cachePath = getCachePath(sourcePath, format, key);
+        std::error_code error;
+        if(!fs::exists(cachePath, error)) return false;
+
+        if(!file.open(cachePath) || file.size() < sizeof(CacheHeader)) return false;
+        std::memcpy(&header, file.data(), sizeof(CacheHeader));
+
+        // Make sure that the file was written by this version for the same source and that all the blobs are inside the file
+        bool valid = std::memcmp(header.magic, MAGIC, 4) == 0 && header.fileVersion == FILE_VERSION && header.key == key &&
+                     header.vertexFormat <= static_cast<uint32_t>(VertexFormat::PACKED_COLORED) &&
+                     (header.elementType == GL_UNSIGNED_SHORT || header.elementType == GL_UNSIGNED_INT) &&
+                     header.vertexSize == uint64_t(header.vertexCount) * getVertexSize(VertexFormat(header.vertexFormat)) &&
+                     header.elementSize == uint64_t(header.elementCount) * (header.elementType == GL_UNSIGNED_SHORT ? 2 : 4) &&
+                     isInside(header.vertexOffset, header.vertexSize, file.size()) &&
+                     isInside(header.elementOffset, header.elementSize, file.size()) &&
+                     isInside(header.lodOffset, uint64_t(header.lodCount) * sizeof(CacheLod), file.size()) &&
+                     isInside(header.submeshOffset, uint64_t(header.submeshCount) * sizeof(CacheSubmesh), file.size());
+        if(!valid){
+            std::cerr << "Ignoring invalid mesh cache file: " << cachePath << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the submesh table of an opened cache file as (first element, element count) ranges
+    static std::vector<glm::uvec2> readSubmeshRanges(const MappedFile& file, const CacheHeader& header){
+        std::vector<glm::uvec2> ranges(header.submeshCount);
+        for(uint32_t index = 0; index < header.submeshCount; ++index){
+            CacheSubmesh submesh;
+            std::memcpy(&submesh, file.data() + header.submeshOffset + index * sizeof(CacheSubmesh), sizeof(CacheSubmesh));
+            ranges[index] = {submesh.firstElement, submesh.elementCount};
+        }
+        return ranges;
+    }
+
+    Mesh* load(const std::string& sourcePath, VertexFormat format, uint64_t key){
+        MappedFile file;
+        CacheHeader header;
+        if(!open(sourcePath, format, key, file, header)) return nullptr;
+
+        // The blobs are uploaded directly from the mapped file
+        Mesh* mesh = new Mesh(VertexFormat(header.vertexFormat), file.data() + header.vertexOffset, GLsizei(header.vertexCount),
+                              GLenum(header.elementType), file.data() + header.elementOffset, GLsizei(header.elementCount),
+                              glm::make_mat4(header.dequantization));
+        // Then the elements are split into the stored submeshes (if there is more than one)
+        if(header.submeshCount > 1) mesh->splitIntoSubmeshes(readSubmeshRanges(file, header));
+        mesh->setBounds(glm::make_vec3(header.boundsMin), glm::make_vec3(header.boundsMax));
+        return mesh;
+    }
+
+    bool read(const std::string& sourcePath, VertexFormat format, uint64_t key, CacheEntry& entry){
+        MappedFile file;
+        CacheHeader header;
+        if(!open(sourcePath, format, key, file, header)) return false;
+
+        // The blobs are copied out of the mapped file since the entry is uploaded later (usually on another thread)
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+        entry.format = VertexFormat(header.vertexFormat);
+        entry.vertexData.assign(data + header.vertexOffset, data + header.vertexOffset + header.vertexSize);
+        entry.vertexCount = GLsizei(header.vertexCount);
+        entry.elementType = GLenum(header.elementType);
+        entry.elementData.assign(data + header.elementOffset, data + header.elementOffset + header.elementSize);
+        entry.elementCount = GLsizei(header.elementCount);
+        entry.boundsMin = glm::make_vec3(header.boundsMin);
+        entry.boundsMax = glm::make_vec3(header.boundsMax);
+        entry.dequantization = glm::make_mat4(header.dequantization);
+        entry.lods.resize(header.lodCount);
+        if(header.lodCount) std::memcpy(entry.lods.data(), data + header.lodOffset, header.lodCount * sizeof(CacheLod));
+        entry.submeshes.resize(header.submeshCount);
+        if(header.submeshCount) std::memcpy(entry.submeshes.data(), data + header.submeshOffset, header.submeshCount * sizeof(CacheSubmesh));
+        return true;
+    }
+
+    bool store(const std::string& sourcePath, VertexFormat format, uint64_t key, const CacheEntry& entry){
+        std::error_code error;
+        fs::create_directories(CACHE_DIRECTORY, error);
+        std::string cachePath = getCachePath(sourcePath, format, key);
+
+        CacheHeader header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.fileVersion = FILE_VERSION;
+        header.key = key;
+        header.vertexFormat = static_cast<uint32_t>(entry.format);
+        header.elementType = entry.elementType;
+        header.vertexCount = uint32_t(entry.vertexCount);
+        header.elementCount = uint32_t(entry.elementCount);
+        std::memcpy(header.boundsMin, glm::value_ptr(entry.boundsMin), sizeof(header.boundsMin));
+        std::memcpy(header.boundsMax, glm::value_ptr(entry.boundsMax), sizeof(header.boundsMax));
+        std::memcpy(header.dequantization, glm::value_ptr(entry.dequantization), sizeof(header.dequantization));
+        header.lodCount = uint32_t(entry.lods.size());
+        header.submeshCount = uint32_t(entry.submeshes.size());
+        header.vertexOffset = alignTo16(sizeof(CacheHeader));
+        header.vertexSize = entry.vertexData.size();
+        header.elementOffset = alignTo16(header.vertexOffset + header.vertexSize);
+        header.elementSize = entry.elementData.size();
+        header.lodOffset = alignTo16(header.elementOffset + header.elementSize);
+        header.submeshOffset = alignTo16(header.lodOffset + entry.lods.size() * sizeof(CacheLod));
+
+        bool written = cache_file::writeAtomically(cachePath, [&](std::ostream& file){
+            file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+            cache_file::writeAt(file, header.vertexOffset, entry.vertexData.data(), entry.vertexData.size());
+            cache_file::writeAt(file, header.elementOffset, entry.elementData.data(), entry.elementData.size());
+            cache_file::writeAt(file, header.lodOffset, entry.lods.data(), entry.lods.size() * sizeof(CacheLod));
+            cache_file::writeAt(file, header.submeshOffset, entry.submeshes.data(), entry.submeshes.size() * sizeof(CacheSubmesh));
+            return true;
+        });
+        if(!written) return false;
+
+        // Delete the stale cache files of the same source & format (they have the same prefix but a different key)
+        cache_file::removeStale(CACHE_DIRECTORY, getCachePrefix(sourcePath, format), ".mesh", fs::path(cachePath).filename().string());
+        return true;
+    }
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace our::mesh_cache {
+
+    // Loading a mesh from an ".obj" file means parsing text, welding vertices, optimizing the triangle order and packing the vertices.
+    // So the first time a file is loaded, the result is written to a binary cache file which stores the vertex & element data
+    // exactly as they are uploaded to the GPU. On the next launches, the cache file is memory mapped and uploaded directly.
+    //
+    // The cache file name contains a hash of the source file contents, the loader version and the requested vertex format,
+    // so editing the source file (or changing the loader) makes the old cache file stale and it is replaced on the next load.
+    //
+    // File layout (little endian, every blob starts at a multiple of 16 bytes):
+    //   CacheHeader | vertex blob | element blob | LOD table | submesh table
+
+    // Increment this whenever the parser, the optimizer or the packing changes the output, so that the old cache files are rebuilt
+    constexpr uint32_t LOADER_VERSION = 1;
+    // Increment this whenever the layout of the cache file changes
+    constexpr uint32_t FILE_VERSION = 1;
+
+    // A level of detail is a range of the element blob (the first LOD is the full mesh)
+    struct CacheLod {
+        uint32_t firstElement, elementCount;
+        float error;                // The maximum deviation from the full mesh in the local space
+        uint32_t padding = 0;
+    };
+
+    // A submesh is a range of the element blob that is drawn with its own material
+    struct CacheSubmesh {
+        uint32_t firstElement, elementCount;
+    };
+
+    struct CacheHeader {
+        char magic[4];              // Always "OMSH"
+        uint32_t fileVersion;
+        uint64_t key;               // The hash of the source contents, the loader version and the requested format
+        uint32_t vertexFormat;      // The actual format of the vertex blob (a "VertexFormat")
+        uint32_t elementType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        uint32_t vertexCount, elementCount;
+        float boundsMin[3], boundsMax[3];   // The mesh bounds in the local space
+        float dequantization[16];   // The matrix that returns the packed positions to the local space (column major)
+        uint32_t lodCount, submeshCount;
+        uint64_t vertexOffset, vertexSize;
+        uint64_t elementOffset, elementSize;
+        uint64_t lodOffset, submeshOffset;
+    };
+    static_assert(sizeof(CacheHeader) == 176, "The cache header should not contain any padding");
+
+    // The mesh data that is written to a cache file
+    struct CacheEntry {
+        VertexFormat format;
+        std::vector<uint8_t> vertexData;
+        GLsizei vertexCount;
+        GLenum elementType;
+        std::vector<uint8_t> elementData;
+        GLsizei elementCount;
+        glm::vec3 boundsMin, boundsMax;
+        glm::mat4 dequantization;
+        std::vector<CacheLod> lods;
+        std::vector<CacheSubmesh> submeshes;
+    };
+
+    // Returns the key that identifies the cache file of the given source file when it is loaded in the given format
+    // Returns 0 if the source file could not be read
+    uint64_t computeKey(const std::string& sourcePath, VertexFormat format);
+
+    // Returns the path of the cache file of the given source file, requested format and key (inside the "cache/meshes" folder)
+    // The name contains the source name, a hash of its path and the requested format, so that different sources with the same name
+    // and the same source loaded in different formats do not collide
+    std::string getCachePath(const std::string& sourcePath, VertexFormat format, uint64_t key);
+
+    // Creates a mesh from the cache file of the given source file or returns nullptr if there is no valid cache file for this key
+    Mesh* load(const std::string& sourcePath, VertexFormat format, uint64_t key);
+
+    // Reads the cache file of the given source file into the given entry (without creating a mesh, so it can run on any thread)
+    // Returns false if there is no valid cache file for this key
+    bool read(const std::string& sourcePath, VertexFormat format, uint64_t key, CacheEntry& entry);
+
+    // Writes the given data into the cache file of the given source file and deletes the stale cache files of the same source & format
+    // Returns false if the file could not be written (the mesh can still be used, it will just be parsed again on the next launch)
+    bool store(const std::string& sourcePath, VertexFormat format, uint64_t key, const CacheEntry& entry);
+
+}
@@ -0,0 +1,177 @@
+#include "mesh-optimizer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+namespace our::mesh_optimizer {
+
+    float computeACMR(const std::vector<GLuint>& elements, size_t vertexCount, size_t cacheSize){
+        size_t triangleCount = elements.size() / 3;
+        if(triangleCount == 0) return 0.0f;
+        // Instead of storing the cache content, we store the time each vertex entered the cache.
+        // A vertex is in a FIFO cache if less than "cacheSize" vertices entered the cache after it.
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        size_t time = cacheSize + 1, misses = 0;
+        for(GLuint element : elements){
+            if(time - cacheTime[element] > cacheSize){
+                cacheTime[element] = time++;
+                ++misses;
+            }
+        }
+        return float(misses) / float(triangleCount);
+    }
+
+    std::vector<size_t> optimizeVertexCache(std::vector<GLuint>& elements, size_t vertexCount, size_t cacheSize){
+        size_t triangleCount = elements.size() / 3;
+        std::vector<size_t> clusters;
+        if(triangleCount == 0) return clusters;
+
+        // Build the vertex-triangle adjacency as a compact list: the triangles of vertex v are in [offsets[v], offsets[v+1])
+        std::vector<uint32_t> liveTriangles(vertexCount, 0);
+        for(GLuint element : elements) ++liveTriangles[element];
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        std::partial_sum(liveTriangles.begin(), liveTriangles.end(), offsets.begin() + 1);
+        std::vector<uint32_t> adjacency(elements.size());
+        std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for(size_t index = 0; index < elements.size(); ++index){
+            adjacency[filled[elements[index]]++] = uint32_t(index / 3);
+        }
+
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> deadEnds;       // The recently used vertices which may still have triangles to emit
+        std::vector<GLuint> candidates;     // The vertices of the triangles emitted around the current fanning vertex
+        std::vector<GLuint> output;
+        output.reserve(elements.size());
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;                  // Used to scan the vertices in order when the dead-end stack is empty
+
+        // Returns the next vertex with live triangles from the dead-end stack or in the input order (or -1 if there is none)
+        auto skipDeadEnd = [&]() -> int64_t {
+            while(!deadEnds.empty()){
+                GLuint vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if(liveTriangles[vertex] > 0) return vertex;
+            }
+            while(cursor < vertexCount){
+                if(liveTriangles[cursor] > 0) return int64_t(cursor);
+                ++cursor;
+            }
+            return -1;
+        };
+
+        int64_t fanning = skipDeadEnd();
+        clusters.push_back(0);
+        while(fanning >= 0){
+            // Emit all the remaining triangles around the fanning vertex
+            candidates.clear();
+            for(uint32_t slot = offsets[fanning]; slot < offsets[fanning + 1]; ++slot){
+                uint32_t triangle = adjacency[slot];
+                if(emitted[triangle]) continue;
+                emitted[triangle] = true;
+                for(int corner = 0; corner < 3; ++corner){
+                    GLuint vertex = elements[3 * triangle + corner];
+                    output.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --liveTriangles[vertex];
+                    if(time - cacheTime[vertex] > cacheSize) cacheTime[vertex] = time++;
+                }
+            }
+
+            // Pick the candidate that is the oldest in the cache but will still be in the cache after its triangles are emitted
+            int64_t next = -1;
+            size_t bestPriority = 0;
+            for(GLuint vertex : candidates){
+                if(liveTriangles[vertex] == 0) continue;
+                size_t priority = 0;
+                if(time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) priority = time - cacheTime[vertex];
+                if(next < 0 || priority > bestPriority){
+                    bestPriority = priority;
+                    next = vertex;
+                }
+            }
+            // If no candidate is left, we reached a dead end and have to jump somewhere else, which starts a new cluster
+            if(next < 0){
+                next = skipDeadEnd();
+                if(next >= 0) clusters.push_back(output.size() / 3);
+            }
+            fanning = next;
+        }
+
+        elements = std::move(output);
+        return clusters;
+    }
+
+    void optimizeOverdraw(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters){
+        size_t triangleCount = elements.size() / 3;
+        if(clusters.size() <= 1) return;
+
+        // The mesh center is the area weighted average of the triangle centers
+        struct Cluster { size_t start, end; glm::vec3 center, normal; float area; };
+        std::vector<Cluster> data(clusters.size());
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        for(size_t index = 0; index < clusters.size(); ++index){
+            Cluster& cluster = data[index];
+            cluster.start = clusters[index];
+            cluster.end = index + 1 < clusters.size() ? clusters[index + 1] : triangleCount;
+            cluster.center = cluster.normal = glm::vec3(0.0f);
+            cluster.area = 0.0f;
+            for(size_t triangle = cluster.start; triangle < cluster.end; ++triangle){
+                const glm::vec3& a = vertices[elements[3 * triangle + 0]].position;
+                const glm::vec3& b = vertices[elements[3 * triangle + 1]].position;
+                const glm::vec3& c = vertices[elements[3 * triangle + 2]].position;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float area = glm::length(normal);
+                cluster.center += (a + b + c) * (area / 3.0f);
+                cluster.normal += normal;
+                cluster.area += area;
+            }
+            meshCenter += cluster.center;
+            meshArea += cluster.area;
+            if(cluster.area > 0.0f) cluster.center /= cluster.area;
+        }
+        if(meshArea > 0.0f) meshCenter /= meshArea;
+
+        // A cluster that faces away from the center is likely to be in front of the other clusters when it is visible
+        std::vector<float> facing(data.size());
+        for(size_t index = 0; index < data.size(); ++index){
+            float length = glm::length(data[index].normal);
+            facing[index] = length > 0.0f ? glm::dot(data[index].center - meshCenter, data[index].normal / length) : 0.0f;
+        }
+        std::vector<size_t> order(data.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t first, size_t second){ return facing[first] > facing[second]; });
+
+        std::vector<GLuint> output;
+        output.reserve(elements.size());
+        for(size_t index : order){
+            output.insert(output.end(), elements.begin() + 3 * data[index].start, elements.begin() + 3 * data[index].end);
+        }
+        elements = std::move(output);
+    }
+
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& elements){
+        // Give each vertex a new index in the order of its first use (unused vertices are dropped)
+        std::vector<GLuint> remap(vertices.size(), GLuint(-1));
+        std::vector<Vertex> output;
+        output.reserve(vertices.size());
+        for(GLuint& element : elements){
+            if(remap[element] == GLuint(-1)){
+                remap[element] = GLuint(output.size());
+                output.push_back(vertices[element]);
+            }
+            element = remap[element];
+        }
+        vertices = std::move(output);
+    }
+
+    void optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& elements){
+        std::vector<size_t> clusters = optimizeVertexCache(elements, vertices.size());
+        optimizeOverdraw(elements, vertices, clusters);
+        optimizeVertexFetch(vertices, elements);
+    }
+
+}
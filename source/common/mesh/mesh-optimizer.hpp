@@ -0,0 +1,31 @@
+#pragma once
+
+#include "vertex.hpp"
+#include <glad/gl.h>
+#include <vector>
+
+namespace our::mesh_optimizer {
+
+    // The number of vertices in the simulated post-transform vertex cache (a FIFO cache of this size is a good model of most GPUs)
+    constexpr size_t CACHE_SIZE = 16;
+
+    // Returns the Average Cache Miss Ratio: the number of vertex shader invocations per triangle when drawing the elements
+    // through a FIFO cache of the given size. The lowest possible value is around 0.5 and the worst is 3.
+    float computeACMR(const std::vector<GLuint>& elements, size_t vertexCount, size_t cacheSize = CACHE_SIZE);
+
+    // Reorders the triangles so that the vertices that were recently transformed are reused (the Tipsify algorithm)
+    // The starts of the triangle clusters (the points where the algorithm had to jump to a new region of the mesh)
+    // are returned since the triangles can be reordered at these points without hurting the cache reuse
+    std::vector<size_t> optimizeVertexCache(std::vector<GLuint>& elements, size_t vertexCount, size_t cacheSize = CACHE_SIZE);
+
+    // Reorders the clusters found by "optimizeVertexCache" so that the clusters facing away from the mesh center are drawn first
+    // Since these clusters tend to occlude the rest of the mesh, this reduces the overdraw
+    void optimizeOverdraw(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters);
+
+    // Reorders the vertices in the order they are first used by the elements so that the vertex fetches are close in memory
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
+
+    // Applies all the above optimizations in order
+    void optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
+
+}
@@ -1,4 +1,8 @@
 #include "mesh-utils.hpp"
+#include "mesh-optimizer.hpp"
+#include "obj-parser.hpp"
+#include "mesh-cache.hpp"
+#include "gltf-loader.hpp"
 
 // We will use "Tiny OBJ Loader" to read and process '.obj" files
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -7,13 +11,84 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <filesystem>
 
-our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+// Parses an ".obj" file and processes it into the data that is uploaded to the GPU (then stores it in the cache if the key is not 0)
+static bool parseOBJ(const std::string& filename, our::VertexFormat format, uint64_t cacheKey, our::mesh_cache::CacheEntry& entry) {
+    using namespace our;
 
     // The data that we will use to initialize our mesh
     std::vector<our::Vertex> vertices;
     std::vector<GLuint> elements;
 
+    // The file is read by our parallel parser which also welds the duplicated vertices
+    if(!obj_parser::parse(filename, vertices, elements)) return false;
+
+    // Reorder the triangles and the vertices for the vertex cache, the overdraw and the vertex fetch
+    // (the vertex cache efficiency can be measured with "mesh_optimizer::computeACMR")
+    mesh_optimizer::optimize(vertices, elements);
+
+    // Pack the data into the layout that will be uploaded to the GPU (this is also what the cache stores)
+    entry.format = format == VertexFormat::STANDARD ? format : selectPackedFormat(vertices);
+    entry.vertexData = packVertices(vertices, entry.format, entry.dequantization);
+    entry.vertexCount = static_cast<GLsizei>(vertices.size());
+    entry.elementData = packElements(elements, vertices.size(), entry.elementType);
+    entry.elementCount = static_cast<GLsizei>(elements.size());
+    entry.boundsMin = entry.boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+    for(const auto& vertex : vertices){
+        entry.boundsMin = glm::min(entry.boundsMin, vertex.position);
+        entry.boundsMax = glm::max(entry.boundsMax, vertex.position);
+    }
+    // For now, an obj file is loaded as a single submesh with a single level of detail
+    entry.lods.push_back({0, uint32_t(elements.size()), 0.0f});
+    entry.submeshes.push_back({0, uint32_t(elements.size())});
+    if(cacheKey != 0) mesh_cache::store(filename, format, cacheKey, entry);
+    return true;
+}
+
+our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename, VertexFormat format, bool useCache) {
+
+    // If the file was loaded before (and did not change since then), we upload the processed data from the cache
+    uint64_t cacheKey = useCache ? mesh_cache::computeKey(filename, format) : 0;
+    if(cacheKey != 0){
+        if(Mesh* mesh = mesh_cache::load(filename, format, cacheKey)) return mesh;
+    }
+
+    mesh_cache::CacheEntry entry;
+    if(!parseOBJ(filename, format, cacheKey, entry)) return nullptr;
+    return createMesh(entry);
+}
+
+bool our::mesh_utils::prepareOBJ(const std::string& filename, mesh_cache::CacheEntry& entry, VertexFormat format, bool useCache) {
+    // This is the same as "loadOBJ" except that the cached data is copied into the entry instead of being uploaded
+    uint64_t cacheKey = useCache ? mesh_cache::computeKey(filename, format) : 0;
+    if(cacheKey != 0 && mesh_cache::read(filename, format, cacheKey, entry)) return true;
+    return parseOBJ(filename, format, cacheKey, entry);
+}
+
+our::Mesh* our::mesh_utils::createMesh(const mesh_cache::CacheEntry& entry) {
+    Mesh* mesh = new our::Mesh(entry.format, entry.vertexData.data(), entry.vertexCount,
+                               entry.elementType, entry.elementData.data(), entry.elementCount, entry.dequantization);
+    if(entry.submeshes.size() > 1){
+        std::vector<glm::uvec2> ranges;
+        for(const auto& submesh : entry.submeshes) ranges.push_back({submesh.firstElement, submesh.elementCount});
+        mesh->splitIntoSubmeshes(ranges);
+    }
+    mesh->setBounds(entry.boundsMin, entry.boundsMax);
+    return mesh;
+}
+
+our::Mesh* our::mesh_utils::loadMesh(const std::string& filename, VertexFormat format, bool useCache, const std::string& meshName) {
+    std::string extension = std::filesystem::path(filename).extension().string();
+    if(extension == ".gltf" || extension == ".glb") return gltf_loader::load(filename, meshName, format, useCache);
+    return loadOBJ(filename, format, useCache);
+}
+
+bool our::mesh_utils::readOBJWithTinyObj(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements) {
+
+    vertices.clear();
+    elements.clear();
+
     // Since the OBJ can have duplicated vertices, we make them unique using this map
     // The key is the vertex, the value is its index in the vector "vertices".
     // That index will be used to populate the "elements" vector.
@@ -27,7 +102,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
         std::cerr << "Failed to load obj file \"" << filename << "\" due to error: " << err << std::endl;
-        return nullptr;
+        return false;
     }
     if (!warn.empty()) {
         std::cout << "WARN while loading obj file \"" << filename << "\": " << warn << std::endl;
@@ -81,7 +156,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    return true;
 }
 
 // Create a sphere (the vertex order in the triangles are CCW from the outside)
@@ -1,11 +1,25 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "mesh-cache.hpp"
 #include <string>
 
 namespace our::mesh_utils {
     // Load an ".obj" file into the mesh
-    Mesh* loadOBJ(const std::string& filename);
+    // The format defines the layout of the vertices on the VRAM (see "VertexFormat")
+    // If "useCache" is true, the processed mesh is read from (or written to) the binary mesh cache (see "mesh-cache.hpp")
+    Mesh* loadOBJ(const std::string& filename, VertexFormat format = VertexFormat::STANDARD, bool useCache = true);
+    // Read an ".obj" file (or its cache file) into the data that is uploaded to the GPU
+    // This does not use OpenGL, so it can run on a worker thread (the mesh is then created on the main thread by "createMesh")
+    bool prepareOBJ(const std::string& filename, mesh_cache::CacheEntry& entry, VertexFormat format = VertexFormat::STANDARD, bool useCache = true);
+    // Create a mesh from the data prepared by "prepareOBJ"
+    Mesh* createMesh(const mesh_cache::CacheEntry& entry);
+    // Load a mesh file by its extension: ".gltf" and ".glb" files are loaded by "gltf_loader::load" (where "meshName" selects the mesh)
+    // and any other file is loaded as an ".obj" file by "loadOBJ"
+    Mesh* loadMesh(const std::string& filename, VertexFormat format = VertexFormat::STANDARD, bool useCache = true, const std::string& meshName = "");
+    // Read an ".obj" file into vertices & elements using Tiny OBJ Loader
+    // This was the loader used by "loadOBJ" before our own parser, it is kept for comparison in the mesh loading benchmark
+    bool readOBJWithTinyObj(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
     // Segments define the number of divisions on the both the latitude and the longitude
     Mesh* sphere(const glm::ivec2& segments);
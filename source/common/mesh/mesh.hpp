@@ -2,6 +2,11 @@
 
 #include <glad/gl.h>
 #include "vertex.hpp"
+#include "geometry-arena.hpp"
+#include <vector>
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
 
 namespace our {
 
@@ -10,93 +15,144 @@ namespace our {
     #define ATTRIB_LOC_TEXCOORD 2
     #define ATTRIB_LOC_NORMAL   3
 
+    // A submesh is a part of a mesh that can be drawn with its own material
+    struct Submesh {
+        GLenum mode = GL_TRIANGLES;             // The primitive type
+        GLenum elementType = GL_UNSIGNED_INT;   // The type of the elements (0 if the submesh has no elements and is drawn with glDrawArrays)
+        GLsizei elementCount = 0;               // The number of elements to draw (or vertices if the submesh has no elements)
+        size_t elementOffset = 0;               // The offset (in bytes) of the first element in the element buffer (or the index of the first vertex)
+        GLint baseVertex = 0;                   // The value added to each element before reading the vertex
+    };
+
     class Mesh {
-        // Here, we store the object names of the 3 main components of a mesh:
-        // A vertex array object, A vertex buffer and an element buffer
-        unsigned int VBO, EBO;
-        unsigned int VAO;
-        // We need to remember the number of elements that will be draw by glDrawElements 
-        GLsizei elementCount;
+        // Instead of owning a vertex array object, a vertex buffer and an element buffer,
+        // the mesh stores its data in a range of the shared buffers of the geometry arena
+        GeometryAllocation allocation;
+        // The layout of the vertices on the VRAM and the matrix that returns the (quantized) positions to the local space
+        VertexFormat format = VertexFormat::STANDARD;
+        glm::mat4 dequantization = glm::mat4(1.0f);
+        // The parts of the mesh. A mesh always has at least one submesh.
+        std::vector<Submesh> submeshes;
+        // The radius of a sphere around the local origin that contains all the vertices (0 if it is unknown)
+        float boundingRadius = 0.0f;
+
+        // Stores the given data in the geometry arena and creates a single submesh that covers all the elements
+        void upload(VertexFormat format, const void* vertexData, GLsizei vertexCount,
+                    GLenum elementType, const void* elementData, GLsizei elementCount, const glm::mat4& dequantization)
+        {
+            this->format = format;
+            this->dequantization = dequantization;
+            size_t elementSize = getElementTypeSize(elementType);
+            allocation = GeometryArena::get().allocate(format, vertexData, vertexCount, elementData, elementCount * elementSize, elementSize);
+
+            Submesh submesh;
+            submesh.elementType = elementType;
+            submesh.elementCount = elementCount;
+            submesh.elementOffset = allocation.elementOffset;
+            submesh.baseVertex = allocation.baseVertex;
+            submeshes = { submesh };
+        }
     public:
 
         // The constructor takes two vectors:
         // - vertices which contain the vertex data.
         // - elements which contain the indices of the vertices out of which each rectangle will be constructed.
-        // The mesh class does not keep a these data on the RAM. Instead, it should create
-        // a vertex buffer to store the vertex data on the VRAM,
-        // an element buffer to store the element data on the VRAM,
-        // a vertex array object to define how to read the vertex & element buffer during rendering 
-        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements)
+        // The mesh class does not keep a these data on the RAM. Instead, it uploads them
+        // into a range of the geometry arena buffers on the VRAM.
+        // The arena page vertex array object defines how to read the vertex & element buffer during rendering 
+        // If a packed format is requested, the vertices are quantized before uploading (and the color is only kept if needed)
+        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements, VertexFormat format = VertexFormat::STANDARD)
         {
-            //TODO: (Req 2) Write this function
-            // remember to store the number of elements in "elementCount" since you will need it for drawing
-            // For the attribute locations, use the constants defined above: ATTRIB_LOC_POSITION, ATTRIB_LOC_COLOR, etc
-
-            // Create VAO, VBO and EBO
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-            glGenBuffers(1, &EBO);
-
-            // Bind VAO
-            glBindVertexArray(VAO);
-
-            // Upload vertex data
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER,
-                         static_cast<GLsizeiptr>(vertices.size() * sizeof(Vertex)),
-                         vertices.data(),
-                         GL_STATIC_DRAW);
-
-            // Upload element/index data
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                         static_cast<GLsizeiptr>(elements.size() * sizeof(unsigned int)),
-                         elements.data(),
-                         GL_STATIC_DRAW);
-
-            // Remember element count
-            elementCount = static_cast<GLsizei>(elements.size());
-
-            // Setup vertex attributes using offsetof so we match the actual Vertex layout
-            constexpr GLsizei stride = static_cast<GLsizei>(sizeof(Vertex));
-
-            glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
-            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, position));
-
-            glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
-            glVertexAttribPointer(ATTRIB_LOC_COLOR, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const void*)offsetof(Vertex, color));
-
-            glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
-            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, tex_coord));
+            VertexFormat packedFormat = format == VertexFormat::STANDARD ? format : selectPackedFormat(vertices);
+            glm::mat4 packedDequantization;
+            std::vector<uint8_t> vertexData = packVertices(vertices, packedFormat, packedDequantization);
+            // If every element fits in 16 bits, we halve the size of the element buffer
+            GLenum packedElementType;
+            std::vector<uint8_t> elementData = packElements(elements, vertices.size(), packedElementType);
+            upload(packedFormat, vertexData.data(), static_cast<GLsizei>(vertices.size()),
+                   packedElementType, elementData.data(), static_cast<GLsizei>(elements.size()), packedDequantization);
+            for(const auto& vertex : vertices) boundingRadius = std::max(boundingRadius, glm::length(vertex.position));
+        }
 
-            glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
-            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, normal));
+        // This constructor takes data that is already in the layout used on the VRAM (for example, when it is read from the mesh cache)
+        Mesh(VertexFormat format, const void* vertexData, GLsizei vertexCount,
+             GLenum elementType, const void* elementData, GLsizei elementCount, const glm::mat4& dequantization)
+        {
+            upload(format, vertexData, vertexCount, elementType, elementData, elementCount, dequantization);
+        }
 
-            // Unbind VAO (safe practice)
-            glBindVertexArray(0);
-            
+        // Splits the elements of the (single) arena submesh into the given ranges where each range is (first element, element count)
+        void splitIntoSubmeshes(const std::vector<glm::uvec2>& ranges){
+            if(submeshes.size() != 1 || ranges.empty()) return;
+            Submesh whole = submeshes[0];
+            submeshes.clear();
+            for(auto& range : ranges){
+                Submesh submesh = whole;
+                submesh.elementOffset += range.x * getElementTypeSize(whole.elementType);
+                submesh.elementCount = GLsizei(range.y);
+                submeshes.push_back(submesh);
+            }
         }
 
         // this function should render the mesh
         void draw() 
         {
-            //TODO: (Req 2) Write this function
+            for(size_t index = 0; index < submeshes.size(); ++index) drawSubmesh(index);
+        }
+
+        // Draws a single submesh (so that it can be drawn with its own material)
+        void drawSubmesh(size_t index)
+        {
+            const Submesh& submesh = submeshes[index];
+            // The vertex array stays bound after the draw so that the next mesh from the same page does not bind it again
+            GeometryArena::get().bind(allocation.page);
+            if(submesh.elementType == 0){
+                glDrawArrays(submesh.mode, GLint(submesh.elementOffset), submesh.elementCount);
+            } else {
+                glDrawElementsBaseVertex(submesh.mode, submesh.elementCount, submesh.elementType,
+                                         (void*)submesh.elementOffset, submesh.baseVertex);
+            }
+        }
+
+        size_t getSubmeshCount() const { return submeshes.size(); }
+        const Submesh& getSubmesh(size_t index) const { return submeshes[index]; }
+
+        // These are needed by the renderer to batch the draws of meshes that share an arena page
+        // Only the indexed triangle submeshes stored in the arena can be batched
+        bool isInArena() const { return allocation.isValid(); }
+        bool isBatchable(size_t index) const {
+            return isInArena() && submeshes[index].mode == GL_TRIANGLES && submeshes[index].elementType != 0;
+        }
+        uint32_t getPage() const { return allocation.page; }
+
+        static size_t getElementTypeSize(GLenum elementType) {
+            switch(elementType){
+                case GL_UNSIGNED_BYTE: return sizeof(GLubyte);
+                case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+                default: return sizeof(GLuint);
+            }
+        }
 
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, nullptr);
-            glBindVertexArray(0);
+        // The renderer multiplies the model matrix by the dequantization matrix (M * dequantization) before sending it to the shader,
+        // and it tells the shader to decode the normals if they are octahedral encoded
+        VertexFormat getVertexFormat() const { return format; }
+        const glm::mat4& getDequantizationMatrix() const { return dequantization; }
+        bool hasOctahedralNormals() const { return our::hasOctahedralNormals(format); }
+
+        // The bounding radius is used by the renderer to estimate the size of the mesh on the screen (e.g. to pick the texture levels to stream)
+        float getBoundingRadius() const { return boundingRadius; }
+        // Sets the bounding radius from a local bounding box (the farthest corner from the origin is on the sphere)
+        void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+            boundingRadius = glm::length(glm::max(glm::abs(boundsMin), glm::abs(boundsMax)));
         }
 
-        // this function should delete the vertex & element buffers and the vertex array object
+        // this function should give the mesh range back to the geometry arena
         ~Mesh(){
-            //TODO: (Req 2) Write this function
-            if(VBO) glDeleteBuffers(1, &VBO);
-            if(EBO) glDeleteBuffers(1, &EBO);
-            if(VAO) glDeleteVertexArrays(1, &VAO);
+            GeometryArena::get().free(allocation);
         }
 
         Mesh(Mesh const &) = delete;
         Mesh &operator=(Mesh const &) = delete;
     };
 
-}
\ No newline at end of file
+}
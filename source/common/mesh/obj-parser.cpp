@@ -0,0 +1,338 @@
+#include "obj-parser.hpp"
+#include "../io/virtual-file-system.hpp"
+#include "../jobs/job-system.hpp"
+#include "../hash-utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+namespace our::obj_parser {
+
+    namespace {
+
+        // A corner of a triangle. Each index is 0-based after the chunks are merged and -1 means that the attribute is missing
+        struct Corner {
+            int64_t position, tex_coord, normal;
+        };
+
+        // Since the relative (negative) indices refer to the vertices before the current line, and the chunk does not know
+        // how many vertices the previous chunks have, they are stored relative to the chunk start and marked by these flags
+        enum RelativeFlags : uint8_t {
+            RELATIVE_POSITION = 1,
+            RELATIVE_TEX_COORD = 2,
+            RELATIVE_NORMAL = 4
+        };
+
+        // The data read from a range of lines in the file
+        struct Chunk {
+            const char *begin, *end;
+            std::vector<glm::vec3> positions, colors, normals;
+            std::vector<glm::vec2> tex_coords;
+            std::vector<Corner> corners;        // 3 corners per triangle
+            std::vector<uint8_t> relative;      // The relative flags of each corner
+            const char* error = nullptr;        // The line at which parsing failed (if any)
+        };
+
+        inline bool isSpace(char character){ return character == ' ' || character == '\t'; }
+        inline bool isDigit(char character){ return character >= '0' && character <= '9'; }
+
+        inline const char* skipSpaces(const char* cursor, const char* end){
+            while(cursor < end && isSpace(*cursor)) ++cursor;
+            return cursor;
+        }
+
+        inline const char* skipLine(const char* cursor, const char* end){
+            while(cursor < end && *cursor != '\n') ++cursor;
+            return cursor < end ? cursor + 1 : end;
+        }
+
+        // Parses a decimal floating point number (with an optional exponent) starting at "cursor"
+        // Returns a pointer after the number or nullptr if there is no number
+        // Unlike "strtof", it does not depend on the locale and it does not handle hexadecimal numbers, infinities or NaNs
+        const char* parseFloat(const char* cursor, const char* end, float& value){
+            // The powers of 10 that can be represented exactly by a double
+            static const double powers[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            cursor = skipSpaces(cursor, end);
+            bool negative = false;
+            if(cursor < end && (*cursor == '-' || *cursor == '+')) negative = *cursor++ == '-';
+
+            // Read the digits into an integer mantissa and remember the power of ten it should be multiplied by
+            uint64_t mantissa = 0;
+            int exponent = 0, digits = 0;
+            for(; cursor < end && isDigit(*cursor); ++cursor, ++digits){
+                if(mantissa < 100000000000000000ULL) mantissa = mantissa * 10 + (*cursor - '0');
+                else ++exponent; // The extra digits are too small to affect a float
+            }
+            if(cursor < end && *cursor == '.'){
+                for(++cursor; cursor < end && isDigit(*cursor); ++cursor, ++digits){
+                    if(mantissa < 100000000000000000ULL){
+                        mantissa = mantissa * 10 + (*cursor - '0');
+                        --exponent;
+                    }
+                }
+            }
+            if(digits == 0) return nullptr;
+            if(cursor < end && (*cursor == 'e' || *cursor == 'E')){
+                const char* start = cursor++;
+                bool negativeExponent = false;
+                if(cursor < end && (*cursor == '-' || *cursor == '+')) negativeExponent = *cursor++ == '-';
+                if(cursor < end && isDigit(*cursor)){
+                    int explicitExponent = 0;
+                    for(; cursor < end && isDigit(*cursor); ++cursor)
+                        if(explicitExponent < 10000) explicitExponent = explicitExponent * 10 + (*cursor - '0');
+                    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+                } else {
+                    cursor = start; // The "e" is not followed by a number, so it is not a part of this number
+                }
+            }
+
+            double result = double(mantissa);
+            if(exponent < 0) result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+            else if(exponent > 0) result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+            value = float(negative ? -result : result);
+            return cursor;
+        }
+
+        // Parses a (possibly negative) integer. Returns a pointer after the number or nullptr if there is no number
+        inline const char* parseInteger(const char* cursor, const char* end, int64_t& value){
+            bool negative = false;
+            if(cursor < end && (*cursor == '-' || *cursor == '+')) negative = *cursor++ == '-';
+            if(cursor >= end || !isDigit(*cursor)) return nullptr;
+            int64_t result = 0;
+            for(; cursor < end && isDigit(*cursor); ++cursor) result = result * 10 + (*cursor - '0');
+            value = negative ? -result : result;
+            return cursor;
+        }
+
+        // Converts an index from the file (1-based or negative) to a 0-based index.
+        // "count" is the number of elements of this attribute read so far in this chunk.
+        inline int64_t resolveIndex(int64_t index, size_t count, uint8_t flag, uint8_t& relative){
+            if(index > 0) return index - 1;
+            relative |= flag;
+            return int64_t(count) + index;
+        }
+
+        // Parses a face corner in the form "v", "v/t", "v//n" or "v/t/n"
+        const char* parseCorner(const char* cursor, const char* end, const Chunk& chunk, Corner& corner, uint8_t& relative){
+            int64_t index;
+            relative = 0;
+            corner.tex_coord = corner.normal = -1;
+            if(!(cursor = parseInteger(cursor, end, index)) || index == 0) return nullptr;
+            corner.position = resolveIndex(index, chunk.positions.size(), RELATIVE_POSITION, relative);
+            if(cursor < end && *cursor == '/'){
+                ++cursor;
+                if(cursor < end && *cursor != '/'){
+                    if(!(cursor = parseInteger(cursor, end, index)) || index == 0) return nullptr;
+                    corner.tex_coord = resolveIndex(index, chunk.tex_coords.size(), RELATIVE_TEX_COORD, relative);
+                }
+                if(cursor < end && *cursor == '/'){
+                    ++cursor;
+                    if(!(cursor = parseInteger(cursor, end, index)) || index == 0) return nullptr;
+                    corner.normal = resolveIndex(index, chunk.normals.size(), RELATIVE_NORMAL, relative);
+                }
+            }
+            return cursor;
+        }
+
+        // Returns true if there is nothing but spaces till the end of the line
+        inline bool atLineEnd(const char* cursor, const char* end){
+            cursor = skipSpaces(cursor, end);
+            return cursor >= end || *cursor == '\n' || *cursor == '\r' || *cursor == '#';
+        }
+
+        void parseChunk(Chunk& chunk){
+            const char* end = chunk.end;
+            std::vector<Corner> polygon;
+            std::vector<uint8_t> polygonRelative;
+            for(const char* line = chunk.begin; line < end; line = skipLine(line, end)){
+                const char* cursor = skipSpaces(line, end);
+                if(end - cursor < 2) continue;
+                if(cursor[0] == 'v' && isSpace(cursor[1])){
+                    // A position with an optional color: "v x y z [r g b]"
+                    glm::vec3 position, color(1.0f);
+                    cursor += 2;
+                    for(int component = 0; component < 3 && cursor; ++component) cursor = parseFloat(cursor, end, position[component]);
+                    if(!cursor){ chunk.error = line; return; }
+                    if(!atLineEnd(cursor, end)){
+                        const char* colorCursor = cursor;
+                        for(int component = 0; component < 3 && colorCursor; ++component) colorCursor = parseFloat(colorCursor, end, color[component]);
+                        if(!colorCursor) color = glm::vec3(1.0f); // It may be a "w" component which we ignore
+                    }
+                    chunk.positions.push_back(position);
+                    chunk.colors.push_back(color);
+                } else if(cursor[0] == 'v' && cursor[1] == 't'){
+                    glm::vec2 tex_coord(0.0f);
+                    cursor += 2;
+                    if(!(cursor = parseFloat(cursor, end, tex_coord.x))){ chunk.error = line; return; }
+                    // The v coordinate is optional in the format
+                    if(!atLineEnd(cursor, end) && !parseFloat(cursor, end, tex_coord.y)){ chunk.error = line; return; }
+                    chunk.tex_coords.push_back(tex_coord);
+                } else if(cursor[0] == 'v' && cursor[1] == 'n'){
+                    glm::vec3 normal;
+                    cursor += 2;
+                    for(int component = 0; component < 3 && cursor; ++component) cursor = parseFloat(cursor, end, normal[component]);
+                    if(!cursor){ chunk.error = line; return; }
+                    chunk.normals.push_back(normal);
+                } else if(cursor[0] == 'f' && isSpace(cursor[1])){
+                    polygon.clear();
+                    polygonRelative.clear();
+                    cursor += 2;
+                    while(!atLineEnd(cursor, end)){
+                        Corner corner;
+                        uint8_t relative;
+                        if(!(cursor = parseCorner(skipSpaces(cursor, end), end, chunk, corner, relative))){ chunk.error = line; return; }
+                        polygon.push_back(corner);
+                        polygonRelative.push_back(relative);
+                    }
+                    if(polygon.size() < 3){ chunk.error = line; return; }
+                    // Triangulate the polygon as a fan around its first corner
+                    for(size_t index = 2; index < polygon.size(); ++index){
+                        for(size_t corner : {size_t(0), index - 1, index}){
+                            chunk.corners.push_back(polygon[corner]);
+                            chunk.relative.push_back(polygonRelative[corner]);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Prints the line at which parsing failed
+        void reportError(const std::string& filename, const char* fileStart, const char* line, const char* end){
+            size_t lineNumber = 1 + std::count(fileStart, line, '\n');
+            const char* lineEnd = std::find(line, end, '\n');
+            std::cerr << "Failed to parse obj file \"" << filename << "\" at line " << lineNumber << ": "
+                      << std::string(line, lineEnd) << std::endl;
+        }
+
+    }
+
+    bool parse(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements){
+        vertices.clear();
+        elements.clear();
+        FileView file = vfs::open(filename);
+        if(!file.isOpen()) return false;
+        const char* data = file.data();
+        const char* end = data + file.size();
+
+        // Split the file into chunks that start at line beginnings
+        // We create a few chunks per thread so that the threads stay busy if some chunks are slower than others
+        JobSystem& jobs = JobSystem::get();
+        constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(4 * (jobs.getWorkerCount() + 1), file.size() / MIN_CHUNK_SIZE));
+        std::vector<Chunk> chunks(chunkCount);
+        const char* start = data;
+        for(size_t index = 0; index < chunkCount; ++index){
+            const char* split = index + 1 == chunkCount ? end : std::max(start, data + file.size() * (index + 1) / chunkCount);
+            if(split < end) split = skipLine(split, end);
+            chunks[index].begin = start;
+            chunks[index].end = split;
+            start = split;
+        }
+
+        jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t finish){
+            for(size_t index = begin; index < finish; ++index) parseChunk(chunks[index]);
+        });
+
+        // Find where the data of each chunk starts in the merged arrays and check for errors
+        std::vector<size_t> positionBase(chunkCount), texCoordBase(chunkCount), normalBase(chunkCount), cornerBase(chunkCount);
+        size_t cornerCount = 0;
+        std::vector<glm::vec3> positions, colors, normals;
+        std::vector<glm::vec2> tex_coords;
+        for(size_t index = 0; index < chunkCount; ++index){
+            const Chunk& chunk = chunks[index];
+            if(chunk.error){
+                reportError(filename, data, chunk.error, end);
+                return false;
+            }
+            positionBase[index] = positions.size();
+            texCoordBase[index] = tex_coords.size();
+            normalBase[index] = normals.size();
+            cornerBase[index] = cornerCount;
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+            tex_coords.insert(tex_coords.end(), chunk.tex_coords.begin(), chunk.tex_coords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+            cornerCount += chunk.corners.size();
+        }
+        if(cornerCount > UINT32_MAX){
+            std::cerr << "Failed to load obj file \"" << filename << "\" since it has too many triangles" << std::endl;
+            return false;
+        }
+
+        // Build the vertex of every corner and its hash in parallel
+        std::vector<Vertex> cornerVertices(cornerCount);
+        std::vector<uint64_t> cornerHashes(cornerCount);
+        std::vector<uint8_t> chunkValid(chunkCount, 1);
+        jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t finish){
+            for(size_t chunkIndex = begin; chunkIndex < finish; ++chunkIndex){
+                const Chunk& chunk = chunks[chunkIndex];
+                for(size_t corner = 0; corner < chunk.corners.size(); ++corner){
+                    // The relative indices become absolute by adding the number of elements before the chunk
+                    Corner indices = chunk.corners[corner];
+                    uint8_t relative = chunk.relative[corner];
+                    if(relative & RELATIVE_POSITION) indices.position += positionBase[chunkIndex];
+                    if(relative & RELATIVE_TEX_COORD) indices.tex_coord += texCoordBase[chunkIndex];
+                    if(relative & RELATIVE_NORMAL) indices.normal += normalBase[chunkIndex];
+                    bool valid = indices.position >= 0 && indices.position < int64_t(positions.size()) &&
+                                 indices.tex_coord < int64_t(tex_coords.size()) && indices.normal < int64_t(normals.size()) &&
+                                 (!(relative & RELATIVE_TEX_COORD) || indices.tex_coord >= 0) &&
+                                 (!(relative & RELATIVE_NORMAL) || indices.normal >= 0);
+                    if(!valid){
+                        chunkValid[chunkIndex] = 0;
+                        break;
+                    }
+
+                    Vertex vertex = {};
+                    vertex.position = positions[indices.position];
+                    vertex.color = Color(glm::u8vec3(glm::clamp(colors[indices.position], 0.0f, 1.0f) * 255.0f), 255);
+                    if(indices.tex_coord >= 0) vertex.tex_coord = tex_coords[indices.tex_coord];
+                    if(indices.normal >= 0) vertex.normal = normals[indices.normal];
+
+                    size_t output = cornerBase[chunkIndex] + corner;
+                    cornerVertices[output] = vertex;
+                    cornerHashes[output] = hash_utils::hash(&vertex, sizeof(Vertex));
+                }
+            }
+        });
+        if(std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end()){
+            std::cerr << "Failed to load obj file \"" << filename << "\" since a face refers to a missing vertex" << std::endl;
+            return false;
+        }
+
+        // Weld the identical vertices using an open addressing hash table (with linear probing) that stores vertex indices
+        // The table is kept at most half full so that the probe sequences stay short
+        size_t capacity = 16;
+        while(capacity < 2 * cornerCount) capacity <<= 1;
+        const size_t mask = capacity - 1;
+        constexpr GLuint EMPTY = UINT32_MAX;
+        std::vector<GLuint> table(capacity, EMPTY);
+        std::vector<uint64_t> vertexHashes;
+        vertices.reserve(cornerCount / 2);
+        vertexHashes.reserve(cornerCount / 2);
+        elements.reserve(cornerCount);
+        for(size_t corner = 0; corner < cornerCount; ++corner){
+            uint64_t hash = cornerHashes[corner];
+            for(size_t slot = hash & mask;; slot = (slot + 1) & mask){
+                GLuint index = table[slot];
+                if(index == EMPTY){
+                    index = table[slot] = GLuint(vertices.size());
+                    vertices.push_back(cornerVertices[corner]);
+                    vertexHashes.push_back(hash);
+                    elements.push_back(index);
+                    break;
+                }
+                if(vertexHashes[index] == hash && vertices[index] == cornerVertices[corner]){
+                    elements.push_back(index);
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "vertex.hpp"
+#include <glad/gl.h>
+#include <string>
+#include <vector>
+
+namespace our::obj_parser {
+
+    // Reads an ".obj" file into a list of unique vertices and the elements of its triangles
+    // The file is opened through the virtual file system (so it is memory mapped or read from the asset pack),
+    // split into line-aligned chunks and the chunks are parsed in parallel using the job system.
+    // Only the geometry is read (positions, optional vertex colors, texture coordinates, normals and faces);
+    // polygons are triangulated as fans and the other statements (materials, groups, etc.) are ignored.
+    // Returns false (after printing the reason) if the file could not be read or is invalid.
+    bool parse(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
+
+}
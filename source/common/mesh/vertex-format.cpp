@@ -0,0 +1,138 @@
+#include "vertex-format.hpp"
+#include "mesh.hpp"
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace our {
+
+    size_t getVertexSize(VertexFormat format){
+        switch(format){
+            case VertexFormat::PACKED: return sizeof(PackedVertex);
+            case VertexFormat::PACKED_COLORED: return sizeof(PackedColoredVertex);
+            default: return sizeof(Vertex);
+        }
+    }
+
+    void setupVertexAttributes(VertexFormat format){
+        const GLsizei stride = static_cast<GLsizei>(getVertexSize(format));
+        if(format == VertexFormat::STANDARD){
+            // Setup vertex attributes using offsetof so we match the actual Vertex layout
+            glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, position));
+
+            glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
+            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const void*)offsetof(Vertex, color));
+
+            glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
+            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, tex_coord));
+
+            glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, normal));
+            return;
+        }
+
+        // Both packed layouts start the same way, so we can use the offsets of "PackedVertex" for the shared attributes
+        // The positions are normalized to [0, 1] and the normals to [-1, 1] by OpenGL
+        glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+        glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (const void*)offsetof(PackedVertex, position));
+
+        glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
+        glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_HALF_FLOAT, GL_FALSE, stride, (const void*)offsetof(PackedVertex, tex_coord));
+
+        glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+        glVertexAttribPointer(ATTRIB_LOC_NORMAL, 2, GL_SHORT, GL_TRUE, stride, (const void*)offsetof(PackedVertex, normal));
+
+        if(format == VertexFormat::PACKED_COLORED){
+            glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
+            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const void*)offsetof(PackedColoredVertex, color));
+        } else {
+            // When an attribute array is disabled, the shader reads the current generic value of the attribute instead.
+            // This value is a part of the context state (not the vertex array), so we set it to white for all the meshes without colors.
+            glDisableVertexAttribArray(ATTRIB_LOC_COLOR);
+            glVertexAttrib4f(ATTRIB_LOC_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    }
+
+    VertexFormat selectPackedFormat(const std::vector<Vertex>& vertices){
+        const Color white = Color(255, 255, 255, 255);
+        bool colored = std::any_of(vertices.begin(), vertices.end(), [&](const Vertex& vertex){ return vertex.color != white; });
+        return colored ? VertexFormat::PACKED_COLORED : VertexFormat::PACKED;
+    }
+
+    glm::i16vec2 encodeOctahedral(glm::vec3 normal){
+        // Project the normal on the octahedron |x| + |y| + |z| = 1 then unfold the lower half over the corners of the square
+        float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+        if(length <= 0.0f) return glm::i16vec2(0, 0);
+        glm::vec2 encoded = glm::vec2(normal) / length;
+        if(normal.z < 0.0f){
+            glm::vec2 signs = glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+            encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * signs;
+        }
+        return glm::i16vec2(glm::round(glm::clamp(encoded, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    std::vector<uint8_t> packVertices(const std::vector<Vertex>& vertices, VertexFormat format, glm::mat4& dequantization){
+        std::vector<uint8_t> bytes(vertices.size() * getVertexSize(format));
+        dequantization = glm::mat4(1.0f);
+        if(format == VertexFormat::STANDARD){
+            if(!vertices.empty()) std::memcpy(bytes.data(), vertices.data(), bytes.size());
+            return bytes;
+        }
+
+        // Find the mesh bounds, the positions are stored as fractions of the bounds size
+        glm::vec3 minimum(0.0f), maximum(0.0f);
+        if(!vertices.empty()) minimum = maximum = vertices[0].position;
+        for(const auto& vertex : vertices){
+            minimum = glm::min(minimum, vertex.position);
+            maximum = glm::max(maximum, vertex.position);
+        }
+        glm::vec3 extent = maximum - minimum;
+        dequantization = glm::scale(glm::translate(glm::mat4(1.0f), minimum), extent);
+        // If the mesh is flat along an axis, all the positions along that axis are quantized to 0
+        glm::vec3 inverseExtent = glm::vec3(
+            extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+            extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+        );
+
+        const size_t stride = getVertexSize(format);
+        for(size_t index = 0; index < vertices.size(); ++index){
+            const Vertex& vertex = vertices[index];
+            PackedColoredVertex packed;
+            glm::vec3 position = glm::clamp((vertex.position - minimum) * inverseExtent, 0.0f, 1.0f);
+            packed.position = glm::u16vec4(glm::u16vec3(glm::round(position * 65535.0f)), 0);
+            packed.normal = encodeOctahedral(vertex.normal);
+            packed.tex_coord = glm::u16vec2(glm::packHalf1x16(vertex.tex_coord.x), glm::packHalf1x16(vertex.tex_coord.y));
+            packed.color = vertex.color;
+            // The colored layout only adds the color at the end, so we copy the part that fits the format
+            std::memcpy(bytes.data() + index * stride, &packed, stride);
+        }
+        return bytes;
+    }
+
+    std::vector<uint8_t> packElements(const std::vector<GLuint>& elements, size_t vertexCount, GLenum& elementType){
+        std::vector<uint8_t> bytes;
+        if(vertexCount <= 65536){
+            elementType = GL_UNSIGNED_SHORT;
+            bytes.resize(elements.size() * sizeof(GLushort));
+            auto* output = reinterpret_cast<GLushort*>(bytes.data());
+            for(size_t index = 0; index < elements.size(); ++index) output[index] = static_cast<GLushort>(elements[index]);
+        } else {
+            elementType = GL_UNSIGNED_INT;
+            bytes.resize(elements.size() * sizeof(GLuint));
+            if(!elements.empty()) std::memcpy(bytes.data(), elements.data(), bytes.size());
+        }
+        return bytes;
+    }
+
+    VertexFormat parseVertexFormat(const std::string& name){
+        if(name == "packed") return VertexFormat::PACKED;
+        if(name != "standard") std::cerr << "Unknown vertex format \"" << name << "\", the standard format will be used" << std::endl;
+        return VertexFormat::STANDARD;
+    }
+
+}
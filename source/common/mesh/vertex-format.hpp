@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vertex.hpp"
+
+namespace our {
+
+    // The vertex layouts that a mesh can be stored in on the VRAM
+    // - STANDARD: The "Vertex" struct as is (36 bytes)
+    // - PACKED: The position is quantized to 16-bit per component relative to the mesh bounds,
+    //           the normal is octahedral encoded into 2 16-bit snorms and the texture coordinates are half floats (16 bytes)
+    // - PACKED_COLORED: Same as PACKED but the vertex color is kept too (20 bytes)
+    enum class VertexFormat {
+        STANDARD,
+        PACKED,
+        PACKED_COLORED
+    };
+
+    // The packed vertex layouts. Their attributes are decoded in the vertex shader
+    // (the positions by the model matrix and the normals when the "oct_normals" uniform is true)
+    struct PackedVertex {
+        glm::u16vec4 position;  // The w component is not used, it only keeps the rest aligned to 4 bytes
+        glm::i16vec2 normal;
+        glm::u16vec2 tex_coord;
+    };
+
+    struct PackedColoredVertex {
+        glm::u16vec4 position;
+        glm::i16vec2 normal;
+        glm::u16vec2 tex_coord;
+        Color color;
+    };
+
+    static_assert(sizeof(PackedVertex) == 16, "The packed vertex should be 16 bytes");
+    static_assert(sizeof(PackedColoredVertex) == 20, "The packed colored vertex should be 20 bytes");
+
+    // Returns the size of a single vertex in the given format
+    size_t getVertexSize(VertexFormat format);
+
+    // Returns whether the normals are octahedral encoded in the given format
+    inline bool hasOctahedralNormals(VertexFormat format) { return format != VertexFormat::STANDARD; }
+
+    // Sets up the vertex attributes of the given format for the currently bound vertex array and vertex buffer
+    void setupVertexAttributes(VertexFormat format);
+
+    // Returns the packed format that fits the given vertices (the color is only kept if some vertex is not white)
+    VertexFormat selectPackedFormat(const std::vector<Vertex>& vertices);
+
+    // Converts the vertices into the given format and returns the raw bytes that should be uploaded to the vertex buffer
+    // Since the quantized positions are in the range [0, 1], "dequantization" is set to the matrix that returns them to the local space
+    // The matrix should be applied before the model matrix (it is the identity for the standard format)
+    std::vector<uint8_t> packVertices(const std::vector<Vertex>& vertices, VertexFormat format, glm::mat4& dequantization);
+
+    // Converts the elements into 16-bit integers if every vertex index fits in 16 bits (otherwise, they are kept as 32-bit integers)
+    // The chosen type is returned in "elementType" and the raw bytes that should be uploaded to the element buffer are returned
+    std::vector<uint8_t> packElements(const std::vector<GLuint>& elements, size_t vertexCount, GLenum& elementType);
+
+    // Encodes a unit vector into 2 snorm values using the octahedral mapping
+    glm::i16vec2 encodeOctahedral(glm::vec3 normal);
+
+    // Reads a vertex format from its name ("standard" or "packed"). The packed format with color is selected per mesh.
+    VertexFormat parseVertexFormat(const std::string& name);
+
+}
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
+#include "../hash-utils.hpp"
 
 namespace our {
 
@@ -28,8 +29,8 @@ namespace our {
 
 // We plan to use struct Vertex as a key for a map so we need to define a hash function for it
 namespace std {
-    //A Simple method to combine two hash values
-    inline size_t hash_combine(size_t h1, size_t h2){ return h1 ^ (h2 << 1); }
+    //A method to combine two hash values (a simple "h1 ^ (h2 << 1)" gives many collisions for similar vertices)
+    inline size_t hash_combine(size_t h1, size_t h2){ return static_cast<size_t>(our::hash_utils::combine(h1, h2)); }
 
     //A Hash function for struct Vertex
     template<> struct hash<our::Vertex> {
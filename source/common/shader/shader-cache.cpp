@@ -0,0 +1,109 @@
+#include "shader-cache.hpp"
+#include "../io/mapped-file.hpp"
+#include "../io/cache-file.hpp"
+#include "../hash-utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace our::shader_cache {
+
+    namespace {
+        const char MAGIC[4] = {'O', 'S', 'H', 'D'};
+        const char* CACHE_DIRECTORY = "cache/shaders";
+
+        // Hashes a string returned by glGetString (which can be null if there is no context)
+        uint64_t hashString(GLenum name, uint64_t seed){
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            return value ? hash_utils::hash(value, std::strlen(value), seed) : seed;
+        }
+    }
+
+    bool isSupported(){
+        if(!(GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary)) return false;
+        // Some drivers support the functions but no binary format, so they never return a binary
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    uint64_t getDriverHash(){
+        // The driver cannot change while the application runs, so the hash is only computed once
+        static const uint64_t driverHash = hashString(GL_VERSION, hashString(GL_RENDERER, hashString(GL_VENDOR, 0)));
+        return driverHash;
+    }
+
+    // The cache file name is "<program name hash>-<key>.bin"
+    // This function returns the part before the key (which is shared by all the cache files of the same program)
+    static std::string getCachePrefix(const std::string& name){
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash_utils::hash(name.data(), name.size())));
+        return std::string(hex) + "-";
+    }
+
+    std::string getCachePath(const std::string& name, uint64_t key){
+        return (fs::path(CACHE_DIRECTORY) / cache_file::getFileName(getCachePrefix(name), key, ".bin")).string();
+    }
+
+    bool load(GLuint program, const std::string& name, uint64_t key){
+        std::string cachePath = getCachePath(name, key);
+        std::error_code error;
+        if(!fs::exists(cachePath, error)) return false;
+
+        MappedFile file(cachePath);
+        if(!file.isOpen() || file.size() < sizeof(CacheHeader)) return false;
+        CacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(CacheHeader));
+        bool valid = std::memcmp(header.magic, MAGIC, 4) == 0 && header.fileVersion == FILE_VERSION && header.key == key &&
+                     header.binarySize > 0 && header.binarySize <= file.size() - sizeof(CacheHeader);
+        if(!valid){
+            std::cerr << "Ignoring invalid shader cache file: " << cachePath << std::endl;
+            return false;
+        }
+
+        // The driver can still reject the binary (e.g. after an update that did not change the version string)
+        glProgramBinary(program, header.binaryFormat, file.data() + sizeof(CacheHeader), GLsizei(header.binarySize));
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+    bool store(GLuint program, const std::string& name, uint64_t key){
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) return false;
+        std::vector<char> binary(static_cast<size_t>(length));
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        if(written <= 0) return false;
+
+        std::error_code error;
+        fs::create_directories(CACHE_DIRECTORY, error);
+        std::string cachePath = getCachePath(name, key);
+
+        CacheHeader header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.fileVersion = FILE_VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binarySize = uint32_t(written);
+
+        bool stored = cache_file::writeAtomically(cachePath, [&](std::ostream& file){
+            file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+            file.write(binary.data(), std::streamsize(written));
+            return true;
+        });
+        if(!stored) return false;
+
+        // Delete the stale cache files of the same program (they have the same prefix but a different key)
+        cache_file::removeStale(CACHE_DIRECTORY, getCachePrefix(name), ".bin", fs::path(cachePath).filename().string());
+        return true;
+    }
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <string>
+
+namespace our::shader_cache {
+
+    // Compiling & linking the shaders is a large part of the start up time (especially on Mesa), so once a program is linked,
+    // its binary is read back from the driver (glGetProgramBinary) and written to a cache file. On the next launches,
+    // the binary is given to the driver (glProgramBinary) instead of compiling the sources again.
+    // The cache key contains a hash of the sources of all the stages and of the driver (vendor, renderer & version),
+    // since a driver only accepts the binaries that it produced. If the driver still rejects a binary, the program is compiled as usual.
+    //
+    // File layout (little endian):
+    //   CacheHeader | program binary
+
+    // Increment this whenever the layout of the cache file changes
+    constexpr uint32_t FILE_VERSION = 1;
+
+    struct CacheHeader {
+        char magic[4];              // Always "OSHD"
+        uint32_t fileVersion;
+        uint64_t key;               // The hash of the program sources & the driver
+        uint32_t binaryFormat;      // The format returned by glGetProgramBinary
+        uint32_t binarySize;
+    };
+    static_assert(sizeof(CacheHeader) == 24, "The cache header should not contain any padding");
+
+    // Returns whether the driver can save & load program binaries (this needs an OpenGL context)
+    bool isSupported();
+
+    // Returns a hash of the vendor, the renderer & the version of the driver (this needs an OpenGL context)
+    uint64_t getDriverHash();
+
+    // Returns the path of the cache file of the given program and key (inside the "cache/shaders" folder)
+    // The name identifies the program (e.g. the paths of its sources), so the stale cache files of the same program can be found
+    std::string getCachePath(const std::string& name, uint64_t key);
+
+    // Loads the cached binary into the given program. Returns false if there is no valid cache file for this key
+    // or if the driver rejected the binary (then the program should be compiled & linked from its sources).
+    bool load(GLuint program, const std::string& name, uint64_t key);
+
+    // Writes the binary of the given (linked) program into its cache file and deletes the stale cache files of the same program
+    bool store(GLuint program, const std::string& name, uint64_t key);
+
+}
@@ -0,0 +1,108 @@
+#include "shader-preprocessor.hpp"
+#include "../io/virtual-file-system.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace our::shader_preprocessor {
+
+    namespace {
+        // The files can not include each other in a cycle (each file is only included once), so this only limits very long include chains
+        constexpr int MAX_INCLUDE_DEPTH = 16;
+
+        // If the line is an include directive, this function returns the included path (otherwise it returns an empty string)
+        std::string_view getIncludePath(std::string_view line){
+            size_t start = line.find_first_not_of(" \t");
+            if(start == std::string_view::npos || line[start] != '#') return {};
+            size_t keyword = line.find_first_not_of(" \t", start + 1);
+            if(keyword == std::string_view::npos || line.compare(keyword, 7, "include") != 0) return {};
+            size_t open = line.find('"', keyword + 7), close = line.rfind('"');
+            if(open == std::string_view::npos || close <= open) return {};
+            return line.substr(open + 1, close - open - 1);
+        }
+
+        bool isVersionLine(std::string_view line){
+            size_t start = line.find_first_not_of(" \t");
+            return start != std::string_view::npos && line.compare(start, 8, "#version") == 0;
+        }
+
+        // Turns "NAME" into "#define NAME" and "NAME=VALUE" into "#define NAME VALUE"
+        std::string toDirective(const std::string& define){
+            std::string directive = "#define " + define;
+            if(size_t equal = directive.find('='); equal != std::string::npos) directive[equal] = ' ';
+            return directive + "\n";
+        }
+
+        struct Context {
+            const std::vector<std::string>& defines;
+            std::vector<std::string>& files;
+            std::string& output;
+            bool definesAdded = false;
+        };
+
+        bool expand(Context& context, const std::string& filename, int depth){
+            if(depth > MAX_INCLUDE_DEPTH){
+                std::cerr << "ERROR: The shader includes are nested too deeply at: " << filename << std::endl;
+                return false;
+            }
+            FileView file = vfs::open(filename);
+            if(!file.isOpen()){
+                std::cerr << "ERROR: Couldn't open shader file: " << filename << std::endl;
+                return false;
+            }
+            size_t fileIndex = context.files.size();
+            context.files.push_back(filename);
+            std::string_view text(file.data(), file.size());
+
+            size_t lineNumber = 0;
+            for(size_t position = 0; position < text.size();){
+                size_t end = text.find('\n', position);
+                if(end == std::string_view::npos) end = text.size();
+                std::string_view line = text.substr(position, end - position);
+                position = end + 1;
+                ++lineNumber;
+
+                std::string_view include = getIncludePath(line);
+                if(include.empty()){
+                    context.output.append(line);
+                    context.output += '\n';
+                    // The defines must come after the version (which must be the first line of the main file)
+                    if(fileIndex == 0 && !context.definesAdded && isVersionLine(line)){
+                        context.definesAdded = true;
+                        for(const auto& define : context.defines) context.output += toDirective(define);
+                        context.output += "#line " + std::to_string(lineNumber + 1) + " 0\n";
+                    }
+                    continue;
+                }
+                std::string includePath = (fs::path(filename).parent_path() / std::string(include)).lexically_normal().generic_string();
+                // Each file is only included once
+                if(std::find(context.files.begin(), context.files.end(), includePath) == context.files.end()){
+                    context.output += "#line 1 " + std::to_string(context.files.size()) + "\n";
+                    if(!expand(context, includePath, depth + 1)) return false;
+                }
+                context.output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            return true;
+        }
+    }
+
+    bool preprocess(const std::string& filename, const std::vector<std::string>& defines, std::string& source, std::vector<std::string>* files){
+        std::vector<std::string> includedFiles;
+        source.clear();
+        Context context = {defines, includedFiles, source};
+        bool success = expand(context, filename, 0);
+        // A shader without a version gets the defines at its start
+        if(!context.definesAdded && !defines.empty()){
+            std::string directives;
+            for(const auto& define : defines) directives += toDirective(define);
+            source.insert(0, directives + "#line 1 0\n");
+        }
+        if(files) *files = std::move(includedFiles);
+        return success;
+    }
+
+}
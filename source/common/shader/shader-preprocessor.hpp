@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace our::shader_preprocessor {
+
+    // GLSL has no includes and the only way to configure a shader is through its uniforms (which costs branches at runtime).
+    // So before a shader is compiled, its source goes through this preprocessor which:
+    // - Replaces every line in the form: #include "path" by the contents of the file. The path is relative to the including file
+    //   and each file is only included once (so shared files do not need include guards).
+    // - Adds a "#define" after the "#version" line for each define in the form "NAME" or "NAME=VALUE",
+    //   so the shader can select its code with "#ifdef NAME" (see "ShaderProgram::getVariant").
+    // Every included file gets a source string number in "#line" directives, so the compiler errors point at the right file & line.
+    // The number of a file is its index in "files" (the main file is 0).
+
+    // Reads the given file (through the virtual file system) and writes the preprocessed source into "source"
+    // Returns false if the file or one of its includes could not be read
+    bool preprocess(const std::string& filename, const std::vector<std::string>& defines, std::string& source,
+                    std::vector<std::string>* files = nullptr);
+
+}
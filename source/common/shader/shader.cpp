@@ -1,63 +1,143 @@
 #include "shader.hpp"
+#include "shader-cache.hpp"
+#include "shader-preprocessor.hpp"
+#include "../hash-utils.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
-#include <fstream>
 #include <string>
 
 //Forward definition for error checking functions
 std::string checkForShaderCompilationErrors(GLuint shader);
 std::string checkForLinkingErrors(GLuint program);
 
-bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const {
+// Sorts the defines and removes the duplicates
+static std::vector<std::string> normalizeDefines(std::vector<std::string> defines){
+    std::sort(defines.begin(), defines.end());
+    defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+    return defines;
+}
+
+our::ShaderProgram::ShaderProgram(std::vector<std::string> defines): ShaderProgram() {
+    this->defines = normalizeDefines(std::move(defines));
+}
+
+bool our::ShaderProgram::attach(const std::string &filename, GLenum type) {
     // Here, we open the file and read a string from it containing the GLSL code of our shader
-    std::ifstream file(filename);
-    if(!file){
-        std::cerr << "ERROR: Couldn't open shader file: " << filename << std::endl;
-        return false;
-    }
-    std::string sourceString = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-    const char* sourceCStr = sourceString.c_str();
-    file.close();
+    // (the files are opened through the virtual file system, so they can come from the asset pack)
+    // The source is kept till the program is linked, since the program may be loaded from the shader cache without compiling it
+    Stage stage;
+    stage.type = type;
+    stage.filename = filename;
+    if(!our::shader_preprocessor::preprocess(filename, defines, stage.source, &stage.files)) return false;
+    stages.push_back(std::move(stage));
+    stageFiles.emplace_back(type, filename);
+    return true;
+}
 
-    //TODO: Complete this function
-    //Note: The function "checkForShaderCompilationErrors" checks if there is
-    // an error in the given shader. You should use it to check if there is a
-    // compilation error and print it so that you can know what is wrong with
-    // the shader. The returned string will be empty if there is no errors.
+our::ShaderProgram::~ShaderProgram(){
+    // A program that is still linking is forgotten without checking its result
+    if(linking){
+        linkingPrograms.erase(std::find(linkingPrograms.begin(), linkingPrograms.end(), this));
+        for(const auto& stage : pendingStages) glDeleteShader(stage.shader);
+    }
+    //TODO: (Req 1) Delete a shader program
+    glDeleteProgram(this->program);
+}
 
-    // Compile shader
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &sourceCStr, nullptr);
-    glCompileShader(shader);
+void our::ShaderProgram::enableParallelCompilation() {
+    // 0xFFFFFFFF lets the driver pick the number of threads (the default is implementation defined and can be 0 on some drivers)
+    if(GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    else if(GLAD_GL_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+}
 
-    // Check compilation errors
-    std::string compileError = checkForShaderCompilationErrors(shader);
-    if(!compileError.empty()){
-        std::cerr << "ERROR: Shader compilation failed for \"" << filename << "\":\n" << compileError << std::endl;
-        glDeleteShader(shader);
-        return false;
+bool our::ShaderProgram::link() {
+    // The cache key covers the type & source of every stage and the driver, while the name (the defines & the file names) finds the stale cache files
+    bool useCache = shader_cache::isSupported();
+    std::string name;
+    uint64_t key = shader_cache::getDriverHash();
+    for(const auto& define : defines) name += define + ";";
+    for(const auto& stage : stages){
+        name += stage.filename + ";";
+        key = hash_utils::combine(key, stage.type);
+        key = hash_utils::combine(key, hash_utils::hash(stage.source.data(), stage.source.size()));
+    }
+    if(useCache && shader_cache::load(this->program, name, key)){
+        stages.clear();
+        linked = true;
+        return true;
     }
 
-    // Attach shader to program and delete the shader object (program keeps a reference)
-    glAttachShader(this->program, shader);
-    glDeleteShader(shader);
+    // The stages are compiled & the program is linked without querying any status, since a query waits for the driver to finish.
+    // So all the programs are submitted before any of them is checked, and a driver with parallel compilation
+    // (or with a compiler thread) compiles them while the application does other work. The result is checked by "finishLink".
+    for(const auto& stage : stages){
+        const char* sourceCStr = stage.source.c_str();
+        GLuint shader = glCreateShader(stage.type);
+        glShaderSource(shader, 1, &sourceCStr, nullptr);
+        glCompileShader(shader);
+        glAttachShader(this->program, shader);
+        pendingStages.push_back({shader, stage.filename, stage.files});
+    }
+    stages.clear();
 
-    //We return true if the compilation succeeded
+    // The driver only keeps the binary of the program if we ask for it before linking
+    if(useCache) glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    // Link program
+    glLinkProgram(this->program);
+    linking = true;
+    cacheName = useCache ? name : "";
+    cacheKey = key;
+    linkingPrograms.push_back(this);
     return true;
 }
 
+bool our::ShaderProgram::isReady() const {
+    if(!linking) return true;
+    // Without the extension, the driver can not tell whether the link is done, so we can only wait for it
+    if(!(GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile)) return true;
+    GLint completed = GL_FALSE;
+    glGetProgramiv(this->program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+bool our::ShaderProgram::finishLink() {
+    if(!linking) return linked;
+    linking = false;
+    linkingPrograms.erase(std::find(linkingPrograms.begin(), linkingPrograms.end(), this));
 
+    //TODO: Complete this function
+    //Note: The function "checkForShaderCompilationErrors" checks if there is
+    // an error in the given shader. You should use it to check if there is a
+    // compilation error and print it so that you can know what is wrong with
+    // the shader. The returned string will be empty if there is no errors.
+
+    // Check compilation errors
+    bool compiled = true;
+    for(const auto& stage : pendingStages){
+        std::string compileError = checkForShaderCompilationErrors(stage.shader);
+        if(!compileError.empty()){
+            std::cerr << "ERROR: Shader compilation failed for \"" << stage.filename << "\":\n" << compileError << std::endl;
+            // The errors refer to the included files by their source string numbers
+            for(size_t index = 1; index < stage.files.size(); ++index){
+                std::cerr << "  (source " << index << " is \"" << stage.files[index] << "\")" << std::endl;
+            }
+            compiled = false;
+        }
+        // The linked program does not need the shader objects anymore
+        glDetachShader(this->program, stage.shader);
+        glDeleteShader(stage.shader);
+    }
+    pendingStages.clear();
+    if(!compiled) return false;
 
-bool our::ShaderProgram::link() const {
     //TODO: Complete this function
     //Note: The function "checkForLinkingErrors" checks if there is
     // an error in the given program. You should use it to check if there is a
     // linking error and print it so that you can know what is wrong with the
     // program. The returned string will be empty if there is no errors.
 
-    // Link program
-    glLinkProgram(this->program);
     // Check linking errors
     std::string linkError = checkForLinkingErrors(this->program);
     if(!linkError.empty()){
@@ -65,9 +145,43 @@ bool our::ShaderProgram::link() const {
         return false;
     }
 
+    linked = true;
+    if(!cacheName.empty()) shader_cache::store(this->program, cacheName, cacheKey);
     return true;
 }
 
+size_t our::ShaderProgram::updateLinking() {
+    // "finishLink" removes the program from the list, so we go over a copy
+    std::vector<ShaderProgram*> programs = linkingPrograms;
+    for(ShaderProgram* program : programs){
+        if(program->isReady()) program->finishLink();
+    }
+    return linkingPrograms.size();
+}
+
+void our::ShaderProgram::finishLinking() {
+    while(!linkingPrograms.empty()) linkingPrograms.back()->finishLink();
+}
+
+our::ShaderProgram* our::ShaderProgram::getVariant(const std::vector<std::string>& features) {
+    std::vector<std::string> variantDefines = defines;
+    variantDefines.insert(variantDefines.end(), features.begin(), features.end());
+    variantDefines = normalizeDefines(std::move(variantDefines));
+    if(variantDefines == defines) return this;
+    if(variantDefines == root->defines) return root;
+
+    std::string key;
+    for(const auto& define : variantDefines) key += define + ";";
+    auto& variant = root->variants[key];
+    if(!variant){
+        variant = std::make_unique<ShaderProgram>(variantDefines);
+        variant->root = root;
+        for(const auto& [type, filename] : root->stageFiles) variant->attach(filename, type);
+        variant->link();
+    }
+    return variant.get();
+}
+
 ////////////////////////////////////////////////////////////////////
 // Function to check for compilation and linking error in shaders //
 ////////////////////////////////////////////////////////////////////
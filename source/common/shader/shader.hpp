@@ -1,7 +1,11 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
@@ -15,26 +19,88 @@ namespace our {
         //Shader Program Handle (OpenGL object name)
         GLuint program;
 
+        // The sources of the attached stages. They are only compiled by "link" and only if the program is not in the shader cache.
+        struct Stage {
+            GLenum type;
+            std::string filename;
+            std::string source;                 // The preprocessed source (see "shader-preprocessor.hpp")
+            std::vector<std::string> files;     // The main file & its includes (by their source string number)
+        };
+        std::vector<Stage> stages;
+
+        // The files of the stages are kept so that the variants can be compiled from the same files
+        std::vector<std::pair<GLenum, std::string>> stageFiles;
+        // The defines of this program (sorted, so that the same feature set always gives the same variant)
+        std::vector<std::string> defines;
+        // The program that the variants are compiled from. It owns all the variants (by their defines), so they are deleted with it.
+        ShaderProgram* root = this;
+        std::map<std::string, std::unique_ptr<ShaderProgram>> variants;
+
+        // The stages of a program that is linking. They are kept till "finishLink" checks their compilation errors.
+        struct PendingStage {
+            GLuint shader;
+            std::string filename;
+            std::vector<std::string> files;
+        };
+        std::vector<PendingStage> pendingStages;
+        bool linking = false;                   // True from "link" till its result is checked by "finishLink"
+        bool linked = false;
+        std::string cacheName;                  // The program binary is stored in the shader cache once it is linked (if this is not empty)
+        uint64_t cacheKey = 0;
+        // The programs that are linking (the programs are only linked on the main thread, so this needs no lock)
+        static inline std::vector<ShaderProgram*> linkingPrograms;
+
+        // The program is used or queried, so we have to wait for the link if it is not checked yet
+        void ensureLinked() {
+            if(linking) finishLink();
+        }
+
     public:
         ShaderProgram(){
             //TODO: (Req 1) Create A shader program
             this->program = glCreateProgram();
         }
-        ~ShaderProgram(){
-            //TODO: (Req 1) Delete a shader program
-            glDeleteProgram(this->program);
-        }
-
-        bool attach(const std::string &filename, GLenum type) const;
-
-        bool link() const;
+        // Creates a program whose stages are compiled with the given defines (in the form "NAME" or "NAME=VALUE")
+        explicit ShaderProgram(std::vector<std::string> defines);
+        ~ShaderProgram();
+
+        // Reads the source of a stage from the given file. Returns false if the file could not be read.
+        // The compilation errors are reported by "link" (since a cached program is not compiled at all)
+        // The includes in the file are expanded and the defines of the program are added (see "shader-preprocessor.hpp")
+        bool attach(const std::string &filename, GLenum type);
+
+        // Compiles the attached stages and links the program, unless its binary is found in the shader cache (see "shader-cache.hpp")
+        // The compilation & the link are only submitted to the driver, their errors are reported when the result is checked
+        // by "finishLink" (which is done on the first use of the program at the latest)
+        bool link();
+        // Returns whether the result of the link can be checked without waiting
+        // (if the driver does not support "KHR_parallel_shader_compile", it can not tell, so this is always true)
+        bool isReady() const;
+        // Waits for the link if needed, reports the errors and returns whether the program is linked
+        bool finishLink();
+
+        // Checks the programs that finished linking and returns the number of the programs that are still linking
+        static size_t updateLinking();
+        // Waits for all the programs that are linking
+        static void finishLinking();
+        // Lets the driver compile the shaders on its own threads (if it supports "KHR_parallel_shader_compile")
+        // This should be called once after the OpenGL context is created
+        static void enableParallelCompilation();
+
+        // Returns the variant of this program that is compiled with the given defines added to the defines of this program,
+        // so the shader can drop the code of the features that are not used (e.g. a material without an emissive map does not sample it).
+        // Each variant is compiled & linked the first time it is requested and then it is reused.
+        ShaderProgram* getVariant(const std::vector<std::string>& features);
+        const std::vector<std::string>& getDefines() const { return defines; }
 
         void use() { 
+            ensureLinked();
             glUseProgram(program);
         }
 
         GLuint getUniformLocation(const std::string &name) {
             //TODO: (Req 1) Return the location of the uniform with the given name
+            ensureLinked();
             return glGetUniformLocation(this->program, name.c_str());
         }
 
@@ -68,11 +134,20 @@ namespace our {
             glUniform4fv(getUniformLocation(uniform), 1, glm::value_ptr(value));
         }
 
+        void set(const std::string &uniform, glm::ivec3 value) {
+            glUniform3iv(getUniformLocation(uniform), 1, glm::value_ptr(value));
+        }
+
         void set(const std::string &uniform, glm::mat4 matrix) {
             //TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
             glUniformMatrix4fv(getUniformLocation(uniform), 1, GL_FALSE, glm::value_ptr(matrix));
         }
 
+        // Sends an array of matrices starting at the given uniform (which should be the first element, e.g. "matrices[0]")
+        void set(const std::string &uniform, const glm::mat4* matrices, GLsizei count) {
+            if(count > 0) glUniformMatrix4fv(getUniformLocation(uniform), count, GL_FALSE, glm::value_ptr(matrices[0]));
+        }
+
         //TODO: (Req 1) Delete the copy constructor and assignment operator.
         //Question: Why do we delete the copy constructor and assignment operator?
         ShaderProgram(const ShaderProgram&) = delete;
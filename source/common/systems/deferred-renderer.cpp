@@ -0,0 +1,118 @@
+#include "deferred-renderer.hpp"
+#include "../texture/texture-utils.hpp"
+#include "../mesh/geometry-arena.hpp"
+
+#include <iostream>
+
+namespace our {
+
+    void DeferredRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
+        ForwardRenderer::initialize(windowSize, config);
+        createSceneFrameBuffer();
+
+        // The normals need more precision than the colors (the specular highlights of the smooth surfaces are sharp)
+        albedoTarget = texture_utils::empty(GL_RGBA8, windowSize);
+        normalTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+        specularTarget = texture_utils::empty(GL_RGBA8, windowSize);
+
+        // The outputs of "light.frag": the scene color then the albedo, the normal & the specular targets
+        glGenFramebuffers(1, &gbufferFrameBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFrameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedoTarget->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normalTarget->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, specularTarget->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
+        GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+        glDrawBuffers(4, drawBuffers);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+            std::cerr << "ERROR: The G-buffer framebuffer is incomplete" << std::endl;
+        }
+
+        glGenFramebuffers(1, &lightingFrameBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingFrameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget->getOpenGLName(), 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // The lighting pass reads a single texel of each target per pixel
+        gbufferSampler = new Sampler();
+        gbufferSampler->set(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        gbufferSampler->set(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        gbufferSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gbufferSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        lightingShader = new ShaderProgram();
+        lightingShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+        lightingShader->attach("assets/shaders/deferred-lighting.frag", GL_FRAGMENT_SHADER);
+        lightingShader->link();
+    }
+
+    void DeferredRenderer::destroy(){
+        if(gbufferFrameBuffer){
+            glDeleteFramebuffers(1, &gbufferFrameBuffer);
+            glDeleteFramebuffers(1, &lightingFrameBuffer);
+            delete albedoTarget;
+            delete normalTarget;
+            delete specularTarget;
+            delete gbufferSampler;
+            delete lightingShader;
+            gbufferFrameBuffer = lightingFrameBuffer = 0;
+        }
+        ForwardRenderer::destroy();
+    }
+
+    bool DeferredRenderer::drawsInPass(const Material* material, DrawPass pass){
+        // The depth of a deferred surface must be written since the lighting pass reconstructs its position from it
+        bool deferred = !material->transparent && material->pipelineState.depthTesting.enabled && material->pipelineState.depthMask &&
+                        supportsGBuffer(material->shader);
+        if(pass == DrawPass::GBUFFER) return deferred;
+        if(pass == DrawPass::COLOR) return !deferred;
+        return ForwardRenderer::drawsInPass(material, pass);
+    }
+
+    void DeferredRenderer::shadeOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition){
+        // The G-buffer pass draws the same sorted commands (and batches) as the forward color pass would
+        // The surface targets are cleared since the lighting pass reads every pixel with a depth: a pixel covered only by a forward surface
+        // (whose depth comes from the pre-pass) would otherwise be lit with the data of an older frame before the forward pass covers it
+        // (the color target is not cleared here since it was cleared with the scene framebuffer at the start of the frame)
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFrameBuffer);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        const GLfloat clearSurface[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for(GLint target = 1; target <= 3; ++target) glClearBufferfv(GL_COLOR, target, clearSurface);
+        drawOpaqueCommands(VP, cameraPosition, DrawPass::GBUFFER);
+
+        // The lighting pass adds the light of each pixel to the ambient & emissive light (it does not test or write the depth)
+        // It is drawn outside "drawOpaqueCommands", so its samples are not counted in the overdraw of the opaque passes
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingFrameBuffer);
+        PipelineState lightingPipelineState{};
+        lightingPipelineState.blending.enabled = true;
+        lightingPipelineState.blending.sourceFactor = GL_ONE;
+        lightingPipelineState.blending.destinationFactor = GL_ONE;
+        lightingPipelineState.depthMask = false;
+        lightingPipelineState.setup();
+        lightingShader->use();
+        Texture2D* targets[] = {albedoTarget, normalTarget, specularTarget, depthTarget};
+        for(GLuint unit = 0; unit < 4; ++unit){
+            glActiveTexture(GL_TEXTURE0 + unit);
+            targets[unit]->bind();
+            gbufferSampler->bind(unit);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        lightingShader->set("gbuffer_albedo", GLint(0));
+        lightingShader->set("gbuffer_normal", GLint(1));
+        lightingShader->set("gbuffer_specular", GLint(2));
+        lightingShader->set("gbuffer_depth", GLint(3));
+        lightingShader->set("inverse_VP", glm::inverse(VP));
+        lightingShader->set("viewport_size", glm::vec2(windowSize));
+        setupLighting(lightingShader, cameraPosition);
+        GeometryArena::bindVertexArray(postProcessVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        // The materials drawn after this may not bind their own samplers
+        for(GLuint unit = 0; unit < 4; ++unit) Sampler::unbind(unit);
+
+        // The opaque commands that are not deferred are drawn forward over the lit surfaces
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
+        drawOpaqueCommands(VP, cameraPosition, DrawPass::COLOR);
+    }
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "forward-renderer.hpp"
+
+#include <string>
+
+namespace our
+{
+
+    // A deferred renderer draws the opaque lit surfaces into a G-buffer (their diffuse color, normal, specular color & roughness
+    // and their depth) then shades every pixel once in a fullscreen lighting pass.
+    // The forward renderer shades each fragment of each object with the lights of its cluster, so its cost grows with the overdraw
+    // and the number of objects times the lights. The lighting pass only loops over the lights of the cluster of each visible pixel,
+    // which is cheaper for scenes with many lights (at the cost of the memory & bandwidth of the G-buffer).
+    // The point & spot lights are still assigned to the tiles & slices of the "LightClusters", so the lighting pass shares
+    // the light data, the shadows and the shading functions of the forward shaders (see "lights.glsl").
+    // Everything else is shared with the forward renderer: the commands, their sorting & batching, the depth pre-pass,
+    // the sky, the transparent objects (which are still drawn forward) and the post processing.
+    // The opaque materials whose shaders cannot write the G-buffer (no "gbuffer" uniform) are drawn forward after the lighting pass.
+    class DeferredRenderer : public ForwardRenderer {
+        // The G-buffer shares the color & depth targets of the scene framebuffer:
+        // The color target receives the ambient & emissive light in the G-buffer pass, then the lighting pass adds the other lights
+        GLuint gbufferFrameBuffer = 0;
+        Texture2D *albedoTarget = nullptr, *normalTarget = nullptr, *specularTarget = nullptr;
+        // The lighting pass reads the depth target, so it draws into a framebuffer that only has the color target
+        GLuint lightingFrameBuffer = 0;
+        ShaderProgram* lightingShader = nullptr;
+        Sampler* gbufferSampler = nullptr;
+
+    protected:
+        // The opaque materials that can write the G-buffer are drawn in the G-buffer pass instead of the color pass
+        bool drawsInPass(const Material* material, DrawPass pass) override;
+        // Draws the G-buffer, the lighting pass then the opaque commands that are not deferred
+        void shadeOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition) override;
+
+    public:
+        // The config is the same as the forward renderer (the scene framebuffer is always created since the G-buffer shares it)
+        void initialize(glm::ivec2 windowSize, const nlohmann::json& config) override;
+        void destroy() override;
+    };
+
+    // This function returns a new renderer instance based on the given type ("forward" or "deferred")
+    inline ForwardRenderer* createRendererFromType(const std::string& type){
+        if(type == "deferred"){
+            return new DeferredRenderer();
+        } else {
+            return new ForwardRenderer();
+        }
+    }
+
+}
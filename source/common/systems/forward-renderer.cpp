@@ -1,7 +1,12 @@
 #include "forward-renderer.hpp"
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
+#include "../texture/texture-streamer.hpp"
 #include "../components/light.hpp"
+#include "../mesh/geometry-arena.hpp"
+
+#include <cmath>
+#include <iostream>
 
 namespace our {
 
@@ -9,6 +14,38 @@ namespace our {
         // First, we store the window size for later use
         this->windowSize = windowSize;
 
+        // Create the light clusters (the grid size can be changed via the "lightClusters" key in the configuration)
+        lightClusters.initialize(config.value("lightClusters", nlohmann::json::object()));
+        // Create the shadow maps (the shadows are only enabled if the configuration has a "shadows" object)
+        shadowMaps.initialize(config.value("shadows", nlohmann::json()));
+
+        // If requested, the opaque commands are drawn with a few glMultiDrawElementsIndirect calls (this needs OpenGL 4.3 or the equivalent extensions)
+        if(config.value("multiDrawIndirect", false)){
+            if(GeometryArena::supportsMultiDrawIndirect()){
+                multiDrawIndirect = true;
+                glGenBuffers(1, &objectBuffer);
+                glBindBuffer(GL_TEXTURE_BUFFER, objectBuffer);
+                glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+                glGenTextures(1, &objectTexture);
+                glBindTexture(GL_TEXTURE_BUFFER, objectTexture);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, objectBuffer);
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+                glBindBuffer(GL_TEXTURE_BUFFER, 0);
+                glGenBuffers(1, &indirectBuffer);
+            } else {
+                std::cerr << "Multi draw indirect is not supported by the OpenGL context, falling back to a draw call per object" << std::endl;
+            }
+        }
+
+        // The opaque commands can be drawn after a depth pre-pass and the cost of the opaque passes can be measured
+        depthPrepass = config.value("depthPrepass", false);
+        profileOpaquePass = config.value("profileOpaquePass", false);
+        if(profileOpaquePass){
+            glGenQueries(QUERY_FRAMES, prepassQueries);
+            glGenQueries(QUERY_FRAMES, shadingQueries);
+            glGenQueries(QUERY_FRAMES * SAMPLE_PASSES, &sampleQueries[0][0]);
+        }
+
         // Then we check if there is a sky texture in the configuration
         if(config.contains("sky")){
             // First, we create a sphere which will be used to draw the sky
@@ -53,24 +90,40 @@ namespace our {
             this->skyMaterial->transparent = false;
         }
 
-        // Then we check if there is a postprocessing shader in the configuration
-        if(config.contains("postprocess")){
-            //TODO: (Req 11) Create a framebuffer
-            glGenFramebuffers(1, &postprocessFrameBuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, postprocessFrameBuffer);
-            //TODO: (Req 11) Create a color and a depth texture and attach them to the framebuffer
-            // Hints: The color format can be (Red, Green, Blue and Alpha components with 8 bits for each channel).
-            // The depth format can be (Depth component with 24 bits).
-            colorTarget = our::texture_utils::empty(GL_RGBA8, windowSize);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget->getOpenGLName(), 0);
-
-            depthTarget = our::texture_utils::empty(GL_DEPTH_COMPONENT24, windowSize);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
+        // The transparent objects are sorted from back to front unless the weighted blended transparency is selected
+        weightedTransparency = config.value("transparency", "sorted") == "weighted";
 
-            //TODO: (Req 11) Unbind the framebuffer just to be safe
+        // The scene needs its own framebuffer if it is post processed or if the transparency targets have to share its depth
+        if(config.contains("postprocess") || weightedTransparency) createSceneFrameBuffer();
+
+        if(weightedTransparency){
+            // The transparency targets are drawn with the depth of the scene (which is tested but not written)
+            accumulationTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+            weightTarget = texture_utils::empty(GL_R16F, windowSize);
+            glGenFramebuffers(1, &transparencyFrameBuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, transparencyFrameBuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationTarget->getOpenGLName(), 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTarget->getOpenGLName(), 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
+            GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+            glDrawBuffers(2, drawBuffers);
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            // Create a vertex array to use for drawing the texture
-            glGenVertexArrays(1, &postProcessVertexArray);
+
+            // The composite pass reads a single texel of each target per pixel
+            targetSampler = new Sampler();
+            targetSampler->set(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            targetSampler->set(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            targetSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            targetSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            compositeShader = new ShaderProgram();
+            compositeShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+            compositeShader->attach("assets/shaders/transparency-composite.frag", GL_FRAGMENT_SHADER);
+            compositeShader->link();
+        }
+
+        // Then we check if there is a postprocessing shader in the configuration
+        if(config.contains("postprocess")){
 
             // Create a sampler to use for sampling the scene texture in the post processing shader
             Sampler* postprocessSampler = new Sampler();
@@ -96,7 +149,42 @@ namespace our {
         }
     }
 
+    void ForwardRenderer::createSceneFrameBuffer(){
+        if(sceneFrameBuffer) return;
+        //TODO: (Req 11) Create a framebuffer
+        glGenFramebuffers(1, &sceneFrameBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
+        //TODO: (Req 11) Create a color and a depth texture and attach them to the framebuffer
+        // Hints: The color format can be (Red, Green, Blue and Alpha components with 8 bits for each channel).
+        // The depth format can be (Depth component with 24 bits).
+        colorTarget = our::texture_utils::empty(GL_RGBA8, windowSize);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget->getOpenGLName(), 0);
+
+        depthTarget = our::texture_utils::empty(GL_DEPTH_COMPONENT24, windowSize);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
+
+        //TODO: (Req 11) Unbind the framebuffer just to be safe
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // Create a vertex array to use for drawing the fullscreen triangles
+        glGenVertexArrays(1, &postProcessVertexArray);
+    }
+
     void ForwardRenderer::destroy(){
+        lightClusters.destroy();
+        shadowMaps.destroy();
+        if(profileOpaquePass){
+            glDeleteQueries(QUERY_FRAMES, prepassQueries);
+            glDeleteQueries(QUERY_FRAMES, shadingQueries);
+            glDeleteQueries(QUERY_FRAMES * SAMPLE_PASSES, &sampleQueries[0][0]);
+            std::fill(std::begin(queriesIssued), std::end(queriesIssued), false);
+            profileOpaquePass = false;
+        }
+        if(multiDrawIndirect){
+            glDeleteTextures(1, &objectTexture);
+            glDeleteBuffers(1, &objectBuffer);
+            glDeleteBuffers(1, &indirectBuffer);
+            multiDrawIndirect = false;
+        }
         // Delete all objects related to the sky
         if(skyMaterial){
             delete skySphere;
@@ -105,15 +193,29 @@ namespace our {
             delete skyMaterial->sampler;
             delete skyMaterial;
         }
+        // Delete all objects related to the weighted blended transparency
+        if(weightedTransparency){
+            glDeleteFramebuffers(1, &transparencyFrameBuffer);
+            delete accumulationTarget;
+            delete weightTarget;
+            delete targetSampler;
+            delete compositeShader;
+            weightedTransparency = false;
+        }
         // Delete all objects related to post processing
         if(postprocessMaterial){
-            glDeleteFramebuffers(1, &postprocessFrameBuffer);
-            glDeleteVertexArrays(1, &postProcessVertexArray);
-            delete colorTarget;
-            delete depthTarget;
             delete postprocessMaterial->sampler;
             delete postprocessMaterial->shader;
             delete postprocessMaterial;
+            postprocessMaterial = nullptr;
+        }
+        if(sceneFrameBuffer){
+            glDeleteFramebuffers(1, &sceneFrameBuffer);
+            GeometryArena::bindVertexArray(0);
+            glDeleteVertexArrays(1, &postProcessVertexArray);
+            delete colorTarget;
+            delete depthTarget;
+            sceneFrameBuffer = 0;
         }
     }
 
@@ -122,6 +224,9 @@ namespace our {
         CameraComponent* camera = nullptr;
         opaqueCommands.clear();
         transparentCommands.clear();
+        blendedCommands.clear();
+        gbufferShaders.clear();
+        shadowCasters.clear();
         std::vector<LightComponent*> lights;
         for(auto entity : world->getEntities()){
             // If we hadn't found a camera yet, we look for a camera in this entity
@@ -133,18 +238,33 @@ namespace our {
 
             // If this entity has a mesh renderer component
             if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer && meshRenderer->enabled){
-                // We construct a command from it
+                // Getting the mesh loads it if it was deferred (and it is skipped if it could not be loaded)
+                Mesh* mesh = meshRenderer->mesh.get();
+                if(!mesh) continue;
+                // We construct a command from it for each submesh (since each submesh can have its own material)
                 RenderCommand command;
                 command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
                 command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
-                command.mesh = meshRenderer->mesh;
-                command.material = meshRenderer->material;
-                // if it is transparent, we add it to the transparent commands list
-                if(command.material->transparent){
-                    transparentCommands.push_back(command);
-                } else {
-                // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
+                command.mesh = mesh;
+                bool castShadows = shadowMaps.isEnabled() && meshRenderer->castShadows;
+                float scale = std::max({glm::length(glm::vec3(command.localToWorld[0])), glm::length(glm::vec3(command.localToWorld[1])),
+                                        glm::length(glm::vec3(command.localToWorld[2]))});
+                for(size_t submesh = 0; submesh < command.mesh->getSubmeshCount(); ++submesh){
+                    command.submesh = submesh;
+                    command.material = command.batchMaterial = meshRenderer->getMaterial(submesh);
+                    if(!command.material) continue;
+                    // if it is transparent, we add it to the transparent commands list
+                    if(command.material->transparent){
+                        transparentCommands.push_back(command);
+                    } else {
+                    // Otherwise, we add it to the opaque command list
+                        opaqueCommands.push_back(command);
+                        // Only the opaque submeshes cast shadows
+                        if(castShadows){
+                            shadowCasters.push_back({command.localToWorld, command.center, mesh->getBoundingRadius() * scale,
+                                                     mesh, submesh, meshRenderer->isStatic});
+                        }
+                    }
                 }
             }
         }
@@ -156,6 +276,17 @@ namespace our {
         // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
         auto M = camera->getOwner()->getLocalToWorldMatrix();
         glm::vec3 cameraForward = glm::vec3(M * glm::vec4(0, 0, -1, 0));
+        // With the weighted blended transparency, the order of the transparent commands does not matter,
+        // so only the commands whose shaders do not support it are left to be sorted
+        if(weightedTransparency){
+            blendedShaders.clear();
+            size_t sortedCount = 0;
+            for(auto& command : transparentCommands){
+                if(supportsWeightedBlending(command.material->shader)) blendedCommands.push_back(command);
+                else transparentCommands[sortedCount++] = command;
+            }
+            transparentCommands.resize(sortedCount);
+        }
         std::sort(transparentCommands.begin(), transparentCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
             //TODO: (Req 9) Finish this function
             // HINT: the following return should return true "first" should be drawn before "second". 
@@ -165,8 +296,18 @@ namespace our {
         });
 
         //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
-        glm::mat4 VP = camera->getProjectionMatrix(windowSize) * camera->getViewMatrix();
+        glm::mat4 view = camera->getViewMatrix();
+        glm::mat4 projection = camera->getProjectionMatrix(windowSize);
+        glm::mat4 VP = projection * view;
         glm::vec3 cameraPosition = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
+
+        // The streamed textures only get the levels that can be seen at the current sizes of their objects on the screen
+        requestTextureLevels(projection, cameraPosition);
+
+        // Draw the shadow maps then assign the lights (with the indices of their shadow maps) to the clusters of the camera frustum
+        shadowMaps.update(shadowCasters, lights, shadowIndices, M, projection, camera->near, camera->far);
+        lightClusters.update(lights, shadowIndices, M, view, projection, camera->near, camera->far, windowSize);
+        litShaders.clear();
         //TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
         glViewport(0, 0, windowSize.x, windowSize.y);
         //TODO: (Req 9) Set the clear color to black and the clear depth to 1
@@ -176,62 +317,57 @@ namespace our {
         glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         glDepthMask(GL_TRUE);
 
-        // If there is a postprocess material, bind the framebuffer
-        if(postprocessMaterial){
+        // If the scene has its own framebuffer, bind it
+        if(sceneFrameBuffer){
             //TODO: (Req 11) bind the framebuffer
-            glBindFramebuffer(GL_FRAMEBUFFER, postprocessFrameBuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
         }
 
         //TODO: (Req 9) Clear the color and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         //TODO: (Req 9) Draw all the opaque commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        std::sort(opaqueCommands.begin(), opaqueCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
-            //TODO: (Req 9) Finish this function
-            // HINT: the following return should return true "first" should be drawn before "second". 
-            if(glm::dot(first.center, cameraForward) < glm::dot(second.center, cameraForward))
-                return true;
-            return false;
-        });
-        for(auto& command : opaqueCommands){
-            command.material->setup();
-            glm::mat4 M = command.localToWorld;
-            glm::mat4 MVP = VP * M;
-            command.material->shader->set("transform", MVP);
-            
-            // Set light uniforms
-            command.material->shader->set("M", M);
-            command.material->shader->set("M_IT", glm::transpose(glm::inverse(M)));
-            command.material->shader->set("VP", VP);
-            command.material->shader->set("camera_position", cameraPosition);
-            command.material->shader->set("light_count", (int)lights.size());
-            command.material->shader->set("ambient_light", glm::vec3(0.1f)); // Default ambient
-
-            for(int i = 0; i < lights.size(); ++i){
-                LightComponent* light = lights[i];
-                glm::vec3 lightPos = light->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
-
-                std::string prefix = "lights[" + std::to_string(i) + "].";
-                command.material->shader->set(prefix + "type", (int)lights[i]->lightType);
-                command.material->shader->set(prefix + "position", lightPos);
-
-                if (light->lightType == LightType::DIRECTIONAL) {
-                    glm::vec3 direction = glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, -1, 0));
-                    command.material->shader->set(prefix + "direction", glm::normalize(direction));
-                }
-                else if (light->lightType == LightType::SPOT) {
-                    glm::vec3 direction = glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, -1, 0));
-                    command.material->shader->set(prefix + "direction", glm::normalize(direction));
-                    command.material->shader->set(prefix + "inner_cone", glm::radians(lights[i]->innerCone));
-                    command.material->shader->set(prefix + "outer_cone", glm::radians(lights[i]->outerCone));
-                }
-
-                command.material->shader->set(prefix + "color", lights[i]->color * lights[i]->intensity);
-                command.material->shader->set(prefix + "attenuation", lights[i]->attenuation);
-
-            }
-
-            command.mesh->draw();
+        // The queries of this frame reuse the set of an older frame, so its results are read first
+        querySet = queryFrame;
+        queryFrame = (queryFrame + 1) % QUERY_FRAMES;
+        if(profileOpaquePass && queriesIssued[querySet]) readOpaqueQueries(querySet);
+        if(multiDrawIndirect){
+            // The commands that share a batch material, an arena page and an element type can be drawn together,
+            // so they are sorted by these keys. Within a batch, the opaque commands are still sorted from front to back.
+            // The blended transparent commands are batched the same way (their order inside a batch does not matter).
+            assignBatchMaterials(opaqueCommands);
+            sortByBatch(opaqueCommands, cameraForward);
+            assignBatchMaterials(blendedCommands);
+            sortByBatch(blendedCommands, glm::vec3(0.0f));
+            objectData.clear();
+            indirectCommands.clear();
+            opaqueBatchedCount = appendBatchData(opaqueCommands);
+            blendedBatchedCount = appendBatchData(blendedCommands);
+            uploadBatchData();
+        } else {
+            std::sort(opaqueCommands.begin(), opaqueCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
+                //TODO: (Req 9) Finish this function
+                // HINT: the following return should return true "first" should be drawn before "second". 
+                if(glm::dot(first.center, cameraForward) < glm::dot(second.center, cameraForward))
+                    return true;
+                return false;
+            });
+        }
+        // The depth pre-pass draws the same sorted commands (and batches) as the color pass
+        if(depthPrepass){
+            if(profileOpaquePass) glBeginQuery(GL_TIME_ELAPSED, prepassQueries[querySet]);
+            drawOpaqueCommands(VP, cameraPosition, DrawPass::DEPTH_ONLY);
+            if(profileOpaquePass) glEndQuery(GL_TIME_ELAPSED);
+        }
+        if(profileOpaquePass){
+            glBeginQuery(GL_TIME_ELAPSED, shadingQueries[querySet]);
+            std::fill(std::begin(samplesIssued[querySet]), std::end(samplesIssued[querySet]), false);
+        }
+        shadeOpaqueCommands(VP, cameraPosition);
+        if(profileOpaquePass){
+            glEndQuery(GL_TIME_ELAPSED);
+            queriesIssued[querySet] = true;
+            prepassIssued[querySet] = depthPrepass;
         }
         // If there is a sky material, draw the sky
         if(this->skyMaterial){
@@ -256,46 +392,12 @@ namespace our {
             //TODO: (Req 10) draw the sky sphere
             skySphere->draw();
         }
+        // The blended transparent commands are composited first, then the sorted ones are drawn over them
+        if(!blendedCommands.empty()) drawWeightedTransparency(VP, cameraPosition);
         //TODO: (Req 9) Draw all the transparent commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
         for(auto& command : transparentCommands){
-            command.material->setup();
-            glm::mat4 M = command.localToWorld;
-            glm::mat4 MVP = VP * M;
-            command.material->shader->set("transform", MVP);
-
-            // Set light uniforms
-            LitMaterial *litMaterial = dynamic_cast<LitMaterial *>(command.material);
-            command.material->shader->set("M", M);
-            command.material->shader->set("M_IT", glm::transpose(glm::inverse(M)));
-            command.material->shader->set("VP", VP);
-            command.material->shader->set("camera_position", cameraPosition);
-            command.material->shader->set("light_count", (int)lights.size());
-            command.material->shader->set("ambient_light", glm::vec3(0.1f)); // Default ambient
-
-            for(int i = 0; i < lights.size(); ++i){
-                std::string prefix = "lights[" + std::to_string(i) + "].";
-                command.material->shader->set(prefix + "type", (int)lights[i]->lightType);
-
-                glm::vec3 lightPos = lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
-                command.material->shader->set(prefix + "position", lightPos);
-
-                if (lights[i]->lightType == LightType::DIRECTIONAL) {
-                    glm::vec3 direction = glm::vec3(lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, -1, 0));
-                    command.material->shader->set(prefix + "direction", glm::normalize(direction));
-                }
-                else if (lights[i]->lightType == LightType::SPOT) {
-                    glm::vec3 direction = glm::vec3(lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, -1, 0));
-                    command.material->shader->set(prefix + "direction", glm::normalize(direction));
-                    command.material->shader->set(prefix + "inner_cone", glm::radians(lights[i]->innerCone));
-                    command.material->shader->set(prefix + "outer_cone", glm::radians(lights[i]->outerCone));
-                }
-
-                command.material->shader->set(prefix + "color", lights[i]->color * lights[i]->intensity);
-                command.material->shader->set(prefix + "attenuation", lights[i]->attenuation);
-            }
-
-            command.mesh->draw();
+            drawCommand(command, VP, cameraPosition);
         }
 
         // If there is a postprocess material, apply postprocessing
@@ -304,12 +406,329 @@ namespace our {
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
             //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
             postprocessMaterial->setup();
-            glBindVertexArray(postProcessVertexArray);
+            GeometryArena::bindVertexArray(postProcessVertexArray);
 
             glDrawArrays(GL_TRIANGLES, 0, 3);
+        } else if(sceneFrameBuffer){
+            // Without postprocessing, the scene is copied as is to the window
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFrameBuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBlitFramebuffer(0, 0, windowSize.x, windowSize.y, 0, 0, windowSize.x, windowSize.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+    }
+
+    void ForwardRenderer::drawOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass){
+        // The samples of the color & the G-buffer passes are counted to measure the overdraw (the depth pre-pass is not shaded)
+        int samplePass = pass == DrawPass::COLOR ? 0 : pass == DrawPass::GBUFFER ? 1 : -1;
+        bool countSamples = profileOpaquePass && samplePass >= 0;
+        if(countSamples) glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[querySet][samplePass]);
+        if(multiDrawIndirect){
+            drawBatches(opaqueCommands, 0, opaqueBatchedCount, VP, cameraPosition, pass);
+        } else {
+            for(auto& command : opaqueCommands){
+                if(drawsInPass(command.material, pass)) drawCommand(command, VP, cameraPosition, pass);
+            }
+        }
+        if(countSamples){
+            glEndQuery(GL_SAMPLES_PASSED);
+            samplesIssued[querySet][samplePass] = true;
+        }
+    }
+
+    void ForwardRenderer::shadeOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition){
+        drawOpaqueCommands(VP, cameraPosition, DrawPass::COLOR);
+    }
+
+    void ForwardRenderer::drawWeightedTransparency(const glm::mat4& VP, const glm::vec3& cameraPosition){
+        // The accumulation starts with no color and a full revealage, and the weights start at zero
+        glBindFramebuffer(GL_FRAMEBUFFER, transparencyFrameBuffer);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        const GLfloat clearAccumulation[] = {0.0f, 0.0f, 0.0f, 1.0f}, clearWeight[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+        glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+        if(multiDrawIndirect){
+            drawBatches(blendedCommands, opaqueBatchedCount, blendedBatchedCount, VP, cameraPosition, DrawPass::WEIGHTED_BLENDED);
+        } else {
+            for(auto& command : blendedCommands) drawCommand(command, VP, cameraPosition, DrawPass::WEIGHTED_BLENDED);
+        }
+
+        // Composite the average color of the transparent layers over the scene with the coverage given by the revealage
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
+        PipelineState compositePipelineState{};
+        compositePipelineState.blending.enabled = true;
+        compositePipelineState.depthMask = false;
+        compositePipelineState.setup();
+        compositeShader->use();
+        glActiveTexture(GL_TEXTURE0);
+        accumulationTarget->bind();
+        targetSampler->bind(0);
+        glActiveTexture(GL_TEXTURE1);
+        weightTarget->bind();
+        targetSampler->bind(1);
+        glActiveTexture(GL_TEXTURE0);
+        compositeShader->set("accumulation", GLint(0));
+        compositeShader->set("weights", GLint(1));
+        GeometryArena::bindVertexArray(postProcessVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        // The materials drawn after this may not bind their own samplers
+        Sampler::unbind(0);
+        Sampler::unbind(1);
+    }
+
+    void ForwardRenderer::requestTextureLevels(const glm::mat4& projection, const glm::vec3& cameraPosition){
+        auto& streamer = TextureStreamer::get();
+        // The size of an object on the screen is divided by its distance unless the projection is orthographic
+        bool orthographic = projection[3][3] == 1.0f;
+        float pixelsPerUnit = projection[1][1] * float(windowSize.y) * 0.5f;
+        for(auto commands : {&opaqueCommands, &transparentCommands, &blendedCommands}){
+            for(const auto& command : *commands){
+                // We assume that the texture is mapped once over the mesh, so it covers the diameter of the bounding sphere on the screen
+                // If the bounds are unknown (or the camera is inside the sphere), the full resolution is requested
+                float scale = std::max({glm::length(glm::vec3(command.localToWorld[0])), glm::length(glm::vec3(command.localToWorld[1])),
+                                        glm::length(glm::vec3(command.localToWorld[2]))});
+                float radius = command.mesh->getBoundingRadius() * scale;
+                float distance = orthographic ? 1.0f : glm::distance(cameraPosition, command.center) - radius;
+                float screenPixels = radius > 0.0f && distance > 0.0f ? 2.0f * radius * pixelsPerUnit / distance : INFINITY;
+                commandTextures.clear();
+                command.material->collectTextures(commandTextures);
+                for(Texture2D* texture : commandTextures) streamer.request(texture, screenPixels);
+            }
+        }
+    }
+
+    void ForwardRenderer::setupLighting(ShaderProgram* shader, const glm::vec3& cameraPosition){
+        if(std::find(litShaders.begin(), litShaders.end(), shader) != litShaders.end()) return;
+        litShaders.push_back(shader);
+        shader->set("camera_position", cameraPosition);
+        shader->set("ambient_light", glm::vec3(0.1f)); // Default ambient
+        // The material uses the texture units 0 to 4, so the light texture buffers use the units 5 to 7
+        lightClusters.setup(shader, 5);
+        // The unit 8 holds the object data of the batches, so the shadow maps use the units 9 & 10
+        shadowMaps.setup(shader, 9);
+    }
+
+    bool ForwardRenderer::usesDepthPrepass(const Material* material) const {
+        // The material must write its depth (and be tested against it) for the equal test of the color pass to work
+        return depthPrepass && !material->transparent && material->pipelineState.depthTesting.enabled &&
+               material->pipelineState.depthMask && material->getDepthShader();
+    }
+
+    bool ForwardRenderer::supportsWeightedBlending(ShaderProgram* shader){
+        auto it = std::find_if(blendedShaders.begin(), blendedShaders.end(), [shader](const auto& entry){ return entry.first == shader; });
+        if(it != blendedShaders.end()) return it->second;
+        bool supported = GLint(shader->getUniformLocation("weighted_oit")) >= 0;
+        blendedShaders.emplace_back(shader, supported);
+        return supported;
+    }
+
+    bool ForwardRenderer::supportsGBuffer(ShaderProgram* shader){
+        auto it = std::find_if(gbufferShaders.begin(), gbufferShaders.end(), [shader](const auto& entry){ return entry.first == shader; });
+        if(it != gbufferShaders.end()) return it->second;
+        bool supported = GLint(shader->getUniformLocation("gbuffer")) >= 0;
+        gbufferShaders.emplace_back(shader, supported);
+        return supported;
+    }
+
+    bool ForwardRenderer::drawsInPass(const Material* material, DrawPass pass){
+        return pass != DrawPass::DEPTH_ONLY || usesDepthPrepass(material);
+    }
 
-            glBindVertexArray(0);
+    ShaderProgram* ForwardRenderer::setupMaterial(const Material* material, DrawPass pass){
+        if(pass == DrawPass::DEPTH_ONLY){
+            ShaderProgram* shader = material->getDepthShader();
+            material->pipelineState.setup();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            shader->use();
+            return shader;
         }
+        material->setup();
+        // The shaders that support the weighted blended transparency or the G-buffer must be told which outputs to write
+        // (the uniforms are stored per program, so a program used by both renderers must be reset for the color pass)
+        if(weightedTransparency && material->transparent) material->shader->set("weighted_oit", GLint(pass == DrawPass::WEIGHTED_BLENDED));
+        if(!material->transparent && supportsGBuffer(material->shader)) material->shader->set("gbuffer", GLint(pass == DrawPass::GBUFFER));
+        if(pass == DrawPass::WEIGHTED_BLENDED){
+            // The colors are added to the accumulation (RGB) while the revealage (A) is multiplied by the transparency of each fragment.
+            // The weight target has a single channel, so the same factors add the weighted alphas to it.
+            glEnable(GL_BLEND);
+            glBlendEquation(GL_FUNC_ADD);
+            glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+        } else if(usesDepthPrepass(material)){
+            // The depth is already written by the pre-pass, so only the visible fragments pass the test (and are shaded)
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        return material->shader;
+    }
+
+    void ForwardRenderer::drawCommand(const RenderCommand& command, const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass){
+        ShaderProgram* shader = setupMaterial(command.material, pass);
+        // The dequantization matrix returns the packed positions to the local space (it is the identity for the standard format)
+        glm::mat4 M = command.localToWorld * command.mesh->getDequantizationMatrix();
+        glm::mat4 MVP = VP * M;
+        shader->set("transform", MVP);
+
+        // Set the object uniforms then the lighting uniforms
+        // The normals are not quantized, so their matrix is computed from the original model matrix
+        shader->set("M", M);
+        shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
+        shader->set("VP", VP);
+        shader->set("oct_normals", GLint(command.mesh->hasOctahedralNormals()));
+        // The shaders that support batching must read the matrices from the uniforms for single draws
+        if(multiDrawIndirect) shader->set("multi_draw", GLint(false));
+        // The G-buffer pass also needs the lighting uniforms for the ambient light (and the samplers of the lights must be valid)
+        if(pass != DrawPass::DEPTH_ONLY) setupLighting(shader, cameraPosition);
+
+        command.mesh->drawSubmesh(command.submesh);
+    }
+
+    void ForwardRenderer::assignBatchMaterials(std::vector<RenderCommand>& commands){
+        // There are only a few distinct materials, so each one is compared with the batch materials found so far
+        std::vector<Material*> batchMaterials;
+        for(size_t index = 0; index < commands.size(); ++index){
+            RenderCommand& command = commands[index];
+            // Consecutive commands usually come from the same kind of entities, so we skip the search if the material did not change
+            if(index > 0 && commands[index - 1].material == command.material){
+                command.batchMaterial = commands[index - 1].batchMaterial;
+                continue;
+            }
+            auto it = std::find_if(batchMaterials.begin(), batchMaterials.end(), [&](Material* material){
+                return command.material->canBatchWith(material);
+            });
+            if(it == batchMaterials.end()) it = batchMaterials.insert(batchMaterials.end(), command.material);
+            command.batchMaterial = *it;
+        }
+    }
+
+    void ForwardRenderer::sortByBatch(std::vector<RenderCommand>& commands, const glm::vec3& cameraForward){
+        // The meshes that are not stored in the arena have an invalid page, so they end up after the batchable commands of their material
+        std::sort(commands.begin(), commands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
+            if(first.batchMaterial != second.batchMaterial) return first.batchMaterial < second.batchMaterial;
+            if(first.mesh->getPage() != second.mesh->getPage()) return first.mesh->getPage() < second.mesh->getPage();
+            GLenum firstType = first.mesh->getSubmesh(first.submesh).elementType, secondType = second.mesh->getSubmesh(second.submesh).elementType;
+            if(firstType != secondType) return firstType < secondType;
+            return glm::dot(first.center, cameraForward) < glm::dot(second.center, cameraForward);
+        });
+    }
+
+    size_t ForwardRenderer::appendBatchData(const std::vector<RenderCommand>& commands){
+        // The draw index is limited by the size of the draw id buffer, so any extra commands will be drawn one by one
+        size_t firstDraw = indirectCommands.size();
+        size_t batchedCount = std::min<size_t>(commands.size(), GeometryArena::MAX_DRAW_IDS - std::min<size_t>(firstDraw, GeometryArena::MAX_DRAW_IDS));
+        objectData.resize(OBJECT_DATA_TEXELS * (firstDraw + batchedCount));
+        indirectCommands.resize(firstDraw + batchedCount);
+        for(size_t index = 0; index < batchedCount; ++index){
+            const RenderCommand& command = commands[index];
+            glm::mat4 M = command.localToWorld * command.mesh->getDequantizationMatrix();
+            glm::mat4 M_IT = glm::transpose(glm::inverse(command.localToWorld));
+            glm::vec4* data = &objectData[OBJECT_DATA_TEXELS * (firstDraw + index)];
+            for(int column = 0; column < 4; ++column){
+                data[column] = M[column];
+                data[4 + column] = M_IT[column];
+            }
+            // The materials in a batch can differ in the region of their packed texture, so it is sent per draw
+            const TextureRegion* region = command.material->getBatchRegion();
+            data[8] = region ? region->rect : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            data[9] = glm::vec4(region ? float(region->layer) : 0.0f, 0.0f, 0.0f, 0.0f);
+            // The commands that cannot be batched still get an indirect command (which is never drawn) to keep the indices aligned
+            const Submesh& submesh = command.mesh->getSubmesh(command.submesh);
+            DrawElementsIndirectCommand& indirect = indirectCommands[firstDraw + index];
+            indirect.count = GLuint(submesh.elementCount);
+            indirect.instanceCount = 1;
+            indirect.firstIndex = GLuint(submesh.elementOffset / Mesh::getElementTypeSize(submesh.elementType));
+            indirect.baseVertex = submesh.baseVertex;
+            indirect.baseInstance = GLuint(firstDraw + index);
+        }
+        return batchedCount;
+    }
+
+    void ForwardRenderer::uploadBatchData(){
+        if(indirectCommands.empty()) return;
+        // The buffers are orphaned before uploading so we don't wait for the previous frame draws to finish reading them
+        glBindBuffer(GL_TEXTURE_BUFFER, objectBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, objectData.size() * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, objectData.size() * sizeof(glm::vec4), objectData.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCommands.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, indirectCommands.size() * sizeof(DrawElementsIndirectCommand), indirectCommands.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void ForwardRenderer::drawBatches(const std::vector<RenderCommand>& commands, size_t firstDraw, size_t batchedCount,
+                                      const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass){
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        // The material uses the texture units 0 to 4 and the lights use the units 5 to 7, so the object data uses the unit 8
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_BUFFER, objectTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        bool depthOnly = pass == DrawPass::DEPTH_ONLY;
+        size_t start = 0;
+        while(start < batchedCount){
+            // Find the end of the batch (the commands sharing the batch material, the page and the element type of the first one)
+            const RenderCommand& first = commands[start];
+            GLenum elementType = first.mesh->getSubmesh(first.submesh).elementType;
+            size_t end = start + 1;
+            while(end < batchedCount && commands[end].batchMaterial == first.batchMaterial &&
+                  commands[end].mesh->getPage() == first.mesh->getPage() &&
+                  commands[end].mesh->getSubmesh(commands[end].submesh).elementType == elementType) ++end;
+
+            // The materials of a batch can be batched together, so they are either all drawn in the pass or none of them is
+            if(!drawsInPass(first.material, pass)){
+                start = end;
+                continue;
+            }
+            ShaderProgram* shader = depthOnly ? first.material->getDepthShader() : first.material->shader;
+            // Only the arena submeshes can be batched and only by the shaders that can read the matrices from the object data (have a "multi_draw" uniform)
+            // Since the meshes outside the arena have an invalid page, they never share a batch with an arena mesh
+            if(first.mesh->isBatchable(first.submesh) && GLint(shader->getUniformLocation("multi_draw")) >= 0){
+                setupMaterial(first.material, pass);
+                shader->set("multi_draw", GLint(true));
+                shader->set("object_data", GLint(8));
+                shader->set("VP", VP);
+                // All the meshes in a page share the vertex format
+                shader->set("oct_normals", GLint(first.mesh->hasOctahedralNormals()));
+                if(!depthOnly) setupLighting(shader, cameraPosition);
+                GeometryArena::get().bind(first.mesh->getPage());
+                glMultiDrawElementsIndirect(GL_TRIANGLES, elementType,
+                                            (void*)((firstDraw + start) * sizeof(DrawElementsIndirectCommand)), GLsizei(end - start), 0);
+            } else {
+                for(size_t index = start; index < end; ++index) drawCommand(commands[index], VP, cameraPosition, pass);
+            }
+            start = end;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        for(size_t index = batchedCount; index < commands.size(); ++index){
+            if(drawsInPass(commands[index].material, pass)) drawCommand(commands[index], VP, cameraPosition, pass);
+        }
+    }
+
+    void ForwardRenderer::readOpaqueQueries(int frame){
+        // If the results are not ready yet, the frame is skipped instead of waiting for the GPU
+        // (the time query ends after all the other queries of the frame, so its result is the last one to be ready)
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(shadingQueries[frame], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) return;
+        GLuint64 prepassTime = 0, shadingTime = 0, samples = 0;
+        if(prepassIssued[frame]) glGetQueryObjectui64v(prepassQueries[frame], GL_QUERY_RESULT, &prepassTime);
+        glGetQueryObjectui64v(shadingQueries[frame], GL_QUERY_RESULT, &shadingTime);
+        for(int samplePass = 0; samplePass < SAMPLE_PASSES; ++samplePass){
+            if(!samplesIssued[frame][samplePass]) continue;
+            GLuint64 passSamples = 0;
+            glGetQueryObjectui64v(sampleQueries[frame][samplePass], GL_QUERY_RESULT, &passSamples);
+            samples += passSamples;
+        }
+
+        // The values are smoothed with an exponential moving average so they can be read on the screen
+        auto average = [](double& value, double sample){ value += (sample - value) * 0.05; };
+        opaqueStats.depthPrepass = prepassIssued[frame];
+        average(opaqueStats.prepassMilliseconds, prepassTime * 1e-6);
+        average(opaqueStats.shadingMilliseconds, shadingTime * 1e-6);
+        average(opaqueStats.overdraw, double(samples) / (double(windowSize.x) * windowSize.y));
     }
 
-}
\ No newline at end of file
+}
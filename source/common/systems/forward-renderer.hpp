@@ -4,6 +4,8 @@
 #include "../components/camera.hpp"
 #include "../components/mesh-renderer.hpp"
 #include "../asset-loader.hpp"
+#include "light-clusters.hpp"
+#include "shadow-maps.hpp"
 
 #include <glad/gl.h>
 #include <vector>
@@ -19,14 +21,43 @@ namespace our
         glm::mat4 localToWorld;
         glm::vec3 center;
         Mesh* mesh;
+        size_t submesh;     // The index of the submesh that should be drawn
         Material* material;
+        Material* batchMaterial;    // The material whose setup is used when the command is drawn in a batch (see "Material::canBatchWith")
+    };
+
+    // The layout of a single draw in the indirect buffer read by glMultiDrawElementsIndirect (defined by OpenGL)
+    struct DrawElementsIndirectCommand {
+        GLuint count;           // The number of elements to draw
+        GLuint instanceCount;   // We always draw a single instance
+        GLuint firstIndex;      // The index (not the byte offset) of the first element in the element buffer
+        GLint baseVertex;       // The value added to each element before reading the vertex
+        GLuint baseInstance;    // We use it as the index of the draw (it is read from the draw id attribute)
+    };
+
+    // The passes in which a command can be drawn
+    enum class DrawPass {
+        DEPTH_ONLY,         // The depth pre-pass (see "Material::getDepthShader")
+        COLOR,              // The normal pass where the fragment shader outputs the final color
+        WEIGHTED_BLENDED,   // The weighted blended transparency where the fragment shader outputs its weighted color & alpha
+        GBUFFER,            // The G-buffer pass where the fragment shader outputs the surface data instead of shading it (see "DeferredRenderer")
+    };
+
+    // The GPU cost of the opaque passes, measured with queries when the renderer config has "profileOpaquePass": true
+    // The values are averaged over the last frames (the results are read a few frames late so that the CPU does not wait for them)
+    struct OpaquePassStats {
+        bool depthPrepass = false;
+        double prepassMilliseconds = 0;     // The GPU time of the depth pre-pass
+        double shadingMilliseconds = 0;     // The GPU time of the opaque color pass
+        double overdraw = 0;                // The samples shaded by the opaque geometry passes per pixel of the render target (the deferred lighting is left out)
     };
 
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
     // In other words, the fragment shader in the material should output the color that we should see on the screen
     // This is different from more complex renderers that could draw intermediate data to a framebuffer before computing the final color
-    // In this project, we only need to implement a forward renderer
+    // The "DeferredRenderer" extends it by shading the opaque lit surfaces in screen space, so the shared parts are protected
     class ForwardRenderer {
+    protected:
         // These window size will be used on multiple occasions (setting the viewport, computing the aspect ratio, etc.)
         glm::ivec2 windowSize;
         // These are two vectors in which we will store the opaque and the transparent commands.
@@ -34,22 +65,122 @@ namespace our
         std::vector<RenderCommand> opaqueCommands;
         std::vector<RenderCommand> transparentCommands;
         // Objects used for rendering a skybox
-        Mesh* skySphere;
-        TexturedMaterial* skyMaterial;
+        Mesh* skySphere = nullptr;
+        TexturedMaterial* skyMaterial = nullptr;
+        // The scene is drawn into its own framebuffer if it is post processed or if the transparency needs to read its depth
+        GLuint sceneFrameBuffer = 0, postProcessVertexArray = 0;
+        Texture2D *colorTarget = nullptr, *depthTarget = nullptr;
         // Objects used for Postprocessing
-        GLuint postprocessFrameBuffer, postProcessVertexArray;
-        Texture2D *colorTarget, *depthTarget;
-        TexturedMaterial* postprocessMaterial;
+        TexturedMaterial* postprocessMaterial = nullptr;
+        // Objects used for the weighted blended order independent transparency (enabled by "transparency": "weighted")
+        // The transparent objects are drawn in any order into the accumulation target (RGB: the sum of the weighted premultiplied colors,
+        // A: the product of the transparencies, i.e. the revealage) and the weight target (the sum of the weighted alphas)
+        // then they are composited over the scene in a fullscreen pass
+        bool weightedTransparency = false;
+        GLuint transparencyFrameBuffer = 0;
+        Texture2D *accumulationTarget = nullptr, *weightTarget = nullptr;
+        ShaderProgram* compositeShader = nullptr;
+        Sampler* targetSampler = nullptr;
+        // The transparent commands whose shaders support the weighted blended transparency (the others are still sorted)
+        std::vector<RenderCommand> blendedCommands;
+        // Whether each shader found this frame has the "weighted_oit" uniform (cached since uniform lookups are costly)
+        std::vector<std::pair<ShaderProgram*, bool>> blendedShaders;
+        // Whether each shader found this frame has the "gbuffer" uniform (i.e. it can write the G-buffer of the "DeferredRenderer")
+        std::vector<std::pair<ShaderProgram*, bool>> gbufferShaders;
+        // The lights are assigned to clusters of the view frustum so that each fragment only loops over the lights that reach it
+        LightClusters lightClusters;
+        // The shadow maps of the lights, the opaque meshes that are drawn into them and the shadow index of each light
+        ShadowMaps shadowMaps;
+        std::vector<ShadowCaster> shadowCasters;
+        std::vector<int> shadowIndices;
+        // The shaders whose lighting uniforms were already sent this frame (uniforms are stored per program so we only send them once)
+        std::vector<ShaderProgram*> litShaders;
+        // Objects used for drawing the opaque commands via glMultiDrawElementsIndirect (if enabled and supported)
+        // The model matrices are read in the shader from a texture buffer using the draw id
+        // (10 texels per draw: M, M_IT, then the rect & the layer of the packed texture region)
+        static constexpr size_t OBJECT_DATA_TEXELS = 10;
+        bool multiDrawIndirect = false;
+        GLuint objectBuffer = 0, objectTexture = 0, indirectBuffer = 0;
+        std::vector<glm::vec4> objectData;
+        std::vector<DrawElementsIndirectCommand> indirectCommands;
+        // The number of opaque & blended transparent commands that have a draw index in the batch data (the rest are drawn one by one)
+        size_t opaqueBatchedCount = 0, blendedBatchedCount = 0;
+        // The textures of the current command (reused to prevent reallocating it for each command)
+        std::vector<Texture2D*> commandTextures;
+        // If enabled, the opaque commands are first drawn with a depth only shader, then they are drawn again with an equal depth test
+        // so each pixel is only shaded once (instead of once per overlapping object that passed the depth test at the time)
+        bool depthPrepass = false;
+        // The queries that measure the opaque passes (each frame uses its own set, which is read when the set is reused)
+        static constexpr int QUERY_FRAMES = 3;
+        bool profileOpaquePass = false;
+        GLuint prepassQueries[QUERY_FRAMES] = {}, shadingQueries[QUERY_FRAMES] = {};
+        bool queriesIssued[QUERY_FRAMES] = {}, prepassIssued[QUERY_FRAMES] = {};
+        // The samples are counted by a query per geometry pass (the color & the G-buffer passes) in "drawOpaqueCommands",
+        // so the passes that do not draw the scene geometry (such as the deferred lighting) are not counted as overdraw
+        static constexpr int SAMPLE_PASSES = 2;
+        GLuint sampleQueries[QUERY_FRAMES][SAMPLE_PASSES] = {};
+        bool samplesIssued[QUERY_FRAMES][SAMPLE_PASSES] = {};
+        int queryFrame = 0, querySet = 0; // The next set to use and the set used by the current frame
+        OpaquePassStats opaqueStats;
+
+        // Requests the mip levels of the streamed textures of each command from the "TextureStreamer"
+        // based on the size of the command bounding sphere on the screen
+        void requestTextureLevels(const glm::mat4& projection, const glm::vec3& cameraPosition);
+        // Sends the lighting uniforms (which are the same for all the objects in the frame) to the given shader
+        void setupLighting(ShaderProgram* shader, const glm::vec3& cameraPosition);
+        // Returns whether the material is drawn in the depth pre-pass
+        bool usesDepthPrepass(const Material* material) const;
+        // Returns whether the shader can draw in the weighted blended pass
+        bool supportsWeightedBlending(ShaderProgram* shader);
+        // Returns whether the shader can draw in the G-buffer pass
+        bool supportsGBuffer(ShaderProgram* shader);
+        // Returns whether the opaque commands with the given material are drawn in the given pass
+        // (the forward renderer draws all of them in the color pass and only the pre-passed ones in the depth pre-pass)
+        virtual bool drawsInPass(const Material* material, DrawPass pass);
+        // Creates the framebuffer (with a color and a depth target) that the scene is drawn into, if it does not exist yet
+        void createSceneFrameBuffer();
+        // Sets up the material for the given pass and returns the shader to use
+        ShaderProgram* setupMaterial(const Material* material, DrawPass pass);
+        // Draws a single command with its own draw call
+        void drawCommand(const RenderCommand& command, const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass = DrawPass::COLOR);
+        // Sets the batch material of each command to the first material that it can be batched with
+        void assignBatchMaterials(std::vector<RenderCommand>& commands);
+        // Sorts the commands by the keys of their batches (the batch material, the geometry arena page and the element type)
+        // The commands in the same batch are sorted from front to back if "cameraForward" is not zero
+        void sortByBatch(std::vector<RenderCommand>& commands, const glm::vec3& cameraForward);
+        // Adds the object data and the indirect commands of the given commands (their draw indices start at the current count)
+        // Returns the number of commands that got a draw index
+        size_t appendBatchData(const std::vector<RenderCommand>& commands);
+        // Uploads the object data and the indirect commands added this frame
+        void uploadBatchData();
+        // Draws the commands in batches where each batch shares the batch material, the geometry arena page and the element type
+        // The commands must be sorted by "sortByBatch" and the first "batchedCount" of them must have the draw indices starting at "firstDraw"
+        void drawBatches(const std::vector<RenderCommand>& commands, size_t firstDraw, size_t batchedCount,
+                         const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass);
+        // Draws the opaque commands that are drawn in the given pass (see "drawsInPass")
+        void drawOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition, DrawPass pass);
+        // Shades the opaque commands into the scene (after the depth pre-pass if it is enabled)
+        virtual void shadeOpaqueCommands(const glm::mat4& VP, const glm::vec3& cameraPosition);
+        // Draws the blended transparent commands into the transparency targets then composites them over the scene
+        void drawWeightedTransparency(const glm::mat4& VP, const glm::vec3& cameraPosition);
+        // Reads the results of the queries issued by the given frame into "opaqueStats"
+        void readOpaqueQueries(int frame);
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
         // windowSize is the width & height of the window (in pixels).
-        void initialize(glm::ivec2 windowSize, const nlohmann::json& config);
+        virtual void initialize(glm::ivec2 windowSize, const nlohmann::json& config);
         // Clean up the renderer
-        void destroy();
+        virtual void destroy();
         // This function should be called every frame to draw the given world
         void render(World* world);
 
+        // The depth pre-pass can be toggled at runtime (e.g. to compare the costs of the two modes)
+        bool hasDepthPrepass() const { return depthPrepass; }
+        void setDepthPrepass(bool enabled) { depthPrepass = enabled; }
+        bool isProfilingOpaquePass() const { return profileOpaquePass; }
+        const OpaquePassStats& getOpaqueStats() const { return opaqueStats; }
 
+        virtual ~ForwardRenderer() = default;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include "light-clusters.hpp"
+#include "../jobs/job-system.hpp"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace our {
+
+    // These values must match the light types in the shader (see "assets/shaders/light.frag")
+    static constexpr int LIGHT_TYPE_DIRECTIONAL = 0;
+    static constexpr int LIGHT_TYPE_POINT = 1;
+    static constexpr int LIGHT_TYPE_SPOT = 2;
+
+    void LightClusters::initialize(const nlohmann::json& config){
+        if(config.is_object()){
+            gridSize.x = std::max(config.value("x", gridSize.x), 1);
+            gridSize.y = std::max(config.value("y", gridSize.y), 1);
+            gridSize.z = std::max(config.value("z", gridSize.z), 1);
+        }
+
+        // Create a buffer for each data type and a texture buffer through which the shader can read it
+        auto createTextureBuffer = [](GLuint& buffer, GLuint& texture, GLenum format){
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        };
+        createTextureBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+        createTextureBuffer(clusterBuffer, clusterTexture, GL_RG32UI);
+        createTextureBuffer(indexBuffer, indexTexture, GL_R32UI);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // Force the cluster bounds to be rebuilt on the first update
+        clusterProjection = glm::mat4(0.0f);
+    }
+
+    void LightClusters::destroy(){
+        GLuint textures[] = {lightTexture, clusterTexture, indexTexture};
+        GLuint buffers[] = {lightBuffer, clusterBuffer, indexBuffer};
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+        lightTexture = clusterTexture = indexTexture = 0;
+        lightBuffer = clusterBuffer = indexBuffer = 0;
+    }
+
+    float LightClusters::computeRange(const LightComponent* light, float cutoff){
+        if(light->range > 0) return light->range;
+        glm::vec3 color = light->color * light->intensity;
+        float brightness = std::max(color.r, std::max(color.g, color.b));
+        if(brightness <= 0) return 0;
+        // The light contribution is brightness / (c + l*d + q*d^2), so we solve for the distance "d" at which it equals the cutoff
+        float c = light->attenuation.x, l = light->attenuation.y, q = light->attenuation.z;
+        float k = brightness / cutoff;
+        if(q > 0){
+            float discriminant = l * l - 4 * q * (c - k);
+            if(discriminant < 0) return 0;
+            return std::max((-l + std::sqrt(discriminant)) / (2 * q), 0.0f);
+        } else if(l > 0) {
+            return std::max((k - c) / l, 0.0f);
+        }
+        return std::numeric_limits<float>::infinity();
+    }
+
+    void LightClusters::buildClusterBounds(const glm::mat4& projection){
+        clusterProjection = projection;
+        size_t clusterCount = (size_t)gridSize.x * gridSize.y * gridSize.z;
+        clusterMin.resize(clusterCount);
+        clusterMax.resize(clusterCount);
+
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        auto unproject = [&](glm::vec3 ndc){
+            glm::vec4 point = inverseProjection * glm::vec4(ndc, 1.0f);
+            return glm::vec3(point) / point.w;
+        };
+
+        for(int y = 0; y < gridSize.y; ++y){
+            for(int x = 0; x < gridSize.x; ++x){
+                // For each corner of the tile, we find the view space ray that passes through it (from the near to the far plane)
+                glm::vec3 rayStart[4], rayEnd[4];
+                for(int corner = 0; corner < 4; ++corner){
+                    float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / gridSize.x;
+                    float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / gridSize.y;
+                    rayStart[corner] = unproject({ndcX, ndcY, -1.0f});
+                    rayEnd[corner] = unproject({ndcX, ndcY, 1.0f});
+                }
+                for(int z = 0; z < gridSize.z; ++z){
+                    // The slices are exponentially distributed in depth so that the clusters are roughly cubic in view space
+                    float sliceNear = near * std::pow(far / near, (float)z / gridSize.z);
+                    float sliceFar = near * std::pow(far / near, (float)(z + 1) / gridSize.z);
+                    glm::vec3 low(std::numeric_limits<float>::max()), high(std::numeric_limits<float>::lowest());
+                    for(int corner = 0; corner < 4; ++corner){
+                        float startDepth = -rayStart[corner].z, endDepth = -rayEnd[corner].z;
+                        for(float depth : {sliceNear, sliceFar}){
+                            float t = (depth - startDepth) / (endDepth - startDepth);
+                            glm::vec3 point = glm::mix(rayStart[corner], rayEnd[corner], t);
+                            low = glm::min(low, point);
+                            high = glm::max(high, point);
+                        }
+                    }
+                    size_t index = x + (size_t)gridSize.x * (y + (size_t)gridSize.y * z);
+                    clusterMin[index] = low;
+                    clusterMax[index] = high;
+                }
+            }
+        }
+    }
+
+    void LightClusters::update(const std::vector<LightComponent*>& lights, const std::vector<int>& shadowIndices, const glm::mat4& cameraToWorld,
+                               const glm::mat4& view, const glm::mat4& projection, float near, float far, glm::ivec2 viewportSize){
+        bool depthChanged = near != this->near || far != this->far;
+        this->near = near;
+        this->far = far;
+        if(depthChanged || projection != clusterProjection) buildClusterBounds(projection);
+
+        cameraForward = glm::normalize(glm::vec3(cameraToWorld * glm::vec4(0, 0, -1, 0)));
+        tileSize = glm::vec2(viewportSize) / glm::vec2(gridSize.x, gridSize.y);
+        sliceScale = gridSize.z / std::log(far / near);
+        sliceBias = -gridSize.z * std::log(near) / std::log(far / near);
+
+        // The view space bounding sphere of a point or spot light and the range of slices it overlaps
+        struct LightBounds {
+            glm::vec3 center;
+            float radius;
+            int firstSlice, lastSlice;
+            bool unbounded;
+        };
+        std::vector<LightBounds> bounds;
+
+        // Write the light data. Directional lights are written first since every fragment loops over them.
+        lightData.clear();
+        auto writeLight = [&](size_t index, int type, float range){
+            const LightComponent* light = lights[index];
+            glm::mat4 M = light->getOwner()->getLocalToWorldMatrix();
+            glm::vec3 position = M * glm::vec4(0, 0, 0, 1);
+            glm::vec3 direction = glm::normalize(glm::vec3(M * glm::vec4(0, 0, -1, 0)));
+            lightData.emplace_back(position, (float)type);
+            lightData.emplace_back(direction, std::isinf(range) ? 0.0f : range);
+            lightData.emplace_back(light->color * light->intensity, glm::radians(light->innerCone));
+            lightData.emplace_back(light->attenuation, glm::radians(light->outerCone));
+            lightData.emplace_back(index < shadowIndices.size() ? (float)shadowIndices[index] : -1.0f, 0.0f, 0.0f, 0.0f);
+        };
+        directionalCount = 0;
+        for(size_t index = 0; index < lights.size(); ++index){
+            if(lights[index]->lightType != LightType::DIRECTIONAL) continue;
+            writeLight(index, LIGHT_TYPE_DIRECTIONAL, 0);
+            ++directionalCount;
+        }
+
+        float logDepthRange = std::log(far / near);
+        auto sliceOf = [&](float depth){
+            return std::clamp((int)std::floor(std::log(std::max(depth, near) / near) / logDepthRange * gridSize.z), 0, gridSize.z - 1);
+        };
+        for(size_t index = 0; index < lights.size(); ++index){
+            const LightComponent* light = lights[index];
+            if(light->lightType == LightType::DIRECTIONAL) continue;
+            float range = computeRange(light, cutoff);
+            if(range <= 0) continue;
+
+            LightBounds bound;
+            bound.unbounded = std::isinf(range);
+            glm::mat4 M = light->getOwner()->getLocalToWorldMatrix();
+            glm::vec3 position = M * glm::vec4(0, 0, 0, 1);
+            bound.center = position;
+            bound.radius = range;
+            if(light->lightType == LightType::SPOT && !bound.unbounded){
+                // A cone has a tighter bounding sphere than the sphere of its range
+                glm::vec3 direction = glm::normalize(glm::vec3(M * glm::vec4(0, 0, -1, 0)));
+                float angle = glm::radians(light->outerCone);
+                if(angle < glm::quarter_pi<float>()){
+                    bound.radius = range / (2.0f * std::cos(angle));
+                    bound.center = position + direction * bound.radius;
+                } else if(angle < glm::half_pi<float>()) {
+                    bound.center = position + direction * (std::cos(angle) * range);
+                    bound.radius = std::sin(angle) * range;
+                }
+            }
+            bound.center = glm::vec3(view * glm::vec4(bound.center, 1.0f));
+
+            if(bound.unbounded){
+                bound.firstSlice = 0;
+                bound.lastSlice = gridSize.z - 1;
+            } else {
+                float depth = -bound.center.z;
+                if(depth + bound.radius < near || depth - bound.radius > far) continue;
+                bound.firstSlice = sliceOf(depth - bound.radius);
+                bound.lastSlice = sliceOf(depth + bound.radius);
+            }
+            bounds.push_back(bound);
+            writeLight(index, light->lightType == LightType::SPOT ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT, range);
+        }
+
+        // Assign the lights to the clusters. Each depth slice is handled independently so the slices run in parallel.
+        // Every slice writes its indices into its own list and the lists are concatenated afterwards.
+        size_t tilesPerSlice = (size_t)gridSize.x * gridSize.y;
+        clusterData.assign(tilesPerSlice * gridSize.z, glm::uvec2(0, 0));
+        std::vector<std::vector<GLuint>> sliceIndices(gridSize.z);
+        JobSystem::get().parallelFor(gridSize.z, 1, [&](size_t begin, size_t end){
+            std::vector<GLuint> candidates;
+            for(size_t z = begin; z < end; ++z){
+                candidates.clear();
+                for(size_t index = 0; index < bounds.size(); ++index){
+                    if((int)z >= bounds[index].firstSlice && (int)z <= bounds[index].lastSlice)
+                        candidates.push_back((GLuint)index);
+                }
+                auto& indices = sliceIndices[z];
+                indices.clear();
+                for(size_t tile = 0; tile < tilesPerSlice; ++tile){
+                    size_t cluster = tile + tilesPerSlice * z;
+                    GLuint start = (GLuint)indices.size();
+                    for(GLuint candidate : candidates){
+                        const LightBounds& bound = bounds[candidate];
+                        if(!bound.unbounded){
+                            // Sphere vs box test: find the closest point in the box to the sphere center
+                            glm::vec3 closest = glm::clamp(bound.center, clusterMin[cluster], clusterMax[cluster]);
+                            glm::vec3 offset = closest - bound.center;
+                            if(glm::dot(offset, offset) > bound.radius * bound.radius) continue;
+                        }
+                        // The light index is offset by the directional lights since they are stored first
+                        indices.push_back(candidate + directionalCount);
+                    }
+                    clusterData[cluster] = glm::uvec2(start, (GLuint)indices.size() - start);
+                }
+            }
+        });
+
+        // Concatenate the slice lists and turn the offsets into global offsets
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        lightIndices.clear();
+        for(int z = 0; z < gridSize.z; ++z){
+            GLuint sliceStart = (GLuint)lightIndices.size();
+            auto& indices = sliceIndices[z];
+            // If we exceed what the texture buffer can hold, the lists are truncated (should only happen with absurd light counts)
+            size_t available = (size_t)maxTexels > lightIndices.size() ? (size_t)maxTexels - lightIndices.size() : 0;
+            size_t copied = std::min(indices.size(), available);
+            lightIndices.insert(lightIndices.end(), indices.begin(), indices.begin() + copied);
+            for(size_t tile = 0; tile < tilesPerSlice; ++tile){
+                auto& cluster = clusterData[tile + tilesPerSlice * z];
+                GLuint end = std::min<GLuint>(cluster.x + cluster.y, (GLuint)copied);
+                cluster.y = end > cluster.x ? end - cluster.x : 0;
+                cluster.x += sliceStart;
+            }
+        }
+
+        // Upload the data (texture buffers cannot be empty so we add a dummy element if needed)
+        if(lightData.empty()) lightData.emplace_back(0.0f);
+        if(lightIndices.empty()) lightIndices.push_back(0);
+        auto upload = [](GLuint buffer, GLsizeiptr size, const void* data){
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            // Orphan the old storage so that we don't wait for the previous frame to finish reading it
+            glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        };
+        upload(lightBuffer, lightData.size() * sizeof(glm::vec4), lightData.data());
+        upload(clusterBuffer, clusterData.size() * sizeof(glm::uvec2), clusterData.data());
+        upload(indexBuffer, lightIndices.size() * sizeof(GLuint), lightIndices.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::setup(ShaderProgram* shader, GLuint firstUnit) const {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader->set("light_data", (GLint)firstUnit);
+        shader->set("cluster_data", (GLint)(firstUnit + 1));
+        shader->set("light_indices", (GLint)(firstUnit + 2));
+        shader->set("directional_light_count", (GLint)directionalCount);
+        shader->set("cluster_grid", gridSize);
+        shader->set("cluster_tile_size", tileSize);
+        shader->set("cluster_slice_scale", sliceScale);
+        shader->set("cluster_slice_bias", sliceBias);
+        shader->set("cluster_camera_forward", cameraForward);
+    }
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../components/light.hpp"
+#include "../shader/shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <vector>
+
+namespace our {
+
+    // The light clusters slice the view frustum into a 3D grid (tiles on the screen and exponential slices in depth)
+    // and find the point & spot lights that reach each cluster on the CPU.
+    // The lights and the per-cluster light lists are uploaded into texture buffers,
+    // so a fragment only loops over the lights that affect the cluster it lies in instead of every light in the scene.
+    // Directional lights reach every cluster, so they are stored at the start of the light buffer and are not added to the lists.
+    class LightClusters {
+        // The number of clusters along the x (screen width), y (screen height) and z (depth) axes
+        glm::ivec3 gridSize = {16, 9, 24};
+        // The brightness below which a light is considered to not reach a point (used to find the light range from its attenuation)
+        float cutoff = 1.0f / 256.0f;
+
+        // Each of the following data is stored in a buffer and read in the shader via a texture buffer
+        // - Light data: 5 texels (RGBA32F) per light
+        // - Cluster data: 1 texel (RG32UI) per cluster holding the offset and the count of its lights in the index list
+        // - Light indices: 1 texel (R32UI) per light per cluster
+        GLuint lightBuffer = 0, lightTexture = 0;
+        GLuint clusterBuffer = 0, clusterTexture = 0;
+        GLuint indexBuffer = 0, indexTexture = 0;
+
+        // The CPU side copies of the buffers. They are members to avoid reallocating them every frame
+        std::vector<glm::vec4> lightData;
+        std::vector<glm::uvec2> clusterData;
+        std::vector<GLuint> lightIndices;
+        // The view space bounding boxes of the clusters (recomputed when the projection changes)
+        std::vector<glm::vec3> clusterMin, clusterMax;
+        glm::mat4 clusterProjection = glm::mat4(0.0f);
+
+        // The values needed by the shader to find the cluster of a fragment
+        int directionalCount = 0;
+        glm::vec3 cameraForward = {0, 0, -1};
+        glm::vec2 tileSize = {1, 1};
+        float sliceScale = 0, sliceBias = 0;
+        float near = 0.01f, far = 100.0f;
+
+        // Recomputes the view space bounding boxes of all the clusters
+        void buildClusterBounds(const glm::mat4& projection);
+
+    public:
+        // Creates the buffers and reads the (optional) grid size from the config
+        // The config can be in the form: { "x": 16, "y": 9, "z": 24 }
+        void initialize(const nlohmann::json& config);
+        // Deletes the buffers
+        void destroy();
+
+        // Assigns the given lights to the clusters of the camera defined by the given matrices and uploads the result
+        // "shadowIndices" holds the index of the shadow map of each light or -1 if it has none (see "ShadowMaps::update"), it can be empty
+        // "near" and "far" are the distances of the camera near and far planes and "viewportSize" is the size of the render target in pixels
+        void update(const std::vector<LightComponent*>& lights, const std::vector<int>& shadowIndices, const glm::mat4& cameraToWorld,
+                    const glm::mat4& view, const glm::mat4& projection, float near, float far, glm::ivec2 viewportSize);
+
+        // Binds the texture buffers to the texture units starting at "firstUnit" and sends the cluster uniforms to the shader
+        void setup(ShaderProgram* shader, GLuint firstUnit) const;
+
+        // Returns the distance after which the light contribution is less than "cutoff"
+        // If the light does not fade with distance, an infinite distance is returned
+        static float computeRange(const LightComponent* light, float cutoff);
+    };
+
+}
@@ -0,0 +1,332 @@
+#include "shadow-maps.hpp"
+#include "light-clusters.hpp"
+#include "../hash-utils.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace our {
+
+    // Returns a rotation that looks along the given direction (the up vector is changed if it is parallel to the direction)
+    static glm::mat4 lookAlong(const glm::vec3& position, const glm::vec3& direction){
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        return glm::lookAt(position, position + direction, up);
+    }
+
+    // Maps the NDC (from -1 to 1) to the texture space (from 0 to 1) inside the given region of the texture
+    static glm::mat4 toTextureSpace(glm::vec2 offset, float scale){
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(offset + 0.5f * scale, 0.5f));
+        return glm::scale(matrix, glm::vec3(0.5f * scale, 0.5f * scale, 0.5f));
+    }
+
+    void ShadowMaps::initialize(const nlohmann::json& config){
+        enabled = config.is_object();
+        if(enabled){
+            cascadeCount = std::clamp(config.value("cascades", cascadeCount), 1, MAX_CASCADES);
+            resolution = std::max(config.value("resolution", resolution), 64);
+            distance = config.value("distance", distance);
+            splitLambda = std::clamp(config.value("splitLambda", splitLambda), 0.0f, 1.0f);
+            cacheStatic = config.value("cacheStatic", cacheStatic);
+            // The margin is limited to a quarter of the map, otherwise most of the texels would be spent outside the frustum slice
+            cacheMargin = std::clamp(config.value("cacheMargin", cacheMargin), 0.0f, resolution * 0.25f);
+            atlasResolution = std::max(config.value("atlasResolution", atlasResolution), 64);
+            tileResolution = std::clamp(config.value("spotResolution", tileResolution), 16, atlasResolution);
+            slopeBias = config.value("slopeBias", slopeBias);
+            constantBias = config.value("constantBias", constantBias);
+        }
+
+        // The shadow maps are compared with the fragment depth in the shader (sampler2DShadow) with a bilinear filter
+        // When the shadows are disabled, we still create tiny textures since the lighting shaders always declare their samplers
+        auto createDepthTexture = [](GLenum target, GLsizei size, GLsizei layers, bool compare){
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(target, texture);
+            if(target == GL_TEXTURE_2D_ARRAY){
+                glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            } else {
+                glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            }
+            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+            glTexParameteri(target, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            if(compare){
+                glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+                glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            }
+            glBindTexture(target, 0);
+            return texture;
+        };
+        cascadeTexture = createDepthTexture(GL_TEXTURE_2D_ARRAY, enabled ? resolution : 1, enabled ? cascadeCount : 1, true);
+        atlasTexture = createDepthTexture(GL_TEXTURE_2D, enabled ? atlasResolution : 1, 1, true);
+        for(auto& cascade : cascades) cascade.cacheValid = false;
+        if(!enabled) return;
+        if(cacheStatic) staticTexture = createDepthTexture(GL_TEXTURE_2D_ARRAY, resolution, cascadeCount, false);
+
+        // The frame buffers only have a depth attachment (which is attached before drawing each map)
+        for(GLuint* buffer : {&frameBuffer, &staticFrameBuffer}){
+            glGenFramebuffers(1, buffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, *buffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // The casters only write their depth, so they are all drawn with the same shader
+        casterShader = new ShaderProgram();
+        casterShader->attach("assets/shaders/shadow.vert", GL_VERTEX_SHADER);
+        casterShader->attach("assets/shaders/shadow.frag", GL_FRAGMENT_SHADER);
+        casterShader->link();
+    }
+
+    void ShadowMaps::destroy(){
+        GLuint textures[] = {cascadeTexture, staticTexture, atlasTexture};
+        GLuint frameBuffers[] = {frameBuffer, staticFrameBuffer};
+        glDeleteTextures(3, textures);
+        glDeleteFramebuffers(2, frameBuffers);
+        cascadeTexture = staticTexture = atlasTexture = 0;
+        frameBuffer = staticFrameBuffer = 0;
+        delete casterShader;
+        casterShader = nullptr;
+        enabled = false;
+    }
+
+    void ShadowMaps::update(const std::vector<ShadowCaster>& casters, const std::vector<LightComponent*>& lights, std::vector<int>& shadowIndices,
+                            const glm::mat4& cameraToWorld, const glm::mat4& projection, float near, float far){
+        shadowIndices.assign(lights.size(), -1);
+        activeCascades = 0;
+        spotMatrices.clear();
+        if(!enabled) return;
+
+        // The casters only write their depth. The faces are not culled since many meshes (such as planes) are single sided.
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDisable(GL_BLEND);
+        glDisable(GL_CULL_FACE);
+        // The slope scaled bias removes most of the self shadowing (acne), the shader adds a small offset along the normal for the rest
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(slopeBias, constantBias);
+        casterShader->use();
+
+        // Only the first directional light that casts shadows gets the cascades
+        for(size_t index = 0; index < lights.size(); ++index){
+            if(lights[index]->lightType != LightType::DIRECTIONAL || !lights[index]->castShadows) continue;
+            updateCascades(casters, lights[index], cameraToWorld, projection, near, far);
+            shadowIndices[index] = 0;
+            break;
+        }
+        updateSpotShadows(casters, lights, shadowIndices, glm::vec3(cameraToWorld[3]));
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void ShadowMaps::updateCascades(const std::vector<ShadowCaster>& casters, const LightComponent* light, const glm::mat4& cameraToWorld,
+                                    const glm::mat4& projection, float near, float far){
+        glm::vec3 direction = glm::normalize(glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, -1, 0)));
+        glm::mat4 rotation = lookAlong(glm::vec3(0.0f), direction);
+        bool lightChanged = rotation != lightRotation;
+        lightRotation = rotation;
+
+        // Split the casters and hash the static ones, so the cached depth is redrawn if a static caster is added, removed or moved
+        staticCasters.clear();
+        dynamicCasters.clear();
+        uint64_t hash = 0;
+        for(const auto& caster : casters){
+            if(caster.isStatic && cacheStatic){
+                staticCasters.push_back(&caster);
+                uint64_t seed = hash_utils::combine(uint64_t(reinterpret_cast<uintptr_t>(caster.mesh)), caster.submesh);
+                hash = hash_utils::combine(hash, hash_utils::hash(&caster.localToWorld, sizeof(glm::mat4), seed));
+            } else {
+                dynamicCasters.push_back(&caster);
+            }
+        }
+        bool staticChanged = lightChanged || hash != staticHash;
+        staticHash = hash;
+
+        // Find the view space rays along the edges of the view frustum (from the near to the far plane)
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        glm::vec3 rayStart[4], rayEnd[4];
+        for(int corner = 0; corner < 4; ++corner){
+            glm::vec4 start = inverseProjection * glm::vec4(corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, -1, 1);
+            glm::vec4 end = inverseProjection * glm::vec4(corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, 1, 1);
+            rayStart[corner] = glm::vec3(start) / start.w;
+            rayEnd[corner] = glm::vec3(end) / end.w;
+        }
+        // The splits are a blend of logarithmic splits (which give the same texel density to every cascade) and uniform splits
+        float shadowFar = std::min(far, distance);
+        auto splitDepth = [&](int index){
+            float ratio = float(index) / cascadeCount;
+            float logarithmic = near * std::pow(shadowFar / near, ratio);
+            float uniform = near + (shadowFar - near) * ratio;
+            return glm::mix(uniform, logarithmic, splitLambda);
+        };
+
+        glViewport(0, 0, resolution, resolution);
+        for(int index = 0; index < cascadeCount; ++index){
+            Cascade& cascade = cascades[index];
+            float sliceNear = splitDepth(index), sliceFar = splitDepth(index + 1);
+
+            // The cascade covers the bounding sphere of its slice of the frustum. Unlike a tight box, the sphere does not change
+            // when the camera rotates, so the texels keep the same size and their edges do not crawl.
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for(int corner = 0; corner < 4; ++corner){
+                float startDepth = -rayStart[corner].z, endDepth = -rayEnd[corner].z;
+                for(int side = 0; side < 2; ++side){
+                    float t = ((side ? sliceFar : sliceNear) - startDepth) / (endDepth - startDepth);
+                    glm::vec3 point = glm::mix(rayStart[corner], rayEnd[corner], t);
+                    corners[2 * corner + side] = glm::vec3(cameraToWorld * glm::vec4(point, 1.0f));
+                    center += corners[2 * corner + side];
+                }
+            }
+            center /= 8.0f;
+            float radius = 0.0f;
+            for(const auto& corner : corners) radius = std::max(radius, glm::distance(corner, center));
+            // The radius is rounded up, so the floating point noise does not change the texel size from frame to frame
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            // The map is larger than the sphere by the margin (in texels), so the camera can move a bit before the cache is invalid
+            float extent = radius / (1.0f - 2.0f * cacheMargin / resolution);
+            float texelSize = 2.0f * extent / resolution;
+            glm::vec3 lightCenter = glm::vec3(rotation * glm::vec4(center, 1.0f));
+            glm::vec3 snapped = glm::floor(lightCenter / texelSize + 0.5f) * texelSize;
+
+            bool redraw = !cacheStatic || staticChanged || !cascade.cacheValid || cascade.extent != extent ||
+                          glm::any(glm::greaterThan(glm::abs(snapped - cascade.origin), glm::vec3(extent - radius)));
+            if(redraw){
+                cascade.origin = snapped;
+                cascade.extent = extent;
+            }
+            cascade.splitDepth = sliceFar;
+
+            // The casters between the light and the slice must be drawn too, so the map extends toward the light by the shadow distance
+            const glm::vec3& origin = cascade.origin;
+            glm::mat4 lightProjection = glm::ortho(origin.x - extent, origin.x + extent, origin.y - extent, origin.y + extent,
+                                                   -(origin.z + extent + distance), -(origin.z - extent));
+            cascade.viewProjection = lightProjection * rotation;
+            cascade.shadowMatrix = toTextureSpace(glm::vec2(0.0f), 1.0f) * cascade.viewProjection;
+            cascade.texelSize = texelSize;
+
+            if(cacheStatic){
+                glBindFramebuffer(GL_FRAMEBUFFER, staticFrameBuffer);
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, index);
+                if(redraw){
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    drawCasters(staticCasters, cascade);
+                    cascade.cacheValid = true;
+                }
+                // Start the cascade from the cached static depth
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+                glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, index);
+                glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+            } else {
+                glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, index);
+                glClear(GL_DEPTH_BUFFER_BIT);
+            }
+            drawCasters(dynamicCasters, cascade);
+        }
+        activeCascades = cascadeCount;
+    }
+
+    void ShadowMaps::drawCasters(const std::vector<const ShadowCaster*>& casters, const Cascade& cascade){
+        // A caster is culled if its bounding sphere does not intersect the box covered by the cascade (in the light space)
+        const glm::vec3& origin = cascade.origin;
+        for(const ShadowCaster* caster : casters){
+            glm::vec3 center = glm::vec3(lightRotation * glm::vec4(caster->center, 1.0f));
+            float reach = cascade.extent + caster->radius;
+            if(std::abs(center.x - origin.x) > reach || std::abs(center.y - origin.y) > reach) continue;
+            if(center.z - caster->radius > origin.z + cascade.extent + distance || center.z + caster->radius < origin.z - cascade.extent) continue;
+            drawCaster(*caster, cascade.viewProjection);
+        }
+    }
+
+    void ShadowMaps::drawCaster(const ShadowCaster& caster, const glm::mat4& VP){
+        // The dequantization matrix returns the packed positions to the local space (it is the identity for the standard format)
+        casterShader->set("transform", VP * caster.localToWorld * caster.mesh->getDequantizationMatrix());
+        caster.mesh->drawSubmesh(caster.submesh);
+    }
+
+    void ShadowMaps::updateSpotShadows(const std::vector<ShadowCaster>& casters, const std::vector<LightComponent*>& lights,
+                                       std::vector<int>& shadowIndices, const glm::vec3& cameraPosition){
+        // The closest spot lights to the camera get the tiles of the atlas
+        std::vector<size_t> spotLights;
+        for(size_t index = 0; index < lights.size(); ++index){
+            if(lights[index]->lightType == LightType::SPOT && lights[index]->castShadows) spotLights.push_back(index);
+        }
+        if(spotLights.empty()) return;
+        auto positionOf = [&](size_t index){ return glm::vec3(lights[index]->getOwner()->getLocalToWorldMatrix()[3]); };
+        std::sort(spotLights.begin(), spotLights.end(), [&](size_t first, size_t second){
+            return glm::distance(positionOf(first), cameraPosition) < glm::distance(positionOf(second), cameraPosition);
+        });
+        int tilesPerRow = atlasResolution / tileResolution;
+        size_t tileCount = std::min<size_t>({spotLights.size(), size_t(MAX_SPOT_SHADOWS), size_t(tilesPerRow * tilesPerRow)});
+
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlasTexture, 0);
+        // The scissor limits the clear to the tile
+        glEnable(GL_SCISSOR_TEST);
+        for(size_t tile = 0; tile < tileCount; ++tile){
+            const LightComponent* light = lights[spotLights[tile]];
+            glm::mat4 M = light->getOwner()->getLocalToWorldMatrix();
+            glm::vec3 position = M * glm::vec4(0, 0, 0, 1);
+            glm::vec3 direction = glm::normalize(glm::vec3(M * glm::vec4(0, 0, -1, 0)));
+            // The map covers the cone of the light up to its range (a light without a range is limited to the shadow distance)
+            float range = LightClusters::computeRange(light, 1.0f / 256.0f);
+            if(std::isinf(range)) range = distance;
+            if(range <= 0.0f) continue;
+            float fov = std::min(2.0f * glm::radians(light->outerCone), glm::radians(170.0f));
+            glm::mat4 VP = glm::perspective(fov, 1.0f, std::max(range * 0.002f, 0.01f), range) * lookAlong(position, direction);
+
+            glm::ivec2 offset = glm::ivec2(int(tile) % tilesPerRow, int(tile) / tilesPerRow) * tileResolution;
+            glViewport(offset.x, offset.y, tileResolution, tileResolution);
+            glScissor(offset.x, offset.y, tileResolution, tileResolution);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            for(const auto& caster : casters){
+                // Skip the casters out of the light range or behind the light
+                glm::vec3 offsetFromLight = caster.center - position;
+                if(glm::length(offsetFromLight) > range + caster.radius || glm::dot(offsetFromLight, direction) < -caster.radius) continue;
+                drawCaster(caster, VP);
+            }
+
+            float scale = float(tileResolution) / atlasResolution;
+            shadowIndices[spotLights[tile]] = int(spotMatrices.size());
+            spotMatrices.push_back(toTextureSpace(glm::vec2(offset) / float(atlasResolution), scale) * VP);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    void ShadowMaps::setup(ShaderProgram* shader, GLuint firstUnit) const {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascadeTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader->set("shadow_cascades", (GLint)firstUnit);
+        shader->set("spot_shadow_atlas", (GLint)(firstUnit + 1));
+        shader->set("shadow_cascade_count", (GLint)activeCascades);
+        if(activeCascades > 0){
+            glm::mat4 matrices[MAX_CASCADES];
+            glm::vec4 splits(0.0f), texelSizes(0.0f);
+            for(int index = 0; index < activeCascades; ++index){
+                matrices[index] = cascades[index].shadowMatrix;
+                splits[index] = cascades[index].splitDepth;
+                texelSizes[index] = cascades[index].texelSize;
+            }
+            shader->set("shadow_cascade_matrices[0]", matrices, activeCascades);
+            shader->set("shadow_cascade_splits", splits);
+            shader->set("shadow_cascade_texel_sizes", texelSizes);
+        }
+        shader->set("spot_shadow_matrices[0]", spotMatrices.data(), GLsizei(spotMatrices.size()));
+        shader->set("spot_shadow_resolution", (GLfloat)tileResolution);
+    }
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../components/light.hpp"
+#include "../mesh/mesh.hpp"
+#include "../shader/shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace our {
+
+    // A mesh (submesh) that is drawn into the shadow maps
+    struct ShadowCaster {
+        glm::mat4 localToWorld;
+        glm::vec3 center;   // The world space center & radius of the bounding sphere (used to cull the caster for each shadow map)
+        float radius;
+        Mesh* mesh;
+        size_t submesh;
+        bool isStatic;      // Static casters never move, so their depth is cached (see "MeshRendererComponent::isStatic")
+    };
+
+    // The shadow maps of the lights:
+    // - The first directional light that casts shadows gets cascaded shadow maps: the view frustum is split in depth
+    //   and each slice gets its own orthographic shadow map (stored as a layer of a depth texture array).
+    // - The spot lights that cast shadows (the closest ones to the camera first) get a tile in a depth atlas.
+    //
+    // Redrawing every caster into every cascade each frame is too costly for a large scene, so the static casters are drawn into
+    // a separate cache per cascade. Each cascade covers a slightly larger region than the frustum slice and its center is snapped to
+    // the shadow texels, so the cached depth stays valid (and does not shimmer) while the camera moves inside that margin.
+    // The static depth is only redrawn when the slice leaves the margin, when the light turns or when the static casters change.
+    // Each frame, the cached depth is copied into the cascade and the dynamic casters (characters, weapons, etc.) are drawn over it.
+    class ShadowMaps {
+    public:
+        // These limits must match the array sizes in the shader (see "assets/shaders/include/lights.glsl")
+        static constexpr int MAX_CASCADES = 4;
+        static constexpr int MAX_SPOT_SHADOWS = 16;
+
+    private:
+        bool enabled = false;
+        // The cascade options
+        int cascadeCount = 3;
+        GLsizei resolution = 2048;
+        float distance = 50.0f;         // The view distance covered by the cascades
+        float splitLambda = 0.75f;      // The blend between logarithmic (1) and uniform (0) splits
+        float cacheMargin = 16.0f;      // The number of texels that the camera can move before the static depth is redrawn
+        bool cacheStatic = true;
+        // The spot light options
+        GLsizei atlasResolution = 2048, tileResolution = 512;
+        // The depth bias applied while drawing the casters (see glPolygonOffset)
+        float slopeBias = 2.0f, constantBias = 4.0f;
+
+        // The cascades are rendered into "cascadeTexture" while "staticTexture" holds the cached depth of the static casters
+        GLuint cascadeTexture = 0, staticTexture = 0, atlasTexture = 0;
+        GLuint frameBuffer = 0, staticFrameBuffer = 0;
+        ShaderProgram* casterShader = nullptr;
+
+        struct Cascade {
+            glm::vec3 origin = {0, 0, 0};   // The light space center of the region covered by the shadow map
+            float extent = 0.0f;            // The half size of the region covered by the shadow map
+            float splitDepth = 0.0f;        // The view depth at which the cascade ends
+            float texelSize = 0.0f;         // The world space size of a texel
+            glm::mat4 viewProjection = glm::mat4(1.0f);
+            glm::mat4 shadowMatrix = glm::mat4(1.0f);  // Maps the world space to the texture space of the map
+            bool cacheValid = false;        // Whether the cached static depth was drawn with the current origin & extent
+        };
+        Cascade cascades[MAX_CASCADES];
+        glm::mat4 lightRotation = glm::mat4(1.0f);
+        uint64_t staticHash = 0;
+
+        // The values sent to the shader
+        int activeCascades = 0;
+        std::vector<glm::mat4> spotMatrices;
+
+        // The casters are split once per frame (and the lists are reused to prevent reallocating them every frame)
+        std::vector<const ShadowCaster*> staticCasters, dynamicCasters;
+
+        void updateCascades(const std::vector<ShadowCaster>& casters, const LightComponent* light, const glm::mat4& cameraToWorld,
+                            const glm::mat4& projection, float near, float far);
+        void updateSpotShadows(const std::vector<ShadowCaster>& casters, const std::vector<LightComponent*>& lights,
+                               std::vector<int>& shadowIndices, const glm::vec3& cameraPosition);
+        // Draws the given casters that intersect the box covered by the cascade
+        void drawCasters(const std::vector<const ShadowCaster*>& casters, const Cascade& cascade);
+        void drawCaster(const ShadowCaster& caster, const glm::mat4& VP);
+
+    public:
+        // Creates the shadow maps from the config. If the config is not an object, the shadows are disabled.
+        // The config can be in the form:
+        // { "cascades": 3, "resolution": 2048, "distance": 50, "splitLambda": 0.75, "cacheStatic": true, "cacheMargin": 16,
+        //   "atlasResolution": 2048, "spotResolution": 512, "slopeBias": 2, "constantBias": 4 }
+        void initialize(const nlohmann::json& config);
+        // Deletes the textures, the frame buffers and the shader
+        void destroy();
+
+        // Draws the shadow maps of the given lights for the camera defined by the given matrices
+        // "shadowIndices" receives the shadow index of each light (-1 if the light has no shadow, see "LightClusters::update")
+        // This changes the bound frame buffer and the viewport
+        void update(const std::vector<ShadowCaster>& casters, const std::vector<LightComponent*>& lights, std::vector<int>& shadowIndices,
+                    const glm::mat4& cameraToWorld, const glm::mat4& projection, float near, float far);
+
+        // Binds the cascades and the spot atlas to the texture units "firstUnit" and "firstUnit + 1" and sends the shadow uniforms
+        // The textures are bound even if the shadows are disabled, since every sampler of a program must have a valid type
+        void setup(ShaderProgram* shader, GLuint firstUnit) const;
+
+        bool isEnabled() const { return enabled; }
+    };
+
+}
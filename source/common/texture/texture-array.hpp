@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec4.hpp>
+
+namespace our {
+
+    // This class defines an OpenGL texture which will be used as a GL_TEXTURE_2D_ARRAY
+    // Each layer of the array holds a whole texture (or an atlas of small textures), so the materials that only differ
+    // in their texture can sample the same array and be drawn in a single batch (see "texture-packer.hpp")
+    class TextureArray {
+        // The OpenGL object name of this texture
+        GLuint name = 0;
+    public:
+        // This constructor creates an OpenGL texture and saves its object name in the member variable "name"
+        TextureArray() {
+            glGenTextures(1, &name);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, name);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        // This deconstructor deletes the underlying OpenGL texture
+        ~TextureArray() {
+            glDeleteTextures(1, &name);
+            name = 0;
+        }
+
+        // Get the internal OpenGL name of the texture
+        GLuint getOpenGLName() {
+            return name;
+        }
+
+        // This method binds this texture to GL_TEXTURE_2D_ARRAY
+        void bind() const {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, name);
+        }
+
+        // This static method ensures that no texture is bound to GL_TEXTURE_2D_ARRAY
+        static void unbind(){
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        TextureArray(const TextureArray&) = delete;
+        TextureArray& operator=(const TextureArray&) = delete;
+    };
+
+    // The place of a packed texture: a layer of a texture array and a rectangle inside it
+    // The texture coordinates of the original texture are mapped to "rect.xy + fract(uv) * rect.zw" (the rectangle covers the whole layer unless it is in an atlas)
+    struct TextureRegion {
+        TextureArray* array = nullptr;
+        GLint layer = 0;
+        glm::vec4 rect = {0.0f, 0.0f, 1.0f, 1.0f};
+    };
+
+}
@@ -0,0 +1,135 @@
+#include "texture-cache.hpp"
+#include "../io/mapped-file.hpp"
+#include "../io/virtual-file-system.hpp"
+#include "../io/cache-file.hpp"
+#include "../hash-utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace our::texture_cache {
+
+    namespace {
+        const char MAGIC[4] = {'O', 'T', 'E', 'X'};
+        const char* CACHE_DIRECTORY = "cache/textures";
+
+        // Returns the number of bytes in a level of the given size
+        inline uint64_t getLevelSize(uint32_t width, uint32_t height, size_t blockSize){
+            return uint64_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+        }
+    }
+
+    using cache_file::alignTo16;
+    using cache_file::isInside;
+
+    uint64_t computeKey(const std::string& sourcePath, texture_compressor::Compression compression){
+        FileView source = vfs::open(sourcePath);
+        if(!source.isOpen()) return 0;
+        uint64_t key = hash_utils::hash(source.data(), source.size());
+        key = hash_utils::combine(key, COMPRESSOR_VERSION);
+        key = hash_utils::combine(key, static_cast<uint64_t>(compression));
+        return key;
+    }
+
+    // The cache file name is "<source name>-<source path hash>-<requested compression>-<key>.tex"
+    // This function returns the part before the key (which is shared by all the cache files of the same source & compression)
+    // The compression is part of the prefix so that the files of the same source loaded with two compressions do not delete each other
+    static std::string getCachePrefix(const std::string& sourcePath, texture_compressor::Compression compression){
+        char hex[9];
+        uint64_t pathHash = hash_utils::hash(sourcePath.data(), sourcePath.size());
+        std::snprintf(hex, sizeof(hex), "%08llx", static_cast<unsigned long long>(pathHash & 0xffffffffULL));
+        return fs::path(sourcePath).stem().string() + "-" + hex + "-" + std::to_string(static_cast<uint32_t>(compression)) + "-";
+    }
+
+    std::string getCachePath(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key){
+        return (fs::path(CACHE_DIRECTORY) / cache_file::getFileName(getCachePrefix(sourcePath, compression), key, ".tex")).string();
+    }
+
+    // Returns the compression that is stored in the given internal format (NONE if the format is not a known compressed format)
+    static texture_compressor::Compression getCompression(uint32_t format){
+        using texture_compressor::Compression;
+        for(Compression compression : {Compression::BC1, Compression::BC3, Compression::BC5}){
+            if(texture_compressor::getInternalFormat(compression) == format) return compression;
+        }
+        return Compression::NONE;
+    }
+
+    bool read(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key, texture_compressor::CompressedImage& image){
+        std::string cachePath = getCachePath(sourcePath, compression, key);
+        std::error_code error;
+        if(!fs::exists(cachePath, error)) return false;
+
+        MappedFile file(cachePath);
+        if(!file.isOpen() || file.size() < sizeof(CacheHeader)) return false;
+        CacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(CacheHeader));
+
+        // Make sure that the file was written by this version for the same source and that all the levels are inside the file
+        auto stored = getCompression(header.format);
+        bool valid = std::memcmp(header.magic, MAGIC, 4) == 0 && header.fileVersion == FILE_VERSION && header.key == key &&
+                     stored != texture_compressor::Compression::NONE && header.width > 0 && header.height > 0 &&
+                     header.levelCount > 0 && header.levelCount <= 32 &&
+                     isInside(sizeof(CacheHeader), uint64_t(header.levelCount) * sizeof(CacheLevel), file.size());
+        std::vector<CacheLevel> levels(valid ? header.levelCount : 0);
+        if(valid) std::memcpy(levels.data(), file.data() + sizeof(CacheHeader), levels.size() * sizeof(CacheLevel));
+        for(uint32_t index = 0; index < levels.size() && valid; ++index){
+            uint32_t width = std::max(1u, header.width >> index), height = std::max(1u, header.height >> index);
+            valid = levels[index].size == getLevelSize(width, height, texture_compressor::getBlockSize(stored)) &&
+                    isInside(levels[index].offset, levels[index].size, file.size());
+        }
+        if(!valid){
+            std::cerr << "Ignoring invalid texture cache file: " << cachePath << std::endl;
+            return false;
+        }
+
+        image.format = header.format;
+        image.size = {int(header.width), int(header.height)};
+        image.levels.resize(levels.size());
+        for(size_t index = 0; index < levels.size(); ++index){
+            const char* start = file.data() + levels[index].offset;
+            image.levels[index].assign(start, start + levels[index].size);
+        }
+        return true;
+    }
+
+    bool store(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key, const texture_compressor::CompressedImage& image){
+        std::error_code error;
+        fs::create_directories(CACHE_DIRECTORY, error);
+        std::string cachePath = getCachePath(sourcePath, compression, key);
+
+        CacheHeader header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.fileVersion = FILE_VERSION;
+        header.key = key;
+        header.format = image.format;
+        header.width = uint32_t(image.size.x);
+        header.height = uint32_t(image.size.y);
+        header.levelCount = uint32_t(image.levels.size());
+        std::vector<CacheLevel> levels(image.levels.size());
+        uint64_t offset = alignTo16(sizeof(CacheHeader) + levels.size() * sizeof(CacheLevel));
+        for(size_t index = 0; index < levels.size(); ++index){
+            levels[index] = {offset, image.levels[index].size()};
+            offset = alignTo16(offset + image.levels[index].size());
+        }
+
+        bool written = cache_file::writeAtomically(cachePath, [&](std::ostream& file){
+            file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+            file.write(reinterpret_cast<const char*>(levels.data()), std::streamsize(levels.size() * sizeof(CacheLevel)));
+            for(size_t index = 0; index < levels.size(); ++index){
+                cache_file::writeAt(file, levels[index].offset, image.levels[index].data(), image.levels[index].size());
+            }
+            return true;
+        });
+        if(!written) return false;
+
+        // Delete the stale cache files of the same source & compression (they have the same prefix but a different key)
+        cache_file::removeStale(CACHE_DIRECTORY, getCachePrefix(sourcePath, compression), ".tex", fs::path(cachePath).filename().string());
+        return true;
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "texture-compressor.hpp"
+#include <cstdint>
+#include <string>
+
+namespace our::texture_cache {
+
+    // Compressing an image and building its mip chain is slow, so the result is written to a binary cache file
+    // that stores the compressed levels exactly as they are uploaded to the GPU (similar to a KTX or a DDS file).
+    // The cache file name contains a hash of the source file contents, the compressor version and the requested compression,
+    // so editing the source file makes the old cache file stale and it is replaced on the next load.
+    //
+    // File layout (little endian, every level starts at a multiple of 16 bytes):
+    //   CacheHeader | level table | level 0 | level 1 | ...
+
+    // Increment this whenever the compressor or the mip filter changes its output, so that the old cache files are rebuilt
+    constexpr uint32_t COMPRESSOR_VERSION = 1;
+    // Increment this whenever the layout of the cache file changes
+    constexpr uint32_t FILE_VERSION = 1;
+
+    struct CacheHeader {
+        char magic[4];              // Always "OTEX"
+        uint32_t fileVersion;
+        uint64_t key;               // The hash of the source contents, the compressor version and the requested compression
+        uint32_t format;            // The compressed internal format
+        uint32_t width, height;     // The size of the first level
+        uint32_t levelCount;
+    };
+    static_assert(sizeof(CacheHeader) == 32, "The cache header should not contain any padding");
+
+    // The location of a level in the cache file
+    struct CacheLevel {
+        uint64_t offset, size;
+    };
+
+    // Returns the key that identifies the cache file of the given source file when it is loaded with the given compression
+    // Returns 0 if the source file could not be read
+    uint64_t computeKey(const std::string& sourcePath, texture_compressor::Compression compression);
+
+    // Returns the path of the cache file of the given source file and key (inside the "cache/textures" folder)
+    // The name contains the source name, a hash of its path and the requested compression, so that different sources with the same name
+    // and the same source loaded with different compressions do not collide
+    std::string getCachePath(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key);
+
+    // Reads the cache file of the given source file into the given image
+    // Returns false if there is no valid cache file for this key
+    bool read(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key, texture_compressor::CompressedImage& image);
+
+    // Writes the given image into the cache file of the given source file and deletes the stale cache files of the same source & compression
+    bool store(const std::string& sourcePath, texture_compressor::Compression compression, uint64_t key, const texture_compressor::CompressedImage& image);
+
+}
@@ -0,0 +1,227 @@
+#include "texture-compressor.hpp"
+#include "texture-cache.hpp"
+#include "texture-utils.hpp"
+#include "../jobs/job-system.hpp"
+
+#include <glm/common.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace our::texture_compressor {
+
+    Compression parseCompression(const std::string& name){
+        if(name == "auto") return Compression::AUTO;
+        if(name == "bc1") return Compression::BC1;
+        if(name == "bc3") return Compression::BC3;
+        if(name == "bc5") return Compression::BC5;
+        return Compression::NONE;
+    }
+
+    bool isSupported(Compression compression){
+        switch(compression){
+            case Compression::AUTO:
+            case Compression::BC1:
+            case Compression::BC3: return GLAD_GL_EXT_texture_compression_s3tc;
+            default: return true;
+        }
+    }
+
+    GLenum getInternalFormat(Compression compression){
+        switch(compression){
+            case Compression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case Compression::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case Compression::BC5: return GL_COMPRESSED_RG_RGTC2;
+            default: return 0;
+        }
+    }
+
+    size_t getBlockSize(Compression compression){
+        return compression == Compression::BC1 ? 8 : 16;
+    }
+
+    std::vector<MipLevel> buildMipChain(const uint8_t* pixels, glm::ivec2 size){
+        std::vector<MipLevel> levels;
+        levels.push_back({size, std::vector<uint8_t>(pixels, pixels + size_t(size.x) * size.y * 4)});
+        while(size.x > 1 || size.y > 1){
+            const MipLevel& source = levels.back();
+            glm::ivec2 next = glm::max(size / 2, glm::ivec2(1));
+            MipLevel level = {next, std::vector<uint8_t>(size_t(next.x) * next.y * 4)};
+            // Each texel is the average of the 2x2 texels above it (the last row or column is repeated if the size is odd)
+            // The inner loop runs over the bytes of a row, so the compiler can vectorize it
+            for(int y = 0; y < next.y; ++y){
+                const uint8_t* row0 = source.pixels.data() + size_t(std::min(2 * y, size.y - 1)) * size.x * 4;
+                const uint8_t* row1 = source.pixels.data() + size_t(std::min(2 * y + 1, size.y - 1)) * size.x * 4;
+                uint8_t* output = level.pixels.data() + size_t(y) * next.x * 4;
+                for(int x = 0; x < next.x; ++x){
+                    int x0 = std::min(2 * x, size.x - 1) * 4, x1 = std::min(2 * x + 1, size.x - 1) * 4;
+                    for(int channel = 0; channel < 4; ++channel){
+                        output[4 * x + channel] = uint8_t((row0[x0 + channel] + row0[x1 + channel] + row1[x0 + channel] + row1[x1 + channel] + 2) >> 2);
+                    }
+                }
+            }
+            levels.push_back(std::move(level));
+            size = next;
+        }
+        return levels;
+    }
+
+    // Converts an RGB color to RGB565 (5 bits for red, 6 bits for green and 5 bits for blue)
+    static uint16_t toRGB565(const int color[3]){
+        return uint16_t(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+    }
+
+    // Converts an RGB565 color back to 8 bits per channel (the high bits are repeated in the low bits, as the GPU does)
+    static void fromRGB565(uint16_t value, int color[3]){
+        int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Compresses the colors of a block into a BC1 block (8 bytes): two RGB565 endpoints then a 2 bit index per texel
+    // The endpoints are the corners of the bounding box of the block colors (inset a bit to reduce the error of the common colors),
+    // and each texel picks the nearest of the 4 colors on the line between the endpoints.
+    static void compressColors(const uint8_t* block, uint8_t* output){
+        int minimum[3] = {255, 255, 255}, maximum[3] = {0, 0, 0};
+        for(int texel = 0; texel < 16; ++texel){
+            for(int channel = 0; channel < 3; ++channel){
+                minimum[channel] = std::min<int>(minimum[channel], block[4 * texel + channel]);
+                maximum[channel] = std::max<int>(maximum[channel], block[4 * texel + channel]);
+            }
+        }
+        for(int channel = 0; channel < 3; ++channel){
+            int inset = (maximum[channel] - minimum[channel]) >> 4;
+            minimum[channel] += inset;
+            maximum[channel] -= inset;
+        }
+        uint16_t endpoints[2] = {toRGB565(maximum), toRGB565(minimum)};
+        // The first endpoint must be greater than the second for the block to use 4 colors (instead of 3 colors and a transparent one)
+        if(endpoints[0] < endpoints[1]) std::swap(endpoints[0], endpoints[1]);
+
+        uint32_t indices = 0;
+        if(endpoints[0] != endpoints[1]){
+            int palette[4][3];
+            fromRGB565(endpoints[0], palette[0]);
+            fromRGB565(endpoints[1], palette[1]);
+            for(int channel = 0; channel < 3; ++channel){
+                palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+                palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+            }
+            for(int texel = 0; texel < 16; ++texel){
+                int best = 0, bestDistance = INT32_MAX;
+                for(int index = 0; index < 4; ++index){
+                    int distance = 0;
+                    for(int channel = 0; channel < 3; ++channel){
+                        int difference = int(block[4 * texel + channel]) - palette[index][channel];
+                        distance += difference * difference;
+                    }
+                    if(distance < bestDistance){ bestDistance = distance; best = index; }
+                }
+                indices |= uint32_t(best) << (2 * texel);
+            }
+        }
+        std::memcpy(output, &endpoints[0], 2);
+        std::memcpy(output + 2, &endpoints[1], 2);
+        std::memcpy(output + 4, &indices, 4);
+    }
+
+    // Compresses a single channel of a block into a BC4 block (8 bytes): two 8 bit endpoints then a 3 bit index per texel
+    // The endpoints are the maximum & minimum of the channel and each texel picks the nearest of the 8 values between them.
+    // (BC3 uses this for the alpha and BC5 uses it for the red and the green)
+    static void compressChannel(const uint8_t* block, int channel, uint8_t* output){
+        int minimum = 255, maximum = 0;
+        for(int texel = 0; texel < 16; ++texel){
+            minimum = std::min<int>(minimum, block[4 * texel + channel]);
+            maximum = std::max<int>(maximum, block[4 * texel + channel]);
+        }
+        output[0] = uint8_t(maximum);
+        output[1] = uint8_t(minimum);
+        uint64_t indices = 0;
+        if(maximum != minimum){
+            int range = maximum - minimum;
+            for(int texel = 0; texel < 16; ++texel){
+                // The position of the value between the endpoints, from 0 (the maximum) to 7 (the minimum)
+                int position = ((maximum - block[4 * texel + channel]) * 14 + range) / (2 * range);
+                // The indices 0 & 1 are the endpoints and the indices 2 to 7 are the values between them
+                int index = position == 0 ? 0 : position == 7 ? 1 : position + 1;
+                indices |= uint64_t(index) << (3 * texel);
+            }
+        }
+        for(int byte = 0; byte < 6; ++byte) output[2 + byte] = uint8_t(indices >> (8 * byte));
+    }
+
+    void compressBlock(Compression compression, const uint8_t* block, uint8_t* output){
+        switch(compression){
+            case Compression::BC1:
+                compressColors(block, output);
+                break;
+            case Compression::BC3:
+                compressChannel(block, 3, output);
+                compressColors(block, output + 8);
+                break;
+            case Compression::BC5:
+                compressChannel(block, 0, output);
+                compressChannel(block, 1, output + 8);
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::vector<uint8_t> compressLevel(Compression compression, const MipLevel& level){
+        glm::ivec2 blocks = (level.size + 3) / 4;
+        size_t blockSize = getBlockSize(compression);
+        std::vector<uint8_t> output(size_t(blocks.x) * blocks.y * blockSize);
+        // The rows of blocks are compressed in parallel
+        JobSystem::get().parallelFor(size_t(blocks.y), 16, [&](size_t begin, size_t end){
+            uint8_t block[64];
+            for(size_t blockY = begin; blockY < end; ++blockY){
+                for(int blockX = 0; blockX < blocks.x; ++blockX){
+                    // Gather the 4x4 texels of the block (repeating the last row & column at the edges)
+                    for(int y = 0; y < 4; ++y){
+                        int sourceY = std::min(int(blockY) * 4 + y, level.size.y - 1);
+                        for(int x = 0; x < 4; ++x){
+                            int sourceX = std::min(blockX * 4 + x, level.size.x - 1);
+                            std::memcpy(block + 4 * (4 * y + x), level.pixels.data() + (size_t(sourceY) * level.size.x + sourceX) * 4, 4);
+                        }
+                    }
+                    compressBlock(compression, block, output.data() + (blockY * blocks.x + blockX) * blockSize);
+                }
+            }
+        });
+        return output;
+    }
+
+    Compression chooseCompression(Compression requested, const uint8_t* pixels, glm::ivec2 size){
+        if(requested != Compression::AUTO) return requested;
+        size_t count = size_t(size.x) * size.y;
+        for(size_t texel = 0; texel < count; ++texel){
+            if(pixels[4 * texel + 3] != 255) return Compression::BC3;
+        }
+        return Compression::BC1;
+    }
+
+    bool load(const std::string& filename, Compression compression, bool useCache, CompressedImage& image){
+        if(compression == Compression::NONE) return false;
+
+        // If the file was compressed before (and did not change since then), we read the compressed levels from the cache
+        uint64_t cacheKey = useCache ? texture_cache::computeKey(filename, compression) : 0;
+        if(cacheKey != 0 && texture_cache::read(filename, compression, cacheKey, image)) return true;
+
+        texture_utils::Image decoded;
+        if(!texture_utils::decodeImage(filename, decoded)) return false;
+        Compression chosen = chooseCompression(compression, decoded.pixels.get(), decoded.size);
+
+        // The mip chain is built on the CPU before compressing since the GPU can not generate the mip levels of a compressed texture
+        std::vector<MipLevel> mips = buildMipChain(decoded.pixels.get(), decoded.size);
+        image.format = getInternalFormat(chosen);
+        image.size = decoded.size;
+        image.levels.clear();
+        for(const auto& mip : mips) image.levels.push_back(compressLevel(chosen, mip));
+
+        if(cacheKey != 0) texture_cache::store(filename, compression, cacheKey, image);
+        return true;
+    }
+
+}
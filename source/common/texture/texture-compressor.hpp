@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace our::texture_compressor {
+
+    // The block compression formats that a texture can be stored in on the GPU.
+    // Each format stores a block of 4x4 texels in a fixed number of bytes, so the GPU samples them without decompressing the whole texture:
+    // - BC1 (8 bytes per block): RGB without alpha. It is 8 times smaller than RGBA8.
+    // - BC3 (16 bytes per block): RGB + a separately compressed alpha. It is 4 times smaller than RGBA8.
+    // - BC5 (16 bytes per block): two separately compressed channels (R & G), which suits normal maps (Z is reconstructed in the shader).
+    // AUTO picks BC3 if the image has any transparent texel, otherwise BC1.
+    enum class Compression {
+        NONE,
+        AUTO,
+        BC1,
+        BC3,
+        BC5
+    };
+
+    // Converts a string ("none", "auto", "bc1", "bc3" or "bc5") to a compression (NONE if the string is not recognized)
+    Compression parseCompression(const std::string& name);
+
+    // Returns whether the context can sample the given compression
+    // BC1 & BC3 need "GL_EXT_texture_compression_s3tc" while BC5 (RGTC) is a part of OpenGL 3.0
+    bool isSupported(Compression compression);
+
+    // Returns the OpenGL internal format of the given compression (0 for NONE and AUTO)
+    GLenum getInternalFormat(Compression compression);
+    // Returns the number of bytes that store a 4x4 block in the given compression
+    size_t getBlockSize(Compression compression);
+
+    // A level of a mip chain in RGBA8
+    struct MipLevel {
+        glm::ivec2 size;
+        std::vector<uint8_t> pixels;
+    };
+
+    // A compressed image with its full mip chain (as it is uploaded to the GPU)
+    struct CompressedImage {
+        GLenum format = 0;                          // The compressed internal format
+        glm::ivec2 size = {0, 0};                   // The size of the first level
+        std::vector<std::vector<uint8_t>> levels;   // The compressed blocks of each level (starting from the full size)
+    };
+
+    // Builds the full mip chain of an RGBA8 image (the first level is a copy of the image)
+    // Each level is computed from the previous one by averaging each 2x2 texels (a box filter)
+    std::vector<MipLevel> buildMipChain(const uint8_t* pixels, glm::ivec2 size);
+
+    // Compresses a single 4x4 block of RGBA8 texels (64 bytes in row order) into "output" (which must have room for a block)
+    void compressBlock(Compression compression, const uint8_t* block, uint8_t* output);
+
+    // Compresses a whole level (the blocks on the right & bottom edges repeat their last texels if the size is not a multiple of 4)
+    std::vector<uint8_t> compressLevel(Compression compression, const MipLevel& level);
+
+    // Picks the compression of an image: AUTO becomes BC3 if the image has any transparent texel, otherwise BC1
+    Compression chooseCompression(Compression requested, const uint8_t* pixels, glm::ivec2 size);
+
+    // Loads an image file as a compressed image with its mip chain
+    // If "useCache" is true, the result is read from (or written to) the texture cache (see "texture-cache.hpp"),
+    // so the image is only decoded & compressed on the first launch.
+    // This does not use OpenGL, so it can run on a worker thread. Returns false if the file could not be decoded.
+    bool load(const std::string& filename, Compression compression, bool useCache, CompressedImage& image);
+
+}
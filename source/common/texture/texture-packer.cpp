@@ -0,0 +1,210 @@
+#include "texture-packer.hpp"
+#include "texture-uploader.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <iostream>
+
+namespace our::texture_packer {
+
+    std::vector<AtlasPlacement> layoutAtlas(const std::vector<glm::ivec2>& sizes, int atlasSize, int padding){
+        auto getCellSize = [padding](glm::ivec2 size){ return (size + 2 * padding + padding - 1) / padding * padding; };
+
+        // The cells are placed from the tallest to the shortest, so the first cell of each shelf defines its height
+        std::vector<size_t> order(sizes.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](size_t first, size_t second){
+            return getCellSize(sizes[first]).y > getCellSize(sizes[second]).y;
+        });
+
+        struct Shelf { int page, y, height, x; };
+        std::vector<Shelf> shelves;
+        std::vector<int> pageHeights; // The height used by the shelves of each page
+        std::vector<AtlasPlacement> placements(sizes.size());
+        for(size_t index : order){
+            glm::ivec2 cell = getCellSize(sizes[index]);
+            if(cell.x > atlasSize || cell.y > atlasSize) continue;
+
+            // Use the first shelf that has room for the cell, otherwise start a new shelf (in a new page if needed)
+            auto shelf = std::find_if(shelves.begin(), shelves.end(), [&](const Shelf& shelf){
+                return shelf.height >= cell.y && shelf.x + cell.x <= atlasSize;
+            });
+            if(shelf == shelves.end()){
+                auto page = std::find_if(pageHeights.begin(), pageHeights.end(), [&](int height){ return height + cell.y <= atlasSize; });
+                if(page == pageHeights.end()) page = pageHeights.insert(pageHeights.end(), 0);
+                shelves.push_back({int(page - pageHeights.begin()), *page, cell.y, 0});
+                *page += cell.y;
+                shelf = shelves.end() - 1;
+            }
+            placements[index].page = shelf->page;
+            placements[index].offset = {shelf->x + padding, shelf->y + padding};
+            shelf->x += cell.x;
+        }
+        return placements;
+    }
+
+    void copyWithBorder(const uint8_t* image, glm::ivec2 size, uint8_t* page, int pageSize, glm::ivec2 offset, int padding){
+        auto wrap = [](int value, int size){ return (value % size + size) % size; };
+        for(int y = -padding; y < size.y + padding; ++y){
+            const uint8_t* source = image + size_t(wrap(y, size.y)) * size.x * 4;
+            uint8_t* destination = page + (size_t(offset.y + y) * pageSize + offset.x) * 4;
+            // The middle of the row is copied as is while the borders wrap around
+            std::memcpy(destination, source, size_t(size.x) * 4);
+            for(int x = -padding; x < 0; ++x) std::memcpy(destination + x * 4, source + wrap(x, size.x) * 4, 4);
+            for(int x = size.x; x < size.x + padding; ++x) std::memcpy(destination + x * 4, source + wrap(x, size.x) * 4, 4);
+        }
+    }
+
+    // Converts an image to RGBA8 (the gray channels are copied to RGB like the channel swizzle does)
+    static std::vector<uint8_t> toRGBA(const texture_utils::Image& image){
+        size_t texelCount = size_t(image.size.x) * image.size.y;
+        std::vector<uint8_t> pixels(texelCount * 4);
+        const uint8_t* source = image.pixels.get();
+        for(size_t texel = 0; texel < texelCount; ++texel){
+            uint8_t* destination = &pixels[4 * texel];
+            switch(image.channels){
+                case 1: destination[0] = destination[1] = destination[2] = source[texel]; destination[3] = 255; break;
+                case 2: destination[0] = destination[1] = destination[2] = source[2 * texel]; destination[3] = source[2 * texel + 1]; break;
+                default: std::memcpy(destination, source + 4 * texel, 4); break;
+            }
+        }
+        return pixels;
+    }
+
+    // Creates a texture array with storage for the given number of layers & levels
+    static TextureArray* createArray(GLenum internalFormat, glm::ivec2 size, GLsizei layers, GLsizei levels){
+        TextureArray* array = new TextureArray();
+        array->bind();
+        if(TextureUploader::supportsTextureStorage()){
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, size.x, size.y, layers);
+        } else {
+            for(GLsizei level = 0; level < levels; ++level){
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, std::max(1, size.x >> level), std::max(1, size.y >> level),
+                             layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        return array;
+    }
+
+    PackResult pack(std::vector<PackInput>& inputs, const PackOptions& options){
+        PackResult result;
+        int padding = 1;
+        while(padding < options.atlasPadding) padding <<= 1;
+
+        // Group the textures by their size & format (the compressed textures must also have the same number of levels)
+        struct Group {
+            glm::ivec2 size;
+            GLenum format;
+            size_t levelCount;
+            std::vector<size_t> members;
+        };
+        std::vector<Group> groups;
+        for(size_t index = 0; index < inputs.size(); ++index){
+            const PackInput& input = inputs[index];
+            bool compressed = !input.compressed.levels.empty();
+            if(!compressed && !input.image.pixels){
+                result.unpacked.push_back(index);
+                continue;
+            }
+            glm::ivec2 size = compressed ? input.compressed.size : input.image.size;
+            GLenum format = compressed ? input.compressed.format : texture_utils::getInternalFormat(input.image.channels, input.image.srgb);
+            size_t levelCount = compressed ? input.compressed.levels.size() : 0;
+            auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& group){
+                return group.size == size && group.format == format && group.levelCount == levelCount;
+            });
+            if(group == groups.end()) group = groups.insert(groups.end(), {size, format, levelCount, {}});
+            group->members.push_back(index);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<size_t> atlasCandidates;
+        for(const Group& group : groups){
+            if(group.members.size() < 2){
+                // A texture without a match can still go into an atlas if it is small enough
+                const PackInput& input = inputs[group.members[0]];
+                bool small = group.size.x <= options.atlasMaxTextureSize && group.size.y <= options.atlasMaxTextureSize;
+                if(group.levelCount == 0 && !input.image.srgb && small) atlasCandidates.push_back(group.members[0]);
+                else result.unpacked.push_back(group.members[0]);
+                continue;
+            }
+
+            GLsizei layers = GLsizei(group.members.size());
+            if(group.levelCount > 0){
+                // The compressed textures already have their mip chains, so each level of each layer is uploaded as is
+                TextureArray* array = createArray(group.format, group.size, layers, GLsizei(group.levelCount));
+                for(GLsizei layer = 0; layer < layers; ++layer){
+                    const auto& levels = inputs[group.members[layer]].compressed.levels;
+                    for(size_t level = 0; level < levels.size(); ++level){
+                        glm::ivec2 size = glm::max(group.size >> int(level), glm::ivec2(1));
+                        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, layer, size.x, size.y, 1,
+                                                  group.format, GLsizei(levels[level].size()), levels[level].data());
+                    }
+                }
+                result.arrays.push_back(array);
+            } else {
+                int channels = inputs[group.members[0]].image.channels;
+                GLsizei levels = 1 + GLsizei(std::floor(std::log2(std::max(group.size.x, group.size.y))));
+                TextureArray* array = createArray(group.format, group.size, layers, levels);
+                for(GLsizei layer = 0; layer < layers; ++layer){
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, group.size.x, group.size.y, 1,
+                                    texture_utils::getPixelFormat(channels), GL_UNSIGNED_BYTE, inputs[group.members[layer]].image.pixels.get());
+                }
+                glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+                texture_utils::setChannelSwizzle(channels, GL_TEXTURE_2D_ARRAY);
+                result.arrays.push_back(array);
+            }
+            for(GLsizei layer = 0; layer < layers; ++layer){
+                PackInput& input = inputs[group.members[layer]];
+                result.regions.push_back({input.name, {result.arrays.back(), layer, {0.0f, 0.0f, 1.0f, 1.0f}}});
+                input.image.pixels.reset();
+                input.compressed.levels.clear();
+            }
+        }
+
+        // Packing a single texture into an atlas would not merge any draws, so an atlas needs at least 2 textures
+        std::vector<glm::ivec2> sizes;
+        for(size_t index : atlasCandidates) sizes.push_back(inputs[index].image.size);
+        std::vector<AtlasPlacement> placements = layoutAtlas(sizes, options.atlasSize, padding);
+        int pageCount = 0;
+        for(const auto& placement : placements) pageCount = std::max(pageCount, placement.page + 1);
+        if(atlasCandidates.size() >= 2 && pageCount > 0){
+            // The cells are aligned to the padding, so the levels up to log2(padding) never mix two cells and still have a border of 1 texel
+            GLsizei levels = std::min(1 + GLsizei(std::log2(padding)), 1 + GLsizei(std::floor(std::log2(options.atlasSize))));
+            TextureArray* array = createArray(GL_RGBA8, glm::ivec2(options.atlasSize), pageCount, levels);
+            std::vector<uint8_t> page(size_t(options.atlasSize) * options.atlasSize * 4);
+            for(int pageIndex = 0; pageIndex < pageCount; ++pageIndex){
+                std::fill(page.begin(), page.end(), uint8_t(0));
+                for(size_t candidate = 0; candidate < atlasCandidates.size(); ++candidate){
+                    if(placements[candidate].page != pageIndex) continue;
+                    PackInput& input = inputs[atlasCandidates[candidate]];
+                    std::vector<uint8_t> pixels = toRGBA(input.image);
+                    copyWithBorder(pixels.data(), input.image.size, page.data(), options.atlasSize, placements[candidate].offset, padding);
+                    glm::vec4 rect = glm::vec4(glm::vec2(placements[candidate].offset), glm::vec2(input.image.size)) / float(options.atlasSize);
+                    result.regions.push_back({input.name, {array, pageIndex, rect}});
+                    input.image.pixels.reset();
+                }
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, pageIndex, options.atlasSize, options.atlasSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, page.data());
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            result.arrays.push_back(array);
+            // The textures that are too big for a page (because of the padding) are left unpacked
+            for(size_t candidate = 0; candidate < atlasCandidates.size(); ++candidate){
+                if(placements[candidate].page < 0) result.unpacked.push_back(atlasCandidates[candidate]);
+            }
+        } else {
+            result.unpacked.insert(result.unpacked.end(), atlasCandidates.begin(), atlasCandidates.end());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        TextureArray::unbind();
+
+        std::sort(result.unpacked.begin(), result.unpacked.end());
+        std::cout << "Packed " << result.regions.size() << " textures into " << result.arrays.size() << " texture arrays" << std::endl;
+        return result;
+    }
+
+}
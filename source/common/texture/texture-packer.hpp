@@ -0,0 +1,56 @@
+#pragma once
+
+#include "texture-array.hpp"
+#include "texture-utils.hpp"
+#include "texture-compressor.hpp"
+
+#include <glm/vec2.hpp>
+#include <string>
+#include <vector>
+
+namespace our::texture_packer {
+
+    // The packer moves textures into texture arrays so that the materials using them can be batched:
+    // - The textures that share the size & the format (at least 2 of them) become the layers of a texture array.
+    // - The remaining small uncompressed textures are packed into atlases (which are the layers of another texture array).
+    //   Each texture in an atlas is surrounded by a border of wrapped texels and the cells are aligned to the border size,
+    //   so the bilinear filtering and the mip levels (which are limited so that each level still has a border) never mix two textures.
+    struct PackOptions {
+        int atlasSize = 1024;           // The width & height of an atlas page
+        int atlasMaxTextureSize = 256;  // The textures whose width & height are not bigger than this can be packed into an atlas
+        int atlasPadding = 8;           // The border around each texture in an atlas (rounded up to a power of 2)
+    };
+
+    // A decoded texture that should be packed. Either the image or the compressed image has data.
+    struct PackInput {
+        std::string name;
+        texture_utils::Image image;
+        texture_compressor::CompressedImage compressed;
+    };
+
+    // The place of a texture inside an atlas page
+    struct AtlasPlacement {
+        int page = -1;                  // -1 if the texture does not fit in a page
+        glm::ivec2 offset = {0, 0};     // The offset of the texture (excluding the border) in texels
+    };
+
+    // Places textures of the given sizes into atlas pages using shelves (rows of cells sorted by height)
+    // Each cell holds the texture and its border and its size is rounded up to a multiple of the padding
+    std::vector<AtlasPlacement> layoutAtlas(const std::vector<glm::ivec2>& sizes, int atlasSize, int padding);
+
+    // Copies an RGBA8 image into an RGBA8 page at the given offset, surrounded by a border of "padding" texels
+    // The border wraps around the image, so sampling near the edges of the region gives the same result as GL_REPEAT
+    void copyWithBorder(const uint8_t* image, glm::ivec2 size, uint8_t* page, int pageSize, glm::ivec2 offset, int padding);
+
+    // The result of packing
+    struct PackResult {
+        std::vector<TextureArray*> arrays;                              // The created arrays (the caller takes their ownership)
+        std::vector<std::pair<std::string, TextureRegion>> regions;     // The region of each packed texture by its name
+        std::vector<size_t> unpacked;                                   // The indices of the inputs that were not packed
+    };
+
+    // Packs the given textures into texture arrays (this uses OpenGL, so it must be called on the main thread)
+    // The images of the packed inputs are freed, while the unpacked inputs are left as they are.
+    PackResult pack(std::vector<PackInput>& inputs, const PackOptions& options);
+
+}
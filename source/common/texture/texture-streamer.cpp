@@ -0,0 +1,200 @@
+#include "texture-streamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+
+namespace our {
+
+    void removeStreamedTexture(Texture2D* texture){
+        TextureStreamer::get().remove(texture);
+    }
+
+    TextureStreamer& TextureStreamer::get(){
+        static TextureStreamer instance;
+        return instance;
+    }
+
+    void TextureStreamer::specifyLevel(const Entry& entry, int level, bool data){
+        // A level is freed by giving it an empty image. This does not break the texture since the levels before the base level are ignored.
+        glm::ivec2 size = data ? glm::max(entry.size >> level, glm::ivec2(1)) : glm::ivec2(0);
+        const std::vector<uint8_t>& pixels = entry.levels[level];
+        if(data && entry.pixelFormat == 0){
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, size.x, size.y, 0, GLsizei(pixels.size()), pixels.data());
+        } else {
+            // The pixel format & type are ignored when there is no data, even for the compressed formats
+            glTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, size.x, size.y, 0,
+                         entry.pixelFormat ? entry.pixelFormat : GL_RGBA, GL_UNSIGNED_BYTE, data ? pixels.data() : nullptr);
+        }
+    }
+
+    Texture2D* TextureStreamer::add(Entry entry){
+        int levelCount = int(entry.levels.size());
+        entry.tailBase = levelCount - 1;
+        for(int level = 0; level < levelCount; ++level){
+            glm::ivec2 size = glm::max(entry.size >> level, glm::ivec2(1));
+            if(size.x <= TAIL_SIZE && size.y <= TAIL_SIZE){ entry.tailBase = level; break; }
+        }
+        entry.residentBase = entry.requestedBase = entry.tailBase;
+
+        // The levels are specified one by one (instead of an immutable storage) so that each level can be freed on its own
+        Texture2D* texture = new Texture2D();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, texture->getOpenGLName());
+        for(int level = entry.tailBase; level < levelCount; ++level){
+            specifyLevel(entry, level, true);
+            residentBytes += entry.levels[level].size();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.tailBase);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        texture->setStreamed(true);
+        entries.emplace(texture, std::move(entry));
+        return texture;
+    }
+
+    Texture2D* TextureStreamer::add(std::vector<texture_compressor::MipLevel> levels, bool srgb){
+        if(levels.empty()) return nullptr;
+        Entry entry;
+        entry.internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        entry.pixelFormat = GL_RGBA;
+        entry.size = levels[0].size;
+        for(auto& level : levels) entry.levels.push_back(std::move(level.pixels));
+        return add(std::move(entry));
+    }
+
+    Texture2D* TextureStreamer::add(texture_compressor::CompressedImage image){
+        if(image.levels.empty()) return nullptr;
+        Entry entry;
+        entry.internalFormat = image.format;
+        entry.pixelFormat = 0;
+        entry.size = image.size;
+        entry.levels = std::move(image.levels);
+        return add(std::move(entry));
+    }
+
+    void TextureStreamer::request(Texture2D* texture, float screenPixels){
+        if(!texture || !texture->isStreamed()) return;
+        auto it = entries.find(texture);
+        if(it == entries.end()) return;
+        Entry& entry = it->second;
+        // Each level halves the size, so the level that fits the screen size is log2(texture size / screen size)
+        float ratio = float(std::max(entry.size.x, entry.size.y)) / std::max(screenPixels, 1.0f);
+        int level = ratio > 1.0f ? std::min(int(std::floor(std::log2(ratio))), entry.tailBase) : 0;
+        if(entry.lastUsedFrame != frame) entry.requestedBase = entry.tailBase;
+        entry.requestedBase = std::min(entry.requestedBase, level);
+        entry.lastUsedFrame = frame;
+    }
+
+    int TextureStreamer::getWantedBase(const Entry& entry) const {
+        // The textures that were not drawn since the last update only need their tail
+        return entry.lastUsedFrame == frame ? entry.requestedBase : entry.tailBase;
+    }
+
+    void TextureStreamer::evict(Texture2D* texture, Entry& entry, int base){
+        // The base level is raised before the levels are freed, so the texture never samples a freed level
+        glBindTexture(GL_TEXTURE_2D, texture->getOpenGLName());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+        for(int level = entry.residentBase; level < base; ++level){
+            specifyLevel(entry, level, false);
+            residentBytes -= entry.levels[level].size();
+        }
+        entry.residentBase = base;
+    }
+
+    void TextureStreamer::update(){
+        if(entries.empty()){ ++frame; return; }
+
+        // The textures are sorted from the least to the most recently used (the bigger textures first among the textures used in the same frame)
+        std::vector<std::pair<Texture2D*, Entry*>> order;
+        order.reserve(entries.size());
+        size_t neededBytes = 0;
+        for(auto& [texture, entry] : entries){
+            order.push_back({texture, &entry});
+            for(int level = getWantedBase(entry); level < entry.residentBase; ++level) neededBytes += entry.levels[level].size();
+        }
+        std::sort(order.begin(), order.end(), [](const auto& first, const auto& second){
+            if(first.second->lastUsedFrame != second.second->lastUsedFrame) return first.second->lastUsedFrame < second.second->lastUsedFrame;
+            return first.second->levels[first.second->residentBase].size() > second.second->levels[second.second->residentBase].size();
+        });
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // First, we evict the levels that are not wanted anymore (in LRU order) till the wanted levels fit in the budget
+        for(auto& [texture, entry] : order){
+            if(residentBytes + neededBytes <= budget) break;
+            int wanted = getWantedBase(*entry);
+            if(wanted > entry->residentBase) evict(texture, *entry, wanted);
+        }
+        // If the textures drawn this frame still do not fit, they lose their finest levels one at a time (in LRU order)
+        bool evicted = true;
+        while(residentBytes > budget && evicted){
+            evicted = false;
+            for(auto& [texture, entry] : order){
+                if(residentBytes <= budget) break;
+                if(entry->residentBase >= entry->tailBase) continue;
+                evict(texture, *entry, entry->residentBase + 1);
+                evicted = true;
+            }
+        }
+
+        // Then we stream in the missing levels, starting from the most recently used textures
+        // Each texture gets its levels from the coarse to the fine ones, so it gets sharper with each level
+        size_t uploadedBytes = 0;
+        for(auto it = order.rbegin(); it != order.rend(); ++it){
+            auto& [texture, entry] = *it;
+            int wanted = getWantedBase(*entry);
+            if(wanted >= entry->residentBase) continue;
+            glBindTexture(GL_TEXTURE_2D, texture->getOpenGLName());
+            while(entry->residentBase > wanted){
+                int level = entry->residentBase - 1;
+                size_t bytes = entry->levels[level].size();
+                // A single level can exceed the frame budget, so the first upload of the frame is always allowed
+                if(uploadedBytes > 0 && uploadedBytes + bytes > frameBudget) break;
+                if(residentBytes + bytes > budget) break;
+                specifyLevel(*entry, level, true);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+                entry->residentBase = level;
+                residentBytes += bytes;
+                uploadedBytes += bytes;
+            }
+            if(uploadedBytes >= frameBudget) break;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        ++frame;
+    }
+
+    void TextureStreamer::remove(Texture2D* texture){
+        auto it = entries.find(texture);
+        if(it == entries.end()) return;
+        const Entry& entry = it->second;
+        for(int level = entry.residentBase; level < int(entry.levels.size()); ++level) residentBytes -= entry.levels[level].size();
+        entries.erase(it);
+    }
+
+    void TextureStreamer::clear(){
+        for(auto& [texture, entry] : entries) texture->setStreamed(false);
+        entries.clear();
+        residentBytes = 0;
+    }
+
+    TextureStreamer::Stats TextureStreamer::getStats() const {
+        Stats stats;
+        stats.textureCount = entries.size();
+        stats.residentBytes = residentBytes;
+        stats.budgetBytes = budget;
+        for(const auto& [texture, entry] : entries){
+            for(const auto& level : entry.levels) stats.fullBytes += level.size();
+            if(entry.residentBase == 0) ++stats.fullyResident;
+            // The requests of the current frame are compared with the resident levels (the update streams them in the next frame)
+            if(entry.lastUsedFrame == frame) stats.pendingLevels += size_t(std::max(0, entry.residentBase - entry.requestedBase));
+        }
+        return stats;
+    }
+
+}
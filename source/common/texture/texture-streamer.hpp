@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "texture2d.hpp"
+#include "texture-compressor.hpp"
+
+namespace our {
+
+    // The texture streamer keeps only the mip levels that are needed on the VRAM.
+    // The whole mip chain of each streamed texture is kept on the RAM, while the texture only holds the levels from its "resident base" to the last level
+    // (the finer levels are not allocated & GL_TEXTURE_BASE_LEVEL is clamped to the resident base, so the texture is still complete).
+    // Each frame, the renderer requests the textures of the objects it draws with their projected size on the screen (see "request"),
+    // which tells the streamer the finest level that the object can show. Then "update":
+    // - Streams the requested levels in (from the coarse to the fine levels) till the frame upload budget is reached.
+    //   The base level is lowered as each level lands, so the texture gets sharper over a few frames.
+    // - Evicts the finest levels of the least recently used textures while the resident levels exceed the VRAM budget.
+    // The levels of 64x64 and smaller (the tail of the chain) are uploaded when the texture is added and are never evicted,
+    // so a texture can always be sampled (blurry at first).
+    // It is a singleton since all the streamed textures share the same budget.
+    class TextureStreamer {
+        struct Entry {
+            GLenum internalFormat = 0;
+            GLenum pixelFormat = 0;                     // 0 if the levels are compressed
+            glm::ivec2 size = glm::ivec2(0);
+            std::vector<std::vector<uint8_t>> levels;   // The data of each level on the RAM (starting from the full size)
+            int tailBase = 0;                           // The first level of the tail (which is always resident)
+            int residentBase = 0;                       // The finest level on the VRAM
+            int requestedBase = 0;                      // The finest level requested since the last update
+            uint64_t lastUsedFrame = 0;                 // The last frame in which the texture was requested
+        };
+
+        std::unordered_map<Texture2D*, Entry> entries;
+        size_t budget = DEFAULT_BUDGET;
+        size_t frameBudget = DEFAULT_FRAME_BUDGET;
+        size_t residentBytes = 0;
+        uint64_t frame = 1;
+
+        TextureStreamer() = default;
+
+        // Creates a texture from the levels, uploads its tail and starts tracking it
+        Texture2D* add(Entry entry);
+        // Uploads (or frees if "data" is false) a single level of the texture which must be bound to GL_TEXTURE_2D
+        static void specifyLevel(const Entry& entry, int level, bool data);
+        // Returns the finest level that the texture should keep this frame
+        int getWantedBase(const Entry& entry) const;
+        // Frees the levels finer than "base" (which must be coarser than the resident base)
+        void evict(Texture2D* texture, Entry& entry, int base);
+
+    public:
+        // The default maximum number of bytes that the streamed textures can use on the VRAM
+        static constexpr size_t DEFAULT_BUDGET = 256 << 20;
+        // The default maximum number of bytes uploaded each frame
+        static constexpr size_t DEFAULT_FRAME_BUDGET = 4 << 20;
+        // The levels whose width & height are not bigger than this are always resident
+        static constexpr int TAIL_SIZE = 64;
+
+        // The residency of the streamed textures
+        struct Stats {
+            size_t textureCount = 0;
+            size_t residentBytes = 0;   // The bytes used by the resident levels
+            size_t budgetBytes = 0;     // The VRAM budget
+            size_t fullBytes = 0;       // The bytes that the textures would use if all their levels were resident
+            size_t fullyResident = 0;   // The number of textures whose first level is resident
+            size_t pendingLevels = 0;   // The number of requested levels that are not resident yet
+        };
+
+        // Returns the only instance of the streamer
+        static TextureStreamer& get();
+
+        // Creates a streamed texture from an RGBA8 mip chain (see "texture_compressor::buildMipChain")
+        Texture2D* add(std::vector<texture_compressor::MipLevel> levels, bool srgb = false);
+        // Creates a streamed texture from a compressed image with its mip chain
+        Texture2D* add(texture_compressor::CompressedImage image);
+
+        // Tells the streamer that the texture is drawn this frame on an object that covers "screenPixels" pixels (along its biggest axis)
+        // The requested level is the one whose size is the closest to the screen size, so the texels are not minified more than twice.
+        // This does nothing if the texture is not streamed.
+        void request(Texture2D* texture, float screenPixels);
+
+        // Evicts the levels over the VRAM budget and streams in the requested levels within the frame budget
+        // This should be called once per frame on the main thread
+        void update();
+
+        // Stops tracking the texture and frees its RAM copy (this is called when a streamed texture is deleted)
+        void remove(Texture2D* texture);
+
+        // Stops tracking all the textures (this should be called before the OpenGL context is destroyed)
+        void clear();
+
+        // Sets the maximum number of bytes that the streamed textures can use on the VRAM
+        void setBudget(size_t bytes) { budget = bytes > 0 ? bytes : DEFAULT_BUDGET; }
+        // Sets the maximum number of bytes uploaded each frame
+        void setFrameBudget(size_t bytes) { frameBudget = bytes > 0 ? bytes : DEFAULT_FRAME_BUDGET; }
+
+        // Returns the residency & the budget usage of the streamed textures
+        Stats getStats() const;
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+    };
+
+}
@@ -0,0 +1,226 @@
+#include "texture-uploader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/common.hpp>
+
+namespace our {
+
+    void cancelTextureUpload(Texture2D* texture){
+        TextureUploader::get().cancel(texture);
+    }
+
+    // Returns whether the fence signaled. If "wait" is true, it blocks till the fence signals.
+    static bool isSignaled(GLsync fence, bool wait = false){
+        GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GLuint64(1e9) : 0);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+
+    TextureUploader& TextureUploader::get(){
+        static TextureUploader instance;
+        return instance;
+    }
+
+    TextureUploader::Slot* TextureUploader::acquireSlot(){
+        if(slots.empty()){
+            slots.resize(SLOT_COUNT);
+            for(auto& slot : slots) glGenBuffers(1, &slot.buffer);
+        }
+        Slot& slot = slots[nextSlot];
+        if(slot.fence){
+            if(!isSignaled(slot.fence)) return nullptr;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        nextSlot = (nextSlot + 1) % slots.size();
+        return &slot;
+    }
+
+    void TextureUploader::finish(Upload& upload){
+        upload.texture->setReady(true);
+        upload.image.pixels.reset();
+        upload.compressed.levels.clear();
+    }
+
+    Texture2D* TextureUploader::createTexture(GLenum internalFormat, glm::ivec2 size, GLsizei levels, int channels){
+        // The placeholder is a single black texel, so the textures that are not ready do not add any color or light
+        if(placeholder == 0){
+            const unsigned char black[4] = {0, 0, 0, 255};
+            glGenTextures(1, &placeholder);
+            glBindTexture(GL_TEXTURE_2D, placeholder);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            Texture2D::setPlaceholder(placeholder);
+        }
+
+        // Allocate the storage of all the mip levels up front (it is immutable if the context supports it)
+        Texture2D* texture = new Texture2D();
+        glBindTexture(GL_TEXTURE_2D, texture->getOpenGLName());
+        if(supportsTextureStorage()){
+            glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, size.x, size.y);
+        } else {
+            // The pixel format & type are ignored since there is no data, even for the compressed formats
+            for(GLsizei level = 0; level < levels; ++level){
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, size.x >> level), std::max(1, size.y >> level),
+                             0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        }
+        texture_utils::setChannelSwizzle(channels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture->setReady(false);
+        return texture;
+    }
+
+    void TextureUploader::copyToSlot(Slot& slot, const void* data, size_t size){
+        // The buffer is orphaned before writing, so the driver gives us new memory instead of waiting for the old contents
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);
+        if(void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)){
+            std::memcpy(mapped, data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        } else {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), data);
+        }
+    }
+
+    Texture2D* TextureUploader::upload(texture_utils::Image image, bool generateMipmap){
+        if(!image.pixels) return nullptr;
+        glm::ivec2 size = image.size;
+        GLsizei levels = generateMipmap ? 1 + GLsizei(std::floor(std::log2(std::max(size.x, size.y)))) : 1;
+        Texture2D* texture = createTexture(texture_utils::getInternalFormat(image.channels, image.srgb), size, levels, image.channels);
+
+        Upload upload;
+        upload.texture = texture;
+        upload.image = std::move(image);
+        upload.generateMipmap = generateMipmap;
+        uploads.push_back(std::move(upload));
+        return texture;
+    }
+
+    Texture2D* TextureUploader::upload(texture_compressor::CompressedImage image){
+        if(image.levels.empty()) return nullptr;
+        Texture2D* texture = createTexture(image.format, image.size, GLsizei(image.levels.size()));
+
+        Upload upload;
+        upload.texture = texture;
+        upload.generateMipmap = false;
+        upload.compressed = std::move(image);
+        uploads.push_back(std::move(upload));
+        return texture;
+    }
+
+    void TextureUploader::update(){
+        // First, the textures whose fences signaled become ready
+        for(auto it = finishing.begin(); it != finishing.end();){
+            if(isSignaled(it->fence)){
+                glDeleteSync(it->fence);
+                finish(*it);
+                it = finishing.erase(it);
+            } else ++it;
+        }
+        if(uploads.empty()) return;
+
+        // Then, we upload rows of the pending images (or levels of the compressed images) in order till the budget is consumed
+        // (at least one row or level is uploaded each frame, even if it is bigger than the budget)
+        // The rows of the gray images are not always a multiple of 4 bytes, so the rows are tightly packed
+        size_t budget = frameBudget;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while(!uploads.empty() && budget > 0){
+            Upload& upload = uploads.front();
+
+            // If the GPU is still reading from the next buffer in the ring, we wait for the next frame
+            Slot* slot = acquireSlot();
+            if(!slot) break;
+
+            // Since a pixel unpack buffer is bound, the last argument of the upload functions is an offset in the buffer
+            bool done;
+            size_t bytes;
+            if(upload.compressed.format != 0){
+                const auto& level = upload.compressed.levels[upload.nextLevel];
+                glm::ivec2 size = glm::max(upload.compressed.size >> int(upload.nextLevel), glm::ivec2(1));
+                bytes = level.size();
+                copyToSlot(*slot, level.data(), bytes);
+                glBindTexture(GL_TEXTURE_2D, upload.texture->getOpenGLName());
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(upload.nextLevel), 0, 0, size.x, size.y, upload.compressed.format, GLsizei(bytes), nullptr);
+                done = ++upload.nextLevel == upload.compressed.levels.size();
+            } else {
+                glm::ivec2 size = upload.image.size;
+                size_t rowSize = size_t(size.x) * upload.image.channels;
+                int rows = int(std::clamp<size_t>(budget / rowSize, 1, size_t(size.y - upload.nextRow)));
+                bytes = rows * rowSize;
+                copyToSlot(*slot, upload.image.pixels.get() + upload.nextRow * rowSize, bytes);
+                glBindTexture(GL_TEXTURE_2D, upload.texture->getOpenGLName());
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.nextRow, size.x, rows, texture_utils::getPixelFormat(upload.image.channels), GL_UNSIGNED_BYTE, nullptr);
+                upload.nextRow += rows;
+                done = upload.nextRow == size.y;
+            }
+            slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            budget -= std::min(budget, bytes);
+
+            if(done){
+                // All the rows are uploaded, so we generate the mip chain on the GPU and wait for the fence to mark the texture as ready
+                if(upload.generateMipmap) glGenerateMipmap(GL_TEXTURE_2D);
+                upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                upload.image.pixels.reset();
+                finishing.push_back(std::move(upload));
+                uploads.pop_front();
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void TextureUploader::flush(){
+        size_t budget = frameBudget;
+        frameBudget = SIZE_MAX;
+        while(!uploads.empty()){
+            update();
+            // If the ring is full, we wait for the GPU to finish reading the next buffer
+            if(!uploads.empty() && slots[nextSlot].fence) isSignaled(slots[nextSlot].fence, true);
+        }
+        frameBudget = budget;
+        for(auto& upload : finishing){
+            isSignaled(upload.fence, true);
+            glDeleteSync(upload.fence);
+            finish(upload);
+        }
+        finishing.clear();
+    }
+
+    void TextureUploader::cancel(Texture2D* texture){
+        auto matches = [texture](const Upload& upload){ return upload.texture == texture; };
+        uploads.erase(std::remove_if(uploads.begin(), uploads.end(), matches), uploads.end());
+        for(auto it = finishing.begin(); it != finishing.end();){
+            if(matches(*it)){
+                glDeleteSync(it->fence);
+                it = finishing.erase(it);
+            } else ++it;
+        }
+    }
+
+    void TextureUploader::clear(){
+        // The textures that are still alive are marked as ready, so they do not cancel their uploads when they are deleted
+        for(auto& upload : uploads) upload.texture->setReady(true);
+        for(auto& upload : finishing){
+            glDeleteSync(upload.fence);
+            upload.texture->setReady(true);
+        }
+        uploads.clear();
+        finishing.clear();
+        for(auto& slot : slots){
+            if(slot.fence) glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+        slots.clear();
+        nextSlot = 0;
+        if(placeholder){
+            glDeleteTextures(1, &placeholder);
+            placeholder = 0;
+            Texture2D::setPlaceholder(0);
+        }
+    }
+
+}
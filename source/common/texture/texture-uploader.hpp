@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "texture2d.hpp"
+#include "texture-utils.hpp"
+#include "texture-compressor.hpp"
+
+namespace our {
+
+    // The texture uploader streams the decoded images into their textures over multiple frames.
+    // Instead of uploading a whole image (and generating its mip chain) in the frame it arrives in,
+    // each frame uploads a few rows of the pending images till it reaches the frame budget.
+    // The rows are copied into a ring of pixel buffer objects (which are orphaned before each copy) and the texture is filled from the buffer,
+    // so the copy from the buffer to the texture happens asynchronously on the GPU.
+    // Each buffer in the ring is guarded by a fence, so we never write into a buffer that the GPU is still reading from.
+    // After the last rows of an image are uploaded, its mip chain is generated and a fence is inserted.
+    // Compressed images already contain their mip chain, so they are uploaded a whole level at a time.
+    // The texture becomes ready (visible to the materials) once that fence signals. Till then, binding it binds a placeholder texture.
+    // It is a singleton since all the textures share the same buffers and the same budget.
+    class TextureUploader {
+        // A pixel buffer object in the ring
+        struct Slot {
+            GLuint buffer = 0;
+            GLsync fence = nullptr;     // Signals when the GPU is done reading the last upload from this buffer
+        };
+        // An image that is being uploaded into its texture
+        struct Upload {
+            Texture2D* texture;
+            texture_utils::Image image;
+            bool generateMipmap;
+            int nextRow = 0;            // The first row that is not uploaded yet
+            texture_compressor::CompressedImage compressed; // Used instead of "image" if its format is not 0
+            size_t nextLevel = 0;       // The first compressed level that is not uploaded yet
+            GLsync fence = nullptr;     // Inserted after the last upload (and the mip generation)
+        };
+
+        std::vector<Slot> slots;
+        size_t nextSlot = 0;
+        std::deque<Upload> uploads;     // The uploads that still have rows to upload (in order)
+        std::deque<Upload> finishing;   // The uploads that wait for their fence to become ready
+        size_t frameBudget = DEFAULT_FRAME_BUDGET;
+        GLuint placeholder = 0;
+
+        TextureUploader() = default;
+
+        // Returns the next buffer in the ring or nullptr if the GPU is still reading from it
+        Slot* acquireSlot();
+        // Marks the texture as ready and frees the image pixels
+        static void finish(Upload& upload);
+        // Creates a texture with storage for the given number of levels (it is immutable if the context supports it)
+        // The channels of the image are needed to sample the gray images as RGBA (see "texture_utils::setChannelSwizzle")
+        Texture2D* createTexture(GLenum internalFormat, glm::ivec2 size, GLsizei levels, int channels = 4);
+        // Copies the data into the slot buffer (which is left bound to GL_PIXEL_UNPACK_BUFFER)
+        static void copyToSlot(Slot& slot, const void* data, size_t size);
+
+    public:
+        // The default maximum number of bytes copied to the pixel buffers each frame
+        static constexpr size_t DEFAULT_FRAME_BUDGET = 8 << 20;
+        // The number of pixel buffers in the ring (enough for the uploads of the last few frames to be in flight)
+        static constexpr size_t SLOT_COUNT = 4;
+
+        // Returns the only instance of the uploader
+        static TextureUploader& get();
+
+        // Creates a texture with an immutable storage for the image and queues the image pixels to be uploaded into it
+        // The returned texture is not ready till the upload is done (the uploader takes the ownership of the pixels)
+        Texture2D* upload(texture_utils::Image image, bool generateMipmap = true);
+        // Creates a texture with the compressed format of the image and queues its levels to be uploaded into it
+        Texture2D* upload(texture_compressor::CompressedImage image);
+
+        // Uploads the pending rows till the frame budget is reached and marks the finished textures as ready
+        // This should be called once per frame on the main thread
+        void update();
+
+        // Uploads everything that is pending and waits till all the textures are ready
+        void flush();
+
+        // Removes the pending upload of the given texture (this is called when a texture is deleted before it is ready)
+        void cancel(Texture2D* texture);
+
+        // Deletes the pending uploads, the buffers and the placeholder (this must be called before the OpenGL context is destroyed)
+        void clear();
+
+        // Sets the maximum number of bytes uploaded each frame
+        void setFrameBudget(size_t bytes) { frameBudget = bytes > 0 ? bytes : DEFAULT_FRAME_BUDGET; }
+        // Returns the number of textures that are not ready yet
+        size_t getPendingCount() const { return uploads.size() + finishing.size(); }
+
+        // Returns whether the context supports allocating immutable texture storage (OpenGL 4.2 or the equivalent extension)
+        static bool supportsTextureStorage(){
+            return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage;
+        }
+
+        TextureUploader(const TextureUploader&) = delete;
+        TextureUploader& operator=(const TextureUploader&) = delete;
+    };
+
+}
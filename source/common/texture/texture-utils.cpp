@@ -1,9 +1,11 @@
 #include "texture-utils.hpp"
+#include "../io/virtual-file-system.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
 #include <iostream>
+#include <cstdlib>
 
 our::Texture2D* our::texture_utils::empty(GLenum format, glm::ivec2 size){
     our::Texture2D* texture = new our::Texture2D();
@@ -17,6 +19,14 @@ our::Texture2D* our::texture_utils::empty(GLenum format, glm::ivec2 size){
             pixel_format = GL_RGBA;
             pixel_type = GL_UNSIGNED_BYTE;
             break;
+        case GL_RGBA16F:
+            pixel_format = GL_RGBA;
+            pixel_type = GL_HALF_FLOAT;
+            break;
+        case GL_R16F:
+            pixel_format = GL_RED;
+            pixel_type = GL_HALF_FLOAT;
+            break;
         case GL_DEPTH_COMPONENT24:
             pixel_format = GL_DEPTH_COMPONENT;
             pixel_type = GL_FLOAT; 
@@ -34,12 +44,52 @@ our::Texture2D* our::texture_utils::empty(GLenum format, glm::ivec2 size){
     return texture;
 }
 
-our::Texture2D* our::texture_utils::loadImage(const std::string& filename, bool generate_mipmap) {
-    glm::ivec2 size;
-    int channels;
+GLenum our::texture_utils::getInternalFormat(int channels, bool srgb) {
+    switch(channels){
+        case 1: return GL_R8;
+        case 2: return GL_RG8;
+        default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+GLenum our::texture_utils::getPixelFormat(int channels) {
+    switch(channels){
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        default: return GL_RGBA;
+    }
+}
+
+void our::texture_utils::setChannelSwizzle(int channels, GLenum target) {
+    // The gray images used to be expanded to RGBA on the CPU, so the swizzle keeps the same sampled values with a quarter (or half) of the memory
+    if(channels == 1){
+        const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    } else if(channels == 2){
+        const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+}
+
+bool our::texture_utils::decodeImage(const std::string& filename, Image& image, int channels) {
+    // The file is opened through the virtual file system (so it can come from the asset pack) and decoded from the memory
+    FileView file = vfs::open(filename);
+    if(!file.isOpen()){
+        std::cerr << "Failed to load image: " << filename << std::endl;
+        return false;
+    }
+    const auto* bytes = reinterpret_cast<const stbi_uc*>(file.data());
+    int length = int(file.size());
+    // To keep the channels of the file, we read them from the header first (RGB is still expanded to RGBA)
+    if(channels == 0){
+        int width, height;
+        if(!stbi_info_from_memory(bytes, length, &width, &height, &channels)) channels = 4;
+        if(channels == 3) channels = 4;
+    }
     //Since OpenGL puts the texture origin at the bottom left while images typically has the origin at the top left,
     //We need to till stb to flip images vertically after loading them
-    stbi_set_flip_vertically_on_load(true);
+    //(the flag is set per thread since images can be decoded on multiple threads at the same time)
+    stbi_set_flip_vertically_on_load_thread(true);
     //Load image data and retrieve width, height and number of channels in the image
     //The last argument is the number of channels we want and it can have the following values:
     //- 0: Keep number of channels the same as in the image file
@@ -48,22 +98,96 @@ our::Texture2D* our::texture_utils::loadImage(const std::string& filename, bool
     //- 3: RGB
     //- 4: RGB and Alpha (RGBA)
     //Note: channels (the 4th argument) always returns the original number of channels in the file
-    unsigned char* pixels = stbi_load(filename.c_str(), &size.x, &size.y, &channels, 4);
+    int fileChannels;
+    unsigned char* pixels = stbi_load_from_memory(bytes, length, &image.size.x, &image.size.y, &fileChannels, channels);
     if(pixels == nullptr){
         std::cerr << "Failed to load image: " << filename << std::endl;
-        return nullptr;
+        return false;
     }
+    image.channels = channels;
+    //The pixels are freed by stb when the image is destroyed
+    image.pixels = std::unique_ptr<unsigned char, void(*)(void*)>(pixels, stbi_image_free);
+    return true;
+}
+
+// Reduces a decoded image to its first channel (a colored image is reduced to its luminance with the same weights as stb)
+// Packing keeps a single channel per map, so the colors of a tinted map (such as a colored specular map) are lost.
+// Since the material would look different than intended, we warn if the image is not gray.
+static void reduceToGray(our::texture_utils::Image& image, const std::string& filename){
+    if(image.channels == 1) return;
+    size_t texelCount = size_t(image.size.x) * image.size.y;
+    const unsigned char* source = image.pixels.get();
+    auto* gray = static_cast<unsigned char*>(std::malloc(texelCount));
+    bool colored = false;
+    for(size_t texel = 0; texel < texelCount; ++texel){
+        const unsigned char* color = source + texel * image.channels;
+        if(image.channels < 3){
+            gray[texel] = color[0];
+            continue;
+        }
+        // A small difference between the channels is ignored since it is usually a compression artifact
+        colored = colored || std::abs(color[0] - color[1]) > 2 || std::abs(color[1] - color[2]) > 2;
+        gray[texel] = static_cast<unsigned char>((color[0] * 77 + color[1] * 150 + color[2] * 29) >> 8);
+    }
+    if(colored) std::cerr << "WARN: " << filename << " is not a gray image, so only its luminance is packed (its colors are lost)" << std::endl;
+    image.channels = 1;
+    image.pixels = std::unique_ptr<unsigned char, void(*)(void*)>(gray, std::free);
+}
+
+bool our::texture_utils::decodePackedImage(const std::array<std::string, 3>& filenames, const std::array<unsigned char, 3>& defaults, Image& image) {
+    // Decode each file with its own channels then reduce it to a gray image
+    std::array<Image, 3> sources;
+    glm::ivec2 size = {0, 0};
+    for(int channel = 0; channel < 3; ++channel){
+        if(filenames[channel].empty()) continue;
+        if(!decodeImage(filenames[channel], sources[channel], 0)) return false;
+        reduceToGray(sources[channel], filenames[channel]);
+        if(size != glm::ivec2(0) && size != sources[channel].size){
+            std::cerr << "Failed to pack image: " << filenames[channel] << " does not have the size of the other channels" << std::endl;
+            return false;
+        }
+        size = sources[channel].size;
+    }
+    // If no file is given, the image is a single texel of the default values
+    if(size == glm::ivec2(0)) size = {1, 1};
+
+    size_t texelCount = size_t(size.x) * size.y;
+    auto* pixels = static_cast<unsigned char*>(std::malloc(texelCount * 4));
+    for(int channel = 0; channel < 3; ++channel){
+        const unsigned char* source = sources[channel].pixels.get();
+        for(size_t texel = 0; texel < texelCount; ++texel) pixels[4 * texel + channel] = source ? source[texel] : defaults[channel];
+    }
+    for(size_t texel = 0; texel < texelCount; ++texel) pixels[4 * texel + 3] = 255;
+
+    image.size = size;
+    image.channels = 4;
+    image.srgb = false;
+    image.pixels = std::unique_ptr<unsigned char, void(*)(void*)>(pixels, std::free);
+    return true;
+}
+
+our::Texture2D* our::texture_utils::createTexture(const Image& image, bool generate_mipmap) {
+    if(!image.pixels) return nullptr;
     // Create a texture
     our::Texture2D* texture = new our::Texture2D();
     //Bind the texture such that we upload the image data to its storage
     //TODO: (Req 5) Finish this function to fill the texture with the data found in "pixels"
     texture->bind();
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    //The rows of a gray image are not always a multiple of 4 bytes, so we tell OpenGL that they are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(image.channels, image.srgb), image.size.x, image.size.y, 0,
+                 getPixelFormat(image.channels), GL_UNSIGNED_BYTE, image.pixels.get());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    setChannelSwizzle(image.channels);
     if(generate_mipmap){
         glGenerateMipmap(GL_TEXTURE_2D);
     }
     our::Texture2D::unbind();
-    
-    stbi_image_free(pixels); //Free image data after uploading to GPU
     return texture;
-}
\ No newline at end of file
+}
+
+our::Texture2D* our::texture_utils::loadImage(const std::string& filename, bool generate_mipmap) {
+    Image image;
+    if(!decodeImage(filename, image)) return nullptr;
+    return createTexture(image, generate_mipmap);
+}
@@ -2,6 +2,8 @@
 
 #include "texture2d.hpp"
 #include <string>
+#include <memory>
+#include <array>
 
 #include <glad/gl.h>
 #include <glm/vec2.hpp>
@@ -9,6 +11,32 @@
 namespace our::texture_utils {
     // This function create an empty texture with a specific format (useful for framebuffers)
     Texture2D* empty(GLenum format, glm::ivec2 size);
+    // The pixels of an image file after decoding (flipped vertically for OpenGL)
+    // An image has 1 (gray), 2 (gray & alpha) or 4 (RGBA) channels. RGB images are stored as RGBA since the GPU pads RGB8 texels anyway.
+    struct Image {
+        glm::ivec2 size = {0, 0};
+        int channels = 4;
+        bool srgb = false;      // If true, the color channels are stored in sRGB and the GPU converts them to linear when sampling
+        std::unique_ptr<unsigned char, void(*)(void*)> pixels{nullptr, nullptr};
+    };
+    // Returns the internal format of the texture that holds an image with the given channels (R8, RG8, RGBA8 or SRGB8_ALPHA8)
+    GLenum getInternalFormat(int channels, bool srgb = false);
+    // Returns the pixel format of the image data with the given channels (GL_RED, GL_RG or GL_RGBA)
+    GLenum getPixelFormat(int channels);
+    // Sets the swizzle of the texture bound to the target so that a gray image is sampled as (gray, gray, gray, alpha) like an RGBA image would be
+    void setChannelSwizzle(int channels, GLenum target = GL_TEXTURE_2D);
+    // This function decodes an image file into the given image. It does not use OpenGL, so it can run on a worker thread.
+    // If "channels" is 0, the channels of the file are kept (except RGB which becomes RGBA), otherwise the image is converted to the given channels.
+    // Returns false if the file could not be decoded
+    bool decodeImage(const std::string& filename, Image& image, int channels = 4);
+    // This function packs the first channel of up to 3 image files into the RGB channels of a single RGBA image
+    // (e.g. an ORM map where R is the ambient occlusion, G is the roughness and B is the metalness/specular).
+    // An empty filename fills its channel with the given default value. All the files must have the same size.
+    // A colored file is reduced to its luminance (with a warning since its colors are lost).
+    // Returns false if a file could not be decoded or the sizes do not match
+    bool decodePackedImage(const std::array<std::string, 3>& filenames, const std::array<unsigned char, 3>& defaults, Image& image);
+    // This function creates a texture from a decoded image (it returns nullptr if the image has no pixels)
+    Texture2D* createTexture(const Image& image, bool generate_mipmap = true);
     // This function loads an image and sends its data to the given Texture2D 
     Texture2D* loadImage(const std::string& filename, bool generate_mipmap = true);
 }
\ No newline at end of file
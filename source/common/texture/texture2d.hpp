@@ -4,10 +4,22 @@
 
 namespace our {
 
+    class Texture2D;
+    // Removes the pending upload of a texture that is deleted before it is ready (defined in "texture-uploader.cpp")
+    void cancelTextureUpload(Texture2D* texture);
+    // Stops streaming the mip levels of a texture that is deleted (defined in "texture-streamer.cpp")
+    void removeStreamedTexture(Texture2D* texture);
+
     // This class defined an OpenGL texture which will be used as a GL_TEXTURE_2D
     class Texture2D {
         // The OpenGL object name of this texture 
         GLuint name = 0;
+        // Whether the texture data is uploaded. The textures streamed by the "TextureUploader" are not ready till their upload is done.
+        bool ready = true;
+        // Whether the mip levels of the texture are streamed in & out by the "TextureStreamer"
+        bool streamed = false;
+        // The texture that is bound instead of the textures that are not ready yet (0 means that there is no placeholder)
+        static inline GLuint placeholder = 0;
     public:
         // This constructor creates an OpenGL texture and saves its object name in the member variable "name" 
         Texture2D() {
@@ -23,6 +35,8 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
             //TODO: (Req 5) Complete this function
+            if(!ready) cancelTextureUpload(this);
+            if(streamed) removeStreamedTexture(this);
             glDeleteTextures(1, &name);
             name = 0;
         }
@@ -32,10 +46,23 @@ namespace our {
             return name;
         }
 
+        // Whether the texture data can be sampled
+        bool isReady() const { return ready; }
+        void setReady(bool ready) { this->ready = ready; }
+
+        // Whether the resident mip levels of the texture are managed by the "TextureStreamer"
+        bool isStreamed() const { return streamed; }
+        void setStreamed(bool streamed) { this->streamed = streamed; }
+
+        // Sets the texture that is bound instead of the textures that are not ready yet
+        static void setPlaceholder(GLuint texture) { placeholder = texture; }
+
         // This method binds this texture to GL_TEXTURE_2D
+        // If the texture is not ready, the placeholder is bound instead
         void bind() const {
             //TODO: (Req 5) Complete this function
-            if(name) glBindTexture(GL_TEXTURE_2D, name);
+            if(!ready && placeholder) glBindTexture(GL_TEXTURE_2D, placeholder);
+            else if(name) glBindTexture(GL_TEXTURE_2D, name);
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
@@ -4,6 +4,7 @@
 #include <json/json.hpp>
 
 #include <application.hpp>
+#include <io/asset-pack.hpp>
 
 #include "states/menu-state.hpp"
 #include "states/play-state.hpp"
@@ -16,6 +17,9 @@
 #include "states/material-test-state.hpp"
 #include "states/entity-test-state.hpp"
 #include "states/renderer-test-state.hpp"
+#include "states/mesh-loading-benchmark-state.hpp"
+#include "states/file-streaming-benchmark-state.hpp"
+#include "states/lighting-benchmark-state.hpp"
 
 int main(int argc, char** argv) {
     
@@ -27,6 +31,13 @@ int main(int argc, char** argv) {
     // This is useful for testing multiple configurations in a batch
     // Default: 0 where the application runs indefinitely until manually closed
     int run_for_frames = args.get<int>("f", 0);
+    // build_pack is the path of an asset pack to build from the "assets" directory (the application exits after building it)
+    // The pack can then be used by setting "assetPack" in the configuration
+    // Default: "" where no pack is built
+    std::string build_pack = args.get<std::string>("build-pack", "");
+    if(!build_pack.empty()){
+        return our::AssetPack::build("assets", build_pack) ? 0 : -1;
+    }
 
     // Open the config file and exit if failed
     std::ifstream file_in(config_path);
@@ -53,6 +64,9 @@ int main(int argc, char** argv) {
     app.registerState<MaterialTestState>("material-test");
     app.registerState<EntityTestState>("entity-test");
     app.registerState<RendererTestState>("renderer-test");
+    app.registerState<MeshLoadingBenchmarkState>("mesh-loading-benchmark");
+    app.registerState<FileStreamingBenchmarkState>("file-streaming-benchmark");
+    app.registerState<LightingBenchmarkState>("lighting-benchmark");
     // Then choose the state to run based on the option "start-scene" in the config
     if(app_config.contains(std::string{"start-scene"})){
         app.changeState(app_config["start-scene"].get<std::string>());
@@ -53,12 +53,14 @@ class EntityTestState: public our::State {
             if(meshRenderer == nullptr) continue;
             //TODO: (Req 8) Complete the loop body to draw the current entity
             // Then we setup the material, send the transform matrix to the shader then draw the mesh
-            if(meshRenderer->material != nullptr && meshRenderer->mesh != nullptr){
-                meshRenderer->material->setup();
+            our::Material* material = meshRenderer->material.get();
+            our::Mesh* mesh = meshRenderer->mesh.get();
+            if(material != nullptr && mesh != nullptr){
+                material->setup();
                 glm::mat4 M = entity->getLocalToWorldMatrix();
                 glm::mat4 MVP = VP * M;
-                meshRenderer->material->shader->set("transform", MVP);
-                meshRenderer->mesh->draw();
+                material->shader->set("transform", MVP);
+                mesh->draw();
             }
         }
     }
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <io/async-file-reader.hpp>
+#include <application.hpp>
+
+#include <imgui.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// This state compares the throughput and the latency of many small reads (as done by the streaming systems)
+// using the blocking reads on the main thread (the current path) and the async file reader (with each of its backends).
+// The latency of a read is the time from the moment all the reads are requested till its data is ready,
+// so it includes the time spent waiting behind the other reads.
+class FileStreamingBenchmarkState: public our::State {
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Read {
+        std::string path;
+        uint64_t offset;
+        size_t size;
+    };
+
+    struct Result {
+        std::string name;
+        double megabytesPerSecond = 0;
+        double mainThreadMilliseconds = 0;      // The time the main thread was blocked while requesting the reads
+        double medianLatency = 0, p99Latency = 0, maxLatency = 0; // In milliseconds
+        size_t failedReads = 0;
+    };
+    std::vector<Result> results;
+    size_t readCount = 0, readSize = 0;
+    uint64_t totalBytes = 0;
+
+    // Sorts the latencies and fills the latency statistics of the result
+    static void summarize(std::vector<double>& latencies, Result& result){
+        std::sort(latencies.begin(), latencies.end());
+        if(latencies.empty()) return;
+        result.medianLatency = latencies[latencies.size() / 2];
+        result.p99Latency = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        result.maxLatency = latencies.back();
+    }
+
+    static double millisecondsSince(Clock::time_point start){
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    Result runBlocking(const std::vector<Read>& reads, int iterations){
+        Result result;
+        result.name = "blocking";
+        std::vector<double> latencies;
+        std::vector<char> buffer(readSize);
+        double totalMilliseconds = 0;
+        for(int iteration = 0; iteration < iterations; ++iteration){
+            auto start = Clock::now();
+            for(auto& read : reads){
+                std::ifstream file(read.path, std::ios::binary);
+                file.seekg(std::streamoff(read.offset));
+                file.read(buffer.data(), std::streamsize(read.size));
+                if(!file && !file.eof()) ++result.failedReads;
+                latencies.push_back(millisecondsSince(start));
+            }
+            totalMilliseconds += millisecondsSince(start);
+        }
+        result.mainThreadMilliseconds = totalMilliseconds / iterations;
+        result.megabytesPerSecond = double(totalBytes) * iterations / (1 << 20) / (totalMilliseconds / 1000);
+        summarize(latencies, result);
+        return result;
+    }
+
+    Result runAsync(const std::vector<Read>& reads, int iterations, our::AsyncFileReader::Backend backend){
+        our::AsyncFileReader reader(backend);
+        Result result;
+        result.name = std::string("async (") + our::AsyncFileReader::getBackendName(reader.getBackend()) + ")";
+        std::vector<double> latencies(reads.size() * iterations);
+        std::atomic<size_t> failedReads{0};
+        double totalMilliseconds = 0, mainThreadMilliseconds = 0;
+        for(int iteration = 0; iteration < iterations; ++iteration){
+            auto start = Clock::now();
+            for(size_t index = 0; index < reads.size(); ++index){
+                double* latency = &latencies[iteration * reads.size() + index];
+                reader.read(reads[index].path, reads[index].offset, reads[index].size, [&failedReads, latency, start](bool success, const char*, size_t){
+                    if(!success) ++failedReads;
+                    *latency = millisecondsSince(start);
+                });
+            }
+            mainThreadMilliseconds += millisecondsSince(start);
+            reader.wait();
+            totalMilliseconds += millisecondsSince(start);
+        }
+        result.failedReads = failedReads;
+        result.mainThreadMilliseconds = mainThreadMilliseconds / iterations;
+        result.megabytesPerSecond = double(totalBytes) * iterations / (1 << 20) / (totalMilliseconds / 1000);
+        summarize(latencies, result);
+        return result;
+    }
+
+    void onInitialize() override {
+        // First of all, we get the scene configuration from the app config
+        auto& config = getApp()->getConfig()["scene"];
+        int iterations = std::max(1, config.value("iterations", 5));
+        readSize = std::max<size_t>(1, config.value("readSize", size_t(64 << 10)));
+        std::string directory = config.value("directory", "assets");
+
+        // Split every file in the directory into reads of "readSize" bytes
+        std::vector<Read> reads;
+        std::error_code error;
+        for(auto it = std::filesystem::recursive_directory_iterator(directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)){
+            if(!it->is_regular_file(error)) continue;
+            uint64_t size = it->file_size(error);
+            for(uint64_t offset = 0; offset < size; offset += readSize){
+                reads.push_back({it->path().string(), offset, size_t(std::min<uint64_t>(readSize, size - offset))});
+            }
+            totalBytes += size;
+        }
+        readCount = reads.size();
+
+        std::cout << "Benchmarking file streaming: " << readCount << " reads of " << readSize / 1024 << " KB from \"" << directory
+                  << "\" (" << totalBytes / (1 << 20) << " MB, " << iterations << " runs)" << std::endl;
+        // The first run warms up the page cache, so all the methods read the same cached files
+        runBlocking(reads, 1);
+        results.push_back(runBlocking(reads, iterations));
+        results.push_back(runAsync(reads, iterations, our::AsyncFileReader::Backend::THREAD_POOL));
+        results.push_back(runAsync(reads, iterations, our::AsyncFileReader::Backend::IO_URING));
+        for(auto& result : results){
+            std::cout << result.name << ": " << result.megabytesPerSecond << " MB/s, main thread " << result.mainThreadMilliseconds
+                      << " ms, latency median " << result.medianLatency << " ms, p99 " << result.p99Latency << " ms, max "
+                      << result.maxLatency << " ms" << (result.failedReads ? " [some reads failed]" : "") << std::endl;
+        }
+
+        // We set the clear color to be black
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+    }
+
+    void onDraw(double deltaTime) override {
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    void onImmediateGui() override {
+        ImGui::Begin("File Streaming Benchmark");
+        ImGui::Text("%zu reads of %zu KB (%.1f MB)", readCount, readSize / 1024, double(totalBytes) / (1 << 20));
+        for(auto& result : results){
+            ImGui::Text("%s", result.name.c_str());
+            ImGui::Text("  %.1f MB/s, main thread: %.2f ms", result.megabytesPerSecond, result.mainThreadMilliseconds);
+            ImGui::Text("  latency median: %.2f ms, p99: %.2f ms, max: %.2f ms", result.medianLatency, result.p99Latency, result.maxLatency);
+            if(result.failedReads) ImGui::TextColored(ImVec4(1, 0, 0, 1), "  %zu reads failed", result.failedReads);
+        }
+        ImGui::End();
+    }
+
+    void onDestroy() override {
+        results.clear();
+        totalBytes = 0;
+    }
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <asset-loader.hpp>
+#include <ecs/world.hpp>
+#include <components/light.hpp>
+#include <systems/deferred-renderer.hpp>
+#include <application.hpp>
+#include <deserialize-utils.hpp>
+
+#include <glm/gtc/constants.hpp>
+#include <imgui.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+// This state compares the GPU time of the renderers (e.g. forward & deferred) on the same scene with an increasing number of lights.
+// For each light count, each renderer draws the scene for a few warm up frames, then the GPU time of the measured frames is averaged.
+// The lights are generated from the same seed for every renderer, so each light count is compared on the exact same lights.
+class LightingBenchmarkState: public our::State {
+
+    struct Result {
+        std::string renderer;
+        int lightCount = 0;
+        double milliseconds = 0;    // The average GPU time of a frame
+    };
+    std::vector<Result> results;
+
+    our::World world;
+    our::ForwardRenderer* renderer = nullptr;
+    std::string rendererType;
+
+    // The runs are every renderer type for every light count (the renderer types change in the inner loop)
+    std::vector<std::string> rendererTypes;
+    std::vector<int> lightCounts;
+    size_t run = 0;
+    int warmupFrames = 30, measuredFrames = 120, frame = 0;
+    std::vector<our::Entity*> lights;
+
+    // The frames are measured with queries that are read a few frames later (so the CPU does not wait for the GPU every frame)
+    static constexpr int QUERY_FRAMES = 4;
+    GLuint queries[QUERY_FRAMES] = {};
+    bool queriesIssued[QUERY_FRAMES] = {};
+    double measuredMilliseconds = 0;
+    int measuredCount = 0;
+
+    bool isDone() const { return run >= rendererTypes.size() * lightCounts.size(); }
+
+    // Replaces the lights of the world by the given number of point & spot lights scattered above the scene
+    void generateLights(int count){
+        for(auto light : lights) world.markForRemoval(light);
+        world.deleteMarkedEntities();
+        lights.clear();
+
+        auto& config = getApp()->getConfig()["scene"]["lights"];
+        glm::vec3 minimum = config.value("min", glm::vec3(-20.0f, 0.5f, -20.0f));
+        glm::vec3 maximum = config.value("max", glm::vec3(20.0f, 2.0f, 20.0f));
+        float range = config.value("range", 5.0f);
+        float spotFraction = config.value("spotFraction", 0.25f);
+        std::mt19937 generator(config.value("seed", 42u));
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for(int index = 0; index < count; ++index){
+            our::Entity* entity = world.add();
+            entity->localTransform.position = glm::mix(minimum, maximum, glm::vec3(unit(generator), unit(generator), unit(generator)));
+            auto light = entity->addComponent<our::LightComponent>();
+            light->color = glm::vec3(0.2f) + 0.8f * glm::vec3(unit(generator), unit(generator), unit(generator));
+            light->attenuation = glm::vec3(1.0f, 0.0f, 1.0f);
+            light->range = range;
+            light->castShadows = false;
+            if(unit(generator) < spotFraction){
+                // The spot lights point down (a light points along its local -Z)
+                light->lightType = our::LightType::SPOT;
+                light->innerCone = glm::radians(20.0f);
+                light->outerCone = glm::radians(35.0f);
+                entity->localTransform.rotation = glm::vec3(-glm::half_pi<float>(), 0.0f, 0.0f);
+            } else {
+                light->lightType = our::LightType::POINT;
+            }
+            lights.push_back(entity);
+        }
+    }
+
+    // Creates the renderer & the lights of the current run
+    void startRun(){
+        auto& config = getApp()->getConfig()["scene"];
+        const std::string& type = rendererTypes[run % rendererTypes.size()];
+        if(!renderer || type != rendererType){
+            if(renderer){
+                renderer->destroy();
+                delete renderer;
+            }
+            rendererType = type;
+            renderer = our::createRendererFromType(rendererType);
+            renderer->initialize(getApp()->getFrameBufferSize(), config["renderer"]);
+        }
+        if(run % rendererTypes.size() == 0) generateLights(lightCounts[run / rendererTypes.size()]);
+        frame = 0;
+        measuredMilliseconds = 0;
+        measuredCount = 0;
+    }
+
+    // Reads the query of the given slot (waiting for it if needed) and adds it to the current run if it was measured
+    void readQuery(int slot, bool measured){
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        queriesIssued[slot] = false;
+        if(measured){
+            measuredMilliseconds += double(nanoseconds) * 1e-6;
+            ++measuredCount;
+        }
+    }
+
+    void finishRun(){
+        Result result;
+        result.renderer = rendererType;
+        result.lightCount = int(lights.size());
+        result.milliseconds = measuredMilliseconds / std::max(measuredCount, 1);
+        std::cout << result.renderer << " renderer, " << result.lightCount << " lights: " << result.milliseconds << " ms" << std::endl;
+        results.push_back(result);
+    }
+
+    void onInitialize() override {
+        // First of all, we get the scene configuration from the app config
+        auto& config = getApp()->getConfig()["scene"];
+        if(config.contains("assets")){
+            our::deserializeAllAssets(config["assets"]);
+        }
+        if(config.contains("world")){
+            world.deserialize(config["world"]);
+        }
+        rendererTypes = config.value("renderers", std::vector<std::string>{"forward", "deferred"});
+        lightCounts = config.value("lightCounts", std::vector<int>{16, 128, 1024});
+        warmupFrames = std::max(0, config.value("warmupFrames", 30));
+        measuredFrames = std::max(1, config.value("measuredFrames", 120));
+
+        std::cout << "Benchmarking the renderers (average GPU time of " << measuredFrames << " frames)" << std::endl;
+        glGenQueries(QUERY_FRAMES, queries);
+        if(!isDone()) startRun();
+    }
+
+    void onDraw(double deltaTime) override {
+        if(isDone()){
+            // Keep showing the scene of the last run
+            if(renderer) renderer->render(&world);
+            return;
+        }
+
+        // The slot is reused every "QUERY_FRAMES" frames, so its previous result (from this run) is read first
+        int slot = frame % QUERY_FRAMES;
+        if(queriesIssued[slot]) readQuery(slot, frame - QUERY_FRAMES >= warmupFrames);
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+        renderer->render(&world);
+        glEndQuery(GL_TIME_ELAPSED);
+        queriesIssued[slot] = true;
+        ++frame;
+
+        if(frame == warmupFrames + measuredFrames){
+            // Wait for the remaining queries of the run
+            for(int previous = frame - QUERY_FRAMES; previous < frame; ++previous){
+                if(previous >= 0 && queriesIssued[previous % QUERY_FRAMES]) readQuery(previous % QUERY_FRAMES, previous >= warmupFrames);
+            }
+            finishRun();
+            ++run;
+            if(!isDone()) startRun();
+        }
+    }
+
+    void onImmediateGui() override {
+        ImGui::Begin("Lighting Benchmark");
+        if(!isDone()){
+            ImGui::Text("Running: %s renderer, %zu lights (%d / %d frames)", rendererType.c_str(), lights.size(),
+                        frame, warmupFrames + measuredFrames);
+        }
+        for(int lightCount : lightCounts){
+            ImGui::Text("%d lights:", lightCount);
+            for(auto& result : results){
+                if(result.lightCount == lightCount) ImGui::Text("  %s: %.3f ms", result.renderer.c_str(), result.milliseconds);
+            }
+        }
+        ImGui::End();
+    }
+
+    void onDestroy() override {
+        glDeleteQueries(QUERY_FRAMES, queries);
+        std::fill(std::begin(queriesIssued), std::end(queriesIssued), false);
+        if(renderer){
+            renderer->destroy();
+            delete renderer;
+            renderer = nullptr;
+        }
+        rendererType.clear();
+        lights.clear();
+        results.clear();
+        run = 0;
+        world.clear();
+        our::clearAllAssets();
+    }
+};
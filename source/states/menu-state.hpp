@@ -6,6 +6,7 @@
 #include <texture/texture-utils.hpp>
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
+#include <asset-loader.hpp>
 
 #include <functional>
 #include <array>
@@ -47,26 +48,38 @@ class Menustate: public our::State {
     // An array of the button that we can interact with
     std::array<Button, 2> buttons;
 
+    // The shaders & the texture used by the menu. They are loaded through the asset registry,
+    // so they stay cached while the game is played and returning to the menu does not load them again
+    // The shaders have the same descriptions as the shaders of the play scene, so both states share them
+    our::AssetManifest getAssetManifest() override {
+        our::AssetManifest manifest;
+        manifest.assets = {
+            {"shaders", {
+                {"textured", {{"vs", "assets/shaders/textured.vert"}, {"fs", "assets/shaders/textured.frag"}}},
+                {"tinted", {{"vs", "assets/shaders/tinted.vert"}, {"fs", "assets/shaders/tinted.frag"}}}
+            }},
+            {"textures", {{"menu", "assets/textures/menu.png"}}}
+        };
+        return manifest;
+    }
+
     void onInitialize() override {
+        // The game is loaded in the background while the menu is shown, so pressing play does not freeze the window
+        getApp()->preloadState("play");
+
         // First, we create a material for the menu's background
         menuMaterial = new our::TexturedMaterial();
-        // Here, we load the shader that will be used to draw the background
-        menuMaterial->shader = new our::ShaderProgram();
-        menuMaterial->shader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-        menuMaterial->shader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-        menuMaterial->shader->link();
-        // Then we load the menu texture
-        menuMaterial->texture = our::texture_utils::loadImage("assets/textures/menu.png");
+        // Here, we get the shader that will be used to draw the background
+        menuMaterial->shader = our::AssetLoader<our::ShaderProgram>::get("textured");
+        // Then we get the menu texture
+        menuMaterial->texture = our::AssetLoader<our::Texture2D>::get("menu");
         // Initially, the menu material will be black, then it will fade in
         menuMaterial->tint = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 
         // Second, we create a material to highlight the hovered buttons
         highlightMaterial = new our::TintedMaterial();
         // Since the highlight is not textured, we used the tinted material shaders
-        highlightMaterial->shader = new our::ShaderProgram();
-        highlightMaterial->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        highlightMaterial->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        highlightMaterial->shader->link();
+        highlightMaterial->shader = our::AssetLoader<our::ShaderProgram>::get("tinted");
         // The tint is white since we will subtract the background color from it to create a negative effect.
         highlightMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
         // To create a negative effect, we enable blending, set the equation to be subtract,
@@ -170,12 +183,9 @@ class Menustate: public our::State {
     }
 
     void onDestroy() override {
-        // Delete all the allocated resources
+        // Delete all the allocated resources (the shaders & the texture are owned by the asset loader, so the application releases them)
         delete rectangle;
-        delete menuMaterial->texture;
-        delete menuMaterial->shader;
         delete menuMaterial;
-        delete highlightMaterial->shader;
         delete highlightMaterial;
     }
 };
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <mesh/mesh-utils.hpp>
+#include <mesh/mesh-optimizer.hpp>
+#include <mesh/obj-parser.hpp>
+#include <jobs/job-system.hpp>
+#include <application.hpp>
+
+#include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <iostream>
+
+// This state compares the time needed to read ".obj" files using Tiny OBJ Loader (the previous loader)
+// and our parallel memory mapped parser. It only measures reading & welding the vertices (not uploading them to the GPU).
+// If "reportACMR" is true in the scene config, it also reports the vertex cache efficiency (ACMR) of each mesh
+// before and after it is optimized by "mesh_optimizer::optimize" (as it is when the mesh is loaded).
+class MeshLoadingBenchmarkState: public our::State {
+
+    struct Result {
+        std::string file;
+        size_t vertexCount = 0, triangleCount = 0;
+        double tinyObjMilliseconds = 0, parserMilliseconds = 0;
+        bool matching = false;  // Whether both loaders produced the same number of vertices and elements
+        float acmrBefore = 0, acmrAfter = 0; // The average cache miss ratio before & after the optimization (0 if it is not reported)
+    };
+    std::vector<Result> results;
+    bool reportACMR = false;
+
+    // Runs the given function multiple times and returns the best (shortest) duration in milliseconds
+    // The best run is the one that was least disturbed by the rest of the system (the page cache is warm after the first run)
+    template<typename Function>
+    static double measure(int iterations, Function function){
+        double best = std::numeric_limits<double>::max();
+        for(int iteration = 0; iteration < iterations; ++iteration){
+            auto start = std::chrono::high_resolution_clock::now();
+            function();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+
+    void onInitialize() override {
+        // First of all, we get the scene configuration from the app config
+        auto& config = getApp()->getConfig()["scene"];
+        int iterations = std::max(1, config.value("iterations", 5));
+        reportACMR = config.value("reportACMR", false);
+        std::vector<std::string> files = config.value("meshes", std::vector<std::string>());
+
+        std::cout << "Benchmarking mesh loading (best of " << iterations << " runs, "
+                  << our::JobSystem::get().getWorkerCount() + 1 << " threads)" << std::endl;
+        for(auto& file : files){
+            Result result;
+            result.file = file;
+            std::vector<our::Vertex> tinyObjVertices, parserVertices;
+            std::vector<GLuint> tinyObjElements, parserElements;
+            result.tinyObjMilliseconds = measure(iterations, [&](){ our::mesh_utils::readOBJWithTinyObj(file, tinyObjVertices, tinyObjElements); });
+            result.parserMilliseconds = measure(iterations, [&](){ our::obj_parser::parse(file, parserVertices, parserElements); });
+            result.vertexCount = parserVertices.size();
+            result.triangleCount = parserElements.size() / 3;
+            result.matching = tinyObjVertices.size() == parserVertices.size() && tinyObjElements.size() == parserElements.size();
+            std::cout << file << ": " << result.vertexCount << " vertices, " << result.triangleCount << " triangles, tinyobj "
+                      << result.tinyObjMilliseconds << " ms, parser " << result.parserMilliseconds << " ms ("
+                      << result.tinyObjMilliseconds / std::max(result.parserMilliseconds, 1e-6) << "x)"
+                      << (result.matching ? "" : " [the loaders produced different vertex counts]") << std::endl;
+            if(reportACMR){
+                result.acmrBefore = our::mesh_optimizer::computeACMR(parserElements, parserVertices.size());
+                our::mesh_optimizer::optimize(parserVertices, parserElements);
+                result.acmrAfter = our::mesh_optimizer::computeACMR(parserElements, parserVertices.size());
+                std::cout << file << ": ACMR " << result.acmrBefore << " before optimization, " << result.acmrAfter << " after" << std::endl;
+            }
+            results.push_back(result);
+        }
+
+        // We set the clear color to be black
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+    }
+
+    void onDraw(double deltaTime) override {
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    void onImmediateGui() override {
+        ImGui::Begin("Mesh Loading Benchmark");
+        for(auto& result : results){
+            ImGui::Text("%s", result.file.c_str());
+            ImGui::Text("  %zu vertices, %zu triangles", result.vertexCount, result.triangleCount);
+            ImGui::Text("  tinyobj: %.2f ms, parser: %.2f ms (%.1fx)", result.tinyObjMilliseconds, result.parserMilliseconds,
+                        result.tinyObjMilliseconds / std::max(result.parserMilliseconds, 1e-6));
+            if(reportACMR) ImGui::Text("  ACMR: %.3f before optimization, %.3f after", result.acmrBefore, result.acmrAfter);
+            if(!result.matching) ImGui::TextColored(ImVec4(1, 0, 0, 1), "  The loaders produced different vertex counts");
+        }
+        ImGui::End();
+    }
+
+    void onDestroy() override {
+        results.clear();
+    }
+};
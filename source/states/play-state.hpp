@@ -3,10 +3,11 @@
 #include <application.hpp>
 
 #include <ecs/world.hpp>
-#include <systems/forward-renderer.hpp>
+#include <systems/deferred-renderer.hpp>
 #include <systems/free-camera-controller.hpp>
 #include <systems/movement.hpp>
 #include <asset-loader.hpp>
+#include <texture/texture-streamer.hpp>
 #include <systems/character-controller.hpp>
 #include <systems/inventory-controller.hpp>
 
@@ -14,19 +15,40 @@
 class Playstate: public our::State {
 
     our::World world;
-    our::ForwardRenderer renderer;
+    // The renderer is picked by the "type" of the renderer config ("forward" or "deferred")
+    our::ForwardRenderer* renderer = nullptr;
     our::FreeCameraControllerSystem cameraController;
     our::MovementSystem movementSystem;
     our::CharacterControllerSystem characterController;
     our::InventoryControllerSystem inventoryController;
 
-    void onInitialize() override {
-        // First of all, we get the scene configuration from the app config
+    // The assets are loaded in the background before the state is initialized (e.g. while the menu is shown)
+    // They stay cached after the state is destroyed, so entering it again does not reload them
+    our::AssetManifest getAssetManifest() override {
+        our::AssetManifest manifest;
         auto& config = getApp()->getConfig()["scene"];
-        // If we have assets in the scene config, we deserialize them
+        // If we have assets in the scene config, they are the manifest of the state
+        // (The images & meshes are decoded on the worker threads unless "parallelAssetLoading" is false, which is useful to compare the loading times)
+        // If "streamTextures" is true, the textures are uploaded over the first frames instead of stalling the loading
+        // "textureCompression" is the compression of the textures that do not pick their own (e.g. "auto" for BC1/BC3)
+        // If "packTextures" is true, the albedo textures are packed into texture arrays so that more draws can be batched
+        // If "streamTextureMips" is true, only the texture levels needed by the objects on the screen are kept on the VRAM
+        // If "deferUnusedAssets" is true, only the assets named by the world are loaded before the state starts (the others are loaded on their first use)
         if(config.contains("assets")){
-            our::deserializeAllAssets(config["assets"]);
+            manifest.assets = config["assets"];
+            manifest.options.parallel = config.value("parallelAssetLoading", true);
+            manifest.options.streamTextures = config.value("streamTextures", false);
+            manifest.options.textureCompression = our::texture_compressor::parseCompression(config.value("textureCompression", "none"));
+            manifest.options.packTextures = config.value("packTextures", false);
+            manifest.options.streamTextureMips = config.value("streamTextureMips", false);
+            if(config.value("deferUnusedAssets", false) && config.contains("world")) manifest.uses = config["world"];
         }
+        return manifest;
+    }
+
+    void onInitialize() override {
+        // First of all, we get the scene configuration from the app config
+        auto& config = getApp()->getConfig()["scene"];
         // If we have a world in the scene config, we use it to populate our world
         if(config.contains("world")){
             world.deserialize(config["world"]);
@@ -37,10 +59,36 @@ class Playstate: public our::State {
         inventoryController.enter(getApp());
         // Then we initialize the renderer
         auto size = getApp()->getFrameBufferSize();
-        renderer.initialize(size, config["renderer"]);
+        renderer = our::createRendererFromType(config["renderer"].value("type", "forward"));
+        renderer->initialize(size, config["renderer"]);
     }
 
     void onImmediateGui() override {
+        // Show how much of the VRAM budget the streamed textures use
+        auto stats = our::TextureStreamer::get().getStats();
+        if(stats.textureCount > 0){
+            constexpr float MB = 1024.0f * 1024.0f;
+            ImGui::Begin("Texture Streaming");
+            ImGui::Text("Textures: %zu (%zu fully resident)", stats.textureCount, stats.fullyResident);
+            ImGui::Text("Resident: %.1f / %.1f MB (full: %.1f MB)", stats.residentBytes / MB, stats.budgetBytes / MB, stats.fullBytes / MB);
+            ImGui::ProgressBar(float(stats.residentBytes) / float(stats.budgetBytes));
+            ImGui::Text("Pending levels: %zu", stats.pendingLevels);
+            ImGui::End();
+        }
+
+        // Show the GPU cost of the opaque passes, the pre-pass can be toggled to compare the two modes
+        if(renderer->isProfilingOpaquePass()){
+            const auto& opaqueStats = renderer->getOpaqueStats();
+            ImGui::Begin("Opaque Pass");
+            bool depthPrepass = renderer->hasDepthPrepass();
+            if(ImGui::Checkbox("Depth pre-pass", &depthPrepass)) renderer->setDepthPrepass(depthPrepass);
+            ImGui::Text("Pre-pass: %.3f ms", opaqueStats.prepassMilliseconds);
+            ImGui::Text("Shading: %.3f ms", opaqueStats.shadingMilliseconds);
+            ImGui::Text("Total: %.3f ms", opaqueStats.prepassMilliseconds + opaqueStats.shadingMilliseconds);
+            ImGui::Text("Overdraw: %.2f shaded samples per pixel", opaqueStats.overdraw);
+            ImGui::End();
+        }
+
         // Find the player entity with inventory
         our::InventoryComponent* inventory = nullptr;
         for(auto entity : world.getEntities()){
@@ -87,7 +135,7 @@ class Playstate: public our::State {
         characterController.update(&world, (float)deltaTime);
         inventoryController.update(&world, (float)deltaTime);
         // And finally we use the renderer system to draw the scene
-        renderer.render(&world);
+        renderer->render(&world);
 
         // Get a reference to the keyboard object
         auto& keyboard = getApp()->getKeyboard();
@@ -100,13 +148,13 @@ class Playstate: public our::State {
 
     void onDestroy() override {
         // Don't forget to destroy the renderer
-        renderer.destroy();
+        renderer->destroy();
+        delete renderer;
+        renderer = nullptr;
         // On exit, we call exit for the camera controller system to make sure that the mouse is unlocked
         cameraController.exit();
         characterController.exit();
-        // Clear the world
+        // Clear the world (the assets are released by the application)
         world.clear();
-        // and we delete all the loaded assets to free memory on the RAM and the VRAM
-        our::clearAllAssets();
     }
 };
\ No newline at end of file
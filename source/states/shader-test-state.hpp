@@ -1,6 +1,7 @@
 #pragma once
 
 #include <shader/shader.hpp>
+#include <mesh/geometry-arena.hpp>
 #include <deserialize-utils.hpp>
 #include <application.hpp>
 
@@ -54,12 +55,13 @@ class ShaderTestState: public our::State {
         glClear(GL_COLOR_BUFFER_BIT);
         // Use the shader then draw the mesh
         shader->use();
-        glBindVertexArray(vertex_array);
+        our::GeometryArena::bindVertexArray(vertex_array);
         glDrawArrays(GL_TRIANGLES, 0, 3);
     }
 
     void onDestroy() override {
         delete shader;
+        our::GeometryArena::bindVertexArray(0);
         glDeleteVertexArrays(1, &vertex_array);
     }
 };
\ No newline at end of file